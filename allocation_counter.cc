@@ -0,0 +1,96 @@
+/*
+ *  Copyright 2023 The WebRTC Project Authors. All rights reserved.
+ *
+ *  Use of this source code is governed by a BSD-style license
+ *  that can be found in the LICENSE file in the root of the source
+ *  tree. An additional intellectual property rights grant can be found
+ *  in the file PATENTS.  All contributing project authors may
+ *  be found in the AUTHORS file in the root of the source tree.
+ */
+
+#include "examples/voipclient/allocation_counter.h"
+
+#include <stdlib.h>
+
+#include <atomic>
+#include <new>
+
+namespace {
+
+std::atomic<uint64_t> g_allocations{0};
+
+void* CountedAllocate(size_t size, size_t alignment) {
+  g_allocations.fetch_add(1, std::memory_order_relaxed);
+  if (size == 0) {
+    size = 1;
+  }
+  if (alignment <= __STDCPP_DEFAULT_NEW_ALIGNMENT__) {
+    return malloc(size);
+  }
+  void* p = nullptr;
+  return posix_memalign(&p, alignment, size) == 0 ? p : nullptr;
+}
+
+}  // namespace
+
+// Counts every heap allocation in the process. The array forms call these
+// by default, and everything is released with free().
+void* operator new(size_t size) {
+  void* p = CountedAllocate(size, __STDCPP_DEFAULT_NEW_ALIGNMENT__);
+  if (!p) {
+    throw std::bad_alloc();
+  }
+  return p;
+}
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept {
+  return CountedAllocate(size, __STDCPP_DEFAULT_NEW_ALIGNMENT__);
+}
+
+void* operator new(size_t size, std::align_val_t alignment) {
+  void* p = CountedAllocate(size, static_cast<size_t>(alignment));
+  if (!p) {
+    throw std::bad_alloc();
+  }
+  return p;
+}
+
+void* operator new(size_t size,
+                   std::align_val_t alignment,
+                   const std::nothrow_t&) noexcept {
+  return CountedAllocate(size, static_cast<size_t>(alignment));
+}
+
+void operator delete(void* p) noexcept {
+  free(p);
+}
+
+void operator delete(void* p, size_t) noexcept {
+  free(p);
+}
+
+void operator delete(void* p, const std::nothrow_t&) noexcept {
+  free(p);
+}
+
+void operator delete(void* p, std::align_val_t) noexcept {
+  free(p);
+}
+
+void operator delete(void* p, size_t, std::align_val_t) noexcept {
+  free(p);
+}
+
+void operator delete(void* p,
+                     std::align_val_t,
+                     const std::nothrow_t&) noexcept {
+  free(p);
+}
+
+namespace webrtc_examples {
+
+uint64_t GetAllocationCount() {
+  return g_allocations.load(std::memory_order_relaxed);
+}
+
+}  // namespace webrtc_examples
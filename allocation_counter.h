@@ -0,0 +1,25 @@
+/*
+ *  Copyright 2023 The WebRTC Project Authors. All rights reserved.
+ *
+ *  Use of this source code is governed by a BSD-style license
+ *  that can be found in the LICENSE file in the root of the source
+ *  tree. An additional intellectual property rights grant can be found
+ *  in the file PATENTS.  All contributing project authors may
+ *  be found in the AUTHORS file in the root of the source tree.
+ */
+
+#ifndef EXAMPLES_VOIPCLIENT_ALLOCATION_COUNTER_H_
+#define EXAMPLES_VOIPCLIENT_ALLOCATION_COUNTER_H_
+
+#include <stdint.h>
+
+namespace webrtc_examples {
+
+// Heap allocations made by any thread of the process so far. Linking
+// allocation_counter.cc in replaces the global operator new of the binary,
+// so only benchmarks and tests may depend on it.
+uint64_t GetAllocationCount();
+
+}  // namespace webrtc_examples
+
+#endif  // EXAMPLES_VOIPCLIENT_ALLOCATION_COUNTER_H_
@@ -0,0 +1,266 @@
+/*
+ *  Copyright 2023 The WebRTC Project Authors. All rights reserved.
+ *
+ *  Use of this source code is governed by a BSD-style license
+ *  that can be found in the LICENSE file in the root of the source
+ *  tree. An additional intellectual property rights grant can be found
+ *  in the file PATENTS.  All contributing project authors may
+ *  be found in the AUTHORS file in the root of the source tree.
+ */
+
+#include "examples/voipclient/audio_device_factory.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <algorithm>
+#include <memory>
+#include <utility>
+
+#include "absl/strings/match.h"
+#include "api/array_view.h"
+#include "modules/audio_device/include/test_audio_device.h"
+#include "rtc_base/buffer.h"
+#include "rtc_base/checks.h"
+#include "rtc_base/logging.h"
+
+namespace webrtc_examples {
+
+namespace {
+
+using webrtc::TestAudioDeviceModule;
+
+class SilenceCapturer : public TestAudioDeviceModule::Capturer {
+ public:
+  SilenceCapturer(int sample_rate_hz, int num_channels)
+      : sample_rate_hz_(sample_rate_hz), num_channels_(num_channels) {}
+
+  int SamplingFrequency() const override { return sample_rate_hz_; }
+  int NumChannels() const override { return num_channels_; }
+  bool Capture(rtc::BufferT<int16_t>* buffer) override {
+    buffer->Clear();
+    buffer->AppendData(
+        TestAudioDeviceModule::SamplesPerFrame(sample_rate_hz_) *
+            num_channels_,
+        [](rtc::ArrayView<int16_t> data) {
+          std::fill(data.begin(), data.end(), 0);
+          return data.size();
+        });
+    return true;
+  }
+
+ private:
+  const int sample_rate_hz_;
+  const int num_channels_;
+};
+
+// Reads headerless 16-bit PCM, one 10 ms frame per call.
+class RawFileCapturer : public TestAudioDeviceModule::Capturer {
+ public:
+  RawFileCapturer(FILE* file, int sample_rate_hz, int num_channels, bool loop)
+      : file_(file),
+        sample_rate_hz_(sample_rate_hz),
+        num_channels_(num_channels),
+        loop_(loop) {}
+  ~RawFileCapturer() override { fclose(file_); }
+
+  int SamplingFrequency() const override { return sample_rate_hz_; }
+  int NumChannels() const override { return num_channels_; }
+  bool Capture(rtc::BufferT<int16_t>* buffer) override {
+    const size_t samples =
+        TestAudioDeviceModule::SamplesPerFrame(sample_rate_hz_) *
+        num_channels_;
+    buffer->SetData(samples, [&](rtc::ArrayView<int16_t> data) {
+      size_t read = fread(data.data(), sizeof(int16_t), samples, file_);
+      if (read < samples && loop_) {
+        rewind(file_);
+        read += fread(data.data() + read, sizeof(int16_t), samples - read,
+                      file_);
+      }
+      return read;
+    });
+    // A short read ends capture.
+    return buffer->size() == samples;
+  }
+
+ private:
+  FILE* const file_;
+  const int sample_rate_hz_;
+  const int num_channels_;
+  const bool loop_;
+};
+
+class RawFileRenderer : public TestAudioDeviceModule::Renderer {
+ public:
+  RawFileRenderer(FILE* file, int sample_rate_hz, int num_channels)
+      : file_(file),
+        sample_rate_hz_(sample_rate_hz),
+        num_channels_(num_channels) {}
+  ~RawFileRenderer() override { fclose(file_); }
+
+  int SamplingFrequency() const override { return sample_rate_hz_; }
+  int NumChannels() const override { return num_channels_; }
+  bool Render(rtc::ArrayView<const int16_t> data) override {
+    return fwrite(data.data(), sizeof(int16_t), data.size(), file_) ==
+           data.size();
+  }
+
+ private:
+  FILE* const file_;
+  const int sample_rate_hz_;
+  const int num_channels_;
+};
+
+bool IsWavFile(const std::string& path) {
+  return absl::EndsWithIgnoreCase(path, ".wav");
+}
+
+uint32_t ReadLittleEndian32(const uint8_t* data) {
+  return data[0] | (data[1] << 8) | (data[2] << 16) |
+         (static_cast<uint32_t>(data[3]) << 24);
+}
+
+uint16_t ReadLittleEndian16(const uint8_t* data) {
+  return static_cast<uint16_t>(data[0] | (data[1] << 8));
+}
+
+// The WAV reader of TestAudioDeviceModule aborts on a file it cannot open
+// or parse, so check up front that `path` holds 16-bit PCM or 32-bit float
+// samples it accepts.
+bool IsReadableWavFile(const std::string& path) {
+  FILE* file = fopen(path.c_str(), "rb");
+  if (!file) {
+    RTC_LOG_ERR(LS_ERROR) << "Cannot open " << path;
+    return false;
+  }
+  uint8_t header[12];
+  bool fmt_ok = false;
+  bool has_data = false;
+  if (fread(header, sizeof(header), 1, file) == 1 &&
+      memcmp(header, "RIFF", 4) == 0 && memcmp(header + 8, "WAVE", 4) == 0) {
+    uint8_t chunk[8];
+    while (!has_data && fread(chunk, sizeof(chunk), 1, file) == 1) {
+      const uint32_t chunk_size = ReadLittleEndian32(chunk + 4);
+      if (memcmp(chunk, "data", 4) == 0) {
+        has_data = true;
+      } else if (memcmp(chunk, "fmt ", 4) == 0 && chunk_size >= 16) {
+        uint8_t fmt[16];
+        if (fread(fmt, sizeof(fmt), 1, file) != 1) {
+          break;
+        }
+        const uint16_t format = ReadLittleEndian16(fmt);
+        const uint16_t num_channels = ReadLittleEndian16(fmt + 2);
+        const uint32_t sample_rate = ReadLittleEndian32(fmt + 4);
+        const uint16_t bits_per_sample = ReadLittleEndian16(fmt + 14);
+        // WAVE_FORMAT_PCM or WAVE_FORMAT_IEEE_FLOAT.
+        fmt_ok = ((format == 1 && bits_per_sample == 16) ||
+                  (format == 3 && bits_per_sample == 32)) &&
+                 num_channels > 0 && sample_rate > 0;
+        // Chunks are padded to an even size.
+        if (fseek(file, ((chunk_size + 1) & ~1u) - sizeof(fmt), SEEK_CUR) !=
+            0) {
+          break;
+        }
+      } else if (fseek(file, (chunk_size + 1) & ~1u, SEEK_CUR) != 0) {
+        break;
+      }
+    }
+  }
+  fclose(file);
+  if (!fmt_ok || !has_data) {
+    RTC_LOG(LS_ERROR) << path
+                      << " is not a 16-bit PCM or 32-bit float WAV file";
+    return false;
+  }
+  return true;
+}
+
+std::unique_ptr<TestAudioDeviceModule::Capturer> CreateCapturer(
+    const AudioDeviceConfig& config) {
+  if (config.capture_file.empty()) {
+    return std::make_unique<SilenceCapturer>(config.sample_rate_hz,
+                                             config.num_channels);
+  }
+  if (IsWavFile(config.capture_file)) {
+    if (!IsReadableWavFile(config.capture_file)) {
+      return nullptr;
+    }
+    return TestAudioDeviceModule::CreateWavFileReader(config.capture_file,
+                                                      config.loop_capture);
+  }
+  FILE* file = fopen(config.capture_file.c_str(), "rb");
+  if (!file) {
+    RTC_LOG_ERR(LS_ERROR) << "Cannot open " << config.capture_file;
+    return nullptr;
+  }
+  return std::make_unique<RawFileCapturer>(file, config.sample_rate_hz,
+                                           config.num_channels,
+                                           config.loop_capture);
+}
+
+std::unique_ptr<TestAudioDeviceModule::Renderer> CreateRenderer(
+    const AudioDeviceConfig& config) {
+  if (config.playout_file.empty()) {
+    return TestAudioDeviceModule::CreateDiscardRenderer(config.sample_rate_hz,
+                                                        config.num_channels);
+  }
+  if (IsWavFile(config.playout_file)) {
+    // The WAV writer aborts on a file it cannot create.
+    FILE* file = fopen(config.playout_file.c_str(), "wb");
+    if (!file) {
+      RTC_LOG_ERR(LS_ERROR) << "Cannot open " << config.playout_file;
+      return nullptr;
+    }
+    fclose(file);
+    return TestAudioDeviceModule::CreateWavFileWriter(
+        config.playout_file, config.sample_rate_hz, config.num_channels);
+  }
+  FILE* file = fopen(config.playout_file.c_str(), "wb");
+  if (!file) {
+    RTC_LOG_ERR(LS_ERROR) << "Cannot open " << config.playout_file;
+    return nullptr;
+  }
+  return std::make_unique<RawFileRenderer>(file, config.sample_rate_hz,
+                                           config.num_channels);
+}
+
+}  // namespace
+
+rtc::scoped_refptr<webrtc::AudioDeviceModule> CreateAudioDevice(
+    const AudioDeviceConfig& config,
+    webrtc::TaskQueueFactory* task_queue_factory) {
+  switch (config.type) {
+    case AudioDeviceType::kPulseAudio:
+      return webrtc::AudioDeviceModule::Create(
+          webrtc::AudioDeviceModule::kLinuxPulseAudio, task_queue_factory);
+    case AudioDeviceType::kNull:
+      return TestAudioDeviceModule::Create(
+          task_queue_factory,
+          std::make_unique<SilenceCapturer>(config.sample_rate_hz,
+                                            config.num_channels),
+          TestAudioDeviceModule::CreateDiscardRenderer(config.sample_rate_hz,
+                                                       config.num_channels));
+    case AudioDeviceType::kFile: {
+      std::unique_ptr<TestAudioDeviceModule::Capturer> capturer =
+          CreateCapturer(config);
+      std::unique_ptr<TestAudioDeviceModule::Renderer> renderer =
+          CreateRenderer(config);
+      if (!capturer || !renderer) {
+        return nullptr;
+      }
+      return TestAudioDeviceModule::Create(
+          task_queue_factory, std::move(capturer), std::move(renderer));
+    }
+    case AudioDeviceType::kCustom:
+      RTC_DCHECK(config.create_capturer);
+      RTC_DCHECK(config.create_renderer);
+      return TestAudioDeviceModule::Create(task_queue_factory,
+                                           config.create_capturer(),
+                                           config.create_renderer());
+  }
+  RTC_DCHECK_NOTREACHED();
+  return nullptr;
+}
+
+}  // namespace webrtc_examples
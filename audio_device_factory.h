@@ -0,0 +1,69 @@
+/*
+ *  Copyright 2023 The WebRTC Project Authors. All rights reserved.
+ *
+ *  Use of this source code is governed by a BSD-style license
+ *  that can be found in the LICENSE file in the root of the source
+ *  tree. An additional intellectual property rights grant can be found
+ *  in the file PATENTS.  All contributing project authors may
+ *  be found in the AUTHORS file in the root of the source tree.
+ */
+
+#ifndef EXAMPLES_VOIPCLIENT_AUDIO_DEVICE_FACTORY_H_
+#define EXAMPLES_VOIPCLIENT_AUDIO_DEVICE_FACTORY_H_
+
+#include <functional>
+#include <memory>
+#include <string>
+
+#include "api/scoped_refptr.h"
+#include "api/task_queue/task_queue_factory.h"
+#include "modules/audio_device/include/audio_device.h"
+#include "modules/audio_device/include/test_audio_device.h"
+
+namespace webrtc_examples {
+
+enum class AudioDeviceType {
+  // The system's sound server.
+  kPulseAudio,
+  // Captures silence and discards playout. Driven by the 10 ms timer of
+  // webrtc::TestAudioDeviceModule, so no sound hardware or server is
+  // needed and the pacing does not depend on one.
+  kNull,
+  // Like kNull, but captures from `capture_file` and plays out to
+  // `playout_file`.
+  kFile,
+  // Like kNull, but with audio supplied and consumed by the application,
+  // e.g. a benchmark's marker tones.
+  kCustom,
+};
+
+struct AudioDeviceConfig {
+  AudioDeviceType type = AudioDeviceType::kPulseAudio;
+  // kFile only. Files ending in ".wav" are read and written as WAV, taking
+  // the capture format from the file header; anything else is headerless
+  // 16-bit native-endian PCM in the format below. An empty capture file
+  // captures silence, an empty playout file discards playout.
+  std::string capture_file;
+  std::string playout_file;
+  // Restart the capture file from the beginning when it runs out instead of
+  // stopping capture.
+  bool loop_capture = true;
+  // Format of the null device, of raw files and of WAV playout files.
+  int sample_rate_hz = 48000;
+  int num_channels = 1;
+  // kCustom only; each is called once, when the device is created.
+  std::function<std::unique_ptr<webrtc::TestAudioDeviceModule::Capturer>()>
+      create_capturer;
+  std::function<std::unique_ptr<webrtc::TestAudioDeviceModule::Renderer>()>
+      create_renderer;
+};
+
+// Returns null on failure, e.g. when a file cannot be opened or a WAV
+// capture file holds samples TestAudioDeviceModule cannot read.
+rtc::scoped_refptr<webrtc::AudioDeviceModule> CreateAudioDevice(
+    const AudioDeviceConfig& config,
+    webrtc::TaskQueueFactory* task_queue_factory);
+
+}  // namespace webrtc_examples
+
+#endif  // EXAMPLES_VOIPCLIENT_AUDIO_DEVICE_FACTORY_H_
@@ -0,0 +1,64 @@
+/*
+ * conductor.cc
+ * Copyright (C) 2023 youfa <vsyfar@gmail.com>
+ *
+ * Distributed under terms of the GPLv2 license.
+ */
+
+#include "examples/voipclient/conductor.h"
+
+#include "rtc_base/logging.h"
+
+namespace webrtc_examples {
+
+Conductor::Conductor(VoipClient* voip_client)
+    : WindowView::Events(), voip_client_(voip_client) {}
+
+Conductor::~Conductor() {}
+
+void Conductor::OnEncoderUpdate(const std::string& encoder) {
+  voip_client_->SetEncoder(VoipClient::kDefaultSessionId, encoder);
+}
+
+void Conductor::OnDecodersUpdate(const std::vector<std::string>& decoders) {
+  voip_client_->SetDecoders(VoipClient::kDefaultSessionId, decoders);
+}
+
+void Conductor::OnSessionEvent(bool on,
+                               const std::string& local_ip,
+                               int local_port,
+                               const std::string& remote_ip,
+                               int remote_port,
+                               const std::string& encoder,
+                               const std::vector<std::string>& decoders) {
+  RTC_LOG(LS_INFO) << "OnSessionEvent";
+  if (on) {
+    voip_client_->SetLocalAddress(VoipClient::kDefaultSessionId, local_ip,
+                                  local_port);
+    voip_client_->SetRemoteAddress(VoipClient::kDefaultSessionId, remote_ip,
+                                   remote_port);
+    voip_client_->StartSession(VoipClient::kDefaultSessionId);
+    voip_client_->SetEncoder(VoipClient::kDefaultSessionId, encoder);
+    voip_client_->SetDecoders(VoipClient::kDefaultSessionId, decoders);
+  } else {
+    voip_client_->StopSession(VoipClient::kDefaultSessionId);
+  }
+}
+
+void Conductor::OnSendAudio(bool send) {
+  if (send) {
+    voip_client_->StartSend(VoipClient::kDefaultSessionId);
+  } else {
+    voip_client_->StopSend(VoipClient::kDefaultSessionId);
+  }
+}
+
+void Conductor::OnPlayoutAudio(bool playout) {
+  if (playout) {
+    voip_client_->StartPlayout(VoipClient::kDefaultSessionId);
+  } else {
+    voip_client_->StopPlayout(VoipClient::kDefaultSessionId);
+  }
+}
+
+}  // namespace webrtc_examples
@@ -0,0 +1,44 @@
+/*
+ * conductor.h
+ * Copyright (C) 2023 youfa <vsyfar@gmail.com>
+ *
+ * Distributed under terms of the GPLv2 license.
+ */
+
+#ifndef CONDUCTOR_H
+#define CONDUCTOR_H
+
+#include <string>
+#include <vector>
+
+#include "examples/voipclient/voip_client.h"
+#include "examples/voipclient/window_view.h"
+
+namespace webrtc_examples {
+
+// Translates WindowView events into calls on the default session of a
+// VoipClient. Shared by the GTK and headless front ends.
+class Conductor : public WindowView::Events {
+ public:
+  explicit Conductor(VoipClient* voip_client);
+  ~Conductor() override;
+
+  void OnEncoderUpdate(const std::string& encoder) override;
+  void OnDecodersUpdate(const std::vector<std::string>& decoders) override;
+  void OnSessionEvent(bool on,
+                      const std::string& local_ip,
+                      int local_port,
+                      const std::string& remote_ip,
+                      int remote_port,
+                      const std::string& encoder,
+                      const std::vector<std::string>& decoders) override;
+  void OnSendAudio(bool send) override;
+  void OnPlayoutAudio(bool playout) override;
+
+ private:
+  VoipClient* voip_client_;
+};
+
+}  // namespace webrtc_examples
+
+#endif /* !CONDUCTOR_H */
@@ -0,0 +1,104 @@
+/*
+ *  Copyright 2023 The WebRTC Project Authors. All rights reserved.
+ *
+ *  Use of this source code is governed by a BSD-style license
+ *  that can be found in the LICENSE file in the root of the source
+ *  tree. An additional intellectual property rights grant can be found
+ *  in the file PATENTS.  All contributing project authors may
+ *  be found in the AUTHORS file in the root of the source tree.
+ */
+
+#include "examples/voipclient/direct_send_handle.h"
+
+#include <string.h>
+#include <sys/socket.h>
+
+#include "rtc_base/checks.h"
+
+namespace webrtc_examples {
+
+void DirectSendHandle::Attach(int fd) {
+  fd_.store(fd, std::memory_order_release);
+}
+
+void DirectSendHandle::Detach() {
+  fd_.store(-1, std::memory_order_release);
+}
+
+void DirectSendHandle::SetCapture(PacketCapture* capture,
+                                  const rtc::SocketAddress& local_address) {
+  RTC_DCHECK_LT(fd_.load(std::memory_order_relaxed), 0);
+  capture_ = capture;
+  capture_local_address_ = local_address;
+}
+
+void DirectSendHandle::SetDestination(const rtc::SocketAddress& address) {
+  sockaddr_storage storage;
+  memset(&storage, 0, sizeof(storage));
+  size_t length = address.ToSockAddrStorage(&storage);
+  RTC_DCHECK_LE(length, kAddressWords * sizeof(uint64_t));
+
+  uint64_t words[kAddressWords];
+  memcpy(words, &storage, sizeof(words));
+
+  uint32_t sequence = sequence_.load(std::memory_order_relaxed);
+  sequence_.store(sequence + 1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+  for (size_t i = 0; i < kAddressWords; ++i) {
+    address_words_[i].store(words[i], std::memory_order_relaxed);
+  }
+  address_length_.store(static_cast<uint32_t>(length),
+                        std::memory_order_relaxed);
+  sequence_.store(sequence + 2, std::memory_order_release);
+}
+
+bool DirectSendHandle::Send(const uint8_t* data, size_t size) {
+  int fd = fd_.load(std::memory_order_acquire);
+  if (fd < 0) {
+    return false;
+  }
+
+  sockaddr_storage storage;
+  uint64_t words[kAddressWords];
+  uint32_t length;
+  uint32_t before;
+  uint32_t after;
+  do {
+    before = sequence_.load(std::memory_order_acquire);
+    for (size_t i = 0; i < kAddressWords; ++i) {
+      words[i] = address_words_[i].load(std::memory_order_relaxed);
+    }
+    length = address_length_.load(std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_acquire);
+    after = sequence_.load(std::memory_order_relaxed);
+  } while ((before & 1) != 0 || before != after);
+  if (length == 0) {
+    send_failures_.fetch_add(1, std::memory_order_relaxed);
+    return false;
+  }
+  memcpy(&storage, words, sizeof(words));
+
+  ssize_t sent = sendto(fd, data, size, MSG_DONTWAIT,
+                        reinterpret_cast<const sockaddr*>(&storage), length);
+  if (sent != static_cast<ssize_t>(size)) {
+    send_failures_.fetch_add(1, std::memory_order_relaxed);
+    return false;
+  }
+  packets_sent_.fetch_add(1, std::memory_order_relaxed);
+  if (capture_) {
+    rtc::SocketAddress destination;
+    rtc::SocketAddressFromSockAddrStorage(storage, &destination);
+    capture_->Capture(PacketCapture::Direction::kOutgoing,
+                      capture_local_address_, destination, data, size);
+  }
+  return true;
+}
+
+DirectSendHandle::Stats DirectSendHandle::GetStats() const {
+  Stats stats;
+  stats.packets_sent = packets_sent_.load(std::memory_order_relaxed);
+  stats.send_failures = send_failures_.load(std::memory_order_relaxed);
+  return stats;
+}
+
+}  // namespace webrtc_examples
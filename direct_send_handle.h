@@ -0,0 +1,81 @@
+/*
+ *  Copyright 2023 The WebRTC Project Authors. All rights reserved.
+ *
+ *  Use of this source code is governed by a BSD-style license
+ *  that can be found in the LICENSE file in the root of the source
+ *  tree. An additional intellectual property rights grant can be found
+ *  in the file PATENTS.  All contributing project authors may
+ *  be found in the AUTHORS file in the root of the source tree.
+ */
+
+#ifndef EXAMPLES_VOIPCLIENT_DIRECT_SEND_HANDLE_H_
+#define EXAMPLES_VOIPCLIENT_DIRECT_SEND_HANDLE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <array>
+#include <atomic>
+
+#include "examples/voipclient/packet_capture.h"
+#include "rtc_base/socket_address.h"
+
+namespace webrtc_examples {
+
+// Writes datagrams on a socket descriptor from any thread without locks or
+// thread hops. The kernel serializes concurrent sendto() calls on a UDP
+// socket, so the only shared state is the descriptor, published through an
+// atomic, and the destination, published through a sequence lock.
+//
+// The handle does not own the descriptor. Detach() must be called before
+// the descriptor is closed, and callers must ensure no Send() is still in
+// flight at that point (e.g. by releasing the VoIP channel first).
+class DirectSendHandle {
+ public:
+  struct Stats {
+    uint64_t packets_sent = 0;
+    uint64_t send_failures = 0;
+  };
+
+  DirectSendHandle() = default;
+  DirectSendHandle(const DirectSendHandle&) = delete;
+  DirectSendHandle& operator=(const DirectSendHandle&) = delete;
+
+  void Attach(int fd);
+  void Detach();
+
+  // Records the packets Send() writes to `capture`, which may be null, as
+  // sent from `local_address`. Must be called while detached.
+  void SetCapture(PacketCapture* capture,
+                  const rtc::SocketAddress& local_address);
+
+  // May be called while other threads are sending. Concurrent calls to
+  // SetDestination() are not allowed.
+  void SetDestination(const rtc::SocketAddress& address);
+
+  // Thread-safe. Returns false if detached or if the write failed.
+  bool Send(const uint8_t* data, size_t size);
+
+  Stats GetStats() const;
+
+ private:
+  // Large enough for a sockaddr_in6.
+  static constexpr size_t kAddressWords = 4;
+
+  std::atomic<int> fd_{-1};
+  // Published to senders by Attach().
+  PacketCapture* capture_ = nullptr;
+  rtc::SocketAddress capture_local_address_;
+
+  // Odd while SetDestination() is rewriting `address_words_`.
+  std::atomic<uint32_t> sequence_{0};
+  std::array<std::atomic<uint64_t>, kAddressWords> address_words_ = {};
+  std::atomic<uint32_t> address_length_{0};
+
+  std::atomic<uint64_t> packets_sent_{0};
+  std::atomic<uint64_t> send_failures_{0};
+};
+
+}  // namespace webrtc_examples
+
+#endif  // EXAMPLES_VOIPCLIENT_DIRECT_SEND_HANDLE_H_
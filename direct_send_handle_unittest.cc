@@ -0,0 +1,190 @@
+/*
+ *  Copyright 2023 The WebRTC Project Authors. All rights reserved.
+ *
+ *  Use of this source code is governed by a BSD-style license
+ *  that can be found in the LICENSE file in the root of the source
+ *  tree. An additional intellectual property rights grant can be found
+ *  in the file PATENTS.  All contributing project authors may
+ *  be found in the AUTHORS file in the root of the source tree.
+ */
+
+#include "examples/voipclient/direct_send_handle.h"
+
+#include <poll.h>
+#include <stdint.h>
+#include <sys/socket.h>
+
+#include <atomic>
+#include <string>
+
+#include "examples/voipclient/media_socket.h"
+#include "rtc_base/platform_thread.h"
+#include "rtc_base/socket_address.h"
+#include "test/gtest.h"
+
+namespace webrtc_examples {
+namespace {
+
+constexpr int kPollTimeoutMs = 1000;
+
+// A UDP socket bound to an ephemeral port of `ip`.
+class TestSocket {
+ public:
+  explicit TestSocket(const std::string& ip) {
+    sockaddr_storage storage;
+    socklen_t length = rtc::SocketAddress(ip, 0).ToSockAddrStorage(&storage);
+    fd_ = calls_.Open(reinterpret_cast<sockaddr*>(&storage), length,
+                      /*reuse_port=*/false);
+    if (fd_ >= 0 &&
+        getsockname(fd_, reinterpret_cast<sockaddr*>(&storage), &length) ==
+            0) {
+      rtc::SocketAddressFromSockAddrStorage(storage, &address_);
+    }
+  }
+  ~TestSocket() {
+    if (fd_ >= 0) {
+      calls_.Close(fd_);
+    }
+  }
+
+  int fd() const { return fd_; }
+  const rtc::SocketAddress& address() const { return address_; }
+
+  // Returns the size of the next datagram, or -1 if none arrives in time.
+  int Receive(uint8_t* data, size_t size) {
+    pollfd fds = {fd_, POLLIN, 0};
+    if (poll(&fds, 1, kPollTimeoutMs) != 1) {
+      return -1;
+    }
+    return static_cast<int>(recv(fd_, data, size, 0));
+  }
+
+ private:
+  MediaSocket::SocketCalls calls_;
+  int fd_ = -1;
+  rtc::SocketAddress address_;
+};
+
+TEST(DirectSendHandleTest, SendsToDestination) {
+  TestSocket sender("127.0.0.1");
+  TestSocket receiver("127.0.0.1");
+  ASSERT_GE(sender.fd(), 0);
+  ASSERT_GE(receiver.fd(), 0);
+
+  DirectSendHandle handle;
+  handle.Attach(sender.fd());
+  handle.SetDestination(receiver.address());
+  const uint8_t packet[] = {1, 2, 3, 4};
+  EXPECT_TRUE(handle.Send(packet, sizeof(packet)));
+
+  uint8_t received[16];
+  ASSERT_EQ(receiver.Receive(received, sizeof(received)), 4);
+  EXPECT_EQ(received[3], 4);
+  EXPECT_EQ(handle.GetStats().packets_sent, 1u);
+  EXPECT_EQ(handle.GetStats().send_failures, 0u);
+}
+
+TEST(DirectSendHandleTest, FailsWhileDetached) {
+  TestSocket receiver("127.0.0.1");
+  DirectSendHandle handle;
+  handle.SetDestination(receiver.address());
+  const uint8_t packet[] = {1};
+  EXPECT_FALSE(handle.Send(packet, sizeof(packet)));
+  // Not an attempted write.
+  EXPECT_EQ(handle.GetStats().send_failures, 0u);
+}
+
+TEST(DirectSendHandleTest, FailsWithoutDestination) {
+  TestSocket sender("127.0.0.1");
+  DirectSendHandle handle;
+  handle.Attach(sender.fd());
+  const uint8_t packet[] = {1};
+  EXPECT_FALSE(handle.Send(packet, sizeof(packet)));
+  EXPECT_EQ(handle.GetStats().send_failures, 1u);
+}
+
+// Flips the destination between an IPv4 and an IPv6 socket while two
+// threads send. The two differ in family, length and where the address
+// lies, so a sender that read a mix of them would fail or write somewhere
+// else, and both sockets together would receive fewer datagrams than were
+// sent.
+TEST(DirectSendHandleTest, SendersNeverSeeTornDestination) {
+  // Dual-stack, to reach both.
+  TestSocket sender("::");
+  TestSocket ipv4_receiver("127.0.0.1");
+  TestSocket ipv6_receiver("::1");
+  if (sender.fd() < 0 || ipv6_receiver.fd() < 0) {
+    GTEST_SKIP() << "No IPv6 loopback";
+  }
+  ASSERT_GE(ipv4_receiver.fd(), 0);
+
+  DirectSendHandle handle;
+  handle.Attach(sender.fd());
+  handle.SetDestination(ipv4_receiver.address());
+
+  constexpr int kPacketsPerThread = 5000;
+  // Bounds what is waiting in the receive buffers, so that none is dropped
+  // there.
+  constexpr int kMaxOutstanding = 32;
+  std::atomic<bool> sending{true};
+  std::atomic<bool> receiving{true};
+  std::atomic<int> sent{0};
+  std::atomic<int> received{0};
+  std::atomic<int> failed{0};
+
+  auto switcher = rtc::PlatformThread::SpawnJoinable(
+      [&] {
+        while (sending.load()) {
+          handle.SetDestination(ipv6_receiver.address());
+          handle.SetDestination(ipv4_receiver.address());
+        }
+      },
+      "switcher");
+  auto receiver = rtc::PlatformThread::SpawnJoinable(
+      [&] {
+        pollfd fds[] = {{ipv4_receiver.fd(), POLLIN, 0},
+                        {ipv6_receiver.fd(), POLLIN, 0}};
+        uint8_t buffer[16];
+        while (sending.load() || received.load() < sent.load()) {
+          if (poll(fds, 2, kPollTimeoutMs) <= 0) {
+            break;
+          }
+          for (const pollfd& fd : fds) {
+            while (recv(fd.fd, buffer, sizeof(buffer), MSG_DONTWAIT) > 0) {
+              received.fetch_add(1);
+            }
+          }
+        }
+        receiving.store(false);
+      },
+      "receiver");
+  auto send = [&] {
+    const uint8_t packet[] = {0x80, 0, 0, 0};
+    for (int i = 0; i < kPacketsPerThread; ++i) {
+      while (receiving.load() &&
+             sent.load() - received.load() > kMaxOutstanding) {
+      }
+      if (handle.Send(packet, sizeof(packet))) {
+        sent.fetch_add(1);
+      } else {
+        failed.fetch_add(1);
+      }
+    }
+  };
+  auto first_sender = rtc::PlatformThread::SpawnJoinable(send, "sender1");
+  auto second_sender = rtc::PlatformThread::SpawnJoinable(send, "sender2");
+
+  first_sender.Finalize();
+  second_sender.Finalize();
+  sending.store(false);
+  switcher.Finalize();
+  receiver.Finalize();
+
+  EXPECT_EQ(failed.load(), 0);
+  EXPECT_EQ(sent.load(), 2 * kPacketsPerThread);
+  EXPECT_EQ(received.load(), sent.load());
+  EXPECT_EQ(handle.GetStats().send_failures, 0u);
+}
+
+}  // namespace
+}  // namespace webrtc_examples
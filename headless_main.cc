@@ -0,0 +1,188 @@
+/*
+ * headless_main.cc
+ * Copyright (C) 2023 youfa <vsyfar@gmail.com>
+ *
+ * Distributed under terms of the GPLv2 license.
+ */
+
+// Runs one call without a GUI. Every flag may also be given in a file
+// passed with --flagfile, one "--name=value" per line, e.g.
+//
+//   voip_client_headless --flagfile=call.flags --duration_s=60
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "absl/flags/flag.h"
+#include "absl/flags/parse.h"
+#include "examples/voipclient/conductor.h"
+#include "examples/voipclient/headless_view.h"
+#include "examples/voipclient/trace_recorder.h"
+#include "examples/voipclient/voip_client.h"
+#include "rtc_base/logging.h"
+#include "rtc_base/socket_address.h"
+
+ABSL_FLAG(std::string,
+          local_ip,
+          "",
+          "Local address; defaults to the address of the default route.");
+ABSL_FLAG(int, local_port, 0, "Local RTP port; RTCP uses the next one.");
+ABSL_FLAG(std::string, remote_ip, "", "Remote address.");
+ABSL_FLAG(int, remote_port, 0, "Remote RTP port; RTCP uses the next one.");
+ABSL_FLAG(std::string,
+          encoder,
+          "",
+          "Send codec, e.g. opus; defaults to the first supported codec.");
+ABSL_FLAG(std::vector<std::string>,
+          decoders,
+          {},
+          "Comma separated receive codecs; defaults to all supported codecs.");
+ABSL_FLAG(bool, send, true, "Start sending once the session is up.");
+ABSL_FLAG(bool, playout, true, "Start playout once the session is up.");
+ABSL_FLAG(std::string,
+          audio_device,
+          "pulse",
+          "Audio backend: pulse, null (silence, discarded playout) or file.");
+ABSL_FLAG(std::string,
+          capture_file,
+          "",
+          "With --audio_device=file: WAV or raw 16-bit PCM to capture from.");
+ABSL_FLAG(std::string,
+          playout_file,
+          "",
+          "With --audio_device=file: WAV or raw 16-bit PCM to play out to.");
+ABSL_FLAG(int,
+          sample_rate_hz,
+          48000,
+          "Sample rate of raw capture files and of the playout file.");
+ABSL_FLAG(int,
+          metrics_port,
+          0,
+          "Serve Prometheus metrics over HTTP on this port; 0 disables.");
+ABSL_FLAG(std::string,
+          metrics_ip,
+          "127.0.0.1",
+          "Address the metrics server binds with --metrics_port.");
+ABSL_FLAG(std::string,
+          trace_file,
+          "",
+          "Record trace events and write them here, in the Chrome trace "
+          "event format, on exit.");
+ABSL_FLAG(std::string,
+          pcap_file,
+          "",
+          "Record all RTP and RTCP packets to this pcap file.");
+ABSL_FLAG(int,
+          pcap_max_mb,
+          0,
+          "Start a new pcap file, named --pcap_file.N, after this many MiB; "
+          "0 disables.");
+ABSL_FLAG(int,
+          pcap_max_files,
+          0,
+          "Delete the oldest pcap files beyond this count; 0 keeps all.");
+ABSL_FLAG(bool,
+          io_uring,
+          false,
+          "Read sockets through io_uring where the kernel supports it.");
+ABSL_FLAG(bool,
+          receive_timestamps,
+          false,
+          "Stamp received packets in the kernel and report the delay until "
+          "they reach the engine.");
+ABSL_FLAG(bool,
+          hardware_receive_timestamps,
+          false,
+          "With --receive_timestamps, use NIC stamps; only if the NIC clock "
+          "is synchronised to the system clock, as by phc2sys.");
+ABSL_FLAG(int,
+          duration_s,
+          0,
+          "Seconds to run the call for; 0 runs until SIGINT or SIGTERM.");
+
+using namespace webrtc_examples;
+
+namespace {
+
+bool ParseAudioDeviceType(const std::string& name, AudioDeviceType* type) {
+  if (name == "pulse") {
+    *type = AudioDeviceType::kPulseAudio;
+  } else if (name == "null") {
+    *type = AudioDeviceType::kNull;
+  } else if (name == "file") {
+    *type = AudioDeviceType::kFile;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  absl::ParseCommandLine(argc, argv);
+
+  VoipClient::Config config;
+  if (!ParseAudioDeviceType(absl::GetFlag(FLAGS_audio_device),
+                            &config.audio_device.type)) {
+    RTC_LOG(LS_ERROR) << "Unknown audio device "
+                      << absl::GetFlag(FLAGS_audio_device);
+    return 1;
+  }
+  config.audio_device.capture_file = absl::GetFlag(FLAGS_capture_file);
+  config.audio_device.playout_file = absl::GetFlag(FLAGS_playout_file);
+  config.audio_device.sample_rate_hz = absl::GetFlag(FLAGS_sample_rate_hz);
+  config.use_io_uring = absl::GetFlag(FLAGS_io_uring);
+  config.receive_timestamps = absl::GetFlag(FLAGS_receive_timestamps);
+  config.hardware_receive_timestamps =
+      absl::GetFlag(FLAGS_hardware_receive_timestamps);
+  config.packet_capture.path = absl::GetFlag(FLAGS_pcap_file);
+  config.packet_capture.max_file_bytes =
+      static_cast<size_t>(absl::GetFlag(FLAGS_pcap_max_mb)) << 20;
+  config.packet_capture.max_files = absl::GetFlag(FLAGS_pcap_max_files);
+  if (absl::GetFlag(FLAGS_metrics_port) > 0) {
+    config.metrics_address = rtc::SocketAddress(
+        absl::GetFlag(FLAGS_metrics_ip), absl::GetFlag(FLAGS_metrics_port));
+  }
+
+  HeadlessView::Settings settings;
+  settings.local_ip = absl::GetFlag(FLAGS_local_ip);
+  settings.local_port = absl::GetFlag(FLAGS_local_port);
+  settings.remote_ip = absl::GetFlag(FLAGS_remote_ip);
+  settings.remote_port = absl::GetFlag(FLAGS_remote_port);
+  settings.encoder = absl::GetFlag(FLAGS_encoder);
+  settings.decoders = absl::GetFlag(FLAGS_decoders);
+  settings.send = absl::GetFlag(FLAGS_send);
+  settings.playout = absl::GetFlag(FLAGS_playout);
+  settings.duration_s = absl::GetFlag(FLAGS_duration_s);
+
+  // Before any thread exists, so that only Run() sees the signals.
+  HeadlessView::BlockTerminationSignals();
+
+  // Process-wide, so started before the client and dumped after it.
+  const std::string trace_file = absl::GetFlag(FLAGS_trace_file);
+  if (!trace_file.empty()) {
+    TraceRecorder::Start();
+  }
+
+  std::unique_ptr<VoipClient> voip_client(VoipClient::Create(config));
+  if (!voip_client) {
+    return 1;
+  }
+  HeadlessView view(settings);
+  view.SetSupportCodecs(voip_client->GetSupportedCodecs());
+  if (settings.local_ip.empty()) {
+    view.SetLocalIpAddress(voip_client->GetLocalIPAddress());
+  }
+
+  Conductor conductor(voip_client.get());
+  view.RegisterEvents(&conductor);
+
+  const bool ok = view.Run();
+  voip_client.reset();
+  if (!trace_file.empty()) {
+    TraceRecorder::Dump(trace_file);
+  }
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,158 @@
+/*
+ * headless_view.cc
+ * Copyright (C) 2023 youfa <vsyfar@gmail.com>
+ *
+ * Distributed under terms of the GPLv2 license.
+ */
+
+#include "examples/voipclient/headless_view.h"
+
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
+
+#include <algorithm>
+
+#include "rtc_base/logging.h"
+
+namespace webrtc_examples {
+
+namespace {
+
+sigset_t TerminationSignals() {
+  sigset_t signals;
+  sigemptyset(&signals);
+  sigaddset(&signals, SIGINT);
+  sigaddset(&signals, SIGTERM);
+  return signals;
+}
+
+bool IsSupported(const std::vector<std::string>& codecs,
+                 const std::string& codec) {
+  return std::find(codecs.begin(), codecs.end(), codec) != codecs.end();
+}
+
+}  // namespace
+
+HeadlessView::HeadlessView(const Settings& settings) : settings_(settings) {}
+
+HeadlessView::~HeadlessView() {}
+
+void HeadlessView::BlockTerminationSignals() {
+  sigset_t signals = TerminationSignals();
+  pthread_sigmask(SIG_BLOCK, &signals, nullptr);
+}
+
+void HeadlessView::SetSupportCodecs(const std::vector<std::string>& codecs) {
+  support_codecs_ = codecs;
+}
+
+void HeadlessView::SetLocalIpAddress(const std::string& ip) {
+  local_ip_ = ip;
+}
+
+bool HeadlessView::Run() {
+  if (!ResolveSettings()) {
+    return false;
+  }
+
+  RTC_LOG(LS_INFO) << "local_ip:" << settings_.local_ip
+                   << ", local_port:" << settings_.local_port
+                   << ", remote_ip:" << settings_.remote_ip
+                   << ", remote_port:" << settings_.remote_port
+                   << ", encoder:" << settings_.encoder;
+
+  events()->OnSessionEvent(true, settings_.local_ip, settings_.local_port,
+                           settings_.remote_ip, settings_.remote_port,
+                           settings_.encoder, settings_.decoders);
+  if (settings_.send) {
+    events()->OnSendAudio(true);
+  }
+  if (settings_.playout) {
+    events()->OnPlayoutAudio(true);
+  }
+
+  WaitForEnd();
+
+  if (settings_.send) {
+    events()->OnSendAudio(false);
+  }
+  if (settings_.playout) {
+    events()->OnPlayoutAudio(false);
+  }
+  events()->OnSessionEvent(false, "", 0, "", 0, settings_.encoder,
+                           settings_.decoders);
+  return true;
+}
+
+bool HeadlessView::ResolveSettings() {
+  if (settings_.local_ip.empty()) {
+    settings_.local_ip = local_ip_;
+  }
+  if (settings_.local_ip.empty() || settings_.remote_ip.empty() ||
+      settings_.local_port <= 0 || settings_.remote_port <= 0) {
+    RTC_LOG(LS_ERROR) << "Local and remote addresses are required";
+    return false;
+  }
+  if (support_codecs_.empty()) {
+    RTC_LOG(LS_ERROR) << "No supported codecs";
+    return false;
+  }
+
+  if (settings_.encoder.empty()) {
+    settings_.encoder = support_codecs_[0];
+  } else if (!IsSupported(support_codecs_, settings_.encoder)) {
+    RTC_LOG(LS_ERROR) << "Unsupported encoder " << settings_.encoder;
+    return false;
+  }
+
+  if (settings_.decoders.empty()) {
+    settings_.decoders = support_codecs_;
+  }
+  for (const std::string& decoder : settings_.decoders) {
+    if (!IsSupported(support_codecs_, decoder)) {
+      RTC_LOG(LS_ERROR) << "Unsupported decoder " << decoder;
+      return false;
+    }
+  }
+  return true;
+}
+
+void HeadlessView::WaitForEnd() {
+  sigset_t signals = TerminationSignals();
+  int signal;
+  if (settings_.duration_s <= 0) {
+    sigwait(&signals, &signal);
+    RTC_LOG(LS_INFO) << "Stopping on signal " << signal;
+    return;
+  }
+
+  timespec deadline;
+  clock_gettime(CLOCK_MONOTONIC, &deadline);
+  deadline.tv_sec += settings_.duration_s;
+  while (true) {
+    timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    timespec remaining;
+    remaining.tv_sec = deadline.tv_sec - now.tv_sec;
+    remaining.tv_nsec = deadline.tv_nsec - now.tv_nsec;
+    if (remaining.tv_nsec < 0) {
+      remaining.tv_nsec += 1000000000;
+      --remaining.tv_sec;
+    }
+    if (remaining.tv_sec < 0) {
+      return;
+    }
+    signal = sigtimedwait(&signals, nullptr, &remaining);
+    if (signal > 0) {
+      RTC_LOG(LS_INFO) << "Stopping on signal " << signal;
+      return;
+    }
+    // EINTR: some other signal interrupted the wait, so wait out the rest.
+    if (errno != EINTR) {
+      return;
+    }
+  }
+}
+
+}  // namespace webrtc_examples
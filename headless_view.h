@@ -0,0 +1,67 @@
+/*
+ * headless_view.h
+ * Copyright (C) 2023 youfa <vsyfar@gmail.com>
+ *
+ * Distributed under terms of the GPLv2 license.
+ */
+
+#ifndef HEADLESS_VIEW_H
+#define HEADLESS_VIEW_H
+
+#include <string>
+#include <vector>
+
+#include "examples/voipclient/window_view.h"
+
+namespace webrtc_examples {
+
+// A WindowView without a window, for servers, containers and load tests.
+// Instead of reacting to widgets it replays a fixed script: start the
+// session, optionally start send and playout, wait, then tear it all down
+// in the order the GTK window would.
+class HeadlessView : public WindowView {
+ public:
+  struct Settings {
+    // Empty means the address passed to SetLocalIpAddress().
+    std::string local_ip;
+    int local_port = 0;
+    std::string remote_ip;
+    int remote_port = 0;
+    // Empty means the first supported codec.
+    std::string encoder;
+    // Empty means every supported codec.
+    std::vector<std::string> decoders;
+    bool send = true;
+    bool playout = true;
+    // How long the session runs; zero runs until SIGINT or SIGTERM.
+    int duration_s = 0;
+  };
+
+  explicit HeadlessView(const Settings& settings);
+  ~HeadlessView() override;
+
+  // Blocks SIGINT and SIGTERM in the calling thread, and in the threads it
+  // creates afterwards, so that Run() can wait for them synchronously. Call
+  // before creating the VoipClient.
+  static void BlockTerminationSignals();
+
+  // WindowView interface
+  void SetSupportCodecs(const std::vector<std::string>& codecs) override;
+  void SetLocalIpAddress(const std::string& ip) override;
+
+  // Runs the script. Returns false, without starting anything, if the
+  // settings are incomplete or name an unsupported codec.
+  bool Run();
+
+ private:
+  bool ResolveSettings();
+  void WaitForEnd();
+
+  Settings settings_;
+  std::string local_ip_;
+  std::vector<std::string> support_codecs_;
+};
+
+}  // namespace webrtc_examples
+
+#endif /* !HEADLESS_VIEW_H */
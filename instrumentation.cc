@@ -0,0 +1,213 @@
+/*
+ *  Copyright 2023 The WebRTC Project Authors. All rights reserved.
+ *
+ *  Use of this source code is governed by a BSD-style license
+ *  that can be found in the LICENSE file in the root of the source
+ *  tree. An additional intellectual property rights grant can be found
+ *  in the file PATENTS.  All contributing project authors may
+ *  be found in the AUTHORS file in the root of the source tree.
+ */
+
+#include "examples/voipclient/instrumentation.h"
+
+#include <atomic>
+#include <vector>
+
+#include "rtc_base/checks.h"
+#include "rtc_base/synchronization/mutex.h"
+
+namespace webrtc_examples {
+
+namespace {
+
+#if defined(VOIP_CLIENT_INSTRUMENTATION)
+
+// Written by its owning thread only, so updates are a relaxed load and
+// store; readers may see any recent value.
+class alignas(64) ThreadSlot {
+ public:
+  void Increment(Counter counter, uint64_t value) {
+    Add(counters_[static_cast<size_t>(counter)], value);
+  }
+
+  void Record(Histogram histogram, int64_t value) {
+    HistogramSlot& slot = histograms_[static_cast<size_t>(histogram)];
+    Add(slot.count, 1);
+    Add(slot.sum, static_cast<uint64_t>(value));
+    Add(slot.buckets[Instrumentation::BucketIndex(value)], 1);
+  }
+
+  void AddTo(Instrumentation::Snapshot* snapshot) const {
+    for (size_t i = 0; i < kNumCounters; ++i) {
+      snapshot->counters[i] += counters_[i].load(std::memory_order_relaxed);
+    }
+    for (size_t i = 0; i < kNumHistograms; ++i) {
+      const HistogramSlot& slot = histograms_[i];
+      Instrumentation::HistogramSnapshot& total = snapshot->histograms[i];
+      total.count += slot.count.load(std::memory_order_relaxed);
+      total.sum += slot.sum.load(std::memory_order_relaxed);
+      for (size_t j = 0; j < Instrumentation::kHistogramBuckets; ++j) {
+        total.buckets[j] += slot.buckets[j].load(std::memory_order_relaxed);
+      }
+    }
+  }
+
+ private:
+  struct HistogramSlot {
+    std::atomic<uint64_t> count{0};
+    std::atomic<uint64_t> sum{0};
+    std::array<std::atomic<uint64_t>, Instrumentation::kHistogramBuckets>
+        buckets = {};
+  };
+
+  static void Add(std::atomic<uint64_t>& cell, uint64_t value) {
+    cell.store(cell.load(std::memory_order_relaxed) + value,
+               std::memory_order_relaxed);
+  }
+
+  std::array<std::atomic<uint64_t>, kNumCounters> counters_ = {};
+  std::array<HistogramSlot, kNumHistograms> histograms_;
+};
+
+// Every slot ever handed out. Slots outlive their threads so that counts
+// recorded by threads that have exited are still reported; the process
+// only runs a handful of threads.
+class SlotRegistry {
+ public:
+  ThreadSlot* Register() {
+    ThreadSlot* slot = new ThreadSlot();
+    webrtc::MutexLock lock(&mutex_);
+    slots_.push_back(slot);
+    return slot;
+  }
+
+  void AddTo(Instrumentation::Snapshot* snapshot) {
+    webrtc::MutexLock lock(&mutex_);
+    for (const ThreadSlot* slot : slots_) {
+      slot->AddTo(snapshot);
+    }
+  }
+
+ private:
+  webrtc::Mutex mutex_;
+  std::vector<ThreadSlot*> slots_ RTC_GUARDED_BY(mutex_);
+};
+
+SlotRegistry* GetRegistry() {
+  static SlotRegistry* const registry = new SlotRegistry();
+  return registry;
+}
+
+ThreadSlot* GetThreadSlot() {
+  thread_local ThreadSlot* const slot = GetRegistry()->Register();
+  return slot;
+}
+
+#endif  // defined(VOIP_CLIENT_INSTRUMENTATION)
+
+}  // namespace
+
+#if defined(VOIP_CLIENT_INSTRUMENTATION)
+void Instrumentation::Increment(Counter counter, uint64_t value) {
+  GetThreadSlot()->Increment(counter, value);
+}
+
+void Instrumentation::Record(Histogram histogram, int64_t value) {
+  GetThreadSlot()->Record(histogram, value < 0 ? 0 : value);
+}
+#endif
+
+Instrumentation::Snapshot Instrumentation::Read() {
+  Snapshot snapshot;
+#if defined(VOIP_CLIENT_INSTRUMENTATION)
+  GetRegistry()->AddTo(&snapshot);
+#endif
+  return snapshot;
+}
+
+size_t Instrumentation::BucketIndex(int64_t value) {
+  constexpr int64_t kSubBuckets = 1 << kSubBucketBits;
+  if (value < kSubBuckets) {
+    return value < 0 ? 0 : static_cast<size_t>(value);
+  }
+  const int msb = 63 - __builtin_clzll(static_cast<uint64_t>(value));
+  const int64_t sub_bucket =
+      (value >> (msb - kSubBucketBits)) & (kSubBuckets - 1);
+  return static_cast<size_t>((msb - kSubBucketBits + 1) * kSubBuckets +
+                             sub_bucket);
+}
+
+int64_t Instrumentation::BucketLowerBound(size_t index) {
+  constexpr size_t kSubBuckets = 1 << kSubBucketBits;
+  RTC_DCHECK_LT(index, kHistogramBuckets);
+  if (index < kSubBuckets) {
+    return static_cast<int64_t>(index);
+  }
+  const int shift = static_cast<int>(index / kSubBuckets) - 1;
+  const int64_t sub_bucket = static_cast<int64_t>(index % kSubBuckets);
+  return (static_cast<int64_t>(kSubBuckets) + sub_bucket) << shift;
+}
+
+int64_t Instrumentation::HistogramSnapshot::Percentile(double fraction) const {
+  // Not `count`, which a snapshot may read ahead of the buckets of a
+  // thread recording meanwhile.
+  uint64_t total = 0;
+  for (uint64_t bucket : buckets) {
+    total += bucket;
+  }
+  if (total == 0) {
+    return 0;
+  }
+  const uint64_t rank = static_cast<uint64_t>(fraction * (total - 1));
+  uint64_t seen = 0;
+  size_t i = 0;
+  for (; i + 1 < kHistogramBuckets; ++i) {
+    seen += buckets[i];
+    if (seen > rank) {
+      break;
+    }
+  }
+  return BucketLowerBound(i);
+}
+
+const char* Instrumentation::Name(Counter counter) {
+  switch (counter) {
+    case Counter::kRtpPacketsQueued:
+      return "rtp_packets_queued";
+    case Counter::kRtpPacketsSent:
+      return "rtp_packets_sent";
+    case Counter::kRtpPacketsReceived:
+      return "rtp_packets_received";
+    case Counter::kSendSyscalls:
+      return "send_syscalls";
+    case Counter::kReceiveSyscalls:
+      return "receive_syscalls";
+    case Counter::kNumCounters:
+      break;
+  }
+  RTC_DCHECK_NOTREACHED();
+  return "";
+}
+
+const char* Instrumentation::Name(Histogram histogram) {
+  switch (histogram) {
+    case Histogram::kSendQueueWait:
+      return "send_queue_wait_ns";
+    case Histogram::kReceiveQueueWait:
+      return "receive_queue_wait_ns";
+    case Histogram::kSendSyscall:
+      return "send_syscall_ns";
+    case Histogram::kReceiveSyscall:
+      return "receive_syscall_ns";
+    case Histogram::kRtpInterArrival:
+      return "rtp_inter_arrival_ns";
+    case Histogram::kReceiveDelay:
+      return "receive_delay_ns";
+    case Histogram::kNumHistograms:
+      break;
+  }
+  RTC_DCHECK_NOTREACHED();
+  return "";
+}
+
+}  // namespace webrtc_examples
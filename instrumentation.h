@@ -0,0 +1,144 @@
+/*
+ *  Copyright 2023 The WebRTC Project Authors. All rights reserved.
+ *
+ *  Use of this source code is governed by a BSD-style license
+ *  that can be found in the LICENSE file in the root of the source
+ *  tree. An additional intellectual property rights grant can be found
+ *  in the file PATENTS.  All contributing project authors may
+ *  be found in the AUTHORS file in the root of the source tree.
+ */
+
+#ifndef EXAMPLES_VOIPCLIENT_INSTRUMENTATION_H_
+#define EXAMPLES_VOIPCLIENT_INSTRUMENTATION_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <array>
+
+#if defined(VOIP_CLIENT_INSTRUMENTATION)
+#include "rtc_base/time_utils.h"
+#endif
+
+namespace webrtc_examples {
+
+// Counters and latency histograms for the packet paths, cheap enough to
+// update per packet. Each thread writes to its own cache line aligned slot
+// without atomic read-modify-write operations; the slots are only summed
+// when Instrumentation::Read() is called.
+//
+// Everything here compiles to nothing unless VOIP_CLIENT_INSTRUMENTATION is
+// defined, which the `voip_client_instrumentation` gn arg does, so an
+// instrumented build differs from a production one by that flag only.
+
+enum class Counter {
+  // SendRtp() calls that posted the packet to the shard thread.
+  kRtpPacketsQueued,
+  // Packets handed from SendRtpPacket() to a socket.
+  kRtpPacketsSent,
+  // Packets handed from ReadRTPPacket() to the engine.
+  kRtpPacketsReceived,
+  kSendSyscalls,
+  kReceiveSyscalls,
+  kNumCounters,
+};
+
+// All histograms record nanoseconds.
+enum class Histogram {
+  // From SendRtp() posting a packet to the shard thread running the task.
+  kSendQueueWait,
+  // From a shard forwarding shared port packets to the shard of their
+  // session running the task.
+  kReceiveQueueWait,
+  kSendSyscall,
+  kReceiveSyscall,
+  // Between consecutive RTP packets of one session.
+  kRtpInterArrival,
+  // From an RTP packet reaching the host to its hand-off to the engine;
+  // only with receive timestamps.
+  kReceiveDelay,
+  kNumHistograms,
+};
+
+constexpr size_t kNumCounters = static_cast<size_t>(Counter::kNumCounters);
+constexpr size_t kNumHistograms =
+    static_cast<size_t>(Histogram::kNumHistograms);
+
+class Instrumentation {
+ public:
+  // Values are bucketed by power of two, each split in four, which bounds
+  // the error of any percentile to 25% over the full int64 range.
+  static constexpr int kSubBucketBits = 2;
+  static constexpr size_t kHistogramBuckets = 248;
+
+  struct HistogramSnapshot {
+    uint64_t count = 0;
+    uint64_t sum = 0;
+    std::array<uint64_t, kHistogramBuckets> buckets = {};
+
+    // Lower bound of the bucket holding the `fraction` quantile of the
+    // values in `buckets`; zero if there are none.
+    int64_t Percentile(double fraction) const;
+  };
+
+  struct Snapshot {
+    std::array<uint64_t, kNumCounters> counters = {};
+    std::array<HistogramSnapshot, kNumHistograms> histograms = {};
+  };
+
+  static constexpr bool IsEnabled() {
+#if defined(VOIP_CLIENT_INSTRUMENTATION)
+    return true;
+#else
+    return false;
+#endif
+  }
+
+  static void Increment(Counter counter, uint64_t value = 1);
+  // Negative values are recorded as zero.
+  static void Record(Histogram histogram, int64_t value);
+
+  // Sums the slots of all threads that ever recorded anything. Counts may
+  // lag a concurrent writer by a few updates. All zero when compiled out.
+  static Snapshot Read();
+
+  static const char* Name(Counter counter);
+  static const char* Name(Histogram histogram);
+
+  static size_t BucketIndex(int64_t value);
+  static int64_t BucketLowerBound(size_t index);
+};
+
+// Measures an interval for a Histogram. Copies into posted tasks to time
+// queue waits; an empty object when instrumentation is compiled out.
+class Stopwatch {
+ public:
+#if defined(VOIP_CLIENT_INSTRUMENTATION)
+  Stopwatch() : start_ns_(rtc::TimeNanos()) {}
+
+  void Record(Histogram histogram) const {
+    Instrumentation::Record(histogram, rtc::TimeNanos() - start_ns_);
+  }
+  // Records the time since the previous lap, or since construction.
+  void Lap(Histogram histogram) {
+    const int64_t now_ns = rtc::TimeNanos();
+    Instrumentation::Record(histogram, now_ns - start_ns_);
+    start_ns_ = now_ns;
+  }
+
+ private:
+  int64_t start_ns_;
+#else
+  void Record(Histogram histogram) const {}
+  void Lap(Histogram histogram) {}
+#endif
+};
+
+#if !defined(VOIP_CLIENT_INSTRUMENTATION)
+inline void Instrumentation::Increment(Counter counter, uint64_t value) {}
+inline void Instrumentation::Record(Histogram histogram, int64_t value) {}
+#endif
+
+}  // namespace webrtc_examples
+
+#endif  // EXAMPLES_VOIPCLIENT_INSTRUMENTATION_H_
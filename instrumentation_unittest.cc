@@ -0,0 +1,110 @@
+/*
+ *  Copyright 2023 The WebRTC Project Authors. All rights reserved.
+ *
+ *  Use of this source code is governed by a BSD-style license
+ *  that can be found in the LICENSE file in the root of the source
+ *  tree. An additional intellectual property rights grant can be found
+ *  in the file PATENTS.  All contributing project authors may
+ *  be found in the AUTHORS file in the root of the source tree.
+ */
+
+#include "examples/voipclient/instrumentation.h"
+
+#include <stdint.h>
+
+#include <limits>
+
+#include "test/gtest.h"
+
+namespace webrtc_examples {
+namespace {
+
+constexpr size_t kLastBucket = Instrumentation::kHistogramBuckets - 1;
+
+TEST(InstrumentationTest, SmallValuesHaveABucketEach) {
+  for (int64_t value = 0; value < 8; ++value) {
+    EXPECT_EQ(Instrumentation::BucketIndex(value), static_cast<size_t>(value));
+    EXPECT_EQ(Instrumentation::BucketLowerBound(value), value);
+  }
+}
+
+TEST(InstrumentationTest, NegativeValuesGoToBucketZero) {
+  EXPECT_EQ(Instrumentation::BucketIndex(-1), 0u);
+  EXPECT_EQ(Instrumentation::BucketIndex(std::numeric_limits<int64_t>::min()),
+            0u);
+}
+
+TEST(InstrumentationTest, PowersOfTwoAreSplitInFour) {
+  // [8, 16) is split into [8, 10), [10, 12), [12, 14) and [14, 16).
+  EXPECT_EQ(Instrumentation::BucketIndex(8), 8u);
+  EXPECT_EQ(Instrumentation::BucketIndex(9), 8u);
+  EXPECT_EQ(Instrumentation::BucketIndex(10), 9u);
+  EXPECT_EQ(Instrumentation::BucketIndex(15), 11u);
+  EXPECT_EQ(Instrumentation::BucketIndex(16), 12u);
+  EXPECT_EQ(Instrumentation::BucketLowerBound(9), 10);
+  EXPECT_EQ(Instrumentation::BucketLowerBound(12), 16);
+}
+
+TEST(InstrumentationTest, BucketsCoverEveryValueInOrder) {
+  for (size_t index = 1; index < Instrumentation::kHistogramBuckets;
+       ++index) {
+    const int64_t lower_bound = Instrumentation::BucketLowerBound(index);
+    EXPECT_GT(lower_bound, Instrumentation::BucketLowerBound(index - 1));
+    EXPECT_EQ(Instrumentation::BucketIndex(lower_bound), index);
+    EXPECT_EQ(Instrumentation::BucketIndex(lower_bound - 1), index - 1);
+  }
+}
+
+TEST(InstrumentationTest, LargestValueGoesToLastBucket) {
+  EXPECT_EQ(Instrumentation::BucketIndex(std::numeric_limits<int64_t>::max()),
+            kLastBucket);
+  EXPECT_EQ(Instrumentation::BucketLowerBound(kLastBucket),
+            int64_t{7} << 60);
+}
+
+TEST(InstrumentationTest, PercentileOfEmptyHistogramIsZero) {
+  Instrumentation::HistogramSnapshot histogram;
+  EXPECT_EQ(histogram.Percentile(0.5), 0);
+  EXPECT_EQ(histogram.Percentile(1.0), 0);
+}
+
+TEST(InstrumentationTest, PercentileReturnsLowerBoundOfItsBucket) {
+  Instrumentation::HistogramSnapshot histogram;
+  // 90 values of 0, 9 of 100 and one of 1000.
+  histogram.buckets[Instrumentation::BucketIndex(0)] = 90;
+  histogram.buckets[Instrumentation::BucketIndex(100)] = 9;
+  histogram.buckets[Instrumentation::BucketIndex(1000)] = 1;
+  histogram.count = 100;
+
+  EXPECT_EQ(histogram.Percentile(0.0), 0);
+  EXPECT_EQ(histogram.Percentile(0.5), 0);
+  EXPECT_EQ(histogram.Percentile(0.9), 0);
+  EXPECT_EQ(histogram.Percentile(0.95), 96);
+  EXPECT_EQ(histogram.Percentile(1.0), 896);
+}
+
+TEST(InstrumentationTest, PercentileOfOverflowBucket) {
+  Instrumentation::HistogramSnapshot histogram;
+  histogram.buckets[0] = 1;
+  histogram.buckets[kLastBucket] = 1;
+  histogram.count = 2;
+
+  EXPECT_EQ(histogram.Percentile(0.0), 0);
+  EXPECT_EQ(histogram.Percentile(1.0),
+            Instrumentation::BucketLowerBound(kLastBucket));
+}
+
+TEST(InstrumentationTest, PercentileIgnoresCountAheadOfBuckets) {
+  // A snapshot can read `count` ahead of the buckets of a concurrent
+  // writer.
+  Instrumentation::HistogramSnapshot histogram;
+  histogram.buckets[Instrumentation::BucketIndex(5)] = 1;
+  histogram.buckets[Instrumentation::BucketIndex(100)] = 1;
+  histogram.count = 5;
+
+  EXPECT_EQ(histogram.Percentile(0.0), 5);
+  EXPECT_EQ(histogram.Percentile(1.0), 96);
+}
+
+}  // namespace
+}  // namespace webrtc_examples
@@ -0,0 +1,503 @@
+/*
+ *  Copyright 2023 The WebRTC Project Authors. All rights reserved.
+ *
+ *  Use of this source code is governed by a BSD-style license
+ *  that can be found in the LICENSE file in the root of the source
+ *  tree. An additional intellectual property rights grant can be found
+ *  in the file PATENTS.  All contributing project authors may
+ *  be found in the AUTHORS file in the root of the source tree.
+ */
+
+#include "examples/voipclient/io_uring_receiver.h"
+
+#include <errno.h>
+#include <netinet/in.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <utility>
+
+#include "absl/memory/memory.h"
+#include "rtc_base/checks.h"
+#include "rtc_base/logging.h"
+
+#if defined(VOIP_CLIENT_IO_URING)
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#endif
+
+namespace webrtc_examples {
+
+#if defined(VOIP_CLIENT_IO_URING)
+
+namespace {
+
+// User data of cancellations, whose completions carry nothing to process.
+constexpr uint64_t kInternalUserData = 0;
+// User data of the receive request Create() tests the kernel with.
+constexpr uint64_t kProbeUserData = ~uint64_t{0};
+constexpr uint16_t kBufferGroup = 0;
+
+int IoUringSetup(unsigned int entries, io_uring_params* params) {
+  return static_cast<int>(syscall(__NR_io_uring_setup, entries, params));
+}
+
+int IoUringEnter(int fd,
+                 unsigned int to_submit,
+                 unsigned int min_complete,
+                 unsigned int flags) {
+  return static_cast<int>(syscall(__NR_io_uring_enter, fd, to_submit,
+                                  min_complete, flags, nullptr, 0));
+}
+
+int IoUringRegister(int fd, unsigned int opcode, void* arg, unsigned int n) {
+  return static_cast<int>(syscall(__NR_io_uring_register, fd, opcode, arg, n));
+}
+
+void PrepareMultishotReceive(io_uring_sqe* sqe,
+                             int fd,
+                             const msghdr* header,
+                             uint64_t user_data) {
+  sqe->opcode = IORING_OP_RECVMSG;
+  sqe->fd = fd;
+  sqe->addr = reinterpret_cast<uint64_t>(header);
+  sqe->len = 1;
+  sqe->ioprio = IORING_RECV_MULTISHOT;
+  sqe->flags = IOSQE_BUFFER_SELECT;
+  sqe->buf_group = kBufferGroup;
+  sqe->user_data = user_data;
+}
+
+void PrepareCancel(io_uring_sqe* sqe, uint64_t target_user_data) {
+  sqe->opcode = IORING_OP_ASYNC_CANCEL;
+  sqe->fd = -1;
+  sqe->addr = target_user_data;
+  sqe->user_data = kInternalUserData;
+}
+
+}  // namespace
+
+struct IoUringReceiver::Ring {
+  ~Ring() {
+    if (buffer_ring) {
+      munmap(buffer_ring, buffer_ring_size);
+    }
+    if (sqes) {
+      munmap(sqes, sqes_size);
+    }
+    if (rings) {
+      munmap(rings, rings_size);
+    }
+    if (fd >= 0) {
+      close(fd);
+    }
+  }
+
+  // Maps the rings of `fd` and registers the provided buffer ring.
+  bool Init(const io_uring_params& params, unsigned int buffers) {
+    if (!(params.features & IORING_FEAT_SINGLE_MMAP)) {
+      return false;
+    }
+    rings_size = std::max<size_t>(
+        params.sq_off.array + params.sq_entries * sizeof(uint32_t),
+        params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe));
+    rings = mmap(nullptr, rings_size, PROT_READ | PROT_WRITE,
+                 MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+    if (rings == MAP_FAILED) {
+      rings = nullptr;
+      return false;
+    }
+    sqes_size = params.sq_entries * sizeof(io_uring_sqe);
+    void* sqes_map = mmap(nullptr, sqes_size, PROT_READ | PROT_WRITE,
+                          MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+    if (sqes_map == MAP_FAILED) {
+      return false;
+    }
+    sqes = static_cast<io_uring_sqe*>(sqes_map);
+
+    uint8_t* base = static_cast<uint8_t*>(rings);
+    sq_tail = reinterpret_cast<uint32_t*>(base + params.sq_off.tail);
+    sq_mask = *reinterpret_cast<uint32_t*>(base + params.sq_off.ring_mask);
+    sq_array = reinterpret_cast<uint32_t*>(base + params.sq_off.array);
+    sq_entries = params.sq_entries;
+    sq_head = reinterpret_cast<uint32_t*>(base + params.sq_off.head);
+    cq_head = reinterpret_cast<uint32_t*>(base + params.cq_off.head);
+    cq_tail = reinterpret_cast<uint32_t*>(base + params.cq_off.tail);
+    cq_mask = *reinterpret_cast<uint32_t*>(base + params.cq_off.ring_mask);
+    cqes = reinterpret_cast<io_uring_cqe*>(base + params.cq_off.cqes);
+
+    buffer_ring_size = buffers * sizeof(io_uring_buf);
+    void* buffer_map = mmap(nullptr, buffer_ring_size, PROT_READ | PROT_WRITE,
+                            MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (buffer_map == MAP_FAILED) {
+      return false;
+    }
+    // Addressed as plain entries: the flexible array of io_uring_buf_ring
+    // is preceded by an empty struct, which takes space in C++.
+    buffer_ring = static_cast<io_uring_buf*>(buffer_map);
+    buffer_ring_tail = &buffer_ring[0].resv;
+    buffer_mask = buffers - 1;
+    io_uring_buf_reg registration = {};
+    registration.ring_addr = reinterpret_cast<uint64_t>(buffer_ring);
+    registration.ring_entries = buffers;
+    registration.bgid = kBufferGroup;
+    return IoUringRegister(fd, IORING_REGISTER_PBUF_RING, &registration, 1) ==
+           0;
+  }
+
+  // Whether the kernel implements multishot recvmsg (Linux 6.0). It
+  // rejects the request when issuing it, so one on an idle socket either
+  // fails at once or waits for data and is cancelled again.
+  bool SupportsMultishotReceive() {
+    int probe_fd =
+        socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (probe_fd < 0) {
+      return false;
+    }
+    msghdr header = {};
+    PrepareMultishotReceive(NextSqe(), probe_fd, &header, kProbeUserData);
+    PrepareCancel(NextSqe(), kProbeUserData);
+    // Both requests complete either way.
+    const int submitted = IoUringEnter(fd, Publish(), 2,
+                                       IORING_ENTER_GETEVENTS);
+    close(probe_fd);
+    if (submitted != 2) {
+      return false;
+    }
+    bool supported = true;
+    uint32_t head = *cq_head;
+    const uint32_t tail = __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE);
+    for (; head != tail; ++head) {
+      const io_uring_cqe& cqe = cqes[head & cq_mask];
+      if (cqe.user_data == kProbeUserData && cqe.res == -EINVAL) {
+        supported = false;
+      }
+    }
+    __atomic_store_n(cq_head, head, __ATOMIC_RELEASE);
+    return supported;
+  }
+
+  // Returns a cleared submission queue entry, or null if the queue is full.
+  io_uring_sqe* NextSqe() {
+    const uint32_t head = __atomic_load_n(sq_head, __ATOMIC_ACQUIRE);
+    if (sq_local_tail - head >= sq_entries) {
+      return nullptr;
+    }
+    const uint32_t index = sq_local_tail & sq_mask;
+    io_uring_sqe* sqe = &sqes[index];
+    memset(sqe, 0, sizeof(*sqe));
+    sq_array[index] = index;
+    ++sq_local_tail;
+    return sqe;
+  }
+
+  // Publishes the entries from NextSqe() and returns how many there are.
+  uint32_t Publish() {
+    const uint32_t tail = *sq_tail;
+    __atomic_store_n(sq_tail, sq_local_tail, __ATOMIC_RELEASE);
+    return sq_local_tail - tail;
+  }
+
+  int fd = -1;
+  void* rings = nullptr;
+  size_t rings_size = 0;
+  io_uring_sqe* sqes = nullptr;
+  size_t sqes_size = 0;
+
+  uint32_t* sq_head = nullptr;
+  uint32_t* sq_tail = nullptr;
+  uint32_t* sq_array = nullptr;
+  uint32_t sq_mask = 0;
+  uint32_t sq_entries = 0;
+  uint32_t sq_local_tail = 0;
+
+  uint32_t* cq_head = nullptr;
+  uint32_t* cq_tail = nullptr;
+  uint32_t cq_mask = 0;
+  io_uring_cqe* cqes = nullptr;
+
+  io_uring_buf* buffer_ring = nullptr;
+  // Overlays the reserved field of the first entry.
+  uint16_t* buffer_ring_tail = nullptr;
+  size_t buffer_ring_size = 0;
+  uint16_t buffer_mask = 0;
+  uint16_t buffer_tail = 0;
+};
+
+std::unique_ptr<IoUringReceiver> IoUringReceiver::Create(
+    rtc::PhysicalSocketServer* socket_server,
+    const Options& options) {
+  RTC_DCHECK(socket_server);
+  RTC_DCHECK_GT(options.buffers, 0);
+  RTC_DCHECK_LE(options.buffers, 1u << 15);
+  RTC_DCHECK_EQ(options.buffers & (options.buffers - 1), 0);
+
+  io_uring_params params = {};
+  // Every packet completes separately, so the completion queue must hold
+  // one entry per provided buffer besides those of control requests.
+  params.flags = IORING_SETUP_CQSIZE;
+  params.cq_entries = options.buffers + options.queue_entries;
+  auto ring = std::make_unique<Ring>();
+  ring->fd = IoUringSetup(options.queue_entries, &params);
+  if (ring->fd < 0) {
+    RTC_LOG_ERR(LS_WARNING) << "io_uring_setup() failed";
+    return nullptr;
+  }
+  if (!ring->Init(params, options.buffers)) {
+    RTC_LOG_ERR(LS_WARNING) << "io_uring provided buffers unavailable";
+    return nullptr;
+  }
+  if (!ring->SupportsMultishotReceive()) {
+    RTC_LOG(LS_WARNING) << "io_uring multishot receive unavailable";
+    return nullptr;
+  }
+
+  // Using `new` to access a non-public constructor.
+  auto receiver = absl::WrapUnique(
+      new IoUringReceiver(socket_server, std::move(ring), options));
+  socket_server->Add(receiver.get());
+  return receiver;
+}
+
+IoUringReceiver::IoUringReceiver(rtc::PhysicalSocketServer* socket_server,
+                                 std::unique_ptr<Ring> ring,
+                                 const Options& options)
+    : socket_server_(socket_server),
+      ring_(std::move(ring)),
+      buffers_(options.buffers) {
+  // An IPv6 address is the largest a UDP socket reports.
+  receive_header_.msg_namelen = sizeof(sockaddr_in6);
+  timestamp_header_.msg_namelen = sizeof(sockaddr_in6);
+  timestamp_header_.msg_controllen = kReceiveTimestampControlSize;
+  for (size_t bid = 0; bid < buffers_.size(); ++bid) {
+    ProvideBuffer(static_cast<uint16_t>(bid));
+  }
+  __atomic_store_n(ring_->buffer_ring_tail, ring_->buffer_tail,
+                   __ATOMIC_RELEASE);
+}
+
+IoUringReceiver::~IoUringReceiver() {
+  RTC_DCHECK(registrations_.empty());
+  socket_server_->Remove(this);
+  // Until every request has completed the kernel may still write into the
+  // buffers, which the pool hands out again.
+  while (active_requests_ > 0) {
+    ++stats_.enter_calls;
+    if (IoUringEnter(ring_->fd, 0, 1, IORING_ENTER_GETEVENTS) < 0 &&
+        errno != EINTR) {
+      RTC_LOG_ERR(LS_ERROR) << "Failed to wait for io_uring requests";
+      break;
+    }
+    ReapCompletions();
+  }
+}
+
+bool IoUringReceiver::Add(int fd, Listener* listener, bool timestamps) {
+  RTC_DCHECK(listener);
+  RTC_DCHECK(ids_by_fd_.find(fd) == ids_by_fd_.end());
+  const uint64_t id = next_id_++;
+  if (!SubmitReceive(id, fd, timestamps)) {
+    return false;
+  }
+  registrations_[id] = {fd, listener, timestamps, /*in_batch=*/false};
+  ids_by_fd_[fd] = id;
+  return true;
+}
+
+void IoUringReceiver::Remove(int fd) {
+  auto it = ids_by_fd_.find(fd);
+  if (it == ids_by_fd_.end()) {
+    return;
+  }
+  const uint64_t id = it->second;
+  ids_by_fd_.erase(it);
+  registrations_.erase(id);
+
+  io_uring_sqe* sqe = ring_->NextSqe();
+  if (!sqe) {
+    // The request keeps running, but its completions are ignored.
+    RTC_LOG(LS_WARNING) << "io_uring submission queue full";
+    return;
+  }
+  PrepareCancel(sqe, id);
+  ++stats_.enter_calls;
+  if (IoUringEnter(ring_->fd, ring_->Publish(), 0, 0) < 0) {
+    RTC_LOG_ERR(LS_WARNING) << "io_uring_enter() failed";
+  }
+}
+
+uint32_t IoUringReceiver::GetRequestedEvents() {
+  return rtc::DE_READ;
+}
+
+void IoUringReceiver::OnEvent(uint32_t ff, int err) {
+  if (ff & rtc::DE_READ) {
+    ++stats_.wakeups;
+    ReapCompletions();
+  }
+}
+
+int IoUringReceiver::GetDescriptor() {
+  return ring_->fd;
+}
+
+bool IoUringReceiver::IsDescriptorClosed() {
+  return false;
+}
+
+bool IoUringReceiver::SubmitReceive(uint64_t id, int fd, bool timestamps) {
+  io_uring_sqe* sqe = ring_->NextSqe();
+  if (!sqe) {
+    RTC_LOG(LS_WARNING) << "io_uring submission queue full";
+    return false;
+  }
+  PrepareMultishotReceive(sqe, fd,
+                          timestamps ? &timestamp_header_ : &receive_header_,
+                          id);
+  ++stats_.enter_calls;
+  if (IoUringEnter(ring_->fd, ring_->Publish(), 0, 0) < 0) {
+    RTC_LOG_ERR(LS_WARNING) << "io_uring_enter() failed";
+    return false;
+  }
+  ++active_requests_;
+  return true;
+}
+
+void IoUringReceiver::ProvideBuffer(uint16_t bid) {
+  buffers_[bid] = PacketBufferPool::Get()->Allocate();
+  io_uring_buf& entry =
+      ring_->buffer_ring[ring_->buffer_tail & ring_->buffer_mask];
+  entry.addr = reinterpret_cast<uint64_t>(buffers_[bid]->data());
+  entry.len = PacketBuffer::kCapacity;
+  entry.bid = bid;
+  ++ring_->buffer_tail;
+}
+
+void IoUringReceiver::ReapCompletions() {
+  std::vector<uint64_t> restarts;
+  uint32_t head = *ring_->cq_head;
+  uint32_t tail = __atomic_load_n(ring_->cq_tail, __ATOMIC_ACQUIRE);
+  for (; head != tail; ++head) {
+    const io_uring_cqe& cqe = ring_->cqes[head & ring_->cq_mask];
+    auto registration = registrations_.find(cqe.user_data);
+    const bool registered = registration != registrations_.end();
+
+    if (cqe.flags & IORING_CQE_F_BUFFER) {
+      const uint16_t bid = cqe.flags >> IORING_CQE_BUFFER_SHIFT;
+      rtc::scoped_refptr<PacketBuffer> buffer = std::move(buffers_[bid]);
+      ProvideBuffer(bid);
+      const msghdr& header = registered && registration->second.timestamps
+                                 ? timestamp_header_
+                                 : receive_header_;
+      const size_t payload_offset = sizeof(io_uring_recvmsg_out) +
+                                    header.msg_namelen + header.msg_controllen;
+      if (registered && cqe.res >= static_cast<int>(payload_offset)) {
+        const auto* out =
+            reinterpret_cast<const io_uring_recvmsg_out*>(buffer->data());
+        sockaddr_storage source = {};
+        memcpy(&source, buffer->data() + sizeof(io_uring_recvmsg_out),
+               std::min<size_t>(out->namelen, header.msg_namelen));
+        msghdr control = {};
+        control.msg_control = buffer->data() + sizeof(io_uring_recvmsg_out) +
+                              header.msg_namelen;
+        control.msg_controllen = out->controllen;
+        const ReceiveTimestamp timestamp = ParseReceiveTimestamp(control);
+        const bool truncated = out->flags & MSG_TRUNC;
+        const size_t size = cqe.res - payload_offset;
+        memmove(buffer->data(), buffer->data() + payload_offset, size);
+        buffer->SetSize(size);
+
+        ++stats_.packets_received;
+        if (truncated) {
+          ++stats_.truncated_packets;
+        }
+        registration->second.listener->OnIoUringPacket(
+            std::move(buffer), source, timestamp, truncated);
+        if (!registration->second.in_batch) {
+          registration->second.in_batch = true;
+          batch_ids_.push_back(cqe.user_data);
+        }
+      }
+    }
+
+    if (!(cqe.flags & IORING_CQE_F_MORE) &&
+        cqe.user_data != kInternalUserData) {
+      // The request has ended; restart it unless the socket was removed.
+      --active_requests_;
+      if (registered) {
+        if (cqe.res == -ENOBUFS) {
+          ++stats_.buffer_shortages;
+        } else if (cqe.res < 0) {
+          RTC_LOG(LS_WARNING) << "io_uring receive failed: " << -cqe.res;
+        }
+        restarts.push_back(cqe.user_data);
+      }
+    }
+  }
+  __atomic_store_n(ring_->cq_head, head, __ATOMIC_RELEASE);
+  __atomic_store_n(ring_->buffer_ring_tail, ring_->buffer_tail,
+                   __ATOMIC_RELEASE);
+
+  // Restarted only now that the buffers consumed above are back.
+  for (uint64_t id : restarts) {
+    auto registration = registrations_.find(id);
+    if (registration != registrations_.end() &&
+        !SubmitReceive(id, registration->second.fd,
+                       registration->second.timestamps)) {
+      RTC_LOG(LS_ERROR) << "Cannot restart receive on "
+                        << registration->second.fd;
+    }
+  }
+
+  std::vector<uint64_t> batch_ids;
+  batch_ids.swap(batch_ids_);
+  for (uint64_t id : batch_ids) {
+    // A listener may remove other sockets from its callback.
+    auto registration = registrations_.find(id);
+    if (registration != registrations_.end()) {
+      registration->second.in_batch = false;
+      registration->second.listener->OnIoUringBatchEnd();
+    }
+  }
+  batch_ids.clear();
+  batch_ids_.swap(batch_ids);
+}
+
+#else  // defined(VOIP_CLIENT_IO_URING)
+
+struct IoUringReceiver::Ring {};
+
+std::unique_ptr<IoUringReceiver> IoUringReceiver::Create(
+    rtc::PhysicalSocketServer* socket_server,
+    const Options& options) {
+  RTC_LOG(LS_WARNING) << "Built without io_uring support";
+  return nullptr;
+}
+
+IoUringReceiver::~IoUringReceiver() = default;
+
+bool IoUringReceiver::Add(int fd, Listener* listener, bool timestamps) {
+  return false;
+}
+
+void IoUringReceiver::Remove(int fd) {}
+
+uint32_t IoUringReceiver::GetRequestedEvents() {
+  return 0;
+}
+
+void IoUringReceiver::OnEvent(uint32_t ff, int err) {}
+
+int IoUringReceiver::GetDescriptor() {
+  return -1;
+}
+
+bool IoUringReceiver::IsDescriptorClosed() {
+  return false;
+}
+
+#endif  // defined(VOIP_CLIENT_IO_URING)
+
+}  // namespace webrtc_examples
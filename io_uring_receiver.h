@@ -0,0 +1,160 @@
+/*
+ *  Copyright 2023 The WebRTC Project Authors. All rights reserved.
+ *
+ *  Use of this source code is governed by a BSD-style license
+ *  that can be found in the LICENSE file in the root of the source
+ *  tree. An additional intellectual property rights grant can be found
+ *  in the file PATENTS.  All contributing project authors may
+ *  be found in the AUTHORS file in the root of the source tree.
+ */
+
+#ifndef EXAMPLES_VOIPCLIENT_IO_URING_RECEIVER_H_
+#define EXAMPLES_VOIPCLIENT_IO_URING_RECEIVER_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/socket.h>
+
+#include <map>
+#include <memory>
+#include <vector>
+
+#include "api/scoped_refptr.h"
+#include "examples/voipclient/packet_buffer_pool.h"
+#include "examples/voipclient/receive_timestamp.h"
+#include "rtc_base/physical_socket_server.h"
+
+namespace webrtc_examples {
+
+// Reads the datagrams of all MediaSockets of one thread through a single
+// io_uring instead of a readiness event and a recvmmsg() per socket.
+//
+// Each socket has one multishot recvmsg request outstanding, which keeps
+// receiving into buffers the kernel picks from a ring of PacketBuffers
+// provided by this class. The io_uring descriptor itself is registered with
+// the thread's rtc::PhysicalSocketServer, so one wakeup reaps the
+// completions of every socket, and handing the filled buffers on and
+// providing fresh ones from the PacketBufferPool takes no system call at
+// all. The kernel is only entered to add or cancel a socket's request, or
+// to restart one that ran out of buffers.
+//
+// The kernel writes a small header, the source address and, for sockets
+// that want one, room for a receive timestamp ahead of the payload, which
+// is moved to the start of its PacketBuffer in place; this leaves slightly
+// less than PacketBuffer::kCapacity for the datagram.
+//
+// Requires Linux 6.0 and a build with the `voip_client_io_uring` gn arg;
+// otherwise Create() fails and sockets read by themselves. All methods run
+// on the thread that owns the socket server.
+class IoUringReceiver : public rtc::Dispatcher {
+ public:
+  // Receives the datagrams of one socket.
+  class Listener {
+   public:
+    virtual ~Listener() = default;
+
+    // A datagram from `source`, with its payload in `buffer`. `timestamp`
+    // is empty unless the socket has receive timestamps enabled.
+    virtual void OnIoUringPacket(rtc::scoped_refptr<PacketBuffer> buffer,
+                                 const sockaddr_storage& source,
+                                 const ReceiveTimestamp& timestamp,
+                                 bool truncated) = 0;
+    // Every packet of the current wakeup has been reported.
+    virtual void OnIoUringBatchEnd() = 0;
+  };
+
+  struct Options {
+    // Submission and completion queue size; bounds the number of requests
+    // that can be added or cancelled between two wakeups.
+    unsigned int queue_entries = 256;
+    // PacketBuffers lent to the kernel, shared by all sockets; a power of
+    // two. Datagrams arriving while all are filled wait in the socket.
+    unsigned int buffers = 1024;
+  };
+
+  struct Stats {
+    // io_uring_enter() system calls issued.
+    uint64_t enter_calls = 0;
+    // Readiness events of the ring that found completions.
+    uint64_t wakeups = 0;
+    uint64_t packets_received = 0;
+    uint64_t truncated_packets = 0;
+    // Requests restarted after the kernel ran out of provided buffers.
+    uint64_t buffer_shortages = 0;
+  };
+
+  // Returns null if io_uring or its multishot receive is unavailable.
+  static std::unique_ptr<IoUringReceiver> Create(
+      rtc::PhysicalSocketServer* socket_server,
+      const Options& options);
+
+  // Must follow the Remove() of every socket.
+  ~IoUringReceiver() override;
+
+  IoUringReceiver(const IoUringReceiver&) = delete;
+  IoUringReceiver& operator=(const IoUringReceiver&) = delete;
+
+  // Starts receiving on `fd`, a datagram socket, until Remove(), with room
+  // for a receive timestamp if `timestamps`. Returns false on failure.
+  // `listener` must outlive the registration.
+  bool Add(int fd, Listener* listener, bool timestamps);
+  // Cancels the request of `fd`; nothing is reported for it afterwards,
+  // so the descriptor may be closed right away.
+  void Remove(int fd);
+
+  Stats GetStats() const { return stats_; }
+
+  // rtc::Dispatcher implementation.
+  uint32_t GetRequestedEvents() override;
+  void OnEvent(uint32_t ff, int err) override;
+  int GetDescriptor() override;
+  bool IsDescriptorClosed() override;
+
+ private:
+  // The mapped submission and completion rings; defined in the .cc file.
+  struct Ring;
+
+  struct Registration {
+    int fd;
+    Listener* listener;
+    bool timestamps;
+    // Whether the socket was handed packets during the current wakeup.
+    bool in_batch;
+  };
+
+  IoUringReceiver(rtc::PhysicalSocketServer* socket_server,
+                  std::unique_ptr<Ring> ring,
+                  const Options& options);
+
+  // Queues the multishot receive of registration `id`.
+  bool SubmitReceive(uint64_t id, int fd, bool timestamps);
+  // Hands buffer `bid` to the kernel again with a fresh PacketBuffer.
+  void ProvideBuffer(uint16_t bid);
+  // Processes every pending completion.
+  void ReapCompletions();
+
+  rtc::PhysicalSocketServer* const socket_server_;
+  std::unique_ptr<Ring> ring_;
+  // Templates of the requests without and with receive timestamps; the
+  // kernel reserves `msg_namelen` bytes for the source address and
+  // `msg_controllen` for ancillary data in each buffer.
+  msghdr receive_header_ = {};
+  msghdr timestamp_header_ = {};
+  // The PacketBuffer the kernel may fill for each buffer id.
+  std::vector<rtc::scoped_refptr<PacketBuffer>> buffers_;
+
+  // By request id, which is the completion's user data. Ids are never
+  // reused, so the completions of a removed socket are recognised.
+  std::map<uint64_t, Registration> registrations_;
+  std::map<int, uint64_t> ids_by_fd_;
+  uint64_t next_id_ = 1;
+  std::vector<uint64_t> batch_ids_;
+  // Receive requests the kernel has not completed for good.
+  int active_requests_ = 0;
+
+  Stats stats_;
+};
+
+}  // namespace webrtc_examples
+
+#endif  // EXAMPLES_VOIPCLIENT_IO_URING_RECEIVER_H_
@@ -0,0 +1,311 @@
+/*
+ *  Copyright 2023 The WebRTC Project Authors. All rights reserved.
+ *
+ *  Use of this source code is governed by a BSD-style license
+ *  that can be found in the LICENSE file in the root of the source
+ *  tree. An additional intellectual property rights grant can be found
+ *  in the file PATENTS.  All contributing project authors may
+ *  be found in the AUTHORS file in the root of the source tree.
+ */
+
+// Measures one-way mouth-to-ear latency through two VoipClients connected
+// over loopback in one process. The sender's audio device captures short
+// tone bursts on a silent background and notes when each one entered the
+// engine; the receiver's device notes when each burst comes out of playout.
+// Both devices are paced by webrtc::TestAudioDeviceModule, as the file
+// device is, so the numbers include the full encode, packetize, network,
+// jitter buffer and decode path but no sound hardware.
+//
+// Each burst gives one sample, so the defaults (a burst every 200 ms for two
+// minutes) yield about 600 per codec. A percentile is only reported when at
+// least kMinTailSamples samples lie at or beyond it, so p99.9 needs about
+// 17 minutes per codec at that rate.
+
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <deque>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "absl/flags/flag.h"
+#include "absl/flags/parse.h"
+#include "absl/types/optional.h"
+#include "api/array_view.h"
+#include "examples/voipclient/audio_device_factory.h"
+#include "examples/voipclient/voip_client.h"
+#include "modules/audio_device/include/test_audio_device.h"
+#include "rtc_base/buffer.h"
+#include "rtc_base/checks.h"
+#include "rtc_base/synchronization/mutex.h"
+#include "rtc_base/thread_annotations.h"
+#include "rtc_base/time_utils.h"
+
+ABSL_FLAG(std::vector<std::string>,
+          codecs,
+          {},
+          "Comma separated codecs to measure; defaults to all supported.");
+ABSL_FLAG(int, duration_s, 120, "Seconds measured per codec.");
+ABSL_FLAG(int, warmup_s, 2, "Seconds ignored after a call starts.");
+ABSL_FLAG(int,
+          marker_interval_ms,
+          200,
+          "Time between tone bursts; must exceed the latency measured.");
+ABSL_FLAG(int, base_port, 42000, "First local UDP port used.");
+
+using webrtc::TestAudioDeviceModule;
+using webrtc_examples::AudioDeviceType;
+using webrtc_examples::SessionId;
+using webrtc_examples::VoipClient;
+
+namespace {
+
+constexpr char kLoopback[] = "127.0.0.1";
+constexpr int kSampleRateHz = 48000;
+constexpr int kToneFrequencyHz = 1000;
+constexpr int kToneAmplitude = 16000;
+constexpr int kToneFrames = 2;
+// Playout above this after at least kMinSilenceMs of quiet is a burst.
+constexpr int kDetectionThreshold = 4000;
+constexpr int kMinSilenceMs = 100;
+// Samples needed at or above a percentile for it to be reported.
+constexpr double kMinTailSamples = 5;
+
+// Codecs VoipClient assigns payload types to.
+const char* const kKnownCodecs[] = {"opus", "G722", "PCMU",
+                                    "PCMA", "ILBC", "ISAC"};
+
+// Pairs each burst heard on playout with the latest burst captured before
+// it. Bursts that are never heard are counted as lost.
+class MarkerLog {
+ public:
+  void OnCaptured(int64_t time_us) {
+    webrtc::MutexLock lock(&mutex_);
+    pending_us_.push_back(time_us);
+    ++captured_;
+  }
+
+  void OnPlayedOut(int64_t time_us) {
+    webrtc::MutexLock lock(&mutex_);
+    absl::optional<int64_t> captured_us;
+    while (!pending_us_.empty() && pending_us_.front() <= time_us) {
+      captured_us = pending_us_.front();
+      pending_us_.pop_front();
+    }
+    if (captured_us) {
+      latencies_us_.push_back(time_us - *captured_us);
+    }
+  }
+
+  // Forgets everything, e.g. after warmup.
+  void Reset() {
+    webrtc::MutexLock lock(&mutex_);
+    pending_us_.clear();
+    latencies_us_.clear();
+    captured_ = 0;
+  }
+
+  int captured() {
+    webrtc::MutexLock lock(&mutex_);
+    return captured_;
+  }
+
+  std::vector<int64_t> latencies_us() {
+    webrtc::MutexLock lock(&mutex_);
+    return latencies_us_;
+  }
+
+ private:
+  webrtc::Mutex mutex_;
+  std::deque<int64_t> pending_us_ RTC_GUARDED_BY(mutex_);
+  std::vector<int64_t> latencies_us_ RTC_GUARDED_BY(mutex_);
+  int captured_ RTC_GUARDED_BY(mutex_) = 0;
+};
+
+// Silence with a kToneFrames long tone burst every `interval_ms`.
+class MarkerCapturer : public TestAudioDeviceModule::Capturer {
+ public:
+  MarkerCapturer(MarkerLog* log, int interval_ms)
+      : log_(log),
+        frames_per_marker_(std::max(kToneFrames + 1, interval_ms / 10)) {}
+
+  int SamplingFrequency() const override { return kSampleRateHz; }
+  int NumChannels() const override { return 1; }
+  bool Capture(rtc::BufferT<int16_t>* buffer) override {
+    const size_t samples =
+        TestAudioDeviceModule::SamplesPerFrame(kSampleRateHz);
+    const int frame = frame_++ % frames_per_marker_;
+    if (frame == 0) {
+      log_->OnCaptured(rtc::TimeMicros());
+    }
+    buffer->SetData(samples, [&](rtc::ArrayView<int16_t> data) {
+      for (size_t i = 0; i < samples; ++i) {
+        data[i] = frame < kToneFrames ? Tone(frame * samples + i) : 0;
+      }
+      return samples;
+    });
+    return true;
+  }
+
+ private:
+  static int16_t Tone(size_t sample) {
+    return static_cast<int16_t>(
+        kToneAmplitude *
+        sin(2 * M_PI * kToneFrequencyHz * sample / kSampleRateHz));
+  }
+
+  MarkerLog* const log_;
+  const int frames_per_marker_;
+  int frame_ = 0;
+};
+
+// Reports the onset of each burst, to the sample.
+class MarkerDetector : public TestAudioDeviceModule::Renderer {
+ public:
+  explicit MarkerDetector(MarkerLog* log) : log_(log) {}
+
+  int SamplingFrequency() const override { return kSampleRateHz; }
+  int NumChannels() const override { return 1; }
+  bool Render(rtc::ArrayView<const int16_t> data) override {
+    const int64_t now_us = rtc::TimeMicros();
+    const int min_silence = kSampleRateHz * kMinSilenceMs / 1000;
+    for (size_t i = 0; i < data.size(); ++i) {
+      if (abs(data[i]) < kDetectionThreshold) {
+        ++quiet_samples_;
+        continue;
+      }
+      if (quiet_samples_ >= min_silence) {
+        log_->OnPlayedOut(now_us + static_cast<int64_t>(i) *
+                                       rtc::kNumMicrosecsPerSec /
+                                       kSampleRateHz);
+      }
+      quiet_samples_ = 0;
+    }
+    return true;
+  }
+
+ private:
+  MarkerLog* const log_;
+  int quiet_samples_ = 0;
+};
+
+// The percentile in ms, or "n/a" when too few samples lie beyond it to
+// tell it from the maximum.
+std::string FormatPercentile(const std::vector<int64_t>& sorted,
+                             double fraction) {
+  if (sorted.size() * (1 - fraction) < kMinTailSamples) {
+    return "n/a";
+  }
+  size_t index = static_cast<size_t>(fraction * (sorted.size() - 1));
+  char text[32];
+  snprintf(text, sizeof(text), "%.1fms", sorted[index] / 1000.0);
+  return text;
+}
+
+std::vector<std::string> CodecsToMeasure(VoipClient* client) {
+  std::vector<std::string> requested = absl::GetFlag(FLAGS_codecs);
+  std::vector<std::string> codecs;
+  for (const std::string& codec : client->GetSupportedCodecs()) {
+    if (std::find(codecs.begin(), codecs.end(), codec) != codecs.end() ||
+        std::find(std::begin(kKnownCodecs), std::end(kKnownCodecs), codec) ==
+            std::end(kKnownCodecs)) {
+      continue;
+    }
+    if (requested.empty() ||
+        std::find(requested.begin(), requested.end(), codec) !=
+            requested.end()) {
+      codecs.push_back(codec);
+    }
+  }
+  return codecs;
+}
+
+void Measure(VoipClient* sender,
+             VoipClient* receiver,
+             MarkerLog* log,
+             SessionId session,
+             const std::string& codec,
+             int sender_port) {
+  const int receiver_port = sender_port + 2;
+
+  receiver->SetLocalAddress(session, kLoopback, receiver_port);
+  receiver->SetRemoteAddress(session, kLoopback, sender_port);
+  receiver->StartSession(session);
+  receiver->SetEncoder(session, codec);
+  receiver->SetDecoders(session, {codec});
+  receiver->StartPlayout(session);
+
+  sender->SetLocalAddress(session, kLoopback, sender_port);
+  sender->SetRemoteAddress(session, kLoopback, receiver_port);
+  sender->StartSession(session);
+  sender->SetEncoder(session, codec);
+  sender->SetDecoders(session, {codec});
+  sender->StartSend(session);
+
+  sleep(absl::GetFlag(FLAGS_warmup_s));
+  log->Reset();
+  sleep(absl::GetFlag(FLAGS_duration_s));
+
+  std::vector<int64_t> latencies_us = log->latencies_us();
+  const int captured = log->captured();
+
+  sender->StopSend(session);
+  sender->StopSession(session);
+  receiver->StopPlayout(session);
+  receiver->StopSession(session);
+
+  std::sort(latencies_us.begin(), latencies_us.end());
+  printf("%-6s markers=%d samples=%zu p50=%s p99=%s p999=%s\n",
+         codec.c_str(), captured, latencies_us.size(),
+         FormatPercentile(latencies_us, 0.5).c_str(),
+         FormatPercentile(latencies_us, 0.99).c_str(),
+         FormatPercentile(latencies_us, 0.999).c_str());
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  absl::ParseCommandLine(argc, argv);
+
+  MarkerLog log;
+  const int interval_ms = absl::GetFlag(FLAGS_marker_interval_ms);
+  // Otherwise the detector never sees enough silence before a burst.
+  RTC_CHECK_GT(interval_ms, kMinSilenceMs + kToneFrames * 10);
+
+  VoipClient::Config sender_config;
+  sender_config.audio_device.type = AudioDeviceType::kCustom;
+  sender_config.audio_device.create_capturer = [&log, interval_ms] {
+    return std::make_unique<MarkerCapturer>(&log, interval_ms);
+  };
+  sender_config.audio_device.create_renderer = [] {
+    return TestAudioDeviceModule::CreateDiscardRenderer(kSampleRateHz);
+  };
+  std::unique_ptr<VoipClient> sender(VoipClient::Create(sender_config));
+  RTC_CHECK(sender);
+
+  VoipClient::Config receiver_config;
+  receiver_config.audio_device.type = AudioDeviceType::kCustom;
+  receiver_config.audio_device.create_capturer = [] {
+    return TestAudioDeviceModule::CreatePulsedNoiseCapturer(
+        /*max_amplitude=*/0, kSampleRateHz);
+  };
+  receiver_config.audio_device.create_renderer = [&log] {
+    return std::make_unique<MarkerDetector>(&log);
+  };
+  std::unique_ptr<VoipClient> receiver(VoipClient::Create(receiver_config));
+  RTC_CHECK(receiver);
+
+  // A fresh session and port pair per codec.
+  int port = absl::GetFlag(FLAGS_base_port);
+  SessionId session = 0;
+  for (const std::string& codec : CodecsToMeasure(sender.get())) {
+    Measure(sender.get(), receiver.get(), &log, session++, codec, port);
+    port += 4;
+  }
+  return 0;
+}
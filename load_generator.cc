@@ -0,0 +1,377 @@
+/*
+ *  Copyright 2023 The WebRTC Project Authors. All rights reserved.
+ *
+ *  Use of this source code is governed by a BSD-style license
+ *  that can be found in the LICENSE file in the root of the source
+ *  tree. An additional intellectual property rights grant can be found
+ *  in the file PATENTS.  All contributing project authors may
+ *  be found in the AUTHORS file in the root of the source tree.
+ */
+
+// Finds how many concurrent calls this machine sustains. Two VoipClients in
+// one process call each other over loopback, one session per call on each
+// side, both sending and playing out through the null (or file) audio
+// device. The number of calls is ramped in steps; each step is measured
+// once it has settled, and the ramp stops at the first step that exceeds
+// the CPU, late packet or loss threshold, or in which a call fails to
+// start.
+//
+// A packet is late when it ends a silence on its session's socket longer
+// than --late_gap_ms; with 20 ms packets the default flags packets delayed
+// by more than 20 ms. Loss compares the packets written by both clients
+// with the packets they read.
+//
+// The --emulated_* flags run every call over an impaired network (see
+// network_emulator.h) in both directions, to find the capacity under
+// jitter and loss. Emulated loss counts towards --max_loss_percent.
+
+#include <stdint.h>
+#include <sys/resource.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "absl/flags/flag.h"
+#include "absl/flags/parse.h"
+#include "absl/types/optional.h"
+#include "api/units/time_delta.h"
+#include "examples/voipclient/audio_device_factory.h"
+#include "examples/voipclient/media_shard.h"
+#include "examples/voipclient/network_emulator.h"
+#include "examples/voipclient/voip_client.h"
+#include "rtc_base/checks.h"
+#include "rtc_base/event.h"
+#include "rtc_base/synchronization/mutex.h"
+#include "rtc_base/thread_annotations.h"
+#include "rtc_base/time_utils.h"
+
+ABSL_FLAG(std::string, codec, "PCMU", "Codec used by every call.");
+ABSL_FLAG(int, initial_calls, 10, "Calls in the first step.");
+ABSL_FLAG(int, call_step, 10, "Calls added per step.");
+ABSL_FLAG(int, max_calls, 2000, "Stop ramping at this many calls.");
+ABSL_FLAG(int, settle_s, 1, "Seconds between adding calls and measuring.");
+ABSL_FLAG(int, step_duration_s, 5, "Seconds measured per step.");
+ABSL_FLAG(double,
+          max_cpu_percent,
+          80,
+          "Stop when the process uses more of all online CPUs than this.");
+ABSL_FLAG(double, max_late_percent, 1, "Stop above this late packet rate.");
+ABSL_FLAG(double, max_loss_percent, 1, "Stop above this packet loss rate.");
+ABSL_FLAG(int, late_gap_ms, 40, "Receive silence that marks a late packet.");
+ABSL_FLAG(int,
+          num_shards,
+          0,
+          "Media threads per client; zero means one per online CPU.");
+ABSL_FLAG(std::string,
+          capture_file,
+          "",
+          "WAV or raw PCM captured by every call; null device if empty.");
+ABSL_FLAG(int, base_port, 44000, "First local UDP port used.");
+ABSL_FLAG(bool, io_uring, false, "Read sockets through io_uring.");
+ABSL_FLAG(int, emulated_delay_ms, 0, "One-way delay added to each packet.");
+ABSL_FLAG(int,
+          emulated_jitter_ms,
+          0,
+          "Standard deviation of the normally distributed emulated delay.");
+ABSL_FLAG(double, emulated_loss_percent, 0, "Average emulated packet loss.");
+ABSL_FLAG(double,
+          emulated_burst_length,
+          1,
+          "Mean number of packets lost in a row; above 1 gives bursty loss.");
+ABSL_FLAG(double,
+          emulated_reorder_percent,
+          0,
+          "Packets that skip the delay and overtake earlier ones.");
+ABSL_FLAG(double, emulated_duplicate_percent, 0, "Packets sent twice.");
+ABSL_FLAG(int,
+          emulated_bandwidth_kbps,
+          0,
+          "Rate of the emulated link of each client; zero is unlimited.");
+
+using webrtc_examples::AudioDeviceType;
+using webrtc_examples::MediaShard;
+using webrtc_examples::NetworkEmulator;
+using webrtc_examples::SessionId;
+using webrtc_examples::VoipClient;
+
+namespace {
+
+constexpr char kLoopback[] = "127.0.0.1";
+// Completions StartCallLeg() waits for: session, send and playout.
+constexpr int kCompletionsPerLeg = 3;
+// How long the legs of a step may take to start.
+constexpr webrtc::TimeDelta kSetupTimeout = webrtc::TimeDelta::Seconds(10);
+
+// Collects the outcome of the call legs one client starts.
+class CallSetup : public VoipClient::Callback {
+ public:
+  explicit CallSetup(const char* side) : side_(side) {}
+
+  // Waits until `completions` start calls have completed in total.
+  bool Wait(int completions) {
+    {
+      webrtc::MutexLock lock(&mutex_);
+      target_ = completions;
+      if (completions_ >= target_) {
+        return true;
+      }
+    }
+    return done_.Wait(kSetupTimeout);
+  }
+
+  // The failures reported since the last call, one line each.
+  std::vector<std::string> TakeFailures() {
+    webrtc::MutexLock lock(&mutex_);
+    std::vector<std::string> failures;
+    failures.swap(failures_);
+    return failures;
+  }
+
+  void OnStartSessionCompleted(SessionId session, bool success) override {
+    Complete("StartSession", session, success);
+  }
+  void OnStartSendCompleted(SessionId session, bool success) override {
+    Complete("StartSend", session, success);
+  }
+  void OnStartPlayoutCompleted(SessionId session, bool success) override {
+    Complete("StartPlayout", session, success);
+  }
+  void OnStopSessionCompleted(SessionId session, bool success) override {}
+  void OnStopSendCompleted(SessionId session, bool success) override {}
+  void OnStopPlayoutCompleted(SessionId session, bool success) override {}
+
+ private:
+  void Complete(const char* call, SessionId session, bool success) {
+    webrtc::MutexLock lock(&mutex_);
+    if (!success) {
+      failures_.push_back(std::string(side_) + " call " +
+                          std::to_string(session) + ": " + call + " failed");
+    }
+    if (++completions_ == target_) {
+      done_.Set();
+    }
+  }
+
+  const char* const side_;
+  rtc::Event done_;
+  webrtc::Mutex mutex_;
+  int completions_ RTC_GUARDED_BY(mutex_) = 0;
+  int target_ RTC_GUARDED_BY(mutex_) = 0;
+  std::vector<std::string> failures_ RTC_GUARDED_BY(mutex_);
+};
+
+// Process-wide counters a step is measured from.
+struct Snapshot {
+  int64_t wall_us = 0;
+  int64_t cpu_us = 0;
+  uint64_t packets_sent = 0;
+  uint64_t packets_received = 0;
+  uint64_t late_packets = 0;
+};
+
+int64_t CpuTimeUs() {
+  rusage usage;
+  RTC_CHECK_EQ(getrusage(RUSAGE_SELF, &usage), 0);
+  return (usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) *
+             rtc::kNumMicrosecsPerSec +
+         usage.ru_utime.tv_usec + usage.ru_stime.tv_usec;
+}
+
+int64_t ResidentBytes() {
+  FILE* statm = fopen("/proc/self/statm", "r");
+  if (!statm) {
+    return 0;
+  }
+  long size_pages = 0;
+  long resident_pages = 0;
+  int fields = fscanf(statm, "%ld %ld", &size_pages, &resident_pages);
+  fclose(statm);
+  return fields == 2 ? resident_pages * sysconf(_SC_PAGESIZE) : 0;
+}
+
+Snapshot TakeSnapshot(VoipClient* caller, VoipClient* callee) {
+  Snapshot snapshot;
+  snapshot.wall_us = rtc::TimeMicros();
+  snapshot.cpu_us = CpuTimeUs();
+  for (VoipClient* client : {caller, callee}) {
+    snapshot.packets_sent += client->GetSendStats().packets_sent;
+    for (const MediaShard::Load& load : client->GetShardLoads()) {
+      snapshot.packets_received += load.packets_received;
+      snapshot.late_packets += load.late_packets;
+    }
+  }
+  return snapshot;
+}
+
+// Options for the emulator of each client, or none if no --emulated_* flag
+// impairs the network.
+absl::optional<NetworkEmulator::Options> GetNetworkEmulation() {
+  NetworkEmulator::Options options;
+  options.delay =
+      webrtc::TimeDelta::Millis(absl::GetFlag(FLAGS_emulated_delay_ms));
+  options.jitter =
+      webrtc::TimeDelta::Millis(absl::GetFlag(FLAGS_emulated_jitter_ms));
+  options.reorder_probability =
+      absl::GetFlag(FLAGS_emulated_reorder_percent) / 100;
+  options.duplicate_probability =
+      absl::GetFlag(FLAGS_emulated_duplicate_percent) / 100;
+  options.bandwidth_kbps = absl::GetFlag(FLAGS_emulated_bandwidth_kbps);
+
+  // Gilbert-Elliott with a lossless good state and a bad state that loses
+  // everything: the mean burst is 1 / bad_to_good, and the stationary loss
+  // good_to_bad / (good_to_bad + bad_to_good).
+  const double loss = absl::GetFlag(FLAGS_emulated_loss_percent) / 100;
+  const double burst_length =
+      std::max(1.0, absl::GetFlag(FLAGS_emulated_burst_length));
+  RTC_CHECK_GE(loss, 0);
+  RTC_CHECK_LT(loss, 1);
+  options.bad_to_good = 1 / burst_length;
+  options.good_to_bad = loss * options.bad_to_good / (1 - loss);
+
+  if (options.delay.IsZero() && options.jitter.IsZero() && loss == 0 &&
+      options.reorder_probability == 0 && options.duplicate_probability == 0 &&
+      options.bandwidth_kbps == 0) {
+    return absl::nullopt;
+  }
+  return options;
+}
+
+std::unique_ptr<VoipClient> CreateClient(
+    std::shared_ptr<CallSetup> call_setup) {
+  VoipClient::Config config;
+  config.callback = call_setup;
+  config.num_shards = absl::GetFlag(FLAGS_num_shards);
+  config.use_io_uring = absl::GetFlag(FLAGS_io_uring);
+  config.late_arrival_gap =
+      webrtc::TimeDelta::Millis(absl::GetFlag(FLAGS_late_gap_ms));
+  const std::string capture_file = absl::GetFlag(FLAGS_capture_file);
+  if (capture_file.empty()) {
+    config.audio_device.type = AudioDeviceType::kNull;
+  } else {
+    config.audio_device.type = AudioDeviceType::kFile;
+    config.audio_device.capture_file = capture_file;
+  }
+  config.network_emulation = GetNetworkEmulation();
+  std::unique_ptr<VoipClient> client(VoipClient::Create(config));
+  RTC_CHECK(client);
+  return client;
+}
+
+// Completes kCompletionsPerLeg calls on the client's CallSetup. The local
+// address is only bound by StartSession(), which reports its failure.
+void StartCallLeg(VoipClient* client,
+                  SessionId session,
+                  int local_port,
+                  int remote_port) {
+  const std::string codec = absl::GetFlag(FLAGS_codec);
+  client->SetLocalAddress(session, kLoopback, local_port);
+  client->SetRemoteAddress(session, kLoopback, remote_port);
+  client->StartSession(session);
+  client->SetEncoder(session, codec);
+  client->SetDecoders(session, {codec});
+  client->StartSend(session);
+  client->StartPlayout(session);
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  absl::ParseCommandLine(argc, argv);
+  RTC_CHECK_GT(absl::GetFlag(FLAGS_initial_calls), 0);
+  RTC_CHECK_GT(absl::GetFlag(FLAGS_call_step), 0);
+
+  const int num_cpus =
+      std::max(1, static_cast<int>(sysconf(_SC_NPROCESSORS_ONLN)));
+  auto caller_setup = std::make_shared<CallSetup>("caller");
+  auto callee_setup = std::make_shared<CallSetup>("callee");
+  std::unique_ptr<VoipClient> caller = CreateClient(caller_setup);
+  std::unique_ptr<VoipClient> callee = CreateClient(callee_setup);
+  const int64_t idle_rss = ResidentBytes();
+
+  printf("%6s %6s %6s %10s %12s %7s %7s\n", "calls", "cores", "cpu%",
+         "calls/core", "rss/call_kb", "loss%", "late%");
+
+  const int base_port = absl::GetFlag(FLAGS_base_port);
+  const int max_calls = absl::GetFlag(FLAGS_max_calls);
+  int calls = 0;
+  int sustained_calls = 0;
+  const char* limit = "max_calls";
+  bool setup_failed = false;
+  int target = absl::GetFlag(FLAGS_initial_calls);
+  while (true) {
+    for (target = std::min(target, max_calls); calls < target; ++calls) {
+      const int caller_port = base_port + 4 * calls;
+      StartCallLeg(caller.get(), calls, caller_port, caller_port + 2);
+      StartCallLeg(callee.get(), calls, caller_port + 2, caller_port);
+    }
+    // A call that did not start would count as capacity it does not use.
+    const int completions = kCompletionsPerLeg * calls;
+    if (!caller_setup->Wait(completions) || !callee_setup->Wait(completions)) {
+      fprintf(stderr, "Calls did not finish starting within %lld s\n",
+              static_cast<long long>(kSetupTimeout.seconds()));
+      limit = "call setup";
+      setup_failed = true;
+      break;
+    }
+    std::vector<std::string> failures = caller_setup->TakeFailures();
+    for (std::string& failure : callee_setup->TakeFailures()) {
+      failures.push_back(std::move(failure));
+    }
+    if (!failures.empty()) {
+      for (const std::string& failure : failures) {
+        fprintf(stderr, "%s\n", failure.c_str());
+      }
+      limit = "call setup";
+      setup_failed = true;
+      break;
+    }
+    sleep(absl::GetFlag(FLAGS_settle_s));
+
+    Snapshot before = TakeSnapshot(caller.get(), callee.get());
+    sleep(absl::GetFlag(FLAGS_step_duration_s));
+    Snapshot after = TakeSnapshot(caller.get(), callee.get());
+
+    const double cores = static_cast<double>(after.cpu_us - before.cpu_us) /
+                         (after.wall_us - before.wall_us);
+    const double cpu_percent = 100 * cores / num_cpus;
+    const uint64_t sent = after.packets_sent - before.packets_sent;
+    const uint64_t received = after.packets_received - before.packets_received;
+    const uint64_t late = after.late_packets - before.late_packets;
+    const double loss_percent =
+        sent > received ? 100.0 * (sent - received) / sent : 0;
+    const double late_percent = received > 0 ? 100.0 * late / received : 0;
+    const double rss_per_call_kb =
+        static_cast<double>(ResidentBytes() - idle_rss) / calls / 1024;
+
+    printf("%6d %6.2f %6.1f %10.1f %12.1f %7.2f %7.2f\n", calls, cores,
+           cpu_percent, cores > 0 ? calls / cores : 0, rss_per_call_kb,
+           loss_percent, late_percent);
+    fflush(stdout);
+
+    if (cpu_percent > absl::GetFlag(FLAGS_max_cpu_percent)) {
+      limit = "cpu";
+      break;
+    }
+    if (late_percent > absl::GetFlag(FLAGS_max_late_percent)) {
+      limit = "late packets";
+      break;
+    }
+    if (loss_percent > absl::GetFlag(FLAGS_max_loss_percent)) {
+      limit = "packet loss";
+      break;
+    }
+    sustained_calls = calls;
+    if (calls >= max_calls) {
+      break;
+    }
+    target += absl::GetFlag(FLAGS_call_step);
+  }
+
+  printf("Sustained %d calls on %d CPUs, limited by %s\n", sustained_calls,
+         num_cpus, limit);
+  return setup_failed ? 1 : 0;
+}
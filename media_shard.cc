@@ -0,0 +1,522 @@
+/*
+ *  Copyright 2023 The WebRTC Project Authors. All rights reserved.
+ *
+ *  Use of this source code is governed by a BSD-style license
+ *  that can be found in the LICENSE file in the root of the source
+ *  tree. An additional intellectual property rights grant can be found
+ *  in the file PATENTS.  All contributing project authors may
+ *  be found in the AUTHORS file in the root of the source tree.
+ */
+
+#include "examples/voipclient/media_shard.h"
+
+#include <pthread.h>
+#include <sched.h>
+
+#include <algorithm>
+#include <utility>
+
+#include "absl/memory/memory.h"
+#include "api/units/time_delta.h"
+#include "examples/voipclient/instrumentation.h"
+#include "examples/voipclient/rtp_utils.h"
+#include "rtc_base/checks.h"
+#include "rtc_base/logging.h"
+
+namespace webrtc_examples {
+
+std::unique_ptr<MediaShard> MediaShard::Create(int index,
+                                               const Options& options) {
+  auto socket_server = std::make_unique<rtc::PhysicalSocketServer>();
+  rtc::PhysicalSocketServer* socket_server_ptr = socket_server.get();
+  auto thread = std::make_unique<MonitoredThread>(std::move(socket_server),
+                                                 options.thread_monitor);
+  thread->SetName("media_shard_" + std::to_string(index), nullptr);
+  if (!thread->Start()) {
+    RTC_LOG(LS_ERROR) << "Failed to start media shard " << index;
+    return nullptr;
+  }
+
+  if (options.cpu >= 0) {
+    const int cpu = options.cpu;
+    thread->BlockingCall([cpu] {
+      cpu_set_t cpus;
+      CPU_ZERO(&cpus);
+      CPU_SET(cpu, &cpus);
+      int error = pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+      if (error != 0) {
+        RTC_LOG(LS_WARNING) << "Failed to pin media shard to CPU " << cpu
+                            << ": " << error;
+      }
+    });
+  }
+
+  std::unique_ptr<IoUringReceiver> io_uring_receiver;
+  if (options.use_io_uring) {
+    io_uring_receiver = thread->BlockingCall([socket_server_ptr] {
+      return IoUringReceiver::Create(socket_server_ptr,
+                                     IoUringReceiver::Options());
+    });
+    if (!io_uring_receiver) {
+      RTC_LOG(LS_WARNING) << "Media shard " << index
+                          << " reads its sockets without io_uring";
+    }
+  }
+
+  Options shard_options = options;
+  std::unique_ptr<NetworkEmulator> network_emulator;
+  if (options.network_emulation) {
+    NetworkEmulator::Options emulation = *options.network_emulation;
+    emulation.seed += static_cast<uint32_t>(index);
+    network_emulator =
+        std::make_unique<NetworkEmulator>(emulation, thread.get());
+    shard_options.session.socket.socket_calls = network_emulator.get();
+  }
+
+  // Using `new` to access a non-public constructor.
+  return absl::WrapUnique(new MediaShard(
+      index, shard_options, std::move(network_emulator), std::move(thread),
+      socket_server_ptr, std::move(io_uring_receiver)));
+}
+
+MediaShard::MediaShard(int index,
+                       const Options& options,
+                       std::unique_ptr<NetworkEmulator> network_emulator,
+                       std::unique_ptr<MonitoredThread> thread,
+                       rtc::PhysicalSocketServer* socket_server,
+                       std::unique_ptr<IoUringReceiver> io_uring_receiver)
+    : index_(index),
+      options_(options),
+      network_emulator_(std::move(network_emulator)),
+      thread_(std::move(thread)),
+      socket_server_(socket_server),
+      io_uring_receiver_(std::move(io_uring_receiver)) {}
+
+MediaShard::~MediaShard() {
+  Shutdown();
+  thread_->Stop();
+}
+
+bool MediaShard::Start(webrtc::VoipEngine* voip_engine) {
+  return thread_->BlockingCall([this, voip_engine] {
+    RTC_DCHECK_RUN_ON(thread_.get());
+    RTC_DCHECK(!voip_engine_);
+    voip_engine_ = voip_engine;
+    if (options_.shared_local_address && !OpenSharedSockets()) {
+      return false;
+    }
+    PublishSessionSnapshots();
+    return true;
+  });
+}
+
+void MediaShard::Shutdown() {
+  // Sessions close their sockets and release their channels on the thread
+  // they live on.
+  thread_->BlockingCall([this] {
+    RTC_DCHECK_RUN_ON(thread_.get());
+    sessions_.clear();
+    shared_rtp_socket_.reset();
+    shared_rtcp_socket_.reset();
+    io_uring_receiver_.reset();
+  });
+  webrtc::MutexLock lock(&snapshot_mutex_);
+  snapshots_.clear();
+}
+
+void MediaShard::PublishSessionSnapshots() {
+  RTC_DCHECK_RUN_ON(thread_.get());
+
+  std::map<SessionId, SessionSnapshot> snapshots;
+  for (const auto& entry : sessions_) {
+    if (entry.second->channel()) {
+      snapshots.emplace(entry.first, TakeSnapshot(*entry.second));
+    }
+  }
+  {
+    webrtc::MutexLock lock(&snapshot_mutex_);
+    snapshots_.swap(snapshots);
+  }
+  thread_->PostDelayedTask([this] { PublishSessionSnapshots(); },
+                           options_.stats_interval);
+}
+
+MediaShard::SessionSnapshot MediaShard::TakeSnapshot(
+    const VoipSession& session) {
+  SessionSnapshot snapshot;
+  snapshot.channel = *session.channel();
+  snapshot.send = session.GetSendStats();
+  snapshot.receive = session.GetReceiveStats();
+  snapshot.receive_delay = session.GetReceiveDelayStats();
+  snapshot.send_queue_depth = session.GetPendingSendCount();
+  return snapshot;
+}
+
+bool MediaShard::OpenSharedSockets() {
+  const rtc::SocketAddress& rtp_address = *options_.shared_local_address;
+  rtc::SocketAddress rtcp_address(rtp_address.ipaddr(),
+                                  rtp_address.port() + 1);
+  const bool rtcp_mux = options_.session.rtcp_mux;
+  // Arrival gaps of interleaved streams say nothing about any one of them.
+  MediaSocket::Options socket_options = options_.session.socket;
+  socket_options.late_arrival_gap = webrtc::TimeDelta::Zero();
+  socket_options.io_uring_receiver = io_uring_receiver_.get();
+  SharedPortGroup* group = options_.shared_port_group;
+  RTC_DCHECK(group);
+  RTC_DCHECK_LT(index_, group->size());
+  socket_options.reuse_port = group->size() > 1;
+
+  shared_rtp_socket_ = MediaSocket::Create(thread_.get(), socket_server_,
+                                           rtp_address, socket_options);
+  if (!rtcp_mux) {
+    MediaSocket::Options rtcp_options = socket_options;
+    rtcp_options.receive_timestamps = false;
+    shared_rtcp_socket_ = MediaSocket::Create(thread_.get(), socket_server_,
+                                              rtcp_address, rtcp_options);
+  }
+  if (!shared_rtp_socket_ || (!rtcp_mux && !shared_rtcp_socket_)) {
+    RTC_LOG(LS_ERROR) << "Shared socket creation failed";
+    shared_rtp_socket_.reset();
+    shared_rtcp_socket_.reset();
+    return false;
+  }
+  // The program belongs to the port's SO_REUSEPORT group, which the first
+  // shard has created by binding.
+  if (index_ == 0 && socket_options.reuse_port &&
+      group->steering() == SharedPortGroup::Steering::kSsrc) {
+    for (MediaSocket* socket :
+         {shared_rtp_socket_.get(), shared_rtcp_socket_.get()}) {
+      if (socket && !group->AttachSsrcSteering(socket->GetDescriptor())) {
+        RTC_LOG(LS_WARNING) << "Shared port packets are steered by address";
+      }
+    }
+  }
+  shared_rtp_socket_->SetReceiveCallback(
+      [this](rtc::ArrayView<const MediaSocket::ReceivedPacket> packets) {
+        RouteSharedPackets(/*rtcp_socket=*/false, packets);
+      });
+  if (shared_rtcp_socket_) {
+    shared_rtcp_socket_->SetReceiveCallback(
+        [this](rtc::ArrayView<const MediaSocket::ReceivedPacket> packets) {
+          RouteSharedPackets(/*rtcp_socket=*/true, packets);
+        });
+  }
+  return true;
+}
+
+VoipSession* MediaShard::FindSession(SessionId session) {
+  RTC_DCHECK_RUN_ON(thread_.get());
+
+  auto it = sessions_.find(session);
+  if (it == sessions_.end()) {
+    RTC_LOG(LS_ERROR) << "Session " << session << " does not exist";
+    return nullptr;
+  }
+  return it->second.get();
+}
+
+VoipSession* MediaShard::GetOrCreateSession(SessionId session) {
+  RTC_DCHECK_RUN_ON(thread_.get());
+
+  std::unique_ptr<VoipSession>& entry = sessions_[session];
+  if (!entry) {
+    VoipSession::Options options = options_.session;
+    options.socket.io_uring_receiver = io_uring_receiver_.get();
+    options.shared_rtp_socket = shared_rtp_socket_.get();
+    options.shared_rtcp_socket = options.rtcp_mux ? shared_rtp_socket_.get()
+                                                  : shared_rtcp_socket_.get();
+    entry = std::make_unique<VoipSession>(session, thread_.get(),
+                                          socket_server_, voip_engine_,
+                                          options);
+  }
+  return entry.get();
+}
+
+void MediaShard::SetRemoteAddress(SessionId session,
+                                  const std::string& ip_address,
+                                  int port_number) {
+  RTC_DCHECK_RUN_ON(thread_.get());
+
+  VoipSession* voip_session = GetOrCreateSession(session);
+  voip_session->SetRemoteAddress(ip_address, port_number);
+  UpdateSharedRoutes(voip_session);
+}
+
+void MediaShard::SetRemoteSsrc(SessionId session, uint32_t ssrc) {
+  RTC_DCHECK_RUN_ON(thread_.get());
+
+  VoipSession* voip_session = GetOrCreateSession(session);
+  voip_session->SetRemoteSsrc(ssrc);
+  UpdateSharedRoutes(voip_session);
+}
+
+void MediaShard::UpdateSharedRoutes(VoipSession* session) {
+  RTC_DCHECK_RUN_ON(thread_.get());
+
+  if (!options_.shared_local_address ||
+      session->rtp_remote_address().IsNil()) {
+    return;
+  }
+  if (!options_.shared_port_group->SetRoutes(
+          session->id(), this, session->rtp_remote_address(),
+          session->rtcp_remote_address(), session->remote_ssrc())) {
+    RTC_LOG(LS_ERROR) << "Session " << session->id()
+                      << " receives nothing on the shared port";
+  }
+}
+
+bool MediaShard::StartSession(SessionId session) {
+  RTC_DCHECK_RUN_ON(thread_.get());
+
+  VoipSession* voip_session = GetOrCreateSession(session);
+  if (!voip_session->Start()) {
+    ForgetSessionRoutes(session);
+    sessions_.erase(session);
+    return false;
+  }
+  // Visible to GetSessionSnapshot() right away rather than on the next
+  // publication.
+  SessionSnapshot snapshot = TakeSnapshot(*voip_session);
+  webrtc::MutexLock lock(&snapshot_mutex_);
+  snapshots_[session] = snapshot;
+  return true;
+}
+
+bool MediaShard::StopSession(SessionId session) {
+  RTC_DCHECK_RUN_ON(thread_.get());
+
+  VoipSession* voip_session = FindSession(session);
+  if (!voip_session || !voip_session->Stop()) {
+    return false;
+  }
+  ForgetSessionRoutes(session);
+  sessions_.erase(session);
+  webrtc::MutexLock lock(&snapshot_mutex_);
+  snapshots_.erase(session);
+  return true;
+}
+
+size_t MediaShard::session_count() const {
+  RTC_DCHECK_RUN_ON(thread_.get());
+  return sessions_.size();
+}
+
+MediaSocket::SendStats MediaShard::GetSendStats() const {
+  RTC_DCHECK_RUN_ON(thread_.get());
+
+  MediaSocket::SendStats total;
+  for (const auto& entry : sessions_) {
+    total.Accumulate(entry.second->GetSendStats());
+  }
+  for (const MediaSocket* socket :
+       {shared_rtp_socket_.get(), shared_rtcp_socket_.get()}) {
+    if (socket) {
+      total.Accumulate(socket->GetSendStats());
+    }
+  }
+  return total;
+}
+
+MediaShard::Load MediaShard::GetLoad() {
+  // Read before queueing the call below, which would count itself.
+  const MonitoredThread::Stats queue = thread_->GetStats();
+  Load load = thread_->BlockingCall([this] {
+    RTC_DCHECK_RUN_ON(thread_.get());
+
+    MediaSocket::ReceiveStats received;
+    for (const auto& entry : sessions_) {
+      received.Accumulate(entry.second->GetReceiveStats());
+    }
+    for (const MediaSocket* socket :
+         {shared_rtp_socket_.get(), shared_rtcp_socket_.get()}) {
+      if (socket) {
+        received.Accumulate(socket->GetReceiveStats());
+      }
+    }
+    MediaSocket::SendStats sent = GetSendStats();
+
+    Load load;
+    load.sessions = sessions_.size();
+    load.receive_calls = received.receive_calls;
+    load.packets_received = received.packets_received;
+    load.late_packets = received.late_packets;
+    load.send_calls = sent.send_calls;
+    load.packets_sent = sent.packets_sent;
+    load.forwarded_packets = forwarded_packets_;
+    return load;
+  });
+  load.queue_depth = queue.queue_depth;
+  load.max_queue_depth = queue.max_queue_depth;
+  load.max_queue_delay = queue.max_queue_delay;
+  load.slow_tasks = queue.slow_tasks;
+  load.backlog_events = queue.backlog_events;
+  return load;
+}
+
+std::vector<MonitoredThread::SlowTask> MediaShard::GetSlowTasks() const {
+  return thread_->GetSlowTasks();
+}
+
+absl::optional<MediaShard::SessionSnapshot> MediaShard::GetSessionSnapshot(
+    SessionId session) const {
+  webrtc::MutexLock lock(&snapshot_mutex_);
+  auto it = snapshots_.find(session);
+  if (it == snapshots_.end()) {
+    return absl::nullopt;
+  }
+  return it->second;
+}
+
+std::map<SessionId, MediaShard::SessionSnapshot>
+MediaShard::GetSessionSnapshots() const {
+  webrtc::MutexLock lock(&snapshot_mutex_);
+  return snapshots_;
+}
+
+absl::optional<NetworkEmulator::Stats> MediaShard::GetNetworkEmulatorStats()
+    const {
+  if (!network_emulator_) {
+    return absl::nullopt;
+  }
+  return network_emulator_->GetStats();
+}
+
+void MediaShard::RouteSharedPackets(
+    bool rtcp_socket,
+    rtc::ArrayView<const MediaSocket::ReceivedPacket> packets) {
+  RTC_DCHECK_RUN_ON(thread_.get());
+
+  SharedPortGroup* group = options_.shared_port_group;
+  const uint64_t removal_generation = group->removal_generation();
+  if (removal_generation != removal_generation_) {
+    removal_generation_ = removal_generation;
+    for (SessionId session : group->TakeRemovedSessions(index_)) {
+      ForgetStream(session);
+      foreign_sessions_.erase(session);
+    }
+  }
+
+  // By destination shard; there are few.
+  std::vector<std::pair<MediaShard*, std::vector<ForwardedPacket>>> forwards;
+  for (const MediaSocket::ReceivedPacket& packet : packets) {
+    const PacketBuffer& buffer = *packet.buffer;
+    const bool rtcp = rtcp_socket || (options_.session.rtcp_mux &&
+                                      IsRtcpPacket(buffer.data(),
+                                                   buffer.size()));
+    uint32_t ssrc;
+    bool parsed =
+        rtcp ? ParseRtcpSenderSsrc(buffer.data(), buffer.size(), &ssrc)
+             : ParseRtpSsrc(buffer.data(), buffer.size(), &ssrc);
+    if (!parsed) {
+      continue;
+    }
+
+    SessionId session;
+    if (!demuxer_.Lookup(ssrc, packet.source, &session)) {
+      MediaShard* owner;
+      if (!group->Lookup(ssrc, packet.source, &session, &owner)) {
+        RTC_LOG(LS_VERBOSE) << "Dropping packet of unknown stream " << ssrc
+                            << " from " << packet.source.ToString();
+        continue;
+      }
+      LearnStream(session, ssrc, packet.source);
+      if (owner != this) {
+        foreign_sessions_[session] = owner;
+      }
+    }
+
+    auto it = sessions_.find(session);
+    if (it != sessions_.end()) {
+      if (rtcp) {
+        it->second->ReadRTCPPacket(packet);
+      } else {
+        it->second->ReadRTPPacket(packet);
+      }
+      continue;
+    }
+    auto foreign = foreign_sessions_.find(session);
+    if (foreign == foreign_sessions_.end()) {
+      continue;
+    }
+    auto forward = std::find_if(
+        forwards.begin(), forwards.end(),
+        [&](const auto& entry) { return entry.first == foreign->second; });
+    if (forward == forwards.end()) {
+      forward = forwards.emplace(forwards.end(), foreign->second,
+                                 std::vector<ForwardedPacket>());
+    }
+    forward->second.push_back({session, rtcp, packet});
+    ++forwarded_packets_;
+  }
+
+  for (auto& forward : forwards) {
+    MediaShard* owner = forward.first;
+    owner->thread()->PostTask(
+        [owner, packets = std::move(forward.second), queued = Stopwatch()] {
+          queued.Record(Histogram::kReceiveQueueWait);
+          owner->DeliverForwardedPackets(packets);
+        });
+  }
+}
+
+void MediaShard::DeliverForwardedPackets(
+    const std::vector<ForwardedPacket>& packets) {
+  RTC_DCHECK_RUN_ON(thread_.get());
+
+  for (const ForwardedPacket& packet : packets) {
+    auto it = sessions_.find(packet.session);
+    if (it == sessions_.end()) {
+      continue;
+    }
+    if (packet.rtcp) {
+      it->second->ReadRTCPPacket(packet.packet);
+    } else {
+      it->second->ReadRTPPacket(packet.packet);
+    }
+  }
+}
+
+void MediaShard::LearnStream(SessionId session,
+                             uint32_t ssrc,
+                             const rtc::SocketAddress& source) {
+  RTC_DCHECK_RUN_ON(thread_.get());
+
+  // Bounds the table by the sessions, whatever SSRCs arrive from their
+  // addresses.
+  LearnedStream& stream = learned_streams_[session];
+  if (stream.ssrc != ssrc) {
+    for (const rtc::SocketAddress& old_source : stream.sources) {
+      demuxer_.Erase(stream.ssrc, old_source);
+    }
+    stream.ssrc = ssrc;
+    stream.sources.clear();
+  }
+  stream.sources.push_back(source);
+  demuxer_.Insert(ssrc, source, session);
+}
+
+void MediaShard::ForgetStream(SessionId session) {
+  RTC_DCHECK_RUN_ON(thread_.get());
+
+  auto it = learned_streams_.find(session);
+  if (it == learned_streams_.end()) {
+    return;
+  }
+  for (const rtc::SocketAddress& source : it->second.sources) {
+    demuxer_.Erase(it->second.ssrc, source);
+  }
+  learned_streams_.erase(it);
+}
+
+void MediaShard::ForgetSessionRoutes(SessionId session) {
+  RTC_DCHECK_RUN_ON(thread_.get());
+
+  if (!options_.shared_local_address) {
+    return;
+  }
+  // Every shard, this one included, drops the learned streams of the
+  // session on its next batch.
+  options_.shared_port_group->RemoveSession(session);
+}
+
+}  // namespace webrtc_examples
@@ -0,0 +1,246 @@
+/*
+ *  Copyright 2023 The WebRTC Project Authors. All rights reserved.
+ *
+ *  Use of this source code is governed by a BSD-style license
+ *  that can be found in the LICENSE file in the root of the source
+ *  tree. An additional intellectual property rights grant can be found
+ *  in the file PATENTS.  All contributing project authors may
+ *  be found in the AUTHORS file in the root of the source tree.
+ */
+
+#ifndef EXAMPLES_VOIPCLIENT_MEDIA_SHARD_H_
+#define EXAMPLES_VOIPCLIENT_MEDIA_SHARD_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <map>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "absl/types/optional.h"
+#include "api/array_view.h"
+#include "api/units/time_delta.h"
+#include "api/voip/voip_engine.h"
+#include "examples/voipclient/io_uring_receiver.h"
+#include "examples/voipclient/media_socket.h"
+#include "examples/voipclient/monitored_thread.h"
+#include "examples/voipclient/network_emulator.h"
+#include "examples/voipclient/shared_port_group.h"
+#include "examples/voipclient/ssrc_demuxer.h"
+#include "examples/voipclient/voip_session.h"
+#include "rtc_base/physical_socket_server.h"
+#include "rtc_base/socket_address.h"
+#include "rtc_base/synchronization/mutex.h"
+#include "rtc_base/thread.h"
+
+namespace webrtc_examples {
+
+// One network/media thread and the slice of sessions assigned to it. The
+// shard owns its rtc::PhysicalSocketServer, so the sockets of its sessions
+// are polled, read and written on its thread only, and the control calls,
+// receive processing and batched sends of one shard never wait on another.
+//
+// Apart from Create(), Start(), Shutdown(), the destructor and the methods
+// documented as safe, all methods run on thread().
+class MediaShard {
+ public:
+  struct Options {
+    VoipSession::Options session;
+    // Sessions of this shard share one port pair bound to this address
+    // instead of opening their own; see VoipClient::Config.
+    absl::optional<rtc::SocketAddress> shared_local_address;
+    // Not owned; required with `shared_local_address`. The shards serving
+    // the shared port, of which this is the index()-th.
+    SharedPortGroup* shared_port_group = nullptr;
+    // CPU the thread is pinned to; negative leaves it to the scheduler.
+    int cpu = -1;
+    // Queue delay, depth and slow task tracking of the thread.
+    MonitoredThread::Options thread_monitor;
+    // Read the shard's sockets through one IoUringReceiver, if the kernel
+    // and build support it, instead of a readiness event per socket.
+    bool use_io_uring = false;
+    // Period of the copy of the sessions' transport counters read by
+    // GetSessionSnapshot().
+    webrtc::TimeDelta stats_interval = webrtc::TimeDelta::Millis(100);
+    // When set, the shard's sockets write through a NetworkEmulator of its
+    // own, seeded with `seed` plus index(), in place of
+    // `session.socket.socket_calls`.
+    absl::optional<NetworkEmulator::Options> network_emulation;
+  };
+
+  // Counters for spotting imbalance between shards; read with GetLoad().
+  struct Load {
+    size_t sessions = 0;
+    uint64_t receive_calls = 0;
+    uint64_t packets_received = 0;
+    uint64_t late_packets = 0;
+    uint64_t send_calls = 0;
+    uint64_t packets_sent = 0;
+    // Packets read from the shared port and handed to the shard of their
+    // session.
+    uint64_t forwarded_packets = 0;
+    // Task queue of the thread; zero unless Options::thread_monitor is
+    // enabled.
+    size_t queue_depth = 0;
+    size_t max_queue_depth = 0;
+    webrtc::TimeDelta max_queue_delay = webrtc::TimeDelta::Zero();
+    uint64_t slow_tasks = 0;
+    uint64_t backlog_events = 0;
+  };
+
+  // A started session's channel and the counters of its own sockets, which
+  // stay zero with shared ones: those are accounted for in Load.
+  struct SessionSnapshot {
+    webrtc::ChannelId channel;
+    MediaSocket::SendStats send;
+    MediaSocket::ReceiveStats receive;
+    VoipSession::ReceiveDelayStats receive_delay;
+    size_t send_queue_depth = 0;
+  };
+
+  // Starts the thread. Returns null on failure.
+  static std::unique_ptr<MediaShard> Create(int index, const Options& options);
+
+  // Shuts down, then stops the thread.
+  ~MediaShard();
+
+  MediaShard(const MediaShard&) = delete;
+  MediaShard& operator=(const MediaShard&) = delete;
+
+  int index() const { return index_; }
+  rtc::Thread* thread() { return thread_.get(); }
+
+  // Hands the shard the engine its sessions create channels on, opens the
+  // shared sockets, if any, and starts publishing session snapshots. Must
+  // be called once, before any session exists; blocks until done. Returns
+  // false if the shared sockets cannot be opened.
+  bool Start(webrtc::VoipEngine* voip_engine);
+  // Destroys the sessions and sockets on the thread; blocks until done.
+  // Shards of a SharedPortGroup forward packets to each other, so every one
+  // of them must have shut down before any is destroyed.
+  void Shutdown();
+
+  // Returns null if the session does not exist.
+  VoipSession* FindSession(SessionId session);
+  VoipSession* GetOrCreateSession(SessionId session);
+
+  void SetRemoteAddress(SessionId session,
+                        const std::string& ip_address,
+                        int port_number);
+  void SetRemoteSsrc(SessionId session, uint32_t ssrc);
+  // Creates the session if needed and starts it. A session that fails to
+  // start is destroyed.
+  bool StartSession(SessionId session);
+  // Stops the session and, on success, destroys it.
+  bool StopSession(SessionId session);
+
+  size_t session_count() const;
+  // Combined send counters of the shard's sessions and shared sockets.
+  MediaSocket::SendStats GetSendStats() const;
+
+  // Safe to call from any thread; blocks on thread().
+  Load GetLoad();
+  // Safe to call from any thread; does not block.
+  std::vector<MonitoredThread::SlowTask> GetSlowTasks() const;
+  // The snapshot of a started session, or nothing if there is none. Safe
+  // to call from any thread; never waits for thread(), at the cost of
+  // counters up to Options::stats_interval old.
+  absl::optional<SessionSnapshot> GetSessionSnapshot(SessionId session) const;
+  std::map<SessionId, SessionSnapshot> GetSessionSnapshots() const;
+  // Nothing unless Options::network_emulation. Safe to call from any
+  // thread; does not block.
+  absl::optional<NetworkEmulator::Stats> GetNetworkEmulatorStats() const;
+
+ private:
+  MediaShard(int index,
+             const Options& options,
+             std::unique_ptr<NetworkEmulator> network_emulator,
+             std::unique_ptr<MonitoredThread> thread,
+             rtc::PhysicalSocketServer* socket_server,
+             std::unique_ptr<IoUringReceiver> io_uring_receiver);
+
+  // The stream of a session learned by this shard from its shared sockets:
+  // one SSRC, seen from up to two remote addresses (RTP and RTCP).
+  struct LearnedStream {
+    uint32_t ssrc = 0;
+    std::vector<rtc::SocketAddress> sources;
+  };
+
+  // A shared port packet read by another shard.
+  struct ForwardedPacket {
+    SessionId session;
+    bool rtcp;
+    MediaSocket::ReceivedPacket packet;
+  };
+
+  bool OpenSharedSockets();
+  // Replaces the session snapshots, then runs again after
+  // Options::stats_interval.
+  void PublishSessionSnapshots();
+  static SessionSnapshot TakeSnapshot(const VoipSession& session);
+  // Publishes the remote addresses and SSRC of `session` to the group.
+  void UpdateSharedRoutes(VoipSession* session);
+
+  // Shared socket mode: routes each packet to its session's
+  // ReadRTPPacket/ReadRTCPPacket, learning the SSRC of a stream from the
+  // first packet that arrives from a session's remote address, or that
+  // carries its declared SSRC. A session keeps one learned SSRC; a new one
+  // replaces it. With rtcp-mux every packet arrives on the RTP socket and
+  // is classified individually.
+  // Runs directly in the socket's receive callback; packets of sessions on
+  // other shards are posted to them, one task per shard and batch.
+  void RouteSharedPackets(
+      bool rtcp_socket,
+      rtc::ArrayView<const MediaSocket::ReceivedPacket> packets);
+  void DeliverForwardedPackets(const std::vector<ForwardedPacket>& packets);
+  void LearnStream(SessionId session,
+                   uint32_t ssrc,
+                   const rtc::SocketAddress& source);
+  // Drops the learned stream of `session` from this shard.
+  void ForgetStream(SessionId session);
+  // Drops the routing state of `session` from every shard.
+  void ForgetSessionRoutes(SessionId session);
+
+  const int index_;
+  const Options options_;
+  // Declared before `thread_`, so that it outlives the delivery tasks
+  // pending on the thread.
+  const std::unique_ptr<NetworkEmulator> network_emulator_;
+  std::unique_ptr<MonitoredThread> thread_;
+  // Owned by `thread_`; kept to register MediaSockets with it.
+  rtc::PhysicalSocketServer* const socket_server_;
+  // Null unless Options::use_io_uring; outlives every socket of the shard.
+  std::unique_ptr<IoUringReceiver> io_uring_receiver_;
+
+  webrtc::VoipEngine* voip_engine_ RTC_GUARDED_BY(thread_) = nullptr;
+  std::unordered_map<SessionId, std::unique_ptr<VoipSession>> sessions_
+      RTC_GUARDED_BY(thread_);
+
+  // Members below are only used with Options::shared_local_address.
+  std::unique_ptr<MediaSocket> shared_rtp_socket_ RTC_GUARDED_BY(thread_);
+  // Null with rtcp-mux.
+  std::unique_ptr<MediaSocket> shared_rtcp_socket_ RTC_GUARDED_BY(thread_);
+  // Learned streams, consulted for every packet, and the same by session.
+  // Streams of removed sessions are dropped when the group's removal
+  // generation moves.
+  SsrcDemuxer demuxer_ RTC_GUARDED_BY(thread_);
+  std::unordered_map<SessionId, LearnedStream> learned_streams_
+      RTC_GUARDED_BY(thread_);
+  uint64_t removal_generation_ RTC_GUARDED_BY(thread_) = 0;
+  // The shards of the learned sessions that live elsewhere.
+  std::unordered_map<SessionId, MediaShard*> foreign_sessions_
+      RTC_GUARDED_BY(thread_);
+  uint64_t forwarded_packets_ RTC_GUARDED_BY(thread_) = 0;
+
+  // Written on the thread, read by any.
+  mutable webrtc::Mutex snapshot_mutex_;
+  std::map<SessionId, SessionSnapshot> snapshots_
+      RTC_GUARDED_BY(snapshot_mutex_);
+};
+
+}  // namespace webrtc_examples
+
+#endif  // EXAMPLES_VOIPCLIENT_MEDIA_SHARD_H_
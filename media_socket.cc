@@ -0,0 +1,618 @@
+/*
+ *  Copyright 2023 The WebRTC Project Authors. All rights reserved.
+ *
+ *  Use of this source code is governed by a BSD-style license
+ *  that can be found in the LICENSE file in the root of the source
+ *  tree. An additional intellectual property rights grant can be found
+ *  in the file PATENTS.  All contributing project authors may
+ *  be found in the AUTHORS file in the root of the source tree.
+ */
+
+#include "examples/voipclient/media_socket.h"
+
+#include <errno.h>
+#include <netinet/in.h>
+#include <netinet/udp.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <utility>
+
+#include "absl/memory/memory.h"
+#include "examples/voipclient/instrumentation.h"
+#include "examples/voipclient/monitored_thread.h"
+#include "examples/voipclient/trace_recorder.h"
+#include "rtc_base/checks.h"
+#include "rtc_base/logging.h"
+#include "rtc_base/time_utils.h"
+
+#ifndef SOL_UDP
+#define SOL_UDP 17
+#endif
+#ifndef UDP_SEGMENT
+#define UDP_SEGMENT 103
+#endif
+
+namespace webrtc_examples {
+
+namespace {
+
+// Queued packets beyond this count are flushed without waiting for the
+// flush window.
+constexpr size_t kMaxSendBatch = 64;
+// Kernel limits for a single UDP_SEGMENT message.
+constexpr size_t kMaxGsoSegments = 64;
+constexpr size_t kMaxGsoBytes = 65000;
+// How soon a socket read through io_uring retries sends that found its
+// buffer full.
+constexpr webrtc::TimeDelta kBlockedSendRetry = webrtc::TimeDelta::Millis(1);
+// Packets that may wait behind a full socket buffer. Reaching it drops the
+// oldest kMaxSendBatch at once, so that a long block costs one erase per
+// batch rather than one per packet.
+constexpr size_t kMaxBlockedSends = 2 * kMaxSendBatch;
+
+bool SameAddress(const sockaddr_storage& a,
+                 socklen_t a_length,
+                 const sockaddr_storage& b,
+                 socklen_t b_length) {
+  return a_length == b_length && memcmp(&a, &b, a_length) == 0;
+}
+
+MediaSocket::SocketCalls* DefaultSocketCalls() {
+  static MediaSocket::SocketCalls* const calls = new MediaSocket::SocketCalls();
+  return calls;
+}
+
+}  // namespace
+
+void MediaSocket::SendStats::Accumulate(const SendStats& other) {
+  send_calls += other.send_calls;
+  packets_sent += other.packets_sent;
+  send_failures += other.send_failures;
+  blocked_sends += other.blocked_sends;
+  blocked_drops += other.blocked_drops;
+  gso_messages += other.gso_messages;
+  for (size_t i = 0; i < kBatchSizeBuckets; ++i) {
+    batch_size_histogram[i] += other.batch_size_histogram[i];
+  }
+}
+
+int MediaSocket::SocketCalls::Open(const sockaddr* address,
+                                   socklen_t address_length,
+                                   bool reuse_port) {
+  int fd = socket(address->sa_family,
+                  SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, IPPROTO_UDP);
+  if (fd < 0) {
+    RTC_LOG_ERR(LS_ERROR) << "socket() failed";
+    return -1;
+  }
+  const int one = 1;
+  if (reuse_port &&
+      setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &one, sizeof(one)) < 0) {
+    RTC_LOG_ERR(LS_ERROR) << "SO_REUSEPORT failed";
+    close(fd);
+    return -1;
+  }
+  if (bind(fd, address, address_length) < 0) {
+    RTC_LOG_ERR(LS_ERROR) << "bind() failed";
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+void MediaSocket::SocketCalls::Close(int fd) {
+  close(fd);
+}
+
+int MediaSocket::SocketCalls::ReceiveMessages(int fd,
+                                              mmsghdr* messages,
+                                              unsigned int count) {
+  return recvmmsg(fd, messages, count, MSG_DONTWAIT, /*timeout=*/nullptr);
+}
+
+int MediaSocket::SocketCalls::SendMessages(int fd,
+                                           mmsghdr* messages,
+                                           unsigned int count) {
+  return sendmmsg(fd, messages, count, MSG_DONTWAIT);
+}
+
+ssize_t MediaSocket::SocketCalls::SendTo(int fd,
+                                         const void* data,
+                                         size_t size,
+                                         const sockaddr* address,
+                                         socklen_t address_length) {
+  return sendto(fd, data, size, 0, address, address_length);
+}
+
+void MediaSocket::ReceiveStats::Accumulate(const ReceiveStats& other) {
+  receive_calls += other.receive_calls;
+  packets_received += other.packets_received;
+  truncated_packets += other.truncated_packets;
+  late_packets += other.late_packets;
+  hardware_timestamps += other.hardware_timestamps;
+  software_timestamps += other.software_timestamps;
+}
+
+std::unique_ptr<MediaSocket> MediaSocket::Create(
+    rtc::Thread* thread,
+    rtc::PhysicalSocketServer* socket_server,
+    const rtc::SocketAddress& local_address,
+    const Options& options) {
+  RTC_DCHECK(thread);
+  RTC_DCHECK(socket_server);
+  RTC_DCHECK_GT(options.receive_batch_size, 0);
+
+  sockaddr_storage addr;
+  socklen_t addr_len = local_address.ToSockAddrStorage(&addr);
+  if (addr_len == 0) {
+    RTC_LOG(LS_ERROR) << "Invalid local address "
+                      << local_address.ToString();
+    return nullptr;
+  }
+
+  SocketCalls* calls =
+      options.socket_calls ? options.socket_calls : DefaultSocketCalls();
+  int fd = calls->Open(reinterpret_cast<const sockaddr*>(&addr), addr_len,
+                       options.reuse_port);
+  if (fd < 0) {
+    RTC_LOG(LS_ERROR) << "Cannot open socket on "
+                      << local_address.ToString();
+    return nullptr;
+  }
+
+  if (options.receive_timestamps &&
+      !EnableReceiveTimestamps(fd, options.hardware_receive_timestamps)) {
+    RTC_LOG(LS_WARNING) << "Reading " << local_address.ToString()
+                        << " without receive timestamps";
+  }
+
+  // The option can only be read back on kernels that implement it.
+  int gso_size = 0;
+  socklen_t gso_size_length = sizeof(gso_size);
+  bool gso_supported = getsockopt(fd, SOL_UDP, UDP_SEGMENT, &gso_size,
+                                  &gso_size_length) == 0;
+
+  // Using `new` to access a non-public constructor.
+  auto socket = absl::WrapUnique(new MediaSocket(thread, socket_server, calls,
+                                                 fd, options, gso_supported));
+  if (options.io_uring_receiver) {
+    if (options.io_uring_receiver->Add(fd, socket.get(),
+                                       options.receive_timestamps)) {
+      socket->io_uring_receiver_ = options.io_uring_receiver;
+      return socket;
+    }
+    RTC_LOG(LS_WARNING) << "Reading " << local_address.ToString()
+                        << " without io_uring";
+  }
+  socket_server->Add(socket.get());
+  return socket;
+}
+
+MediaSocket::MediaSocket(rtc::Thread* thread,
+                         rtc::PhysicalSocketServer* socket_server,
+                         SocketCalls* calls,
+                         int fd,
+                         const Options& options,
+                         bool gso_supported)
+    : thread_(thread),
+      socket_server_(socket_server),
+      calls_(calls),
+      fd_(fd),
+      options_(options),
+      gso_enabled_(options.use_udp_gso && gso_supported),
+      receive_buffers_(options.receive_batch_size),
+      receive_headers_(options.receive_batch_size),
+      receive_iovecs_(options.receive_batch_size),
+      receive_addresses_(options.receive_batch_size),
+      receive_controls_(options.receive_timestamps
+                            ? options.receive_batch_size
+                            : 0) {
+  receive_batch_.reserve(options.receive_batch_size);
+  pending_sends_.reserve(kMaxBlockedSends);
+  send_headers_.reserve(kMaxBlockedSends);
+  send_iovecs_.reserve(kMaxBlockedSends);
+  send_controls_.reserve(kMaxBlockedSends);
+  send_message_packets_.reserve(kMaxBlockedSends);
+}
+
+MediaSocket::~MediaSocket() {
+  Close();
+}
+
+void MediaSocket::SetReceiveCallback(ReceiveCallback callback) {
+  receive_callback_ = std::move(callback);
+}
+
+void MediaSocket::Send(rtc::scoped_refptr<PacketBuffer> packet,
+                       const rtc::SocketAddress& address) {
+  RTC_DCHECK_RUN_ON(thread_);
+  if (fd_ < 0) {
+    return;
+  }
+
+  PendingPacket pending;
+  pending.buffer = std::move(packet);
+  pending.address_length = address.ToSockAddrStorage(&pending.address);
+
+  if (!options_.batch_sends) {
+    ++send_stats_.send_calls;
+    Instrumentation::Increment(Counter::kSendSyscalls);
+    Stopwatch syscall;
+    ScopedTraceEvent trace_event("SendTo", /*arg=*/1);
+    ssize_t sent = calls_->SendTo(
+        fd_, pending.buffer->data(), pending.buffer->size(),
+        reinterpret_cast<sockaddr*>(&pending.address),
+        pending.address_length);
+    syscall.Record(Histogram::kSendSyscall);
+    if (sent == static_cast<ssize_t>(pending.buffer->size())) {
+      ++send_stats_.packets_sent;
+    } else if (sent < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+      ++send_stats_.blocked_drops;
+    } else {
+      ++send_stats_.send_failures;
+    }
+    RecordBatch(1);
+    return;
+  }
+
+  if (send_blocked_) {
+    // Audio goes stale; make room by dropping the oldest packets.
+    if (pending_sends_.size() >= kMaxBlockedSends) {
+      pending_sends_.erase(pending_sends_.begin(),
+                           pending_sends_.begin() + kMaxSendBatch);
+      send_stats_.blocked_drops += kMaxSendBatch;
+    }
+    pending_sends_.push_back(std::move(pending));
+    return;
+  }
+  pending_sends_.push_back(std::move(pending));
+  if (pending_sends_.size() >= kMaxSendBatch) {
+    Flush();
+    return;
+  }
+  if (flush_scheduled_) {
+    return;
+  }
+  flush_scheduled_ = true;
+  auto flush = webrtc::SafeTask(safety_.flag(), [this] {
+    flush_scheduled_ = false;
+    Flush();
+  });
+  ScopedTaskName task_name("MediaSocket::Flush");
+  if (options_.send_flush_window.IsZero()) {
+    thread_->PostTask(std::move(flush));
+  } else {
+    thread_->PostDelayedHighPrecisionTask(std::move(flush),
+                                          options_.send_flush_window);
+  }
+}
+
+void MediaSocket::Flush() {
+  RTC_DCHECK_RUN_ON(thread_);
+  if (pending_sends_.empty() || send_blocked_) {
+    return;
+  }
+  if (fd_ < 0) {
+    pending_sends_.clear();
+    return;
+  }
+
+  const size_t batch_packets = pending_sends_.size();
+  size_t messages = BuildSendMessages(gso_enabled_);
+  size_t next = 0;
+  while (next < messages) {
+    ++send_stats_.send_calls;
+    Instrumentation::Increment(Counter::kSendSyscalls);
+    Stopwatch syscall;
+    ScopedTraceEvent trace_event("SendMessages", messages - next);
+    int sent = calls_->SendMessages(fd_, &send_headers_[next],
+                                    messages - next);
+    syscall.Record(Histogram::kSendSyscall);
+    if (sent < 0) {
+      if (gso_enabled_ && (errno == EIO || errno == EINVAL)) {
+        // The egress device cannot segment; send the rest one datagram per
+        // message from now on.
+        RTC_LOG(LS_WARNING) << "UDP GSO send failed, disabling GSO";
+        gso_enabled_ = false;
+        size_t packets_done = 0;
+        for (size_t i = 0; i < next; ++i) {
+          packets_done += send_message_packets_[i];
+        }
+        pending_sends_.erase(pending_sends_.begin(),
+                             pending_sends_.begin() + packets_done);
+        messages = BuildSendMessages(/*use_gso=*/false);
+        next = 0;
+        continue;
+      }
+      if (errno == EAGAIN || errno == EWOULDBLOCK) {
+        ++send_stats_.blocked_sends;
+        RecordBatch(batch_packets);
+        BlockSends(next);
+        return;
+      }
+      RTC_LOG_ERR(LS_WARNING) << "sendmmsg() failed";
+      for (size_t i = next; i < messages; ++i) {
+        send_stats_.send_failures += send_message_packets_[i];
+      }
+      break;
+    }
+    const size_t sent_messages = static_cast<size_t>(sent);
+    for (size_t i = next; i < next + sent_messages; ++i) {
+      send_stats_.packets_sent += send_message_packets_[i];
+      if (send_message_packets_[i] > 1) {
+        ++send_stats_.gso_messages;
+      }
+    }
+    next += sent_messages;
+  }
+
+  RecordBatch(batch_packets);
+  pending_sends_.clear();
+}
+
+size_t MediaSocket::BuildSendMessages(bool use_gso) {
+  const size_t count = pending_sends_.size();
+  send_headers_.clear();
+  send_message_packets_.clear();
+  send_iovecs_.resize(count);
+  send_controls_.resize(count);
+
+  size_t first = 0;
+  while (first < count) {
+    PendingPacket& head = pending_sends_[first];
+    const size_t segment_size = head.buffer->size();
+
+    // A GSO message is a run of packets to the same destination where every
+    // packet but the last has exactly `segment_size` bytes.
+    size_t segments = 1;
+    if (use_gso && segment_size > 0) {
+      size_t total_bytes = segment_size;
+      while (first + segments < count && segments < kMaxGsoSegments) {
+        const PendingPacket& next = pending_sends_[first + segments];
+        const size_t next_size = next.buffer->size();
+        if (next_size == 0 || next_size > segment_size ||
+            total_bytes + next_size > kMaxGsoBytes ||
+            !SameAddress(head.address, head.address_length, next.address,
+                         next.address_length)) {
+          break;
+        }
+        total_bytes += next_size;
+        ++segments;
+        if (next_size < segment_size) {
+          break;
+        }
+      }
+    }
+
+    for (size_t i = first; i < first + segments; ++i) {
+      send_iovecs_[i].iov_base = pending_sends_[i].buffer->data();
+      send_iovecs_[i].iov_len = pending_sends_[i].buffer->size();
+    }
+
+    mmsghdr header;
+    memset(&header, 0, sizeof(header));
+    header.msg_hdr.msg_name = &head.address;
+    header.msg_hdr.msg_namelen = head.address_length;
+    header.msg_hdr.msg_iov = &send_iovecs_[first];
+    header.msg_hdr.msg_iovlen = segments;
+    if (segments > 1) {
+      GsoControl& control = send_controls_[send_headers_.size()];
+      memset(&control, 0, sizeof(control));
+      header.msg_hdr.msg_control = control.buffer;
+      header.msg_hdr.msg_controllen = sizeof(control.buffer);
+      cmsghdr* cmsg = CMSG_FIRSTHDR(&header.msg_hdr);
+      cmsg->cmsg_level = SOL_UDP;
+      cmsg->cmsg_type = UDP_SEGMENT;
+      cmsg->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+      uint16_t gso_size = static_cast<uint16_t>(segment_size);
+      memcpy(CMSG_DATA(cmsg), &gso_size, sizeof(gso_size));
+    }
+    send_headers_.push_back(header);
+    send_message_packets_.push_back(segments);
+    first += segments;
+  }
+  return send_headers_.size();
+}
+
+void MediaSocket::RecordBatch(size_t packets) {
+  size_t bucket = 0;
+  while (packets > 1 && bucket + 1 < kBatchSizeBuckets) {
+    packets >>= 1;
+    ++bucket;
+  }
+  ++send_stats_.batch_size_histogram[bucket];
+}
+
+void MediaSocket::BlockSends(size_t messages) {
+  size_t packets_done = 0;
+  for (size_t i = 0; i < messages; ++i) {
+    packets_done += send_message_packets_[i];
+  }
+  pending_sends_.erase(pending_sends_.begin(),
+                       pending_sends_.begin() + packets_done);
+  send_blocked_ = true;
+  if (io_uring_receiver_) {
+    // The socket server does not poll this socket; try again shortly.
+    ScopedTaskName task_name("MediaSocket::OnWritable");
+    thread_->PostDelayedHighPrecisionTask(
+        webrtc::SafeTask(safety_.flag(), [this] { OnWritable(); }),
+        kBlockedSendRetry);
+  } else {
+    socket_server_->Update(this);
+  }
+}
+
+void MediaSocket::OnWritable() {
+  if (!send_blocked_) {
+    return;
+  }
+  send_blocked_ = false;
+  if (!io_uring_receiver_) {
+    socket_server_->Update(this);
+  }
+  Flush();
+}
+
+void MediaSocket::Close() {
+  if (fd_ < 0) {
+    return;
+  }
+  // Whatever a full socket buffer held back is lost with the socket.
+  send_blocked_ = false;
+  Flush();
+  send_stats_.send_failures += pending_sends_.size();
+  pending_sends_.clear();
+  if (io_uring_receiver_) {
+    io_uring_receiver_->Remove(fd_);
+    io_uring_receiver_ = nullptr;
+  } else {
+    socket_server_->Remove(this);
+  }
+  calls_->Close(fd_);
+  fd_ = -1;
+}
+
+uint32_t MediaSocket::GetRequestedEvents() {
+  return send_blocked_ ? rtc::DE_READ | rtc::DE_WRITE : rtc::DE_READ;
+}
+
+void MediaSocket::OnEvent(uint32_t ff, int err) {
+  if (ff & rtc::DE_READ) {
+    ReceiveBatch();
+  }
+  if (ff & rtc::DE_WRITE) {
+    OnWritable();
+  }
+}
+
+int MediaSocket::GetDescriptor() {
+  return fd_;
+}
+
+bool MediaSocket::IsDescriptorClosed() {
+  // Datagram sockets have no notion of the peer closing the connection.
+  return false;
+}
+
+void MediaSocket::ReceiveBatch() {
+  const size_t batch_size = receive_buffers_.size();
+  for (size_t i = 0; i < batch_size; ++i) {
+    if (!receive_buffers_[i]) {
+      receive_buffers_[i] = PacketBufferPool::Get()->Allocate();
+    }
+    receive_iovecs_[i].iov_base = receive_buffers_[i]->data();
+    receive_iovecs_[i].iov_len = PacketBuffer::kCapacity;
+
+    msghdr& header = receive_headers_[i].msg_hdr;
+    memset(&header, 0, sizeof(header));
+    header.msg_name = &receive_addresses_[i];
+    header.msg_namelen = sizeof(receive_addresses_[i]);
+    header.msg_iov = &receive_iovecs_[i];
+    header.msg_iovlen = 1;
+    if (!receive_controls_.empty()) {
+      header.msg_control = receive_controls_[i].buffer;
+      header.msg_controllen = sizeof(receive_controls_[i].buffer);
+    }
+  }
+
+  Instrumentation::Increment(Counter::kReceiveSyscalls);
+  Stopwatch syscall;
+  int received;
+  {
+    ScopedTraceEvent trace_event("ReceiveMessages", batch_size);
+    received =
+        calls_->ReceiveMessages(fd_, receive_headers_.data(), batch_size);
+  }
+  syscall.Record(Histogram::kReceiveSyscall);
+  ++receive_stats_.receive_calls;
+  if (received < 0) {
+    if (errno != EAGAIN && errno != EWOULDBLOCK) {
+      RTC_LOG_ERR(LS_WARNING) << "recvmmsg() failed";
+    }
+    return;
+  }
+
+  if (!receive_controls_.empty()) {
+    clock_offset_us_ = rtc::TimeUTCMicros() - rtc::TimeMicros();
+  }
+  RTC_DCHECK(receive_batch_.empty());
+  for (int i = 0; i < received; ++i) {
+    if (receive_headers_[i].msg_hdr.msg_flags & MSG_TRUNC) {
+      RTC_LOG(LS_WARNING) << "Dropping truncated datagram";
+      ++receive_stats_.truncated_packets;
+      continue;
+    }
+    ReceivedPacket packet;
+    packet.buffer = std::move(receive_buffers_[i]);
+    packet.buffer->SetSize(receive_headers_[i].msg_len);
+    rtc::SocketAddressFromSockAddrStorage(receive_addresses_[i],
+                                          &packet.source);
+    if (!receive_controls_.empty()) {
+      SetArrivalTime(ParseReceiveTimestamp(receive_headers_[i].msg_hdr),
+                     &packet);
+    }
+    receive_batch_.push_back(std::move(packet));
+  }
+  DeliverPackets();
+}
+
+void MediaSocket::DeliverPackets() {
+  receive_stats_.packets_received += receive_batch_.size();
+  if (options_.late_arrival_gap > webrtc::TimeDelta::Zero() &&
+      !receive_batch_.empty()) {
+    const int64_t now_us = rtc::TimeMicros();
+    if (last_arrival_us_ >= 0 &&
+        now_us - last_arrival_us_ > options_.late_arrival_gap.us()) {
+      receive_stats_.late_packets += receive_batch_.size();
+    }
+    last_arrival_us_ = now_us;
+  }
+
+  if (receive_callback_ && !receive_batch_.empty()) {
+    receive_callback_(receive_batch_);
+  }
+  // Returns the buffers the callback did not keep to the pool.
+  receive_batch_.clear();
+}
+
+void MediaSocket::SetArrivalTime(const ReceiveTimestamp& timestamp,
+                                 ReceivedPacket* packet) {
+  if (timestamp.time_ns == 0) {
+    return;
+  }
+  if (timestamp.hardware) {
+    ++receive_stats_.hardware_timestamps;
+  } else {
+    ++receive_stats_.software_timestamps;
+  }
+  packet->arrival_time_us =
+      timestamp.time_ns / rtc::kNumNanosecsPerMicrosec - clock_offset_us_;
+}
+
+void MediaSocket::OnIoUringPacket(rtc::scoped_refptr<PacketBuffer> buffer,
+                                  const sockaddr_storage& source,
+                                  const ReceiveTimestamp& timestamp,
+                                  bool truncated) {
+  if (truncated) {
+    RTC_LOG(LS_WARNING) << "Dropping truncated datagram";
+    ++receive_stats_.truncated_packets;
+    return;
+  }
+  ReceivedPacket packet;
+  packet.buffer = std::move(buffer);
+  rtc::SocketAddressFromSockAddrStorage(source, &packet.source);
+  if (options_.receive_timestamps) {
+    if (receive_batch_.empty()) {
+      clock_offset_us_ = rtc::TimeUTCMicros() - rtc::TimeMicros();
+    }
+    SetArrivalTime(timestamp, &packet);
+  }
+  receive_batch_.push_back(std::move(packet));
+}
+
+void MediaSocket::OnIoUringBatchEnd() {
+  DeliverPackets();
+}
+
+}  // namespace webrtc_examples
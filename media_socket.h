@@ -0,0 +1,291 @@
+/*
+ *  Copyright 2023 The WebRTC Project Authors. All rights reserved.
+ *
+ *  Use of this source code is governed by a BSD-style license
+ *  that can be found in the LICENSE file in the root of the source
+ *  tree. An additional intellectual property rights grant can be found
+ *  in the file PATENTS.  All contributing project authors may
+ *  be found in the AUTHORS file in the root of the source tree.
+ */
+
+#ifndef EXAMPLES_VOIPCLIENT_MEDIA_SOCKET_H_
+#define EXAMPLES_VOIPCLIENT_MEDIA_SOCKET_H_
+
+#include <sys/socket.h>
+
+#include <array>
+#include <functional>
+#include <memory>
+#include <vector>
+
+#include "api/array_view.h"
+#include "api/scoped_refptr.h"
+#include "api/task_queue/pending_task_safety_flag.h"
+#include "api/units/time_delta.h"
+#include "examples/voipclient/io_uring_receiver.h"
+#include "examples/voipclient/packet_buffer_pool.h"
+#include "examples/voipclient/receive_timestamp.h"
+#include "rtc_base/physical_socket_server.h"
+#include "rtc_base/socket_address.h"
+#include "rtc_base/thread.h"
+
+namespace webrtc_examples {
+
+// A non-blocking UDP socket registered directly with a
+// rtc::PhysicalSocketServer. Unlike rtc::AsyncUDPSocket, which reads one
+// datagram per readiness event, every wakeup drains up to
+// `receive_batch_size` datagrams with a single recvmmsg() call straight into
+// pooled buffers and hands them to the receive callback as one batch.
+//
+// Outgoing packets are queued and flushed together with sendmmsg(), either
+// at the end of the current task or after `send_flush_window`. Consecutive
+// equally sized packets to the same destination are coalesced into a single
+// UDP_SEGMENT (GSO) message when the kernel supports it.
+//
+// With an IoUringReceiver, datagrams are instead read by the kernel as they
+// arrive and handed over as one batch per wakeup of the receiver.
+//
+// All methods, and the receive callback, run on the thread that owns the
+// socket server.
+class MediaSocket : public rtc::Dispatcher,
+                    private IoUringReceiver::Listener {
+ public:
+  // The system calls a MediaSocket makes on its descriptor. The default
+  // implementation forwards to the kernel; benchmarks substitute their own
+  // to take the kernel out of the measurement.
+  class SocketCalls {
+   public:
+    virtual ~SocketCalls() = default;
+
+    // Returns a non-blocking UDP descriptor bound to `address`, or -1.
+    // With `reuse_port`, other sockets may bind the same address, and the
+    // kernel spreads the incoming datagrams over them.
+    virtual int Open(const sockaddr* address,
+                     socklen_t address_length,
+                     bool reuse_port);
+    virtual void Close(int fd);
+    virtual int ReceiveMessages(int fd,
+                                mmsghdr* messages,
+                                unsigned int count);
+    virtual int SendMessages(int fd, mmsghdr* messages, unsigned int count);
+    virtual ssize_t SendTo(int fd,
+                           const void* data,
+                           size_t size,
+                           const sockaddr* address,
+                           socklen_t address_length);
+  };
+
+  struct Options {
+    // Maximum number of datagrams drained per wakeup.
+    size_t receive_batch_size = 32;
+    // When false, Send() writes each packet immediately with sendto().
+    bool batch_sends = true;
+    // How long a queued packet may wait for others to join its batch. Zero
+    // flushes once the task that queued the first packet has finished.
+    webrtc::TimeDelta send_flush_window = webrtc::TimeDelta::Zero();
+    // Coalesce same-destination bursts with UDP generic segmentation
+    // offload where available.
+    bool use_udp_gso = true;
+    // When positive, packets read after a silence longer than this are
+    // counted as late in ReceiveStats. Only meaningful for a socket that
+    // carries a single paced stream.
+    webrtc::TimeDelta late_arrival_gap = webrtc::TimeDelta::Zero();
+    // Not owned; must outlive the socket. Null uses the kernel.
+    SocketCalls* socket_calls = nullptr;
+    // Not owned; must outlive the socket and belong to the same thread.
+    // When set, datagrams are read through it instead of
+    // ReceiveMessages(); if it cannot take the socket, the socket falls
+    // back to reading by itself.
+    IoUringReceiver* io_uring_receiver = nullptr;
+    // Bind with SO_REUSEPORT, sharing the address with other sockets.
+    bool reuse_port = false;
+    // Read the time each datagram reached the host (see ReceiveTimestamp)
+    // into ReceivedPacket::arrival_time_us.
+    bool receive_timestamps = false;
+    // With `receive_timestamps`, prefer the NIC's stamps to the kernel's.
+    // Only valid if the NIC's clock is synchronised to CLOCK_REALTIME.
+    bool hardware_receive_timestamps = false;
+  };
+
+  // Bucket i counts send batches of [2^i, 2^(i+1)) packets.
+  static constexpr size_t kBatchSizeBuckets = 8;
+
+  struct SendStats {
+    // sendto()/sendmmsg() system calls issued.
+    uint64_t send_calls = 0;
+    uint64_t packets_sent = 0;
+    uint64_t send_failures = 0;
+    // sendmmsg() calls refused with EAGAIN because the socket buffer was
+    // full. The unsent packets stay queued until the socket is writable.
+    uint64_t blocked_sends = 0;
+    // Packets dropped while the socket buffer stayed full: unbatched sends
+    // that were refused, and the oldest queued packets once two full
+    // batches were waiting.
+    uint64_t blocked_drops = 0;
+    // Messages that carried more than one packet using UDP_SEGMENT.
+    uint64_t gso_messages = 0;
+    std::array<uint64_t, kBatchSizeBuckets> batch_size_histogram = {};
+
+    void Accumulate(const SendStats& other);
+  };
+
+  struct ReceiveStats {
+    // recvmmsg() system calls issued, one per readiness event. Zero when
+    // reading through an IoUringReceiver.
+    uint64_t receive_calls = 0;
+    uint64_t packets_received = 0;
+    uint64_t truncated_packets = 0;
+    // Packets of wakeups that followed a gap over `late_arrival_gap`.
+    uint64_t late_packets = 0;
+    // Packets whose arrival time was stamped by the NIC, or by the kernel.
+    uint64_t hardware_timestamps = 0;
+    uint64_t software_timestamps = 0;
+
+    void Accumulate(const ReceiveStats& other);
+  };
+
+  struct ReceivedPacket {
+    rtc::scoped_refptr<PacketBuffer> buffer;
+    rtc::SocketAddress source;
+    // When the datagram reached the host, on the rtc::TimeMicros() clock;
+    // -1 without Options::receive_timestamps.
+    int64_t arrival_time_us = -1;
+  };
+  // Called with every datagram read by one wakeup, straight from the
+  // buffers they were read into. The packets only live until the callback
+  // returns; keep a reference to a buffer to hold on to it.
+  using ReceiveCallback =
+      std::function<void(rtc::ArrayView<const ReceivedPacket> packets)>;
+
+  // Creates a socket bound to `local_address`, served by `thread` whose
+  // socket server is `socket_server`. Returns null on failure.
+  static std::unique_ptr<MediaSocket> Create(
+      rtc::Thread* thread,
+      rtc::PhysicalSocketServer* socket_server,
+      const rtc::SocketAddress& local_address,
+      const Options& options);
+
+  ~MediaSocket() override;
+
+  MediaSocket(const MediaSocket&) = delete;
+  MediaSocket& operator=(const MediaSocket&) = delete;
+
+  void SetReceiveCallback(ReceiveCallback callback);
+
+  // Queues `packet` for `address`. Failures are reported through
+  // GetSendStats() since the actual write may happen later.
+  void Send(rtc::scoped_refptr<PacketBuffer> packet,
+            const rtc::SocketAddress& address);
+  // Writes any queued packets now, unless the socket buffer is full, in
+  // which case they are written once it has room.
+  void Flush();
+
+  SendStats GetSendStats() const { return send_stats_; }
+  ReceiveStats GetReceiveStats() const { return receive_stats_; }
+  // Packets queued by Send() and not yet flushed.
+  size_t pending_send_count() const { return pending_sends_.size(); }
+
+  // Flushes, unregisters from the socket server and closes the descriptor.
+  // Safe to call more than once.
+  void Close();
+
+  // rtc::Dispatcher implementation.
+  uint32_t GetRequestedEvents() override;
+  void OnEvent(uint32_t ff, int err) override;
+  int GetDescriptor() override;
+  bool IsDescriptorClosed() override;
+
+ private:
+  struct PendingPacket {
+    rtc::scoped_refptr<PacketBuffer> buffer;
+    sockaddr_storage address;
+    socklen_t address_length;
+  };
+
+  // Ancillary data carrying the UDP_SEGMENT size of a GSO message.
+  union GsoControl {
+    char buffer[CMSG_SPACE(sizeof(uint16_t))];
+    cmsghdr align;
+  };
+  // Ancillary data carrying the receive timestamp of a datagram.
+  union TimestampControl {
+    char buffer[kReceiveTimestampControlSize];
+    cmsghdr align;
+  };
+
+  MediaSocket(rtc::Thread* thread,
+              rtc::PhysicalSocketServer* socket_server,
+              SocketCalls* calls,
+              int fd,
+              const Options& options,
+              bool gso_supported);
+
+  // Reads one batch of at most `receive_batch_size` datagrams.
+  void ReceiveBatch();
+  // Updates the receive stats, hands `receive_batch_` to the callback and
+  // empties it.
+  void DeliverPackets();
+  // Sets the arrival time of `packet` from `timestamp`, if it has one.
+  void SetArrivalTime(const ReceiveTimestamp& timestamp,
+                      ReceivedPacket* packet);
+
+  // IoUringReceiver::Listener implementation.
+  void OnIoUringPacket(rtc::scoped_refptr<PacketBuffer> buffer,
+                       const sockaddr_storage& source,
+                       const ReceiveTimestamp& timestamp,
+                       bool truncated) override;
+  void OnIoUringBatchEnd() override;
+  // Builds sendmmsg() messages for `pending_sends_`, grouping GSO segments.
+  size_t BuildSendMessages(bool use_gso);
+  void RecordBatch(size_t packets);
+  // Keeps what the first `messages` of `send_headers_` did not carry, to
+  // retry once the socket is writable.
+  void BlockSends(size_t messages);
+  void OnWritable();
+
+  rtc::Thread* const thread_;
+  rtc::PhysicalSocketServer* const socket_server_;
+  SocketCalls* const calls_;
+  int fd_;
+  const Options options_;
+  bool gso_enabled_;
+  ReceiveCallback receive_callback_;
+
+  // recvmmsg() scratch space, sized once at creation. A slot's buffer is
+  // handed off with the batch and replaced on the next read.
+  std::vector<rtc::scoped_refptr<PacketBuffer>> receive_buffers_;
+  std::vector<mmsghdr> receive_headers_;
+  std::vector<iovec> receive_iovecs_;
+  std::vector<sockaddr_storage> receive_addresses_;
+  // Empty without Options::receive_timestamps.
+  std::vector<TimestampControl> receive_controls_;
+  // CLOCK_REALTIME minus the rtc::TimeMicros() clock, read once per batch
+  // to convert receive timestamps.
+  int64_t clock_offset_us_ = 0;
+  // Set while the socket is read through it.
+  IoUringReceiver* io_uring_receiver_ = nullptr;
+  // Packets of the current wakeup. Cleared, not freed, after each one, so
+  // that reading allocates nothing once it has grown to the batch size.
+  std::vector<ReceivedPacket> receive_batch_;
+  // Time of the last wakeup that read packets, for `late_arrival_gap`.
+  int64_t last_arrival_us_ = -1;
+
+  // Packets waiting for the next flush, and sendmmsg() scratch space.
+  std::vector<PendingPacket> pending_sends_;
+  bool flush_scheduled_ = false;
+  // Set from an EAGAIN until the socket is writable again; sending waits.
+  bool send_blocked_ = false;
+  std::vector<mmsghdr> send_headers_;
+  std::vector<iovec> send_iovecs_;
+  std::vector<GsoControl> send_controls_;
+  // Number of packets carried by each entry of `send_headers_`.
+  std::vector<size_t> send_message_packets_;
+
+  SendStats send_stats_;
+  ReceiveStats receive_stats_;
+  webrtc::ScopedTaskSafety safety_;
+};
+
+}  // namespace webrtc_examples
+
+#endif  // EXAMPLES_VOIPCLIENT_MEDIA_SOCKET_H_
@@ -0,0 +1,376 @@
+/*
+ *  Copyright 2023 The WebRTC Project Authors. All rights reserved.
+ *
+ *  Use of this source code is governed by a BSD-style license
+ *  that can be found in the LICENSE file in the root of the source
+ *  tree. An additional intellectual property rights grant can be found
+ *  in the file PATENTS.  All contributing project authors may
+ *  be found in the AUTHORS file in the root of the source tree.
+ */
+
+#include "examples/voipclient/metrics_server.h"
+
+#include <errno.h>
+#include <netinet/in.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <cmath>
+#include <utility>
+
+#include "absl/memory/memory.h"
+#include "absl/strings/match.h"
+#include "rtc_base/checks.h"
+#include "rtc_base/logging.h"
+#include "rtc_base/strings/string_builder.h"
+#include "rtc_base/time_utils.h"
+
+namespace webrtc_examples {
+
+namespace {
+
+constexpr size_t kMaxConnections = 16;
+constexpr size_t kMaxRequestSize = 8192;
+// Time a client has to send its request and read the response.
+constexpr webrtc::TimeDelta kConnectionTimeout = webrtc::TimeDelta::Seconds(5);
+
+std::string FormatLabels(const MetricsWriter::Labels& labels) {
+  if (labels.empty()) {
+    return "";
+  }
+  std::string text = "{";
+  for (const auto& label : labels) {
+    if (text.size() > 1) {
+      text += ",";
+    }
+    text += label.first + "=\"";
+    for (char c : label.second) {
+      if (c == '\n') {
+        text += "\\n";
+        continue;
+      }
+      if (c == '\\' || c == '"') {
+        text += '\\';
+      }
+      text += c;
+    }
+    text += "\"";
+  }
+  return text + "}";
+}
+
+std::string FormatValue(double value) {
+  if (std::isnan(value)) {
+    return "NaN";
+  }
+  if (std::isinf(value)) {
+    return value > 0 ? "+Inf" : "-Inf";
+  }
+  // %g alone keeps six digits, which would freeze counters past a million.
+  char buffer[32];
+  for (int precision = 15;; ++precision) {
+    snprintf(buffer, sizeof(buffer), "%.*g", precision, value);
+    if (precision == 17 || strtod(buffer, nullptr) == value) {
+      return buffer;
+    }
+  }
+}
+
+std::string HttpResponse(const std::string& status,
+                         const std::string& content_type,
+                         const std::string& body) {
+  rtc::StringBuilder response;
+  response << "HTTP/1.0 " << status << "\r\n"
+           << "Content-Type: " << content_type << "\r\n"
+           << "Content-Length: " << body.size() << "\r\n"
+           << "Connection: close\r\n\r\n"
+           << body;
+  return response.Release();
+}
+
+}  // namespace
+
+void MetricsWriter::Add(const std::string& name,
+                        const std::string& type,
+                        const Labels& labels,
+                        double value) {
+  AddSample(name, type, labels, FormatValue(value));
+}
+
+void MetricsWriter::Add(const std::string& name,
+                        const std::string& type,
+                        const Labels& labels,
+                        uint64_t value) {
+  AddSample(name, type, labels, std::to_string(value));
+}
+
+void MetricsWriter::AddSample(const std::string& name,
+                              const std::string& type,
+                              const Labels& labels,
+                              const std::string& value) {
+  if (!type.empty() && typed_names_.insert(name).second) {
+    text_ += "# TYPE " + name + " " + type + "\n";
+  }
+  text_ += name + FormatLabels(labels) + " " + value + "\n";
+}
+
+// Accepts connections on the listening descriptor.
+class MetricsServer::Listener : public rtc::Dispatcher {
+ public:
+  Listener(MetricsServer* server, int fd) : server_(server), fd_(fd) {}
+  ~Listener() override { close(fd_); }
+
+  // rtc::Dispatcher implementation.
+  uint32_t GetRequestedEvents() override { return rtc::DE_ACCEPT; }
+  void OnEvent(uint32_t ff, int err) override {
+    while (true) {
+      int fd = accept4(fd_, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+      if (fd < 0) {
+        if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+          RTC_LOG_ERR(LS_WARNING) << "accept4() failed";
+        }
+        return;
+      }
+      server_->OnAccept(fd);
+    }
+  }
+  int GetDescriptor() override { return fd_; }
+  bool IsDescriptorClosed() override { return false; }
+
+ private:
+  MetricsServer* const server_;
+  const int fd_;
+};
+
+// Reads one request head, writes the response and closes.
+class MetricsServer::Connection : public rtc::Dispatcher {
+ public:
+  Connection(MetricsServer* server, int fd)
+      : server_(server), fd_(fd), accept_time_ms_(rtc::TimeMillis()) {}
+  ~Connection() override { close(fd_); }
+
+  int64_t accept_time_ms() const { return accept_time_ms_; }
+
+  // rtc::Dispatcher implementation.
+  uint32_t GetRequestedEvents() override {
+    return writing_ ? rtc::DE_WRITE : rtc::DE_READ;
+  }
+  void OnEvent(uint32_t ff, int err) override {
+    if (ff & rtc::DE_CLOSE) {
+      server_->CloseConnection(this);
+    } else if (writing_ && (ff & rtc::DE_WRITE)) {
+      Write();
+    } else if (!writing_ && (ff & rtc::DE_READ)) {
+      Read();
+    }
+  }
+  int GetDescriptor() override { return fd_; }
+  bool IsDescriptorClosed() override {
+    char c;
+    ssize_t result = recv(fd_, &c, 1, MSG_PEEK | MSG_DONTWAIT);
+    return result == 0 ||
+           (result < 0 && errno != EAGAIN && errno != EWOULDBLOCK &&
+            errno != EINTR);
+  }
+
+ private:
+  void Read() {
+    char buffer[1024];
+    while (true) {
+      ssize_t size = recv(fd_, buffer, sizeof(buffer), MSG_DONTWAIT);
+      if (size < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+        return;
+      }
+      if (size <= 0) {
+        server_->CloseConnection(this);
+        return;
+      }
+      request_.append(buffer, size);
+      if (absl::StrContains(request_, "\r\n\r\n") ||
+          absl::StrContains(request_, "\n\n")) {
+        response_ = server_->Respond(request_);
+        writing_ = true;
+        Write();
+        return;
+      }
+      if (request_.size() > kMaxRequestSize) {
+        server_->CloseConnection(this);
+        return;
+      }
+    }
+  }
+
+  void Write() {
+    while (sent_ < response_.size()) {
+      ssize_t size = send(fd_, response_.data() + sent_,
+                          response_.size() - sent_,
+                          MSG_DONTWAIT | MSG_NOSIGNAL);
+      if (size < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+        // Picks up the switch to DE_WRITE.
+        server_->socket_server_->Update(this);
+        return;
+      }
+      if (size < 0) {
+        break;
+      }
+      sent_ += size;
+    }
+    server_->CloseConnection(this);
+  }
+
+  MetricsServer* const server_;
+  const int fd_;
+  const int64_t accept_time_ms_;
+  std::string request_;
+  std::string response_;
+  size_t sent_ = 0;
+  bool writing_ = false;
+};
+
+std::unique_ptr<MetricsServer> MetricsServer::Create(
+    const rtc::SocketAddress& address,
+    webrtc::TimeDelta refresh_interval,
+    Renderer renderer) {
+  auto socket_server = std::make_unique<rtc::PhysicalSocketServer>();
+  rtc::PhysicalSocketServer* socket_server_ptr = socket_server.get();
+  auto thread = std::make_unique<rtc::Thread>(std::move(socket_server));
+  thread->SetName("metrics_server", nullptr);
+  if (!thread->Start()) {
+    RTC_LOG(LS_ERROR) << "Failed to start the metrics server thread";
+    return nullptr;
+  }
+
+  // Using `new` to access a non-public constructor.
+  auto server = absl::WrapUnique(
+      new MetricsServer(std::move(thread), socket_server_ptr,
+                        refresh_interval, std::move(renderer)));
+  bool listening = server->thread_->BlockingCall(
+      [&server, &address] { return server->Listen(address); });
+  if (!listening) {
+    return nullptr;
+  }
+  server->thread_->PostTask([server = server.get()] { server->Refresh(); });
+  return server;
+}
+
+MetricsServer::MetricsServer(std::unique_ptr<rtc::Thread> thread,
+                             rtc::PhysicalSocketServer* socket_server,
+                             webrtc::TimeDelta refresh_interval,
+                             Renderer renderer)
+    : thread_(std::move(thread)),
+      socket_server_(socket_server),
+      refresh_interval_(refresh_interval),
+      renderer_(std::move(renderer)) {}
+
+MetricsServer::~MetricsServer() {
+  thread_->BlockingCall([this] {
+    RTC_DCHECK_RUN_ON(thread_.get());
+    for (auto& entry : connections_) {
+      socket_server_->Remove(entry.first);
+    }
+    connections_.clear();
+    if (listener_) {
+      socket_server_->Remove(listener_.get());
+      listener_.reset();
+    }
+  });
+  // Drops the pending refresh.
+  thread_->Stop();
+}
+
+bool MetricsServer::Listen(const rtc::SocketAddress& address) {
+  RTC_DCHECK_RUN_ON(thread_.get());
+
+  sockaddr_storage addr;
+  socklen_t addr_len = address.ToSockAddrStorage(&addr);
+  if (addr_len == 0) {
+    RTC_LOG(LS_ERROR) << "Invalid metrics address " << address.ToString();
+    return false;
+  }
+  int fd = socket(addr.ss_family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC,
+                  IPPROTO_TCP);
+  if (fd < 0) {
+    RTC_LOG_ERR(LS_ERROR) << "socket() failed";
+    return false;
+  }
+  int one = 1;
+  setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+  if (bind(fd, reinterpret_cast<const sockaddr*>(&addr), addr_len) < 0 ||
+      listen(fd, SOMAXCONN) < 0) {
+    RTC_LOG_ERR(LS_ERROR) << "Cannot listen on " << address.ToString();
+    close(fd);
+    return false;
+  }
+  addr_len = sizeof(addr);
+  getsockname(fd, reinterpret_cast<sockaddr*>(&addr), &addr_len);
+  rtc::SocketAddressFromSockAddrStorage(addr, &address_);
+
+  listener_ = std::make_unique<Listener>(this, fd);
+  socket_server_->Add(listener_.get());
+  RTC_LOG(LS_INFO) << "Serving metrics on " << address_.ToString();
+  return true;
+}
+
+void MetricsServer::Refresh() {
+  RTC_DCHECK_RUN_ON(thread_.get());
+
+  page_ = renderer_();
+  thread_->PostDelayedTask([this] { Refresh(); }, refresh_interval_);
+}
+
+void MetricsServer::OnAccept(int fd) {
+  RTC_DCHECK_RUN_ON(thread_.get());
+
+  if (connections_.size() >= kMaxConnections) {
+    close(fd);
+    return;
+  }
+  auto connection = std::make_unique<Connection>(this, fd);
+  Connection* connection_ptr = connection.get();
+  connections_[connection_ptr] = std::move(connection);
+  socket_server_->Add(connection_ptr);
+  thread_->PostDelayedTask([this, connection_ptr] { Expire(connection_ptr); },
+                           kConnectionTimeout);
+}
+
+void MetricsServer::Expire(Connection* connection) {
+  RTC_DCHECK_RUN_ON(thread_.get());
+
+  // The connection may be gone, and its address taken by a newer one.
+  auto it = connections_.find(connection);
+  if (it != connections_.end() &&
+      rtc::TimeMillis() - it->second->accept_time_ms() >=
+          kConnectionTimeout.ms()) {
+    CloseConnection(connection);
+  }
+}
+
+std::string MetricsServer::Respond(const std::string& request) const {
+  RTC_DCHECK_RUN_ON(thread_.get());
+
+  if (!absl::StartsWith(request, "GET ")) {
+    return HttpResponse("405 Method Not Allowed", "text/plain", "");
+  }
+  if (!absl::StartsWith(request, "GET /metrics ") &&
+      !absl::StartsWith(request, "GET / ")) {
+    return HttpResponse("404 Not Found", "text/plain", "");
+  }
+  return HttpResponse("200 OK", "text/plain; version=0.0.4", page_);
+}
+
+void MetricsServer::CloseConnection(Connection* connection) {
+  RTC_DCHECK_RUN_ON(thread_.get());
+
+  auto it = connections_.find(connection);
+  if (it == connections_.end()) {
+    return;
+  }
+  socket_server_->Remove(connection);
+  // Destroyed once its OnEvent() has returned.
+  thread_->PostTask([closed = std::move(it->second)] {});
+  connections_.erase(it);
+}
+
+}  // namespace webrtc_examples
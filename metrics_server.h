@@ -0,0 +1,118 @@
+/*
+ *  Copyright 2023 The WebRTC Project Authors. All rights reserved.
+ *
+ *  Use of this source code is governed by a BSD-style license
+ *  that can be found in the LICENSE file in the root of the source
+ *  tree. An additional intellectual property rights grant can be found
+ *  in the file PATENTS.  All contributing project authors may
+ *  be found in the AUTHORS file in the root of the source tree.
+ */
+
+#ifndef EXAMPLES_VOIPCLIENT_METRICS_SERVER_H_
+#define EXAMPLES_VOIPCLIENT_METRICS_SERVER_H_
+
+#include <stdint.h>
+
+#include <functional>
+#include <map>
+#include <memory>
+#include <set>
+#include <string>
+
+#include "api/units/time_delta.h"
+#include "rtc_base/physical_socket_server.h"
+#include "rtc_base/socket_address.h"
+#include "rtc_base/thread.h"
+
+namespace webrtc_examples {
+
+// Builds a page in the Prometheus text exposition format.
+class MetricsWriter {
+ public:
+  using Labels = std::map<std::string, std::string>;
+
+  // `type` is "counter", "gauge" or "summary". Writes the TYPE line once
+  // per metric name; an empty `type` writes none, for the _sum and _count
+  // samples of a summary. Doubles are written in the shortest form that
+  // reads back exactly; counts are written in full.
+  void Add(const std::string& name,
+           const std::string& type,
+           const Labels& labels,
+           double value);
+  void Add(const std::string& name,
+           const std::string& type,
+           const Labels& labels,
+           uint64_t value);
+
+  const std::string& text() const { return text_; }
+
+ private:
+  void AddSample(const std::string& name,
+                 const std::string& type,
+                 const Labels& labels,
+                 const std::string& value);
+
+  std::set<std::string> typed_names_;
+  std::string text_;
+};
+
+// A minimal HTTP/1.0 server for GET /metrics on its own thread. The page is
+// produced by `renderer` on that thread every `refresh_interval` and kept
+// as a string, so a scrape only copies the latest page and never waits for
+// the threads the renderer reads from. Connections are handled with
+// non-blocking sockets on the thread's socket server, and closed if not
+// done within a few seconds, so idle clients cannot hold every slot.
+class MetricsServer {
+ public:
+  using Renderer = std::function<std::string()>;
+
+  // Listens on `address`; port zero picks a free one. Returns null if the
+  // address cannot be bound.
+  static std::unique_ptr<MetricsServer> Create(
+      const rtc::SocketAddress& address,
+      webrtc::TimeDelta refresh_interval,
+      Renderer renderer);
+
+  // Closes all connections and stops the thread.
+  ~MetricsServer();
+
+  MetricsServer(const MetricsServer&) = delete;
+  MetricsServer& operator=(const MetricsServer&) = delete;
+
+  // The bound address, with the port actually in use.
+  const rtc::SocketAddress& address() const { return address_; }
+
+ private:
+  class Listener;
+  class Connection;
+
+  MetricsServer(std::unique_ptr<rtc::Thread> thread,
+                rtc::PhysicalSocketServer* socket_server,
+                webrtc::TimeDelta refresh_interval,
+                Renderer renderer);
+
+  bool Listen(const rtc::SocketAddress& address);
+  void Refresh();
+  void OnAccept(int fd);
+  // Closes `connection` if it has outlived the timeout.
+  void Expire(Connection* connection);
+  // Builds the response for a complete request head.
+  std::string Respond(const std::string& request) const;
+  void CloseConnection(Connection* connection);
+
+  std::unique_ptr<rtc::Thread> thread_;
+  // Owned by `thread_`.
+  rtc::PhysicalSocketServer* const socket_server_;
+  const webrtc::TimeDelta refresh_interval_;
+  const Renderer renderer_;
+  rtc::SocketAddress address_;
+
+  std::unique_ptr<Listener> listener_ RTC_GUARDED_BY(thread_);
+  std::map<Connection*, std::unique_ptr<Connection>> connections_
+      RTC_GUARDED_BY(thread_);
+  std::string page_ RTC_GUARDED_BY(thread_);
+};
+
+}  // namespace webrtc_examples
+
+#endif  // EXAMPLES_VOIPCLIENT_METRICS_SERVER_H_
@@ -0,0 +1,173 @@
+/*
+ *  Copyright 2023 The WebRTC Project Authors. All rights reserved.
+ *
+ *  Use of this source code is governed by a BSD-style license
+ *  that can be found in the LICENSE file in the root of the source
+ *  tree. An additional intellectual property rights grant can be found
+ *  in the file PATENTS.  All contributing project authors may
+ *  be found in the AUTHORS file in the root of the source tree.
+ */
+
+#include "examples/voipclient/monitored_thread.h"
+
+#include <algorithm>
+#include <utility>
+
+#include "rtc_base/logging.h"
+#include "rtc_base/time_utils.h"
+
+namespace webrtc_examples {
+
+namespace {
+
+constexpr size_t kMaxSlowTasks = 32;
+
+thread_local const char* g_task_name = nullptr;
+
+// Raises `maximum` to `value` if it is lower.
+template <typename T>
+void UpdateMaximum(std::atomic<T>& maximum, T value) {
+  T current = maximum.load(std::memory_order_relaxed);
+  while (current < value &&
+         !maximum.compare_exchange_weak(current, value,
+                                        std::memory_order_relaxed)) {
+  }
+}
+
+}  // namespace
+
+ScopedTaskName::ScopedTaskName(const char* name) : previous_(g_task_name) {
+  g_task_name = name;
+}
+
+ScopedTaskName::~ScopedTaskName() {
+  g_task_name = previous_;
+}
+
+const char* ScopedTaskName::Current() {
+  return g_task_name ? g_task_name : "unnamed";
+}
+
+MonitoredThread::MonitoredThread(
+    std::unique_ptr<rtc::SocketServer> socket_server,
+    const Options& options)
+    : rtc::Thread(std::move(socket_server)), options_(options) {}
+
+MonitoredThread::~MonitoredThread() {
+  Stop();
+}
+
+MonitoredThread::Stats MonitoredThread::GetStats() const {
+  Stats stats;
+  stats.queue_depth = queue_depth_.load(std::memory_order_relaxed);
+  stats.max_queue_depth = max_queue_depth_.load(std::memory_order_relaxed);
+  stats.tasks_run = tasks_run_.load(std::memory_order_relaxed);
+  stats.max_queue_delay = webrtc::TimeDelta::Micros(
+      max_queue_delay_us_.load(std::memory_order_relaxed));
+  stats.slow_tasks = slow_task_count_.load(std::memory_order_relaxed);
+  stats.backlog_events = backlog_events_.load(std::memory_order_relaxed);
+  return stats;
+}
+
+std::vector<MonitoredThread::SlowTask> MonitoredThread::GetSlowTasks()
+    const {
+  webrtc::MutexLock lock(&mutex_);
+  return std::vector<SlowTask>(slow_tasks_.begin(), slow_tasks_.end());
+}
+
+void MonitoredThread::PostTaskImpl(absl::AnyInvocable<void() &&> task,
+                                   const PostTaskTraits& traits,
+                                   const webrtc::Location& location) {
+  if (!options_.enabled) {
+    rtc::Thread::PostTaskImpl(std::move(task), traits, location);
+    return;
+  }
+  const size_t depth =
+      queue_depth_.fetch_add(1, std::memory_order_relaxed) + 1;
+  UpdateMaximum(max_queue_depth_, depth);
+  rtc::Thread::PostTaskImpl(
+      [this, task = std::move(task), name = ScopedTaskName::Current(),
+       due_us = rtc::TimeMicros()]() mutable {
+        RunTask(std::move(task), name, due_us, /*queued=*/true);
+      },
+      traits, location);
+}
+
+void MonitoredThread::PostDelayedTaskImpl(
+    absl::AnyInvocable<void() &&> task,
+    webrtc::TimeDelta delay,
+    const PostDelayedTaskTraits& traits,
+    const webrtc::Location& location) {
+  if (!options_.enabled) {
+    rtc::Thread::PostDelayedTaskImpl(std::move(task), delay, traits,
+                                     location);
+    return;
+  }
+  // Not counted in the queue depth, as it is not runnable before its delay
+  // has passed; its lateness still counts as queue delay.
+  rtc::Thread::PostDelayedTaskImpl(
+      [this, task = std::move(task), name = ScopedTaskName::Current(),
+       due_us = rtc::TimeMicros() + delay.us()]() mutable {
+        RunTask(std::move(task), name, due_us, /*queued=*/false);
+      },
+      delay, traits, location);
+}
+
+void MonitoredThread::RunTask(absl::AnyInvocable<void() &&> task,
+                              const char* name,
+                              int64_t due_us,
+                              bool queued) {
+  const int64_t start_us = rtc::TimeMicros();
+  const int64_t delay_us = std::max<int64_t>(0, start_us - due_us);
+  size_t depth = queue_depth_.load(std::memory_order_relaxed);
+  if (queued) {
+    depth = queue_depth_.fetch_sub(1, std::memory_order_relaxed) - 1;
+  }
+  tasks_run_.fetch_add(1, std::memory_order_relaxed);
+  UpdateMaximum(max_queue_delay_us_, delay_us);
+
+  const webrtc::TimeDelta delay = webrtc::TimeDelta::Micros(delay_us);
+  if (!backlogged_ &&
+      (delay > options_.backlog_delay || depth > options_.backlog_depth)) {
+    backlogged_ = true;
+    backlog_events_.fetch_add(1, std::memory_order_relaxed);
+    RTC_LOG(LS_WARNING) << name_for_logging() << " backlogged: " << depth
+                        << " tasks queued, " << name << " waited "
+                        << delay.ms() << " ms";
+    if (options_.on_backlog) {
+      Backlog backlog;
+      backlog.thread_name = name_for_logging();
+      backlog.task_name = name;
+      backlog.queue_depth = depth;
+      backlog.queue_delay = delay;
+      options_.on_backlog(backlog);
+    }
+  } else if (backlogged_ && delay < options_.backlog_delay / 2 &&
+             depth < options_.backlog_depth / 2) {
+    backlogged_ = false;
+  }
+
+  std::move(task)();
+
+  const int64_t end_us = rtc::TimeMicros();
+  const webrtc::TimeDelta duration =
+      webrtc::TimeDelta::Micros(end_us - start_us);
+  if (duration > options_.slow_task_duration) {
+    slow_task_count_.fetch_add(1, std::memory_order_relaxed);
+    RTC_LOG(LS_WARNING) << "Slow task " << name << " on "
+                        << name_for_logging() << ": ran " << duration.ms()
+                        << " ms after waiting " << delay.ms() << " ms";
+    SlowTask slow_task;
+    slow_task.name = name;
+    slow_task.duration = duration;
+    slow_task.queue_delay = delay;
+    slow_task.end_time_ms = end_us / rtc::kNumMicrosecsPerMillisec;
+    webrtc::MutexLock lock(&mutex_);
+    slow_tasks_.push_back(std::move(slow_task));
+    if (slow_tasks_.size() > kMaxSlowTasks) {
+      slow_tasks_.pop_front();
+    }
+  }
+}
+
+}  // namespace webrtc_examples
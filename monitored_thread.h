@@ -0,0 +1,141 @@
+/*
+ *  Copyright 2023 The WebRTC Project Authors. All rights reserved.
+ *
+ *  Use of this source code is governed by a BSD-style license
+ *  that can be found in the LICENSE file in the root of the source
+ *  tree. An additional intellectual property rights grant can be found
+ *  in the file PATENTS.  All contributing project authors may
+ *  be found in the AUTHORS file in the root of the source tree.
+ */
+
+#ifndef EXAMPLES_VOIPCLIENT_MONITORED_THREAD_H_
+#define EXAMPLES_VOIPCLIENT_MONITORED_THREAD_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <atomic>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "absl/functional/any_invocable.h"
+#include "api/units/time_delta.h"
+#include "rtc_base/socket_server.h"
+#include "rtc_base/synchronization/mutex.h"
+#include "rtc_base/thread.h"
+
+namespace webrtc_examples {
+
+// An rtc::Thread that watches its own task queue: how many posted tasks
+// are waiting, how long each waited past the time it was due, and how long
+// it ran. Tasks that run long are logged by name, see ScopedTaskName, and
+// a callback fires when the queue falls behind.
+//
+// Monitoring wraps every posted task, which costs an allocation per task,
+// so it is off unless Options::enabled is set.
+class MonitoredThread : public rtc::Thread {
+ public:
+  struct Backlog {
+    std::string thread_name;
+    // Name of the task whose wait crossed the threshold.
+    std::string task_name;
+    size_t queue_depth = 0;
+    webrtc::TimeDelta queue_delay = webrtc::TimeDelta::Zero();
+  };
+
+  struct Options {
+    bool enabled = false;
+    // The thread is backlogged once a task starts more than
+    // `backlog_delay` after it was due, or more than `backlog_depth`
+    // tasks are waiting. It recovers when both fall below half of that.
+    webrtc::TimeDelta backlog_delay = webrtc::TimeDelta::Millis(20);
+    size_t backlog_depth = 1000;
+    // Called on the thread each time it becomes backlogged.
+    std::function<void(const Backlog&)> on_backlog;
+    // Tasks running longer than this are logged and kept for
+    // GetSlowTasks().
+    webrtc::TimeDelta slow_task_duration = webrtc::TimeDelta::Millis(5);
+  };
+
+  struct SlowTask {
+    std::string name;
+    webrtc::TimeDelta duration = webrtc::TimeDelta::Zero();
+    webrtc::TimeDelta queue_delay = webrtc::TimeDelta::Zero();
+    // rtc::TimeMillis() when the task finished.
+    int64_t end_time_ms = 0;
+  };
+
+  struct Stats {
+    // Tasks posted and not yet started, excluding delayed tasks that are
+    // not due yet.
+    size_t queue_depth = 0;
+    size_t max_queue_depth = 0;
+    uint64_t tasks_run = 0;
+    webrtc::TimeDelta max_queue_delay = webrtc::TimeDelta::Zero();
+    uint64_t slow_tasks = 0;
+    uint64_t backlog_events = 0;
+  };
+
+  MonitoredThread(std::unique_ptr<rtc::SocketServer> socket_server,
+                  const Options& options);
+  ~MonitoredThread() override;
+
+  // Safe to call from any thread. All zero when monitoring is disabled.
+  Stats GetStats() const;
+  // The most recent slow tasks, oldest first. Safe to call from any thread.
+  std::vector<SlowTask> GetSlowTasks() const;
+
+ protected:
+  void PostTaskImpl(absl::AnyInvocable<void() &&> task,
+                    const PostTaskTraits& traits,
+                    const webrtc::Location& location) override;
+  void PostDelayedTaskImpl(absl::AnyInvocable<void() &&> task,
+                           webrtc::TimeDelta delay,
+                           const PostDelayedTaskTraits& traits,
+                           const webrtc::Location& location) override;
+
+ private:
+  void RunTask(absl::AnyInvocable<void() &&> task,
+               const char* name,
+               int64_t due_us,
+               bool queued);
+
+  const Options options_;
+
+  std::atomic<size_t> queue_depth_{0};
+  std::atomic<size_t> max_queue_depth_{0};
+  std::atomic<uint64_t> tasks_run_{0};
+  std::atomic<int64_t> max_queue_delay_us_{0};
+  std::atomic<uint64_t> slow_task_count_{0};
+  std::atomic<uint64_t> backlog_events_{0};
+  // Only touched by tasks, i.e. on this thread.
+  bool backlogged_ = false;
+
+  mutable webrtc::Mutex mutex_;
+  std::deque<SlowTask> slow_tasks_ RTC_GUARDED_BY(mutex_);
+};
+
+// Names the tasks the current thread posts while in scope, for the slow
+// task log and backlog reports of MonitoredThread. `name` must be a string
+// literal.
+class ScopedTaskName {
+ public:
+  explicit ScopedTaskName(const char* name);
+  ~ScopedTaskName();
+
+  ScopedTaskName(const ScopedTaskName&) = delete;
+  ScopedTaskName& operator=(const ScopedTaskName&) = delete;
+
+  // The innermost name in scope on this thread, or "unnamed".
+  static const char* Current();
+
+ private:
+  const char* const previous_;
+};
+
+}  // namespace webrtc_examples
+
+#endif  // EXAMPLES_VOIPCLIENT_MONITORED_THREAD_H_
@@ -0,0 +1,240 @@
+/*
+ *  Copyright 2023 The WebRTC Project Authors. All rights reserved.
+ *
+ *  Use of this source code is governed by a BSD-style license
+ *  that can be found in the LICENSE file in the root of the source
+ *  tree. An additional intellectual property rights grant can be found
+ *  in the file PATENTS.  All contributing project authors may
+ *  be found in the AUTHORS file in the root of the source tree.
+ */
+
+#include "examples/voipclient/network_emulator.h"
+
+#include <string.h>
+
+#include <algorithm>
+#include <cmath>
+#include <utility>
+
+#include "rtc_base/checks.h"
+#include "rtc_base/time_utils.h"
+
+namespace webrtc_examples {
+
+namespace {
+
+// Shape of the Pareto excess delay; above 2 so that its variance is finite.
+constexpr double kParetoShape = 3.0;
+
+}  // namespace
+
+void NetworkEmulator::Stats::Accumulate(const Stats& other) {
+  packets_in += other.packets_in;
+  packets_out += other.packets_out;
+  lost += other.lost;
+  queue_drops += other.queue_drops;
+  reordered += other.reordered;
+  duplicated += other.duplicated;
+}
+
+NetworkEmulator::NetworkEmulator(const Options& options, rtc::Thread* thread)
+    : options_(options), thread_(thread), random_(options.seed) {}
+
+NetworkEmulator::~NetworkEmulator() = default;
+
+NetworkEmulator::Stats NetworkEmulator::GetStats() const {
+  Stats stats;
+  stats.packets_in = counters_.packets_in.load(std::memory_order_relaxed);
+  stats.packets_out = counters_.packets_out.load(std::memory_order_relaxed);
+  stats.lost = counters_.lost.load(std::memory_order_relaxed);
+  stats.queue_drops = counters_.queue_drops.load(std::memory_order_relaxed);
+  stats.reordered = counters_.reordered.load(std::memory_order_relaxed);
+  stats.duplicated = counters_.duplicated.load(std::memory_order_relaxed);
+  return stats;
+}
+
+int NetworkEmulator::Open(const sockaddr* address,
+                          socklen_t address_length,
+                          bool reuse_port) {
+  RTC_DCHECK_RUN_ON(thread_);
+  int fd =
+      MediaSocket::SocketCalls::Open(address, address_length, reuse_port);
+  if (fd >= 0) {
+    sockets_[fd].generation = next_generation_++;
+  }
+  return fd;
+}
+
+void NetworkEmulator::Close(int fd) {
+  RTC_DCHECK_RUN_ON(thread_);
+  // Datagrams of the socket still in flight are dropped on delivery, by
+  // their generation.
+  sockets_.erase(fd);
+  MediaSocket::SocketCalls::Close(fd);
+}
+
+int NetworkEmulator::SendMessages(int fd,
+                                  mmsghdr* messages,
+                                  unsigned int count) {
+  RTC_DCHECK_RUN_ON(thread_);
+  for (unsigned int i = 0; i < count; ++i) {
+    const msghdr& header = messages[i].msg_hdr;
+    // Each iovec is one datagram, also in the UDP_SEGMENT messages
+    // MediaSocket builds.
+    size_t bytes = 0;
+    for (size_t j = 0; j < header.msg_iovlen; ++j) {
+      const iovec& iov = header.msg_iov[j];
+      Impair(fd, iov.iov_base, iov.iov_len, header.msg_name,
+             header.msg_namelen);
+      bytes += iov.iov_len;
+    }
+    messages[i].msg_len = static_cast<unsigned int>(bytes);
+  }
+  return static_cast<int>(count);
+}
+
+ssize_t NetworkEmulator::SendTo(int fd,
+                                const void* data,
+                                size_t size,
+                                const sockaddr* address,
+                                socklen_t address_length) {
+  RTC_DCHECK_RUN_ON(thread_);
+  Impair(fd, data, size, address, address_length);
+  return static_cast<ssize_t>(size);
+}
+
+void NetworkEmulator::Impair(int fd,
+                             const void* data,
+                             size_t size,
+                             const void* address,
+                             socklen_t address_length) {
+  RTC_DCHECK_RUN_ON(thread_);
+  counters_.packets_in.fetch_add(1, std::memory_order_relaxed);
+  auto socket = sockets_.find(fd);
+  if (socket == sockets_.end() || size > PacketBuffer::kCapacity) {
+    // Not opened through the emulator, so there is nothing to order it
+    // against, or too large to hold; written unimpaired.
+    MediaSocket::SocketCalls::SendTo(
+        fd, data, size, static_cast<const sockaddr*>(address),
+        address_length);
+    counters_.packets_out.fetch_add(1, std::memory_order_relaxed);
+    return;
+  }
+  if (Lose()) {
+    counters_.lost.fetch_add(1, std::memory_order_relaxed);
+    return;
+  }
+
+  const int64_t now_us = rtc::TimeMicros();
+  int64_t departure_us = now_us;
+  if (options_.bandwidth_kbps > 0) {
+    const int64_t start_us = std::max(now_us, link_free_us_);
+    if (start_us - now_us > options_.max_queue_delay.us()) {
+      counters_.queue_drops.fetch_add(1, std::memory_order_relaxed);
+      return;
+    }
+    // Bits over kbit/s gives ms; scaled to us.
+    link_free_us_ = start_us + static_cast<int64_t>(size) * 8 * 1000 /
+                                   options_.bandwidth_kbps;
+    departure_us = link_free_us_;
+  }
+
+  std::uniform_real_distribution<double> uniform(0.0, 1.0);
+  int64_t delivery_us = departure_us + SampleDelayUs();
+  if (options_.reorder_probability > 0 &&
+      uniform(random_) < options_.reorder_probability) {
+    delivery_us = departure_us;
+    counters_.reordered.fetch_add(1, std::memory_order_relaxed);
+  } else if (!options_.allow_reordering) {
+    delivery_us = std::max(delivery_us, socket->second.last_delivery_us);
+    socket->second.last_delivery_us = delivery_us;
+  }
+
+  Datagram datagram;
+  datagram.fd = fd;
+  datagram.generation = socket->second.generation;
+  datagram.address_length = std::min<socklen_t>(
+      address_length, sizeof(datagram.address));
+  memcpy(&datagram.address, address, datagram.address_length);
+  datagram.buffer = PacketBufferPool::Get()->Allocate(
+      static_cast<const uint8_t*>(data), size);
+  datagram.delivery_us = delivery_us;
+
+  if (options_.duplicate_probability > 0 &&
+      uniform(random_) < options_.duplicate_probability) {
+    counters_.duplicated.fetch_add(1, std::memory_order_relaxed);
+    // Shares the buffer, which is only read from here on.
+    Schedule(datagram, now_us);
+  }
+  Schedule(std::move(datagram), now_us);
+}
+
+bool NetworkEmulator::Lose() {
+  RTC_DCHECK_RUN_ON(thread_);
+  std::uniform_real_distribution<double> uniform(0.0, 1.0);
+  if (bad_state_) {
+    bad_state_ = uniform(random_) >= options_.bad_to_good;
+  } else {
+    bad_state_ = uniform(random_) < options_.good_to_bad;
+  }
+  const double loss = bad_state_ ? options_.loss_bad : options_.loss_good;
+  return loss > 0 && uniform(random_) < loss;
+}
+
+int64_t NetworkEmulator::SampleDelayUs() {
+  RTC_DCHECK_RUN_ON(thread_);
+  const double delay_us = options_.delay.us();
+  const double jitter_us = options_.jitter.us();
+  if (jitter_us <= 0) {
+    return std::max<int64_t>(0, options_.delay.us());
+  }
+
+  double sample_us;
+  switch (options_.delay_distribution) {
+    case DelayDistribution::kUniform:
+      sample_us = std::uniform_real_distribution<double>(
+          delay_us - jitter_us, delay_us + jitter_us)(random_);
+      break;
+    case DelayDistribution::kNormal:
+      sample_us =
+          std::normal_distribution<double>(delay_us, jitter_us)(random_);
+      break;
+    case DelayDistribution::kPareto: {
+      const double u = std::uniform_real_distribution<double>(0.0, 1.0)(
+          random_);
+      sample_us =
+          delay_us + jitter_us * (std::pow(1.0 - u, -1.0 / kParetoShape) - 1);
+      break;
+    }
+  }
+  return std::max<int64_t>(0, std::llround(sample_us));
+}
+
+void NetworkEmulator::Schedule(Datagram datagram, int64_t now_us) {
+  RTC_DCHECK_RUN_ON(thread_);
+  const webrtc::TimeDelta delay = webrtc::TimeDelta::Micros(
+      std::max<int64_t>(0, datagram.delivery_us - now_us));
+  datagram.sequence = next_sequence_++;
+  in_flight_.push(std::move(datagram));
+  thread_->PostDelayedHighPrecisionTask([this] { DeliverDue(); }, delay);
+}
+
+void NetworkEmulator::DeliverDue() {
+  RTC_DCHECK_RUN_ON(thread_);
+  const int64_t now_us = rtc::TimeMicros();
+  while (!in_flight_.empty() && in_flight_.top().delivery_us <= now_us) {
+    const Datagram& datagram = in_flight_.top();
+    auto socket = sockets_.find(datagram.fd);
+    if (socket != sockets_.end() &&
+        socket->second.generation == datagram.generation) {
+      MediaSocket::SocketCalls::SendTo(
+          datagram.fd, datagram.buffer->data(), datagram.buffer->size(),
+          reinterpret_cast<const sockaddr*>(&datagram.address),
+          datagram.address_length);
+      counters_.packets_out.fetch_add(1, std::memory_order_relaxed);
+    }
+    in_flight_.pop();
+  }
+}
+
+}  // namespace webrtc_examples
@@ -0,0 +1,200 @@
+/*
+ *  Copyright 2023 The WebRTC Project Authors. All rights reserved.
+ *
+ *  Use of this source code is governed by a BSD-style license
+ *  that can be found in the LICENSE file in the root of the source
+ *  tree. An additional intellectual property rights grant can be found
+ *  in the file PATENTS.  All contributing project authors may
+ *  be found in the AUTHORS file in the root of the source tree.
+ */
+
+#ifndef EXAMPLES_VOIPCLIENT_NETWORK_EMULATOR_H_
+#define EXAMPLES_VOIPCLIENT_NETWORK_EMULATOR_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/socket.h>
+
+#include <atomic>
+#include <queue>
+#include <random>
+#include <unordered_map>
+#include <vector>
+
+#include "api/scoped_refptr.h"
+#include "api/units/time_delta.h"
+#include "examples/voipclient/media_socket.h"
+#include "examples/voipclient/packet_buffer_pool.h"
+#include "rtc_base/thread.h"
+#include "rtc_base/thread_annotations.h"
+
+namespace webrtc_examples {
+
+// Impairs the datagrams MediaSockets write, in process, so that jitter
+// buffer behaviour and CPU cost under bad networks can be measured on one
+// machine. Installed as the sockets' MediaSocket::SocketCalls, it takes
+// each outgoing datagram off the send path into a pooled PacketBuffer and
+// writes it from a task posted to the sockets' thread once the emulated
+// link has delivered it, with the following applied in order:
+//
+//   loss:       Gilbert-Elliott two-state model, for bursty loss;
+//   bandwidth:  a rate-limited link with a bounded queue;
+//   delay:      a base delay plus jitter from the chosen distribution;
+//   reordering: optionally, a packet skipping the delay;
+//   duplication.
+//
+// Incoming datagrams are not touched; impair the peer's sockets to affect
+// the other direction.
+//
+// An emulator serves the sockets of one thread, such as a MediaShard's, and
+// keeps its state unlocked on that thread, so threads with an emulator each
+// never wait for another's sends.
+class NetworkEmulator : public MediaSocket::SocketCalls {
+ public:
+  enum class DelayDistribution {
+    // Uniform in [delay - jitter, delay + jitter].
+    kUniform,
+    // Normal around `delay` with standard deviation `jitter`.
+    kNormal,
+    // `delay` plus a heavy-tailed Pareto excess with scale `jitter`, for
+    // the occasional long delay spike of wireless links.
+    kPareto,
+  };
+
+  struct Options {
+    webrtc::TimeDelta delay = webrtc::TimeDelta::Zero();
+    webrtc::TimeDelta jitter = webrtc::TimeDelta::Zero();
+    DelayDistribution delay_distribution = DelayDistribution::kNormal;
+    // When false, jitter never lets a datagram overtake an earlier one of
+    // the same socket, as on a single path.
+    bool allow_reordering = false;
+    // Probability of a datagram skipping the delay, arriving ahead of
+    // those sent before it.
+    double reorder_probability = 0;
+    double duplicate_probability = 0;
+
+    // Gilbert-Elliott loss: per-datagram probabilities of moving between
+    // the good and bad states, and of losing a datagram in each. The
+    // defaults never enter the bad state and lose nothing; setting only
+    // `loss_good` gives independent random loss.
+    double good_to_bad = 0;
+    double bad_to_good = 1;
+    double loss_good = 0;
+    double loss_bad = 1;
+
+    // Rate of the link the emulator's sockets share; zero is unlimited.
+    // Datagrams that would wait longer than `max_queue_delay` for it are
+    // dropped.
+    int bandwidth_kbps = 0;
+    webrtc::TimeDelta max_queue_delay = webrtc::TimeDelta::Millis(500);
+
+    // Makes runs with the same traffic reproducible.
+    uint32_t seed = 1;
+  };
+
+  struct Stats {
+    uint64_t packets_in = 0;
+    uint64_t packets_out = 0;
+    uint64_t lost = 0;
+    uint64_t queue_drops = 0;
+    uint64_t reordered = 0;
+    uint64_t duplicated = 0;
+
+    void Accumulate(const Stats& other);
+  };
+
+  // Every SocketCalls method must be called on `thread`, which delivers the
+  // datagrams. Datagrams still in flight when the emulator goes away are
+  // dropped; destroy it only once `thread` has stopped, as their delivery
+  // tasks refer to it.
+  NetworkEmulator(const Options& options, rtc::Thread* thread);
+  ~NetworkEmulator() override;
+
+  NetworkEmulator(const NetworkEmulator&) = delete;
+  NetworkEmulator& operator=(const NetworkEmulator&) = delete;
+
+  // Safe to call from any thread.
+  Stats GetStats() const;
+
+  // MediaSocket::SocketCalls implementation.
+  int Open(const sockaddr* address,
+           socklen_t address_length,
+           bool reuse_port) override;
+  void Close(int fd) override;
+  int SendMessages(int fd, mmsghdr* messages, unsigned int count) override;
+  ssize_t SendTo(int fd,
+                 const void* data,
+                 size_t size,
+                 const sockaddr* address,
+                 socklen_t address_length) override;
+
+ private:
+  struct Datagram {
+    int fd;
+    // Of the descriptor's Open(); a datagram outliving its socket is
+    // dropped rather than written to a reused descriptor number.
+    uint64_t generation;
+    sockaddr_storage address;
+    socklen_t address_length;
+    rtc::scoped_refptr<PacketBuffer> buffer;
+    int64_t delivery_us;
+    // Emulator-wide send order, breaking ties between delivery times.
+    uint64_t sequence;
+  };
+
+  // Orders `in_flight_` so that the earliest datagram is on top.
+  struct DeliversLater {
+    bool operator()(const Datagram& a, const Datagram& b) const {
+      return a.delivery_us != b.delivery_us ? a.delivery_us > b.delivery_us
+                                            : a.sequence > b.sequence;
+    }
+  };
+
+  // Written on the thread, read by any.
+  struct Counters {
+    std::atomic<uint64_t> packets_in{0};
+    std::atomic<uint64_t> packets_out{0};
+    std::atomic<uint64_t> lost{0};
+    std::atomic<uint64_t> queue_drops{0};
+    std::atomic<uint64_t> reordered{0};
+    std::atomic<uint64_t> duplicated{0};
+  };
+
+  struct SocketState {
+    uint64_t generation = 0;
+    // Latest delivery time scheduled, for `allow_reordering`.
+    int64_t last_delivery_us = 0;
+  };
+
+  void Impair(int fd,
+              const void* data,
+              size_t size,
+              const void* address,
+              socklen_t address_length);
+  bool Lose();
+  int64_t SampleDelayUs();
+  void Schedule(Datagram datagram, int64_t now_us);
+  void DeliverDue();
+
+  const Options options_;
+  rtc::Thread* const thread_;
+
+  std::mt19937 random_ RTC_GUARDED_BY(thread_);
+  bool bad_state_ RTC_GUARDED_BY(thread_) = false;
+  // Time the link finishes sending what is queued on it.
+  int64_t link_free_us_ RTC_GUARDED_BY(thread_) = 0;
+  uint64_t next_generation_ RTC_GUARDED_BY(thread_) = 1;
+  uint64_t next_sequence_ RTC_GUARDED_BY(thread_) = 0;
+  std::unordered_map<int, SocketState> sockets_ RTC_GUARDED_BY(thread_);
+  // Every datagram has a task posted for its delivery time, which writes
+  // all that are due, so the order does not depend on how the thread rounds
+  // delays. A heap over a vector, so that steady traffic allocates nothing
+  // beyond the pooled buffers.
+  std::priority_queue<Datagram, std::vector<Datagram>, DeliversLater>
+      in_flight_ RTC_GUARDED_BY(thread_);
+  Counters counters_;
+};
+
+}  // namespace webrtc_examples
+
+#endif  // EXAMPLES_VOIPCLIENT_NETWORK_EMULATOR_H_
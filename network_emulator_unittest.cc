@@ -0,0 +1,246 @@
+/*
+ *  Copyright 2023 The WebRTC Project Authors. All rights reserved.
+ *
+ *  Use of this source code is governed by a BSD-style license
+ *  that can be found in the LICENSE file in the root of the source
+ *  tree. An additional intellectual property rights grant can be found
+ *  in the file PATENTS.  All contributing project authors may
+ *  be found in the AUTHORS file in the root of the source tree.
+ */
+
+#include "examples/voipclient/network_emulator.h"
+
+#include <poll.h>
+#include <stdint.h>
+#include <sys/socket.h>
+
+#include <memory>
+#include <vector>
+
+#include "api/units/time_delta.h"
+#include "rtc_base/socket_address.h"
+#include "rtc_base/thread.h"
+#include "rtc_base/time_utils.h"
+#include "test/gtest.h"
+
+namespace webrtc_examples {
+namespace {
+
+using webrtc::TimeDelta;
+
+constexpr int kPollTimeoutMs = 1000;
+constexpr size_t kPacketSize = 100;
+
+// Sends through an emulator on its own thread to a plain socket.
+class NetworkEmulatorTest : public ::testing::Test {
+ protected:
+  NetworkEmulatorTest() : thread_(rtc::Thread::Create()) {
+    thread_->Start();
+    receiver_fd_ = Bind(&default_calls_, &receiver_address_);
+  }
+
+  ~NetworkEmulatorTest() override {
+    CloseSender();
+    // Datagrams still in flight refer to their emulators.
+    thread_->Stop();
+    default_calls_.Close(receiver_fd_);
+  }
+
+  // Makes a new emulator current and opens a sender through it. Earlier
+  // ones live on until the thread has stopped.
+  void CreateEmulator(const NetworkEmulator::Options& options) {
+    CloseSender();
+    emulators_.push_back(
+        std::make_unique<NetworkEmulator>(options, thread_.get()));
+    emulator_ = emulators_.back().get();
+    OpenSender();
+  }
+
+  void OpenSender() {
+    thread_->BlockingCall([&] {
+      rtc::SocketAddress address;
+      sender_fd_ = Bind(emulator_, &address);
+    });
+    ASSERT_GE(sender_fd_, 0);
+  }
+
+  void CloseSender() {
+    if (sender_fd_ >= 0) {
+      thread_->BlockingCall([&] { emulator_->Close(sender_fd_); });
+      sender_fd_ = -1;
+    }
+  }
+
+  // Sends `count` datagrams numbered from zero to the receiver. Returns
+  // which of them the emulator dropped for loss.
+  std::vector<bool> Send(int count) {
+    return thread_->BlockingCall([&] {
+      std::vector<bool> lost;
+      sockaddr_storage address;
+      socklen_t length = receiver_address_.ToSockAddrStorage(&address);
+      uint8_t packet[kPacketSize] = {};
+      for (int i = 0; i < count; ++i) {
+        packet[0] = static_cast<uint8_t>(i);
+        const uint64_t lost_before = emulator_->GetStats().lost;
+        emulator_->SendTo(sender_fd_, packet, sizeof(packet),
+                          reinterpret_cast<sockaddr*>(&address), length);
+        lost.push_back(emulator_->GetStats().lost > lost_before);
+      }
+      return lost;
+    });
+  }
+
+  // Returns the first byte of each datagram received until none arrives
+  // for `timeout_ms`.
+  std::vector<uint8_t> Receive(int timeout_ms = kPollTimeoutMs) {
+    std::vector<uint8_t> received;
+    pollfd fds = {receiver_fd_, POLLIN, 0};
+    uint8_t packet[kPacketSize];
+    while (poll(&fds, 1, timeout_ms) == 1) {
+      if (recv(receiver_fd_, packet, sizeof(packet), 0) > 0) {
+        received.push_back(packet[0]);
+      }
+    }
+    return received;
+  }
+
+  const std::unique_ptr<rtc::Thread> thread_;
+  MediaSocket::SocketCalls default_calls_;
+  int receiver_fd_ = -1;
+  rtc::SocketAddress receiver_address_;
+  std::vector<std::unique_ptr<NetworkEmulator>> emulators_;
+  NetworkEmulator* emulator_ = nullptr;
+  int sender_fd_ = -1;
+
+ private:
+  static int Bind(MediaSocket::SocketCalls* calls,
+                  rtc::SocketAddress* address) {
+    sockaddr_storage storage;
+    socklen_t length =
+        rtc::SocketAddress("127.0.0.1", 0).ToSockAddrStorage(&storage);
+    int fd = calls->Open(reinterpret_cast<sockaddr*>(&storage), length,
+                         /*reuse_port=*/false);
+    if (fd >= 0 &&
+        getsockname(fd, reinterpret_cast<sockaddr*>(&storage), &length) ==
+            0) {
+      rtc::SocketAddressFromSockAddrStorage(storage, address);
+    }
+    return fd;
+  }
+};
+
+int CountLost(const std::vector<bool>& lost) {
+  int count = 0;
+  for (bool packet_lost : lost) {
+    count += packet_lost ? 1 : 0;
+  }
+  return count;
+}
+
+TEST_F(NetworkEmulatorTest, DefaultsDeliverEverythingInOrder) {
+  CreateEmulator(NetworkEmulator::Options());
+  EXPECT_EQ(CountLost(Send(50)), 0);
+
+  std::vector<uint8_t> received = Receive();
+  ASSERT_EQ(received.size(), 50u);
+  for (size_t i = 0; i < received.size(); ++i) {
+    EXPECT_EQ(received[i], i);
+  }
+  NetworkEmulator::Stats stats = emulator_->GetStats();
+  EXPECT_EQ(stats.packets_in, 50u);
+  EXPECT_EQ(stats.packets_out, 50u);
+  EXPECT_EQ(stats.lost, 0u);
+}
+
+TEST_F(NetworkEmulatorTest, DelayHoldsDatagramsBack) {
+  NetworkEmulator::Options options;
+  options.delay = TimeDelta::Millis(100);
+  CreateEmulator(options);
+
+  const int64_t start_ms = rtc::TimeMillis();
+  Send(1);
+  EXPECT_TRUE(Receive(/*timeout_ms=*/20).empty());
+  EXPECT_EQ(Receive().size(), 1u);
+  EXPECT_GE(rtc::TimeMillis() - start_ms, 100);
+}
+
+TEST_F(NetworkEmulatorTest, ClosedSocketDropsDatagramsInFlight) {
+  NetworkEmulator::Options options;
+  options.delay = TimeDelta::Millis(50);
+  CreateEmulator(options);
+
+  Send(5);
+  CloseSender();
+  // Likely to get the same descriptor number back.
+  OpenSender();
+
+  EXPECT_TRUE(Receive(/*timeout_ms=*/200).empty());
+  EXPECT_EQ(emulator_->GetStats().packets_out, 0u);
+}
+
+TEST_F(NetworkEmulatorTest, IndependentLoss) {
+  NetworkEmulator::Options options;
+  options.loss_good = 0.2;
+  CreateEmulator(options);
+
+  const int lost = CountLost(Send(10000));
+  EXPECT_NEAR(lost / 10000.0, 0.2, 0.02);
+  EXPECT_EQ(emulator_->GetStats().lost, static_cast<uint64_t>(lost));
+}
+
+// Losing every datagram in the bad state makes each stay there a loss
+// burst, geometric with mean 1 / bad_to_good, while the fraction of time in
+// it is good_to_bad / (good_to_bad + bad_to_good).
+TEST_F(NetworkEmulatorTest, GilbertElliottLossComesInBursts) {
+  NetworkEmulator::Options options;
+  options.good_to_bad = 0.05;
+  options.bad_to_good = 0.25;
+  options.loss_good = 0;
+  options.loss_bad = 1;
+  CreateEmulator(options);
+
+  const std::vector<bool> lost = Send(20000);
+  int bursts = 0;
+  for (size_t i = 0; i < lost.size(); ++i) {
+    if (lost[i] && (i == 0 || !lost[i - 1])) {
+      ++bursts;
+    }
+  }
+  ASSERT_GT(bursts, 0);
+  EXPECT_NEAR(CountLost(lost) / 20000.0, 0.05 / 0.3, 0.02);
+  EXPECT_NEAR(static_cast<double>(CountLost(lost)) / bursts, 4, 0.5);
+}
+
+TEST_F(NetworkEmulatorTest, SeedMakesLossReproducible) {
+  NetworkEmulator::Options options;
+  options.good_to_bad = 0.05;
+  options.bad_to_good = 0.25;
+  options.loss_good = 0.01;
+  options.loss_bad = 0.8;
+  CreateEmulator(options);
+  const std::vector<bool> first = Send(1000);
+
+  CreateEmulator(options);
+  EXPECT_EQ(Send(1000), first);
+
+  options.seed = 2;
+  CreateEmulator(options);
+  EXPECT_NE(Send(1000), first);
+}
+
+TEST_F(NetworkEmulatorTest, BandwidthLimitDropsWhatWouldQueueTooLong) {
+  NetworkEmulator::Options options;
+  // One byte per ms, so each datagram occupies the link for 100 ms.
+  options.bandwidth_kbps = 8;
+  options.max_queue_delay = TimeDelta::Millis(150);
+  CreateEmulator(options);
+
+  // The first is sent at once and the second waits 100 ms; the rest would
+  // wait longer than allowed.
+  Send(10);
+  EXPECT_EQ(emulator_->GetStats().queue_drops, 8u);
+  EXPECT_EQ(Receive().size(), 2u);
+}
+
+}  // namespace
+}  // namespace webrtc_examples
@@ -0,0 +1,200 @@
+/*
+ *  Copyright 2023 The WebRTC Project Authors. All rights reserved.
+ *
+ *  Use of this source code is governed by a BSD-style license
+ *  that can be found in the LICENSE file in the root of the source
+ *  tree. An additional intellectual property rights grant can be found
+ *  in the file PATENTS.  All contributing project authors may
+ *  be found in the AUTHORS file in the root of the source tree.
+ */
+
+#include "examples/voipclient/packet_buffer_pool.h"
+
+#include <string.h>
+
+#include "rtc_base/checks.h"
+
+namespace webrtc_examples {
+
+namespace {
+
+// Number of buffers moved between a thread's free list and the shared list
+// at a time, and the size the shared list grows by on a miss.
+constexpr size_t kTransferBatch = 32;
+// A thread's free list is spilled back to the shared list once it holds
+// this many buffers, so that buffers allocated on one thread (e.g. the
+// encoder queue) and released on another (e.g. the network thread) keep
+// circulating.
+constexpr size_t kMaxLocalBuffers = 4 * kTransferBatch;
+
+// Set once the calling thread's ThreadCache has been destroyed. Trivially
+// destructible, so it stays readable until the thread is gone.
+thread_local bool g_thread_cache_destroyed = false;
+
+}  // namespace
+
+// There is a single pool per process, so one list per thread is enough.
+struct PacketBufferPool::ThreadCache {
+  ~ThreadCache() {
+    // Hand this thread's buffers back so that other threads can reuse them.
+    if (count > 0) {
+      PacketBufferPool::Get()->Spill(this, count);
+    }
+    g_thread_cache_destroyed = true;
+  }
+
+  PacketBuffer* Pop() {
+    PacketBuffer* buffer = head;
+    if (buffer) {
+      head = buffer->next_free_;
+      buffer->next_free_ = nullptr;
+      --count;
+    }
+    return buffer;
+  }
+
+  void Push(PacketBuffer* buffer) {
+    buffer->next_free_ = head;
+    head = buffer;
+    ++count;
+  }
+
+  PacketBuffer* head = nullptr;
+  size_t count = 0;
+};
+
+PacketBufferPool::ThreadCache* PacketBufferPool::GetThreadCache() {
+  if (g_thread_cache_destroyed) {
+    return nullptr;
+  }
+  thread_local ThreadCache cache;
+  return &cache;
+}
+
+void PacketBuffer::SetSize(size_t size) {
+  RTC_DCHECK_LE(size, kCapacity);
+  size_ = size;
+}
+
+void PacketBuffer::AddRef() const {
+  ref_count_.fetch_add(1, std::memory_order_relaxed);
+}
+
+rtc::RefCountReleaseStatus PacketBuffer::Release() const {
+  if (ref_count_.fetch_sub(1, std::memory_order_acq_rel) != 1) {
+    return rtc::RefCountReleaseStatus::kOtherRefsRemained;
+  }
+  pool_->Recycle(const_cast<PacketBuffer*>(this));
+  return rtc::RefCountReleaseStatus::kDroppedLastRef;
+}
+
+PacketBufferPool* PacketBufferPool::Get() {
+  static PacketBufferPool* const pool = new PacketBufferPool();
+  return pool;
+}
+
+rtc::scoped_refptr<PacketBuffer> PacketBufferPool::Allocate() {
+  ThreadCache* cache = GetThreadCache();
+  PacketBuffer* buffer;
+  if (!cache) {
+    buffer = PopShared();
+  } else if ((buffer = cache->Pop())) {
+    hits_.fetch_add(1, std::memory_order_relaxed);
+  } else {
+    Refill(cache, kTransferBatch);
+    buffer = cache->Pop();
+  }
+  RTC_DCHECK(buffer);
+
+  size_t in_use = in_use_.fetch_add(1, std::memory_order_relaxed) + 1;
+  size_t high_water_mark = high_water_mark_.load(std::memory_order_relaxed);
+  while (in_use > high_water_mark &&
+         !high_water_mark_.compare_exchange_weak(high_water_mark, in_use,
+                                                 std::memory_order_relaxed)) {
+  }
+
+  buffer->size_ = 0;
+  return rtc::scoped_refptr<PacketBuffer>(buffer);
+}
+
+rtc::scoped_refptr<PacketBuffer> PacketBufferPool::Allocate(const uint8_t* data,
+                                                            size_t size) {
+  if (size > PacketBuffer::kCapacity) {
+    return nullptr;
+  }
+  rtc::scoped_refptr<PacketBuffer> buffer = Allocate();
+  memcpy(buffer->data(), data, size);
+  buffer->SetSize(size);
+  return buffer;
+}
+
+PacketBufferPool::Stats PacketBufferPool::GetStats() const {
+  Stats stats;
+  stats.hits = hits_.load(std::memory_order_relaxed);
+  stats.misses = misses_.load(std::memory_order_relaxed);
+  stats.allocated = allocated_.load(std::memory_order_relaxed);
+  stats.in_use = in_use_.load(std::memory_order_relaxed);
+  stats.high_water_mark = high_water_mark_.load(std::memory_order_relaxed);
+  return stats;
+}
+
+void PacketBufferPool::Recycle(PacketBuffer* buffer) {
+  in_use_.fetch_sub(1, std::memory_order_relaxed);
+  ThreadCache* cache = GetThreadCache();
+  if (!cache) {
+    webrtc::MutexLock lock(&mutex_);
+    buffer->next_free_ = shared_free_;
+    shared_free_ = buffer;
+    return;
+  }
+  cache->Push(buffer);
+  if (cache->count > kMaxLocalBuffers) {
+    Spill(cache, kTransferBatch);
+  }
+}
+
+PacketBuffer* PacketBufferPool::PopShared() {
+  webrtc::MutexLock lock(&mutex_);
+  PacketBuffer* buffer = shared_free_;
+  if (!buffer) {
+    misses_.fetch_add(1, std::memory_order_relaxed);
+    allocated_.fetch_add(1, std::memory_order_relaxed);
+    return new PacketBuffer(this);
+  }
+  hits_.fetch_add(1, std::memory_order_relaxed);
+  shared_free_ = buffer->next_free_;
+  buffer->next_free_ = nullptr;
+  return buffer;
+}
+
+void PacketBufferPool::Refill(ThreadCache* cache, size_t count) {
+  webrtc::MutexLock lock(&mutex_);
+  if (!shared_free_) {
+    misses_.fetch_add(1, std::memory_order_relaxed);
+    for (size_t i = 0; i < count; ++i) {
+      cache->Push(new PacketBuffer(this));
+    }
+    allocated_.fetch_add(count, std::memory_order_relaxed);
+    return;
+  }
+  hits_.fetch_add(1, std::memory_order_relaxed);
+  for (size_t i = 0; i < count && shared_free_; ++i) {
+    PacketBuffer* buffer = shared_free_;
+    shared_free_ = buffer->next_free_;
+    cache->Push(buffer);
+  }
+}
+
+void PacketBufferPool::Spill(ThreadCache* cache, size_t count) {
+  webrtc::MutexLock lock(&mutex_);
+  for (size_t i = 0; i < count; ++i) {
+    PacketBuffer* buffer = cache->Pop();
+    if (!buffer) {
+      break;
+    }
+    buffer->next_free_ = shared_free_;
+    shared_free_ = buffer;
+  }
+}
+
+}  // namespace webrtc_examples
@@ -0,0 +1,136 @@
+/*
+ *  Copyright 2023 The WebRTC Project Authors. All rights reserved.
+ *
+ *  Use of this source code is governed by a BSD-style license
+ *  that can be found in the LICENSE file in the root of the source
+ *  tree. An additional intellectual property rights grant can be found
+ *  in the file PATENTS.  All contributing project authors may
+ *  be found in the AUTHORS file in the root of the source tree.
+ */
+
+#ifndef EXAMPLES_VOIPCLIENT_PACKET_BUFFER_POOL_H_
+#define EXAMPLES_VOIPCLIENT_PACKET_BUFFER_POOL_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <atomic>
+
+#include "api/array_view.h"
+#include "api/scoped_refptr.h"
+#include "rtc_base/ref_count.h"
+#include "rtc_base/synchronization/mutex.h"
+
+namespace webrtc_examples {
+
+class PacketBufferPool;
+
+// A fixed-size, MTU-sized buffer holding a single RTP/RTCP packet. Buffers
+// are handed out by PacketBufferPool and are reference counted through
+// rtc::scoped_refptr; dropping the last reference returns the buffer to the
+// pool instead of freeing it.
+class PacketBuffer {
+ public:
+  static constexpr size_t kCapacity = 1500;
+
+  PacketBuffer(const PacketBuffer&) = delete;
+  PacketBuffer& operator=(const PacketBuffer&) = delete;
+
+  uint8_t* data() { return data_; }
+  const uint8_t* data() const { return data_; }
+  size_t size() const { return size_; }
+  void SetSize(size_t size);
+  static constexpr size_t capacity() { return kCapacity; }
+
+  rtc::ArrayView<const uint8_t> view() const {
+    return rtc::ArrayView<const uint8_t>(data_, size_);
+  }
+
+  void AddRef() const;
+  rtc::RefCountReleaseStatus Release() const;
+
+ private:
+  friend class PacketBufferPool;
+
+  explicit PacketBuffer(PacketBufferPool* pool) : pool_(pool) {}
+  ~PacketBuffer() = default;
+
+  PacketBufferPool* const pool_;
+  mutable std::atomic<int> ref_count_{0};
+  size_t size_ = 0;
+  // Intrusive link used while the buffer sits on a free list.
+  PacketBuffer* next_free_ = nullptr;
+  alignas(16) uint8_t data_[kCapacity];
+};
+
+// Process-wide pool of PacketBuffers shared by the send and receive paths.
+// Each thread keeps a small private free list so that the common
+// allocate/release cycle does not take a lock; the shared list is only
+// touched when a thread's list runs empty or overflows. Buffers are never
+// returned to the heap, so the pool only grows to the peak number of packets
+// in flight.
+class PacketBufferPool {
+ public:
+  struct Stats {
+    // Allocations served from a free list.
+    uint64_t hits = 0;
+    // Allocations that had to grow the pool.
+    uint64_t misses = 0;
+    // Buffers owned by the pool, in use or not.
+    size_t allocated = 0;
+    // Buffers currently referenced outside the pool.
+    size_t in_use = 0;
+    // Peak value of `in_use` since the pool was created.
+    size_t high_water_mark = 0;
+  };
+
+  // Returns the process-wide pool. The pool is intentionally leaked so that
+  // buffers released during static destruction stay valid.
+  static PacketBufferPool* Get();
+
+  PacketBufferPool(const PacketBufferPool&) = delete;
+  PacketBufferPool& operator=(const PacketBufferPool&) = delete;
+
+  // Returns an empty buffer. Never returns null.
+  rtc::scoped_refptr<PacketBuffer> Allocate();
+  // Returns a buffer holding a copy of `data`, or null if `size` exceeds
+  // PacketBuffer::kCapacity.
+  rtc::scoped_refptr<PacketBuffer> Allocate(const uint8_t* data, size_t size);
+
+  Stats GetStats() const;
+
+ private:
+  friend class PacketBuffer;
+
+  // Per-thread free list; defined in the .cc file.
+  struct ThreadCache;
+  // Returns null once the calling thread has destroyed its cache, as other
+  // thread_local objects releasing buffers during thread exit may find;
+  // the pool then works on the shared list directly.
+  static ThreadCache* GetThreadCache();
+
+  PacketBufferPool() = default;
+
+  // Called by PacketBuffer when its last reference is dropped.
+  void Recycle(PacketBuffer* buffer);
+  // Takes one buffer from the shared list, or a new one if it is empty.
+  PacketBuffer* PopShared();
+  // Moves up to `count` buffers from the shared list to `cache`, growing
+  // the pool if the shared list is empty.
+  void Refill(ThreadCache* cache, size_t count);
+  // Moves `count` buffers from `cache` to the shared list.
+  void Spill(ThreadCache* cache, size_t count);
+
+  mutable webrtc::Mutex mutex_;
+  PacketBuffer* shared_free_ RTC_GUARDED_BY(mutex_) = nullptr;
+
+  std::atomic<uint64_t> hits_{0};
+  std::atomic<uint64_t> misses_{0};
+  std::atomic<size_t> allocated_{0};
+  std::atomic<size_t> in_use_{0};
+  std::atomic<size_t> high_water_mark_{0};
+};
+
+}  // namespace webrtc_examples
+
+#endif  // EXAMPLES_VOIPCLIENT_PACKET_BUFFER_POOL_H_
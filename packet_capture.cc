@@ -0,0 +1,393 @@
+/*
+ *  Copyright 2023 The WebRTC Project Authors. All rights reserved.
+ *
+ *  Use of this source code is governed by a BSD-style license
+ *  that can be found in the LICENSE file in the root of the source
+ *  tree. An additional intellectual property rights grant can be found
+ *  in the file PATENTS.  All contributing project authors may
+ *  be found in the AUTHORS file in the root of the source tree.
+ */
+
+#include "examples/voipclient/packet_capture.h"
+
+#include <netinet/in.h>
+#include <string.h>
+#include <sys/socket.h>
+
+#include <algorithm>
+#include <utility>
+#include <vector>
+
+#include "absl/memory/memory.h"
+#include "examples/voipclient/packet_buffer_pool.h"
+#include "rtc_base/checks.h"
+#include "rtc_base/logging.h"
+#include "rtc_base/time_utils.h"
+
+namespace webrtc_examples {
+
+namespace {
+
+// pcap file format, microsecond timestamps, in host byte order.
+constexpr uint32_t kPcapMagic = 0xa1b2c3d4;
+// Packets start with an IPv4 or IPv6 header, no link layer.
+constexpr uint32_t kLinkTypeRaw = 101;
+constexpr uint32_t kSnapLength = 65535;
+
+constexpr size_t kIpv4HeaderSize = 20;
+constexpr size_t kIpv6HeaderSize = 40;
+constexpr size_t kUdpHeaderSize = 8;
+
+std::atomic<uint64_t> g_next_capture_id{1};
+
+struct PcapFileHeader {
+  uint32_t magic;
+  uint16_t version_major;
+  uint16_t version_minor;
+  int32_t this_zone;
+  uint32_t sig_figs;
+  uint32_t snap_length;
+  uint32_t link_type;
+};
+
+struct PcapRecordHeader {
+  uint32_t seconds;
+  uint32_t microseconds;
+  uint32_t captured_length;
+  uint32_t original_length;
+};
+
+void WriteBigEndian16(uint8_t* data, uint16_t value) {
+  data[0] = static_cast<uint8_t>(value >> 8);
+  data[1] = static_cast<uint8_t>(value);
+}
+
+// Copies the address and port of `address` as IPv6 if `ipv6`, mapping an
+// IPv4 address into it, or as IPv4. Anything else, including an unset
+// address, becomes the unspecified address.
+void GetEndpoint(const sockaddr_storage& address,
+                 bool ipv6,
+                 uint8_t* ip,
+                 uint16_t* port) {
+  memset(ip, 0, ipv6 ? 16 : 4);
+  *port = 0;
+  if (address.ss_family == AF_INET) {
+    const auto& v4 = reinterpret_cast<const sockaddr_in&>(address);
+    if (ipv6) {
+      ip[10] = 0xff;
+      ip[11] = 0xff;
+      memcpy(ip + 12, &v4.sin_addr, 4);
+    } else {
+      memcpy(ip, &v4.sin_addr, 4);
+    }
+    *port = ntohs(v4.sin_port);
+  } else if (address.ss_family == AF_INET6 && ipv6) {
+    const auto& v6 = reinterpret_cast<const sockaddr_in6&>(address);
+    memcpy(ip, &v6.sin6_addr, 16);
+    *port = ntohs(v6.sin6_port);
+  }
+}
+
+uint16_t Ipv4HeaderChecksum(const uint8_t* header) {
+  uint32_t sum = 0;
+  for (size_t i = 0; i < kIpv4HeaderSize; i += 2) {
+    sum += (header[i] << 8) | header[i + 1];
+  }
+  while (sum >> 16) {
+    sum = (sum & 0xffff) + (sum >> 16);
+  }
+  return static_cast<uint16_t>(~sum);
+}
+
+// Writes the IP and UDP headers of a datagram carrying `payload_size`
+// bytes into `header`, which has room for an IPv6 one. Returns their size.
+size_t BuildHeaders(const sockaddr_storage& source,
+                    const sockaddr_storage& destination,
+                    size_t payload_size,
+                    uint8_t* header) {
+  const bool ipv6 =
+      source.ss_family == AF_INET6 || destination.ss_family == AF_INET6;
+  const size_t ip_header_size = ipv6 ? kIpv6HeaderSize : kIpv4HeaderSize;
+  const size_t udp_size = kUdpHeaderSize + payload_size;
+  uint16_t source_port;
+  uint16_t destination_port;
+
+  memset(header, 0, ip_header_size + kUdpHeaderSize);
+  if (ipv6) {
+    header[0] = 0x60;
+    WriteBigEndian16(header + 4, static_cast<uint16_t>(udp_size));
+    header[6] = IPPROTO_UDP;
+    header[7] = 64;
+    GetEndpoint(source, /*ipv6=*/true, header + 8, &source_port);
+    GetEndpoint(destination, /*ipv6=*/true, header + 24, &destination_port);
+  } else {
+    header[0] = 0x45;
+    WriteBigEndian16(header + 2,
+                     static_cast<uint16_t>(kIpv4HeaderSize + udp_size));
+    // Don't fragment.
+    header[6] = 0x40;
+    header[8] = 64;
+    header[9] = IPPROTO_UDP;
+    GetEndpoint(source, /*ipv6=*/false, header + 12, &source_port);
+    GetEndpoint(destination, /*ipv6=*/false, header + 16, &destination_port);
+    WriteBigEndian16(header + 10, Ipv4HeaderChecksum(header));
+  }
+
+  // The UDP checksum is left zero, i.e. not computed.
+  uint8_t* udp = header + ip_header_size;
+  WriteBigEndian16(udp, source_port);
+  WriteBigEndian16(udp + 2, destination_port);
+  WriteBigEndian16(udp + 4, static_cast<uint16_t>(udp_size));
+  return ip_header_size + kUdpHeaderSize;
+}
+
+}  // namespace
+
+struct PacketCapture::Record {
+  // rtc::TimeUTCMicros() at capture.
+  int64_t time_us;
+  sockaddr_storage source;
+  sockaddr_storage destination;
+  uint32_t original_size;
+  // Larger packets are truncated to PacketBuffer::kCapacity.
+  uint32_t size;
+  uint8_t data[PacketBuffer::kCapacity];
+};
+
+// Single-producer, single-consumer queue of records. The owning thread
+// fills a slot in place and publishes it with a release store of `tail_`;
+// the writer hands slots back the same way through `head_`.
+class PacketCapture::Ring {
+ public:
+  explicit Ring(size_t capacity) : records_(capacity) {}
+
+  // Returns the slot to fill, or null if the ring is full.
+  Record* BeginWrite() {
+    const uint64_t tail = tail_.load(std::memory_order_relaxed);
+    if (tail - head_.load(std::memory_order_acquire) == records_.size()) {
+      return nullptr;
+    }
+    return &records_[tail % records_.size()];
+  }
+  void EndWrite() {
+    tail_.store(tail_.load(std::memory_order_relaxed) + 1,
+                std::memory_order_release);
+  }
+
+  template <typename Visitor>
+  void Drain(Visitor visitor) {
+    const uint64_t head = head_.load(std::memory_order_relaxed);
+    const uint64_t tail = tail_.load(std::memory_order_acquire);
+    for (uint64_t i = head; i < tail; ++i) {
+      visitor(records_[i % records_.size()]);
+    }
+    head_.store(tail, std::memory_order_release);
+  }
+
+ private:
+  std::vector<Record> records_;
+  // Kept apart so that the two threads do not share a cache line.
+  alignas(64) std::atomic<uint64_t> head_{0};
+  alignas(64) std::atomic<uint64_t> tail_{0};
+};
+
+std::unique_ptr<PacketCapture> PacketCapture::Create(const Options& options) {
+  RTC_DCHECK(!options.path.empty());
+  RTC_DCHECK_GT(options.packets_per_thread, 0);
+
+  std::unique_ptr<rtc::Thread> thread = rtc::Thread::Create();
+  thread->SetName("packet_capture", nullptr);
+  if (!thread->Start()) {
+    RTC_LOG(LS_ERROR) << "Failed to start the packet capture thread";
+    return nullptr;
+  }
+
+  // Using `new` to access a non-public constructor.
+  auto capture =
+      absl::WrapUnique(new PacketCapture(options, std::move(thread)));
+  bool opened = capture->thread_->BlockingCall([&capture] {
+    RTC_DCHECK_RUN_ON(capture->thread_.get());
+    return capture->OpenFile();
+  });
+  if (!opened) {
+    return nullptr;
+  }
+  capture->thread_->PostTask(
+      [capture = capture.get()] { capture->ScheduleDrain(); });
+  return capture;
+}
+
+PacketCapture::PacketCapture(const Options& options,
+                             std::unique_ptr<rtc::Thread> thread)
+    : options_(options),
+      id_(g_next_capture_id.fetch_add(1, std::memory_order_relaxed)),
+      thread_(std::move(thread)) {}
+
+PacketCapture::~PacketCapture() {
+  thread_->BlockingCall([this] {
+    RTC_DCHECK_RUN_ON(thread_.get());
+    Drain();
+    if (file_) {
+      fclose(file_);
+      file_ = nullptr;
+    }
+  });
+  // Drops the pending drain.
+  thread_->Stop();
+}
+
+void PacketCapture::Capture(Direction direction,
+                            const rtc::SocketAddress& local,
+                            const rtc::SocketAddress& remote,
+                            const uint8_t* data,
+                            size_t size) {
+  Ring* ring = GetRing();
+  Record* record = ring->BeginWrite();
+  if (!record) {
+    packets_dropped_.fetch_add(1, std::memory_order_relaxed);
+    return;
+  }
+  const bool outgoing = direction == Direction::kOutgoing;
+  record->time_us = rtc::TimeUTCMicros();
+  (outgoing ? local : remote).ToSockAddrStorage(&record->source);
+  (outgoing ? remote : local).ToSockAddrStorage(&record->destination);
+  record->original_size = static_cast<uint32_t>(size);
+  record->size =
+      static_cast<uint32_t>(std::min(size, PacketBuffer::kCapacity));
+  memcpy(record->data, data, record->size);
+  ring->EndWrite();
+}
+
+PacketCapture::Stats PacketCapture::GetStats() const {
+  Stats stats;
+  stats.packets_written = packets_written_.load(std::memory_order_relaxed);
+  stats.packets_dropped = packets_dropped_.load(std::memory_order_relaxed);
+  stats.bytes_written = bytes_written_.load(std::memory_order_relaxed);
+  stats.files = files_.load(std::memory_order_relaxed);
+  return stats;
+}
+
+PacketCapture::Ring* PacketCapture::GetRing() {
+  thread_local uint64_t cached_id = 0;
+  thread_local Ring* cached_ring = nullptr;
+  if (cached_id == id_) {
+    return cached_ring;
+  }
+
+  webrtc::MutexLock lock(&mutex_);
+  std::unique_ptr<Ring>& ring = rings_[rtc::CurrentThreadId()];
+  if (!ring) {
+    ring = std::make_unique<Ring>(options_.packets_per_thread);
+  }
+  cached_id = id_;
+  cached_ring = ring.get();
+  return cached_ring;
+}
+
+bool PacketCapture::OpenFile() {
+  RTC_DCHECK_RUN_ON(thread_.get());
+  RTC_DCHECK(!file_);
+
+  auto file_name = [this](int index) {
+    return index == 0 ? options_.path
+                      : options_.path + "." + std::to_string(index);
+  };
+  const std::string path = file_name(file_index_);
+  file_ = fopen(path.c_str(), "wb");
+  if (!file_) {
+    if (!open_failed_) {
+      RTC_LOG_ERR(LS_ERROR) << "Cannot open capture file " << path;
+    }
+    open_failed_ = true;
+    return false;
+  }
+  if (open_failed_) {
+    RTC_LOG(LS_INFO) << "Capturing to " << path << " again";
+    open_failed_ = false;
+  }
+  if (options_.max_files > 0 && file_index_ >= options_.max_files) {
+    remove(file_name(file_index_ - options_.max_files).c_str());
+  }
+
+  const PcapFileHeader header = {kPcapMagic, 2, 4, 0, 0, kSnapLength,
+                                 kLinkTypeRaw};
+  fwrite(&header, sizeof(header), 1, file_);
+  file_bytes_ = sizeof(header);
+  file_start_ms_ = rtc::TimeMillis();
+  files_.fetch_add(1, std::memory_order_relaxed);
+  return true;
+}
+
+void PacketCapture::ScheduleDrain() {
+  RTC_DCHECK_RUN_ON(thread_.get());
+
+  Drain();
+  thread_->PostDelayedTask([this] { ScheduleDrain(); },
+                           options_.drain_interval);
+}
+
+void PacketCapture::Drain() {
+  RTC_DCHECK_RUN_ON(thread_.get());
+
+  drained_rings_.clear();
+  {
+    webrtc::MutexLock lock(&mutex_);
+    for (const auto& entry : rings_) {
+      drained_rings_.push_back(entry.second.get());
+    }
+  }
+  // After a failed rotation, once per drain.
+  if (!file_) {
+    OpenFile();
+  }
+  for (Ring* ring : drained_rings_) {
+    ring->Drain([this](const Record& record) { WritePacket(record); });
+  }
+  if (file_) {
+    fflush(file_);
+  }
+}
+
+void PacketCapture::WritePacket(const Record& record) {
+  RTC_DCHECK_RUN_ON(thread_.get());
+
+  const bool rotate =
+      file_ &&
+      ((options_.max_file_bytes > 0 &&
+        file_bytes_ >= options_.max_file_bytes) ||
+       (options_.max_file_duration > webrtc::TimeDelta::Zero() &&
+        rtc::TimeMillis() - file_start_ms_ >=
+            options_.max_file_duration.ms()));
+  if (rotate) {
+    fclose(file_);
+    file_ = nullptr;
+    ++file_index_;
+    OpenFile();
+  }
+  if (!file_) {
+    packets_dropped_.fetch_add(1, std::memory_order_relaxed);
+    return;
+  }
+
+  uint8_t headers[kIpv6HeaderSize + kUdpHeaderSize];
+  const size_t headers_size = BuildHeaders(record.source, record.destination,
+                                           record.original_size, headers);
+  PcapRecordHeader record_header;
+  record_header.seconds = static_cast<uint32_t>(record.time_us / 1000000);
+  record_header.microseconds = static_cast<uint32_t>(record.time_us % 1000000);
+  record_header.captured_length =
+      static_cast<uint32_t>(headers_size + record.size);
+  record_header.original_length =
+      static_cast<uint32_t>(headers_size + record.original_size);
+
+  fwrite(&record_header, sizeof(record_header), 1, file_);
+  fwrite(headers, headers_size, 1, file_);
+  fwrite(record.data, record.size, 1, file_);
+  const size_t bytes =
+      sizeof(record_header) + headers_size + record.size;
+  file_bytes_ += bytes;
+  bytes_written_.fetch_add(bytes, std::memory_order_relaxed);
+  packets_written_.fetch_add(1, std::memory_order_relaxed);
+}
+
+}  // namespace webrtc_examples
@@ -0,0 +1,133 @@
+/*
+ *  Copyright 2023 The WebRTC Project Authors. All rights reserved.
+ *
+ *  Use of this source code is governed by a BSD-style license
+ *  that can be found in the LICENSE file in the root of the source
+ *  tree. An additional intellectual property rights grant can be found
+ *  in the file PATENTS.  All contributing project authors may
+ *  be found in the AUTHORS file in the root of the source tree.
+ */
+
+#ifndef EXAMPLES_VOIPCLIENT_PACKET_CAPTURE_H_
+#define EXAMPLES_VOIPCLIENT_PACKET_CAPTURE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include <atomic>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "api/units/time_delta.h"
+#include "rtc_base/platform_thread_types.h"
+#include "rtc_base/socket_address.h"
+#include "rtc_base/synchronization/mutex.h"
+#include "rtc_base/thread.h"
+#include "rtc_base/thread_annotations.h"
+
+namespace webrtc_examples {
+
+// Records RTP and RTCP packets to pcap files that Wireshark decodes as
+// RTP over UDP. Each packet is stored behind synthesized IP and UDP headers
+// carrying the session's addresses (LINKTYPE_RAW).
+//
+// Capture() only copies the packet into a ring owned by the calling thread,
+// with no locks and no system calls; a background thread drains the rings
+// and writes the files. A packet that finds its ring full is dropped and
+// counted rather than slowing the media path down.
+class PacketCapture {
+ public:
+  struct Options {
+    // First file; rotated files append ".1", ".2" and so on.
+    std::string path;
+    // Start a new file once the current one exceeds either limit; zero
+    // disables that limit.
+    size_t max_file_bytes = 0;
+    webrtc::TimeDelta max_file_duration = webrtc::TimeDelta::Zero();
+    // Delete the oldest files beyond this count; zero keeps them all.
+    int max_files = 0;
+    // Packets each capturing thread may have waiting for the writer.
+    size_t packets_per_thread = 1024;
+    // How often the writer drains the rings.
+    webrtc::TimeDelta drain_interval = webrtc::TimeDelta::Millis(10);
+  };
+
+  struct Stats {
+    uint64_t packets_written = 0;
+    // Packets lost to a full ring or to a file that could not be opened.
+    uint64_t packets_dropped = 0;
+    uint64_t bytes_written = 0;
+    uint64_t files = 0;
+  };
+
+  enum class Direction { kIncoming, kOutgoing };
+
+  // Opens the first file and starts the writer. Returns null on failure.
+  static std::unique_ptr<PacketCapture> Create(const Options& options);
+
+  // Writes what has been captured so far and closes the file. No thread
+  // may be in Capture() any more.
+  ~PacketCapture();
+
+  PacketCapture(const PacketCapture&) = delete;
+  PacketCapture& operator=(const PacketCapture&) = delete;
+
+  // Thread-safe. `local` and `remote` are the two ends of the packet's
+  // path; an unset address is recorded as the unspecified one.
+  void Capture(Direction direction,
+               const rtc::SocketAddress& local,
+               const rtc::SocketAddress& remote,
+               const uint8_t* data,
+               size_t size);
+
+  Stats GetStats() const;
+
+ private:
+  struct Record;
+  class Ring;
+
+  PacketCapture(const Options& options, std::unique_ptr<rtc::Thread> thread);
+
+  // Returns the calling thread's ring, creating it on first use.
+  Ring* GetRing();
+
+  // Run on `thread_`. A file that cannot be opened is retried by the next
+  // drain; packets are dropped meanwhile.
+  bool OpenFile();
+  void Drain();
+  void ScheduleDrain();
+  void WritePacket(const Record& record);
+
+  const Options options_;
+  // Distinguishes this capture in the per-thread ring cache from others
+  // that lived at the same address.
+  const uint64_t id_;
+  std::unique_ptr<rtc::Thread> thread_;
+
+  // Only held to add a ring or to list them; rings live as long as the
+  // capture.
+  webrtc::Mutex mutex_;
+  std::map<rtc::PlatformThreadId, std::unique_ptr<Ring>> rings_
+      RTC_GUARDED_BY(mutex_);
+
+  // The rings listed by the current drain, which writes them unlocked.
+  std::vector<Ring*> drained_rings_ RTC_GUARDED_BY(thread_);
+  FILE* file_ RTC_GUARDED_BY(thread_) = nullptr;
+  // Whether the last OpenFile() failed, to log a failure only once.
+  bool open_failed_ RTC_GUARDED_BY(thread_) = false;
+  int file_index_ RTC_GUARDED_BY(thread_) = 0;
+  size_t file_bytes_ RTC_GUARDED_BY(thread_) = 0;
+  int64_t file_start_ms_ RTC_GUARDED_BY(thread_) = 0;
+
+  std::atomic<uint64_t> packets_written_{0};
+  std::atomic<uint64_t> packets_dropped_{0};
+  std::atomic<uint64_t> bytes_written_{0};
+  std::atomic<uint64_t> files_{0};
+};
+
+}  // namespace webrtc_examples
+
+#endif  // EXAMPLES_VOIPCLIENT_PACKET_CAPTURE_H_
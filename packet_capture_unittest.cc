@@ -0,0 +1,133 @@
+/*
+ *  Copyright 2023 The WebRTC Project Authors. All rights reserved.
+ *
+ *  Use of this source code is governed by a BSD-style license
+ *  that can be found in the LICENSE file in the root of the source
+ *  tree. An additional intellectual property rights grant can be found
+ *  in the file PATENTS.  All contributing project authors may
+ *  be found in the AUTHORS file in the root of the source tree.
+ */
+
+#include "examples/voipclient/packet_capture.h"
+
+#include <stdint.h>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "examples/voipclient/rtp_file_reader.h"
+#include "rtc_base/socket_address.h"
+#include "test/gtest.h"
+#include "test/testsupport/file_utils.h"
+
+namespace webrtc_examples {
+namespace {
+
+const rtc::SocketAddress kLocal("192.0.2.1", 5000);
+const rtc::SocketAddress kRemote("192.0.2.2", 6000);
+const rtc::SocketAddress kLocalIpv6("2001:db8::1", 5002);
+const rtc::SocketAddress kRemoteIpv6("2001:db8::2", 6002);
+
+std::vector<uint8_t> MakeRtpPacket(uint8_t sequence_number) {
+  return {0x80, 0x00, 0x00, sequence_number, 0x00, 0x00, 0x00, 0xa0,
+          0x00, 0x00, 0x00, 0x01, 0xaa,            0xbb};
+}
+
+// A receiver report without report blocks.
+const std::vector<uint8_t> kRtcpPacket = {0x80, 201,  0x00, 0x01,
+                                          0x00, 0x00, 0x00, 0x01};
+
+class PacketCaptureTest : public ::testing::Test {
+ protected:
+  PacketCaptureTest()
+      : path_(webrtc::test::TempFilename(webrtc::test::OutputPath(),
+                                         "packet_capture")) {}
+
+  ~PacketCaptureTest() override {
+    webrtc::test::RemoveFile(path_);
+    for (int i = 1; i < 4; ++i) {
+      webrtc::test::RemoveFile(Rotated(i));
+    }
+  }
+
+  std::string Rotated(int index) const {
+    return path_ + "." + std::to_string(index);
+  }
+
+  void Capture(PacketCapture* capture,
+               PacketCapture::Direction direction,
+               const rtc::SocketAddress& local,
+               const rtc::SocketAddress& remote,
+               const std::vector<uint8_t>& packet) {
+    capture->Capture(direction, local, remote, packet.data(), packet.size());
+  }
+
+  const std::string path_;
+};
+
+TEST_F(PacketCaptureTest, WritesWhatTheReaderReadsBack) {
+  PacketCapture::Options options;
+  options.path = path_;
+  std::unique_ptr<PacketCapture> capture = PacketCapture::Create(options);
+  ASSERT_TRUE(capture);
+  Capture(capture.get(), PacketCapture::Direction::kIncoming, kLocal, kRemote,
+          MakeRtpPacket(1));
+  Capture(capture.get(), PacketCapture::Direction::kOutgoing, kLocalIpv6,
+          kRemoteIpv6, MakeRtpPacket(2));
+  Capture(capture.get(), PacketCapture::Direction::kOutgoing, kLocal, kRemote,
+          kRtcpPacket);
+  // Writes the rest and closes the file.
+  capture.reset();
+
+  std::vector<RecordedRtpPacket> packets;
+  ASSERT_TRUE(ReadRtpFile(path_, /*udp_port=*/0, &packets));
+  ASSERT_EQ(packets.size(), 2u);
+  EXPECT_EQ(packets[0].data, MakeRtpPacket(1));
+  EXPECT_EQ(packets[1].data, MakeRtpPacket(2));
+  EXPECT_LE(packets[0].time_us, packets[1].time_us);
+
+  // Both ports are on each packet.
+  packets.clear();
+  ASSERT_TRUE(ReadRtpFile(path_, kRemoteIpv6.port(), &packets));
+  ASSERT_EQ(packets.size(), 1u);
+  EXPECT_EQ(packets[0].data, MakeRtpPacket(2));
+  packets.clear();
+  ASSERT_TRUE(ReadRtpFile(path_, kLocal.port(), &packets));
+  ASSERT_EQ(packets.size(), 1u);
+  EXPECT_EQ(packets[0].data, MakeRtpPacket(1));
+}
+
+TEST_F(PacketCaptureTest, RotatesAndDeletesTheOldestFiles) {
+  PacketCapture::Options options;
+  options.path = path_;
+  // More than the file header, less than it and one packet, so that each
+  // file holds one packet.
+  options.max_file_bytes = 60;
+  options.max_files = 2;
+  std::unique_ptr<PacketCapture> capture = PacketCapture::Create(options);
+  ASSERT_TRUE(capture);
+  for (uint8_t i = 0; i < 4; ++i) {
+    Capture(capture.get(), PacketCapture::Direction::kIncoming, kLocal,
+            kRemote, MakeRtpPacket(i));
+  }
+  capture.reset();
+
+  EXPECT_FALSE(webrtc::test::FileExists(path_));
+  EXPECT_FALSE(webrtc::test::FileExists(Rotated(1)));
+  for (uint8_t i = 2; i < 4; ++i) {
+    std::vector<RecordedRtpPacket> packets;
+    ASSERT_TRUE(ReadRtpFile(Rotated(i), /*udp_port=*/0, &packets));
+    ASSERT_EQ(packets.size(), 1u);
+    EXPECT_EQ(packets[0].data, MakeRtpPacket(i));
+  }
+}
+
+TEST_F(PacketCaptureTest, FailsWithoutAFile) {
+  PacketCapture::Options options;
+  options.path = path_ + "/missing/capture.pcap";
+  EXPECT_FALSE(PacketCapture::Create(options));
+}
+
+}  // namespace
+}  // namespace webrtc_examples
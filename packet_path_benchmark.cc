@@ -0,0 +1,238 @@
+/*
+ *  Copyright 2023 The WebRTC Project Authors. All rights reserved.
+ *
+ *  Use of this source code is governed by a BSD-style license
+ *  that can be found in the LICENSE file in the root of the source
+ *  tree. An additional intellectual property rights grant can be found
+ *  in the file PATENTS.  All contributing project authors may
+ *  be found in the AUTHORS file in the root of the source tree.
+ */
+
+// Microbenchmark of the per-packet work VoipSession and MediaSocket do
+// between the engine and the kernel:
+//
+//   send:    SendRtp() -> SendRtpPacket() -> MediaSocket::Send/Flush
+//   receive: MediaSocket::ReceiveBatch() -> ReadRTPPacket() -> engine
+//
+// The kernel is replaced by MediaSocket::SocketCalls that accept every
+// outgoing datagram and produce incoming ones from a template, and the
+// engine by a stub that only counts. What remains is the packet copy,
+// buffer pooling, task posting and batching code, reported as ns, heap
+// allocations and task queue hops per packet. Any of the --max_* flags
+// turns the run into a pass/fail gate for changes to that code; the receive
+// path must not allocate at all unless
+// --norequire_allocation_free_receive.
+
+#include <stdint.h>
+
+#include <atomic>
+#include <cstdio>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include "absl/flags/flag.h"
+#include "absl/flags/parse.h"
+#include "absl/functional/any_invocable.h"
+#include "api/call/transport.h"
+#include "api/task_queue/task_queue_base.h"
+#include "api/units/time_delta.h"
+#include "examples/voipclient/allocation_counter.h"
+#include "examples/voipclient/packet_path_fakes.h"
+#include "examples/voipclient/voip_session.h"
+#include "rtc_base/checks.h"
+#include "rtc_base/event.h"
+#include "rtc_base/physical_socket_server.h"
+#include "rtc_base/thread.h"
+#include "rtc_base/time_utils.h"
+
+ABSL_FLAG(int, packets, 200000, "Packets measured per path.");
+ABSL_FLAG(int, warmup_packets, 10000, "Packets run before measuring.");
+ABSL_FLAG(int, packet_size, 172, "Packet size in bytes (PCMU 20 ms).");
+ABSL_FLAG(double,
+          max_ns_per_packet,
+          -1,
+          "Fail if either path costs more; negative disables the check.");
+ABSL_FLAG(double,
+          max_allocations_per_packet,
+          -1,
+          "Fail if either path allocates more; negative disables the check.");
+ABSL_FLAG(double,
+          max_hops_per_packet,
+          -1,
+          "Fail if either path posts more tasks; negative disables the check.");
+ABSL_FLAG(bool,
+          require_allocation_free_receive,
+          true,
+          "Fail if the receive path allocates at all once warmed up.");
+
+namespace {
+
+using webrtc_examples::FakeSocketCalls;
+using webrtc_examples::StubVoipEngine;
+using webrtc_examples::VoipSession;
+
+constexpr char kLoopback[] = "127.0.0.1";
+constexpr int kLocalPort = 43000;
+constexpr int kRemotePort = 43002;
+
+// Counts the tasks posted to it, i.e. thread hops.
+class CountingThread : public rtc::Thread {
+ public:
+  explicit CountingThread(std::unique_ptr<rtc::SocketServer> socket_server)
+      : rtc::Thread(std::move(socket_server)) {}
+  ~CountingThread() override { Stop(); }
+
+  uint64_t posted_tasks() const {
+    return posted_tasks_.load(std::memory_order_relaxed);
+  }
+
+ protected:
+  void PostTaskImpl(absl::AnyInvocable<void() &&> task,
+                    const PostTaskTraits& traits,
+                    const webrtc::Location& location) override {
+    posted_tasks_.fetch_add(1, std::memory_order_relaxed);
+    rtc::Thread::PostTaskImpl(std::move(task), traits, location);
+  }
+  void PostDelayedTaskImpl(absl::AnyInvocable<void() &&> task,
+                           webrtc::TimeDelta delay,
+                           const PostDelayedTaskTraits& traits,
+                           const webrtc::Location& location) override {
+    posted_tasks_.fetch_add(1, std::memory_order_relaxed);
+    rtc::Thread::PostDelayedTaskImpl(std::move(task), delay, traits,
+                                     location);
+  }
+
+ private:
+  std::atomic<uint64_t> posted_tasks_{0};
+};
+
+struct Cost {
+  double ns_per_packet = 0;
+  double allocations_per_packet = 0;
+  double hops_per_packet = 0;
+};
+
+// Snapshot of the counters a measurement is taken from.
+struct Counters {
+  int64_t time_ns;
+  uint64_t allocations;
+  uint64_t hops;
+
+  static Counters Read(const CountingThread& thread) {
+    return {rtc::TimeNanos(), webrtc_examples::GetAllocationCount(),
+            thread.posted_tasks()};
+  }
+};
+
+Cost CostPerPacket(const Counters& before,
+                   const Counters& after,
+                   int packets,
+                   uint64_t extra_hops) {
+  Cost cost;
+  cost.ns_per_packet =
+      static_cast<double>(after.time_ns - before.time_ns) / packets;
+  cost.allocations_per_packet =
+      static_cast<double>(after.allocations - before.allocations) / packets;
+  cost.hops_per_packet =
+      static_cast<double>(after.hops - before.hops - extra_hops) / packets;
+  return cost;
+}
+
+// Calls SendRtp() as the engine's encoder would and waits until every
+// packet has been handed to the socket.
+Cost RunSend(VoipSession* session, CountingThread* thread, int packets) {
+  std::vector<uint8_t> packet(absl::GetFlag(FLAGS_packet_size), 0);
+  packet[0] = 0x80;
+  Counters before = Counters::Read(*thread);
+  for (int i = 0; i < packets; ++i) {
+    session->SendRtp(packet.data(), packet.size(), webrtc::PacketOptions());
+  }
+  // Runs after every task posted above, including the final flush.
+  thread->BlockingCall([] {});
+  Counters after = Counters::Read(*thread);
+  return CostPerPacket(before, after, packets, /*extra_hops=*/1);
+}
+
+// Makes packets arrive on the session's RTP socket and waits until the
+// engine has been handed every one of them.
+Cost RunReceive(FakeSocketCalls* calls,
+                StubVoipEngine* engine,
+                CountingThread* thread,
+                int packets) {
+  rtc::Event done;
+  engine->ExpectPackets(packets, &done);
+  Counters before = Counters::Read(*thread);
+  calls->Deliver(packets);
+  done.Wait(rtc::Event::kForever);
+  Counters after = Counters::Read(*thread);
+  return CostPerPacket(before, after, packets, /*extra_hops=*/0);
+}
+
+bool Check(const char* path, const Cost& cost) {
+  printf("%-8s %8.1f ns/packet %6.3f allocations/packet %6.3f hops/packet\n",
+         path, cost.ns_per_packet, cost.allocations_per_packet,
+         cost.hops_per_packet);
+
+  bool ok = true;
+  double max_ns = absl::GetFlag(FLAGS_max_ns_per_packet);
+  if (max_ns >= 0 && cost.ns_per_packet > max_ns) {
+    printf("FAIL: %s ns/packet above %.1f\n", path, max_ns);
+    ok = false;
+  }
+  double max_allocations = absl::GetFlag(FLAGS_max_allocations_per_packet);
+  if (max_allocations >= 0 && cost.allocations_per_packet > max_allocations) {
+    printf("FAIL: %s allocations/packet above %.3f\n", path, max_allocations);
+    ok = false;
+  }
+  double max_hops = absl::GetFlag(FLAGS_max_hops_per_packet);
+  if (max_hops >= 0 && cost.hops_per_packet > max_hops) {
+    printf("FAIL: %s hops/packet above %.3f\n", path, max_hops);
+    ok = false;
+  }
+  return ok;
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  absl::ParseCommandLine(argc, argv);
+
+  FakeSocketCalls calls(absl::GetFlag(FLAGS_packet_size), kRemotePort);
+  StubVoipEngine engine;
+
+  auto socket_server = std::make_unique<rtc::PhysicalSocketServer>();
+  rtc::PhysicalSocketServer* socket_server_ptr = socket_server.get();
+  CountingThread thread(std::move(socket_server));
+  thread.Start();
+
+  VoipSession::Options options;
+  options.socket.socket_calls = &calls;
+  auto session = std::make_unique<VoipSession>(
+      /*id=*/0, &thread, socket_server_ptr, &engine, options);
+  thread.BlockingCall([&] {
+    session->SetLocalAddress(kLoopback, kLocalPort);
+    session->SetRemoteAddress(kLoopback, kRemotePort);
+    RTC_CHECK(session->Start());
+  });
+
+  const int warmup = absl::GetFlag(FLAGS_warmup_packets);
+  const int packets = absl::GetFlag(FLAGS_packets);
+  RunSend(session.get(), &thread, warmup);
+  RunReceive(&calls, &engine, &thread, warmup);
+
+  bool ok = Check("send", RunSend(session.get(), &thread, packets));
+  RTC_CHECK_EQ(calls.packets_sent(), static_cast<uint64_t>(warmup + packets));
+  const Cost receive = RunReceive(&calls, &engine, &thread, packets);
+  ok &= Check("receive", receive);
+  // Datagrams are read into pooled buffers, which the engine is handed in
+  // place, so nothing on the way may allocate once the pool has grown.
+  if (absl::GetFlag(FLAGS_require_allocation_free_receive) &&
+      receive.allocations_per_packet > 0) {
+    printf("FAIL: receive allocated after warmup\n");
+    ok = false;
+  }
+
+  thread.BlockingCall([&] { session.reset(); });
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,101 @@
+/*
+ *  Copyright 2023 The WebRTC Project Authors. All rights reserved.
+ *
+ *  Use of this source code is governed by a BSD-style license
+ *  that can be found in the LICENSE file in the root of the source
+ *  tree. An additional intellectual property rights grant can be found
+ *  in the file PATENTS.  All contributing project authors may
+ *  be found in the AUTHORS file in the root of the source tree.
+ */
+
+#include "examples/voipclient/packet_path_fakes.h"
+
+#include <errno.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#include <algorithm>
+
+#include "rtc_base/checks.h"
+
+namespace webrtc_examples {
+
+FakeSocketCalls::FakeSocketCalls(size_t packet_size, int source_port)
+    : packet_(packet_size, 0) {
+  // Version 2, PCMU, SSRC 0x11223344.
+  packet_[0] = 0x80;
+  packet_[8] = 0x11;
+  packet_[9] = 0x22;
+  packet_[10] = 0x33;
+  packet_[11] = 0x44;
+  source_.sin_family = AF_INET;
+  source_.sin_port = htons(source_port);
+  source_.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+}
+
+void FakeSocketCalls::Deliver(int count) {
+  pending_.fetch_add(count, std::memory_order_relaxed);
+  Signal(rtp_fd_);
+}
+
+int FakeSocketCalls::Open(const sockaddr* address,
+                          socklen_t address_length,
+                          bool reuse_port) {
+  int fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if (rtp_fd_ < 0) {
+    rtp_fd_ = fd;
+  }
+  return fd;
+}
+
+int FakeSocketCalls::ReceiveMessages(int fd,
+                                     mmsghdr* messages,
+                                     unsigned int count) {
+  uint64_t value;
+  if (read(fd, &value, sizeof(value)) < 0 || fd != rtp_fd_) {
+    errno = EAGAIN;
+    return -1;
+  }
+  int available = pending_.load(std::memory_order_relaxed);
+  int received = std::min(available, static_cast<int>(count));
+  for (int i = 0; i < received; ++i) {
+    msghdr& header = messages[i].msg_hdr;
+    memcpy(header.msg_iov[0].iov_base, packet_.data(), packet_.size());
+    memcpy(header.msg_name, &source_, sizeof(source_));
+    header.msg_namelen = sizeof(source_);
+    header.msg_flags = 0;
+    messages[i].msg_len = packet_.size();
+  }
+  if (pending_.fetch_sub(received, std::memory_order_relaxed) > received) {
+    Signal(fd);
+  }
+  return received;
+}
+
+int FakeSocketCalls::SendMessages(int fd,
+                                  mmsghdr* messages,
+                                  unsigned int count) {
+  uint64_t packets = 0;
+  for (unsigned int i = 0; i < count; ++i) {
+    packets += messages[i].msg_hdr.msg_iovlen;
+  }
+  packets_sent_.fetch_add(packets, std::memory_order_relaxed);
+  return count;
+}
+
+ssize_t FakeSocketCalls::SendTo(int fd,
+                                const void* data,
+                                size_t size,
+                                const sockaddr* address,
+                                socklen_t address_length) {
+  packets_sent_.fetch_add(1, std::memory_order_relaxed);
+  return size;
+}
+
+void FakeSocketCalls::Signal(int fd) {
+  uint64_t one = 1;
+  RTC_CHECK_EQ(write(fd, &one, sizeof(one)), sizeof(one));
+}
+
+}  // namespace webrtc_examples
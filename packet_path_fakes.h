@@ -0,0 +1,198 @@
+/*
+ *  Copyright 2023 The WebRTC Project Authors. All rights reserved.
+ *
+ *  Use of this source code is governed by a BSD-style license
+ *  that can be found in the LICENSE file in the root of the source
+ *  tree. An additional intellectual property rights grant can be found
+ *  in the file PATENTS.  All contributing project authors may
+ *  be found in the AUTHORS file in the root of the source tree.
+ */
+
+#ifndef EXAMPLES_VOIPCLIENT_PACKET_PATH_FAKES_H_
+#define EXAMPLES_VOIPCLIENT_PACKET_PATH_FAKES_H_
+
+#include <netinet/in.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/socket.h>
+
+#include <atomic>
+#include <map>
+#include <vector>
+
+#include "absl/types/optional.h"
+#include "api/array_view.h"
+#include "api/call/transport.h"
+#include "api/voip/voip_base.h"
+#include "api/voip/voip_codec.h"
+#include "api/voip/voip_dtmf.h"
+#include "api/voip/voip_engine.h"
+#include "api/voip/voip_network.h"
+#include "api/voip/voip_statistics.h"
+#include "api/voip/voip_volume_control.h"
+#include "examples/voipclient/media_socket.h"
+#include "rtc_base/event.h"
+
+namespace webrtc_examples {
+
+// Fakes for driving VoipSession and MediaSocket without a kernel or a real
+// engine, as the packet path benchmark and tests do.
+
+// Stands in for the kernel. Descriptors are eventfds, which the socket
+// server can poll; a pending receive keeps the RTP one readable. Incoming
+// datagrams are copies of one RTP packet from loopback `source_port`.
+class FakeSocketCalls : public MediaSocket::SocketCalls {
+ public:
+  FakeSocketCalls(size_t packet_size, int source_port);
+
+  // Makes `count` datagrams arrive on the first descriptor opened.
+  void Deliver(int count);
+
+  uint64_t packets_sent() const {
+    return packets_sent_.load(std::memory_order_relaxed);
+  }
+
+  // MediaSocket::SocketCalls implementation.
+  int Open(const sockaddr* address,
+           socklen_t address_length,
+           bool reuse_port) override;
+  int ReceiveMessages(int fd, mmsghdr* messages, unsigned int count) override;
+  int SendMessages(int fd, mmsghdr* messages, unsigned int count) override;
+  ssize_t SendTo(int fd,
+                 const void* data,
+                 size_t size,
+                 const sockaddr* address,
+                 socklen_t address_length) override;
+
+ private:
+  static void Signal(int fd);
+
+  std::vector<uint8_t> packet_;
+  sockaddr_in source_ = {};
+  int rtp_fd_ = -1;
+  std::atomic<int> pending_{0};
+  std::atomic<uint64_t> packets_sent_{0};
+};
+
+// Accepts everything and counts received RTP packets.
+class StubVoipEngine : public webrtc::VoipEngine,
+                       public webrtc::VoipBase,
+                       public webrtc::VoipNetwork,
+                       public webrtc::VoipCodec,
+                       public webrtc::VoipDtmf,
+                       public webrtc::VoipStatistics,
+                       public webrtc::VoipVolumeControl {
+ public:
+  // Signals `done` once `count` more packets have been received.
+  void ExpectPackets(uint64_t count, rtc::Event* done) {
+    // Published by the store to `remaining_`.
+    done_ = done;
+    remaining_.store(count);
+  }
+
+  // webrtc::VoipEngine implementation.
+  webrtc::VoipBase& Base() override { return *this; }
+  webrtc::VoipNetwork& Network() override { return *this; }
+  webrtc::VoipCodec& Codec() override { return *this; }
+  webrtc::VoipDtmf& Dtmf() override { return *this; }
+  webrtc::VoipStatistics& Statistics() override { return *this; }
+  webrtc::VoipVolumeControl& VolumeControl() override { return *this; }
+
+  // webrtc::VoipBase implementation.
+  webrtc::ChannelId CreateChannel(
+      webrtc::Transport* transport,
+      absl::optional<uint32_t> local_ssrc) override {
+    return static_cast<webrtc::ChannelId>(1);
+  }
+  webrtc::VoipResult ReleaseChannel(webrtc::ChannelId channel_id) override {
+    return webrtc::VoipResult::kOk;
+  }
+  webrtc::VoipResult StartSend(webrtc::ChannelId channel_id) override {
+    return webrtc::VoipResult::kOk;
+  }
+  webrtc::VoipResult StopSend(webrtc::ChannelId channel_id) override {
+    return webrtc::VoipResult::kOk;
+  }
+  webrtc::VoipResult StartPlayout(webrtc::ChannelId channel_id) override {
+    return webrtc::VoipResult::kOk;
+  }
+  webrtc::VoipResult StopPlayout(webrtc::ChannelId channel_id) override {
+    return webrtc::VoipResult::kOk;
+  }
+
+  // webrtc::VoipNetwork implementation.
+  webrtc::VoipResult ReceivedRTPPacket(
+      webrtc::ChannelId channel_id,
+      rtc::ArrayView<const uint8_t> rtp_packet) override {
+    if (remaining_.fetch_sub(1) == 1 && done_) {
+      done_->Set();
+    }
+    return webrtc::VoipResult::kOk;
+  }
+  webrtc::VoipResult ReceivedRTCPPacket(
+      webrtc::ChannelId channel_id,
+      rtc::ArrayView<const uint8_t> rtcp_packet) override {
+    return webrtc::VoipResult::kOk;
+  }
+
+  // webrtc::VoipCodec implementation.
+  webrtc::VoipResult SetSendCodec(
+      webrtc::ChannelId channel_id,
+      int payload_type,
+      const webrtc::SdpAudioFormat& encoder_spec) override {
+    return webrtc::VoipResult::kOk;
+  }
+  webrtc::VoipResult SetReceiveCodecs(
+      webrtc::ChannelId channel_id,
+      const std::map<int, webrtc::SdpAudioFormat>& decoder_specs) override {
+    return webrtc::VoipResult::kOk;
+  }
+
+  // webrtc::VoipDtmf implementation.
+  webrtc::VoipResult RegisterTelephoneEventType(webrtc::ChannelId channel_id,
+                                                int rtp_payload_type,
+                                                int sample_rate_hz) override {
+    return webrtc::VoipResult::kOk;
+  }
+  webrtc::VoipResult SendDtmfEvent(webrtc::ChannelId channel_id,
+                                   webrtc::DtmfEvent dtmf_event,
+                                   int duration_ms) override {
+    return webrtc::VoipResult::kOk;
+  }
+
+  // webrtc::VoipStatistics implementation.
+  webrtc::VoipResult GetIngressStatistics(
+      webrtc::ChannelId channel_id,
+      webrtc::IngressStatistics& ingress_stats) override {
+    return webrtc::VoipResult::kOk;
+  }
+  webrtc::VoipResult GetChannelStatistics(
+      webrtc::ChannelId channel_id,
+      webrtc::ChannelStatistics& channel_stats) override {
+    return webrtc::VoipResult::kOk;
+  }
+
+  // webrtc::VoipVolumeControl implementation.
+  webrtc::VoipResult SetInputMuted(webrtc::ChannelId channel_id,
+                                   bool enable) override {
+    return webrtc::VoipResult::kOk;
+  }
+  webrtc::VoipResult GetInputVolumeInfo(
+      webrtc::ChannelId channel_id,
+      webrtc::VolumeInfo& volume_info) override {
+    return webrtc::VoipResult::kOk;
+  }
+  webrtc::VoipResult GetOutputVolumeInfo(
+      webrtc::ChannelId channel_id,
+      webrtc::VolumeInfo& volume_info) override {
+    return webrtc::VoipResult::kOk;
+  }
+
+ private:
+  std::atomic<uint64_t> remaining_{0};
+  rtc::Event* done_ = nullptr;
+};
+
+}  // namespace webrtc_examples
+
+#endif  // EXAMPLES_VOIPCLIENT_PACKET_PATH_FAKES_H_
@@ -0,0 +1,237 @@
+/*
+ *  Copyright 2023 The WebRTC Project Authors. All rights reserved.
+ *
+ *  Use of this source code is governed by a BSD-style license
+ *  that can be found in the LICENSE file in the root of the source
+ *  tree. An additional intellectual property rights grant can be found
+ *  in the file PATENTS.  All contributing project authors may
+ *  be found in the AUTHORS file in the root of the source tree.
+ */
+
+// Compares the two ways a media shard reads its sockets on the same load:
+//
+//   socket server: a readiness event and a recvmmsg() per socket and wakeup;
+//   io_uring:      one IoUringReceiver reaping multishot receives of all
+//                  sockets, with no system call per packet.
+//
+// --sessions MediaSockets on loopback each receive a --packet_size datagram
+// every --packet_interval_ms, as from that many paced audio streams, for
+// --duration_s. For each backend the CPU time of the receiving thread, the
+// receive system calls (recvmmsg() or io_uring_enter()) and the wakeups
+// that read packets are reported per packet. Both backends wait for
+// readiness in the same epoll_wait(), which is not counted.
+
+#include <netinet/in.h>
+#include <stdint.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <cstdio>
+#include <memory>
+#include <vector>
+
+#include "absl/flags/flag.h"
+#include "absl/flags/parse.h"
+#include "api/array_view.h"
+#include "examples/voipclient/io_uring_receiver.h"
+#include "examples/voipclient/media_socket.h"
+#include "rtc_base/checks.h"
+#include "rtc_base/physical_socket_server.h"
+#include "rtc_base/socket_address.h"
+#include "rtc_base/thread.h"
+#include "rtc_base/time_utils.h"
+
+ABSL_FLAG(int, sessions, 200, "Receiving sockets, one stream each.");
+ABSL_FLAG(int, packet_interval_ms, 20, "Interval of each stream's packets.");
+ABSL_FLAG(int, packet_size, 172, "Packet size in bytes (PCMU 20 ms).");
+ABSL_FLAG(int, duration_s, 5, "Seconds measured per backend.");
+ABSL_FLAG(int, base_port, 46000, "First local UDP port used.");
+
+using webrtc_examples::IoUringReceiver;
+using webrtc_examples::MediaSocket;
+
+namespace {
+
+constexpr char kLoopback[] = "127.0.0.1";
+// Time for the packets in flight to be read after the last is sent.
+constexpr int kDrainMs = 100;
+
+// Counters of the receiving thread a run is measured from.
+struct Snapshot {
+  int64_t cpu_ns = 0;
+  uint64_t packets = 0;
+  uint64_t receive_calls = 0;
+  uint64_t wakeups = 0;
+};
+
+int64_t ThreadCpuNs() {
+  timespec now;
+  RTC_CHECK_EQ(clock_gettime(CLOCK_THREAD_CPUTIME_ID, &now), 0);
+  return now.tv_sec * rtc::kNumNanosecsPerSec + now.tv_nsec;
+}
+
+// The receiving side of one run: a thread, its sockets and, for the
+// io_uring backend, the receiver reading them.
+class Receiver {
+ public:
+  // Returns null if the backend is unavailable.
+  static std::unique_ptr<Receiver> Create(bool io_uring) {
+    auto socket_server = std::make_unique<rtc::PhysicalSocketServer>();
+    std::unique_ptr<Receiver> receiver(new Receiver(std::move(socket_server)));
+    if (!receiver->thread_->BlockingCall(
+            [&] { return receiver->Open(io_uring); })) {
+      return nullptr;
+    }
+    return receiver;
+  }
+
+  ~Receiver() {
+    thread_->BlockingCall([this] {
+      sockets_.clear();
+      io_uring_receiver_.reset();
+    });
+    thread_->Stop();
+  }
+
+  Snapshot Read() {
+    return thread_->BlockingCall([this] {
+      Snapshot snapshot;
+      snapshot.cpu_ns = ThreadCpuNs();
+      snapshot.packets = packets_;
+      for (const auto& socket : sockets_) {
+        snapshot.receive_calls += socket->GetReceiveStats().receive_calls;
+      }
+      if (io_uring_receiver_) {
+        IoUringReceiver::Stats stats = io_uring_receiver_->GetStats();
+        snapshot.receive_calls += stats.enter_calls;
+        snapshot.wakeups = stats.wakeups;
+      } else {
+        // One recvmmsg() per readiness event.
+        snapshot.wakeups = snapshot.receive_calls;
+      }
+      return snapshot;
+    });
+  }
+
+ private:
+  explicit Receiver(std::unique_ptr<rtc::PhysicalSocketServer> socket_server)
+      : socket_server_(socket_server.get()),
+        thread_(std::make_unique<rtc::Thread>(std::move(socket_server))) {
+    thread_->SetName("receiver", nullptr);
+    thread_->Start();
+  }
+
+  bool Open(bool io_uring) {
+    if (io_uring) {
+      io_uring_receiver_ =
+          IoUringReceiver::Create(socket_server_, IoUringReceiver::Options());
+      if (!io_uring_receiver_) {
+        return false;
+      }
+    }
+    MediaSocket::Options options;
+    options.io_uring_receiver = io_uring_receiver_.get();
+    const int base_port = absl::GetFlag(FLAGS_base_port);
+    for (int i = 0; i < absl::GetFlag(FLAGS_sessions); ++i) {
+      std::unique_ptr<MediaSocket> socket =
+          MediaSocket::Create(thread_.get(), socket_server_,
+                              rtc::SocketAddress(kLoopback, base_port + i),
+                              options);
+      RTC_CHECK(socket);
+      socket->SetReceiveCallback(
+          [this](rtc::ArrayView<const MediaSocket::ReceivedPacket> packets) {
+            packets_ += packets.size();
+          });
+      sockets_.push_back(std::move(socket));
+    }
+    return true;
+  }
+
+  rtc::PhysicalSocketServer* const socket_server_;
+  std::unique_ptr<rtc::Thread> thread_;
+  std::unique_ptr<IoUringReceiver> io_uring_receiver_;
+  std::vector<std::unique_ptr<MediaSocket>> sockets_;
+  uint64_t packets_ = 0;
+};
+
+// Sends one packet to every session each interval for the run's duration
+// and returns the number sent.
+uint64_t SendStreams() {
+  const int sessions = absl::GetFlag(FLAGS_sessions);
+  const int base_port = absl::GetFlag(FLAGS_base_port);
+  std::vector<uint8_t> packet(absl::GetFlag(FLAGS_packet_size), 0);
+  packet[0] = 0x80;
+  iovec iov = {packet.data(), packet.size()};
+  std::vector<sockaddr_in> addresses(sessions);
+  std::vector<mmsghdr> messages(sessions);
+  for (int i = 0; i < sessions; ++i) {
+    addresses[i].sin_family = AF_INET;
+    addresses[i].sin_port = htons(base_port + i);
+    addresses[i].sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    messages[i] = {};
+    messages[i].msg_hdr.msg_name = &addresses[i];
+    messages[i].msg_hdr.msg_namelen = sizeof(addresses[i]);
+    messages[i].msg_hdr.msg_iov = &iov;
+    messages[i].msg_hdr.msg_iovlen = 1;
+  }
+
+  int fd = socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+  RTC_CHECK_GE(fd, 0);
+  const int64_t interval_us =
+      absl::GetFlag(FLAGS_packet_interval_ms) * rtc::kNumMicrosecsPerMillisec;
+  const int64_t end_us = rtc::TimeMicros() + absl::GetFlag(FLAGS_duration_s) *
+                                                 rtc::kNumMicrosecsPerSec;
+  uint64_t sent = 0;
+  for (int64_t next_us = rtc::TimeMicros(); next_us < end_us;
+       next_us += interval_us) {
+    for (int offset = 0; offset < sessions;) {
+      int count = sendmmsg(fd, &messages[offset], sessions - offset, 0);
+      RTC_CHECK_GT(count, 0);
+      offset += count;
+      sent += count;
+    }
+    const int64_t wait_us = next_us + interval_us - rtc::TimeMicros();
+    if (wait_us > 0) {
+      usleep(wait_us);
+    }
+  }
+  close(fd);
+  return sent;
+}
+
+void Run(const char* backend, bool io_uring) {
+  std::unique_ptr<Receiver> receiver = Receiver::Create(io_uring);
+  if (!receiver) {
+    printf("%-14s unavailable\n", backend);
+    return;
+  }
+  Snapshot before = receiver->Read();
+  const uint64_t sent = SendStreams();
+  usleep(kDrainMs * rtc::kNumMicrosecsPerMillisec);
+  Snapshot after = receiver->Read();
+
+  const uint64_t received = after.packets - before.packets;
+  const double per_packet = received > 0 ? 1.0 / received : 0;
+  printf("%-14s %10llu %7.2f %14.1f %16.3f %15.3f\n", backend,
+         static_cast<unsigned long long>(received),
+         sent > received ? 100.0 * (sent - received) / sent : 0,
+         (after.cpu_ns - before.cpu_ns) * per_packet,
+         (after.receive_calls - before.receive_calls) * per_packet,
+         (after.wakeups - before.wakeups) * per_packet);
+  fflush(stdout);
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  absl::ParseCommandLine(argc, argv);
+  RTC_CHECK_GT(absl::GetFlag(FLAGS_sessions), 0);
+  RTC_CHECK_GT(absl::GetFlag(FLAGS_packet_interval_ms), 0);
+
+  printf("%-14s %10s %7s %14s %16s %15s\n", "backend", "packets", "loss%",
+         "cpu_ns/packet", "syscalls/packet", "wakeups/packet");
+  Run("socket server", /*io_uring=*/false);
+  Run("io_uring", /*io_uring=*/true);
+  return 0;
+}
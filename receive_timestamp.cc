@@ -0,0 +1,66 @@
+/*
+ *  Copyright 2023 The WebRTC Project Authors. All rights reserved.
+ *
+ *  Use of this source code is governed by a BSD-style license
+ *  that can be found in the LICENSE file in the root of the source
+ *  tree. An additional intellectual property rights grant can be found
+ *  in the file PATENTS.  All contributing project authors may
+ *  be found in the AUTHORS file in the root of the source tree.
+ */
+
+#include "examples/voipclient/receive_timestamp.h"
+
+#include <linux/net_tstamp.h>
+#include <string.h>
+
+#include "rtc_base/logging.h"
+#include "rtc_base/time_utils.h"
+
+namespace webrtc_examples {
+
+namespace {
+
+int64_t ToNanoseconds(const timespec& time) {
+  return time.tv_sec * rtc::kNumNanosecsPerSec + time.tv_nsec;
+}
+
+}  // namespace
+
+bool EnableReceiveTimestamps(int fd, bool hardware) {
+  // Software stamps are always generated; the hardware ones only where the
+  // device has been configured for them.
+  int flags = SOF_TIMESTAMPING_RX_SOFTWARE | SOF_TIMESTAMPING_SOFTWARE;
+  if (hardware) {
+    flags |= SOF_TIMESTAMPING_RX_HARDWARE | SOF_TIMESTAMPING_RAW_HARDWARE;
+  }
+  if (setsockopt(fd, SOL_SOCKET, SO_TIMESTAMPING, &flags, sizeof(flags)) <
+      0) {
+    RTC_LOG_ERR(LS_WARNING) << "SO_TIMESTAMPING failed";
+    return false;
+  }
+  return true;
+}
+
+ReceiveTimestamp ParseReceiveTimestamp(const msghdr& header) {
+  ReceiveTimestamp timestamp;
+  for (cmsghdr* control = CMSG_FIRSTHDR(&header); control;
+       control = CMSG_NXTHDR(const_cast<msghdr*>(&header), control)) {
+    if (control->cmsg_level != SOL_SOCKET ||
+        control->cmsg_type != SCM_TIMESTAMPING ||
+        control->cmsg_len < CMSG_LEN(sizeof(scm_timestamping))) {
+      continue;
+    }
+    // Index 0 holds the software stamp, 2 the raw hardware one.
+    scm_timestamping times;
+    memcpy(&times, CMSG_DATA(control), sizeof(times));
+    if (times.ts[2].tv_sec != 0 || times.ts[2].tv_nsec != 0) {
+      timestamp.time_ns = ToNanoseconds(times.ts[2]);
+      timestamp.hardware = true;
+    } else {
+      timestamp.time_ns = ToNanoseconds(times.ts[0]);
+    }
+  }
+  return timestamp;
+}
+
+}  // namespace webrtc_examples
@@ -0,0 +1,52 @@
+/*
+ *  Copyright 2023 The WebRTC Project Authors. All rights reserved.
+ *
+ *  Use of this source code is governed by a BSD-style license
+ *  that can be found in the LICENSE file in the root of the source
+ *  tree. An additional intellectual property rights grant can be found
+ *  in the file PATENTS.  All contributing project authors may
+ *  be found in the AUTHORS file in the root of the source tree.
+ */
+
+#ifndef EXAMPLES_VOIPCLIENT_RECEIVE_TIMESTAMP_H_
+#define EXAMPLES_VOIPCLIENT_RECEIVE_TIMESTAMP_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/socket.h>
+#include <time.h>
+
+// Uses struct timespec without declaring it.
+#include <linux/errqueue.h>
+
+namespace webrtc_examples {
+
+// The time a datagram reached the host, as the kernel reports it with
+// SO_TIMESTAMPING: stamped by the NIC where the driver supports hardware
+// receive timestamps and they are enabled on the device (SIOCSHWTSTAMP, as
+// by hwstamp_ctl), and by the kernel's receive path otherwise. Hardware
+// times are on the NIC's PTP hardware clock, which ptp4l usually runs in
+// TAI rather than UTC, so they are only requested when that clock is
+// known to be synchronised to the system clock, as by phc2sys.
+struct ReceiveTimestamp {
+  // CLOCK_REALTIME nanoseconds; zero if the datagram carried none.
+  int64_t time_ns = 0;
+  bool hardware = false;
+};
+
+// Ancillary data space a received message needs for its timestamp.
+constexpr size_t kReceiveTimestampControlSize =
+    CMSG_SPACE(sizeof(scm_timestamping));
+
+// Asks the kernel to timestamp the datagrams received on `fd` on the system
+// clock, and with `hardware` to report the NIC's stamps as well. Returns
+// false on failure.
+bool EnableReceiveTimestamps(int fd, bool hardware);
+
+// Reads the timestamp from the ancillary data of a received message,
+// preferring the hardware one, which is only there if requested.
+ReceiveTimestamp ParseReceiveTimestamp(const msghdr& header);
+
+}  // namespace webrtc_examples
+
+#endif  // EXAMPLES_VOIPCLIENT_RECEIVE_TIMESTAMP_H_
@@ -0,0 +1,234 @@
+/*
+ *  Copyright 2023 The WebRTC Project Authors. All rights reserved.
+ *
+ *  Use of this source code is governed by a BSD-style license
+ *  that can be found in the LICENSE file in the root of the source
+ *  tree. An additional intellectual property rights grant can be found
+ *  in the file PATENTS.  All contributing project authors may
+ *  be found in the AUTHORS file in the root of the source tree.
+ */
+
+#include "examples/voipclient/rtp_file_reader.h"
+
+#include <netinet/in.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <algorithm>
+#include <utility>
+
+#include "absl/strings/match.h"
+#include "absl/strings/string_view.h"
+#include "api/array_view.h"
+#include "examples/voipclient/rtp_utils.h"
+#include "rtc_base/logging.h"
+#include "rtc_base/time_utils.h"
+
+namespace webrtc_examples {
+
+namespace {
+
+// Largest pcap record accepted whatever the snap length claims; the
+// default snap length of tcpdump.
+constexpr uint32_t kMaxPcapRecordSize = 262144;
+
+uint16_t ReadBigEndian16(const uint8_t* data) {
+  return static_cast<uint16_t>((data[0] << 8) | data[1]);
+}
+
+// Returns the UDP payload of an IPv4 or IPv6 packet, or an empty view,
+// also for datagrams neither from nor to a non-zero `udp_port`.
+rtc::ArrayView<const uint8_t> GetUdpPayload(
+    rtc::ArrayView<const uint8_t> packet,
+    int udp_port) {
+  if (packet.empty()) {
+    return {};
+  }
+  size_t udp_offset;
+  const int version = packet[0] >> 4;
+  if (version == 4 && packet.size() >= 20) {
+    const size_t header_size = (packet[0] & 0x0f) * 4;
+    const bool fragment = (ReadBigEndian16(&packet[6]) & 0x3fff) != 0;
+    if (packet[9] != IPPROTO_UDP || fragment) {
+      return {};
+    }
+    udp_offset = header_size;
+  } else if (version == 6 && packet.size() >= 40) {
+    // Extension headers are not followed.
+    if (packet[6] != IPPROTO_UDP) {
+      return {};
+    }
+    udp_offset = 40;
+  } else {
+    return {};
+  }
+  if (packet.size() < udp_offset + 8) {
+    return {};
+  }
+  if (udp_port != 0 && ReadBigEndian16(&packet[udp_offset]) != udp_port &&
+      ReadBigEndian16(&packet[udp_offset + 2]) != udp_port) {
+    return {};
+  }
+  const size_t udp_size = ReadBigEndian16(&packet[udp_offset + 4]);
+  if (udp_size < 8 || udp_offset + udp_size > packet.size()) {
+    return {};
+  }
+  return packet.subview(udp_offset + 8, udp_size - 8);
+}
+
+// Strips the link layer of a pcap record. Returns an empty view for
+// anything but IP.
+rtc::ArrayView<const uint8_t> GetIpPacket(uint32_t link_type,
+                                          rtc::ArrayView<const uint8_t> frame) {
+  size_t offset;
+  uint16_t ether_type;
+  switch (link_type) {
+    case 101:  // LINKTYPE_RAW
+    case 228:  // LINKTYPE_IPV4
+    case 229:  // LINKTYPE_IPV6
+      return frame;
+    case 1:  // LINKTYPE_ETHERNET
+      if (frame.size() < 14) {
+        return {};
+      }
+      offset = 14;
+      ether_type = ReadBigEndian16(&frame[12]);
+      // 802.1Q VLAN tag.
+      if (ether_type == 0x8100 && frame.size() >= 18) {
+        offset = 18;
+        ether_type = ReadBigEndian16(&frame[16]);
+      }
+      break;
+    case 113:  // LINKTYPE_LINUX_SLL
+      if (frame.size() < 16) {
+        return {};
+      }
+      offset = 16;
+      ether_type = ReadBigEndian16(&frame[14]);
+      break;
+    case 276:  // LINKTYPE_LINUX_SLL2
+      if (frame.size() < 20) {
+        return {};
+      }
+      offset = 20;
+      ether_type = ReadBigEndian16(&frame[0]);
+      break;
+    default:
+      return {};
+  }
+  if (ether_type != 0x0800 && ether_type != 0x86dd) {
+    return {};
+  }
+  return frame.subview(offset);
+}
+
+bool ReadPcap(FILE* file,
+              int udp_port,
+              std::vector<RecordedRtpPacket>* packets) {
+  uint8_t header[24];
+  if (fread(header, sizeof(header), 1, file) != 1) {
+    return false;
+  }
+  uint32_t magic;
+  memcpy(&magic, header, sizeof(magic));
+  const bool swapped = magic == 0xd4c3b2a1 || magic == 0x4d3cb2a1;
+  const bool nanoseconds = magic == 0xa1b23c4d || magic == 0x4d3cb2a1;
+  if (!swapped && magic != 0xa1b2c3d4 && !nanoseconds) {
+    RTC_LOG(LS_ERROR) << "Not a pcap or rtpdump file";
+    return false;
+  }
+  auto read32 = [swapped](const uint8_t* data) {
+    uint32_t value;
+    memcpy(&value, data, sizeof(value));
+    return swapped ? __builtin_bswap32(value) : value;
+  };
+  const uint32_t snap_length = read32(header + 16);
+  const uint32_t link_type = read32(header + 20);
+
+  std::vector<uint8_t> frame;
+  uint8_t record[16];
+  while (fread(record, sizeof(record), 1, file) == 1) {
+    const uint32_t captured_length = read32(record + 8);
+    if (captured_length > std::min(snap_length, kMaxPcapRecordSize)) {
+      RTC_LOG(LS_ERROR) << "Corrupt pcap record of " << captured_length
+                        << " bytes";
+      return false;
+    }
+    frame.resize(captured_length);
+    if (captured_length > 0 &&
+        fread(frame.data(), captured_length, 1, file) != 1) {
+      break;
+    }
+    rtc::ArrayView<const uint8_t> payload =
+        GetUdpPayload(GetIpPacket(link_type, frame), udp_port);
+    if (payload.size() < kMinRtpHeaderSize || (payload[0] >> 6) != 2 ||
+        IsRtcpPacket(payload.data(), payload.size())) {
+      continue;
+    }
+    const int64_t fraction = read32(record + 4);
+    RecordedRtpPacket packet;
+    packet.time_us = int64_t{read32(record)} * rtc::kNumMicrosecsPerSec +
+                     (nanoseconds ? fraction / 1000 : fraction);
+    packet.data.assign(payload.begin(), payload.end());
+    packets->push_back(std::move(packet));
+  }
+  return true;
+}
+
+// rtpdump as written by rtptools: a "#!rtpplay1.0 address/port" line, a
+// 16 byte file header, then packets each preceded by their length, the
+// RTP length (0 for RTCP) and the offset from the start in ms.
+bool ReadRtpDump(FILE* file, std::vector<RecordedRtpPacket>* packets) {
+  int c;
+  while ((c = fgetc(file)) != EOF && c != '\n') {
+  }
+  uint8_t file_header[16];
+  if (c == EOF || fread(file_header, sizeof(file_header), 1, file) != 1) {
+    return false;
+  }
+  uint8_t header[8];
+  while (fread(header, sizeof(header), 1, file) == 1) {
+    const uint16_t length = ReadBigEndian16(header);
+    const uint16_t rtp_length = ReadBigEndian16(header + 2);
+    if (length < sizeof(header)) {
+      break;
+    }
+    RecordedRtpPacket packet;
+    packet.data.resize(length - sizeof(header));
+    if (!packet.data.empty() &&
+        fread(packet.data.data(), packet.data.size(), 1, file) != 1) {
+      break;
+    }
+    if (rtp_length == 0 || packet.data.size() < kMinRtpHeaderSize) {
+      continue;
+    }
+    packet.data.resize(std::min<size_t>(rtp_length, packet.data.size()));
+    packet.time_us = int64_t{ReadBigEndian32(header + 4)} *
+                     rtc::kNumMicrosecsPerMillisec;
+    packets->push_back(std::move(packet));
+  }
+  return true;
+}
+
+}  // namespace
+
+bool ReadRtpFile(const std::string& path,
+                 int udp_port,
+                 std::vector<RecordedRtpPacket>* packets) {
+  FILE* file = fopen(path.c_str(), "rb");
+  if (!file) {
+    RTC_LOG(LS_ERROR) << "Cannot open " << path;
+    return false;
+  }
+  char magic[9];
+  const size_t magic_size = fread(magic, 1, sizeof(magic), file);
+  rewind(file);
+  const bool ok =
+      absl::StartsWith(absl::string_view(magic, magic_size), "#!rtpplay")
+          ? ReadRtpDump(file, packets)
+          : ReadPcap(file, udp_port, packets);
+  fclose(file);
+  return ok;
+}
+
+}  // namespace webrtc_examples
@@ -0,0 +1,39 @@
+/*
+ *  Copyright 2023 The WebRTC Project Authors. All rights reserved.
+ *
+ *  Use of this source code is governed by a BSD-style license
+ *  that can be found in the LICENSE file in the root of the source
+ *  tree. An additional intellectual property rights grant can be found
+ *  in the file PATENTS.  All contributing project authors may
+ *  be found in the AUTHORS file in the root of the source tree.
+ */
+
+#ifndef EXAMPLES_VOIPCLIENT_RTP_FILE_READER_H_
+#define EXAMPLES_VOIPCLIENT_RTP_FILE_READER_H_
+
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+namespace webrtc_examples {
+
+struct RecordedRtpPacket {
+  // Capture time, relative to an arbitrary origin.
+  int64_t time_us;
+  std::vector<uint8_t> data;
+};
+
+// Appends the RTP packets of a pcap or rtpdump file to `packets` in file
+// order; RTCP is skipped. pcap files may use raw IP (as written by
+// PacketCapture), Ethernet or Linux cooked capture framing, with IPv4 or
+// IPv6 UDP inside; a non-zero `udp_port` keeps only the datagrams from or
+// to that port. A truncated last packet ends the file. Returns false if
+// the file cannot be opened, is in neither format or is corrupt.
+bool ReadRtpFile(const std::string& path,
+                 int udp_port,
+                 std::vector<RecordedRtpPacket>* packets);
+
+}  // namespace webrtc_examples
+
+#endif  // EXAMPLES_VOIPCLIENT_RTP_FILE_READER_H_
@@ -0,0 +1,272 @@
+/*
+ *  Copyright 2023 The WebRTC Project Authors. All rights reserved.
+ *
+ *  Use of this source code is governed by a BSD-style license
+ *  that can be found in the LICENSE file in the root of the source
+ *  tree. An additional intellectual property rights grant can be found
+ *  in the file PATENTS.  All contributing project authors may
+ *  be found in the AUTHORS file in the root of the source tree.
+ */
+
+#include "examples/voipclient/rtp_file_reader.h"
+
+#include <netinet/in.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include <string>
+#include <vector>
+
+#include "test/gtest.h"
+#include "test/testsupport/file_utils.h"
+
+namespace webrtc_examples {
+namespace {
+
+constexpr uint32_t kLinkTypeEthernet = 1;
+constexpr uint32_t kLinkTypeRaw = 101;
+constexpr uint16_t kLocalPort = 5000;
+constexpr uint16_t kRemotePort = 6000;
+
+void Append16(std::vector<uint8_t>* data, uint16_t value) {
+  data->push_back(static_cast<uint8_t>(value >> 8));
+  data->push_back(static_cast<uint8_t>(value));
+}
+
+void Append32(std::vector<uint8_t>* data, uint32_t value) {
+  Append16(data, static_cast<uint16_t>(value >> 16));
+  Append16(data, static_cast<uint16_t>(value));
+}
+
+std::vector<uint8_t> MakeRtpPacket(uint32_t ssrc, uint16_t sequence_number) {
+  std::vector<uint8_t> packet = {0x80, 0x00};
+  Append16(&packet, sequence_number);
+  Append32(&packet, /*timestamp=*/160u * sequence_number);
+  Append32(&packet, ssrc);
+  packet.insert(packet.end(), 20, 0xff);
+  return packet;
+}
+
+std::vector<uint8_t> MakeRtcpPacket(uint32_t sender_ssrc) {
+  std::vector<uint8_t> packet = {0x80, 201, 0x00, 0x01};
+  Append32(&packet, sender_ssrc);
+  return packet;
+}
+
+// `payload` in a UDP datagram from kRemotePort to `destination_port`,
+// behind an IPv4 header.
+std::vector<uint8_t> MakeIpv4Packet(const std::vector<uint8_t>& payload,
+                                    uint16_t destination_port = kLocalPort,
+                                    uint8_t protocol = IPPROTO_UDP) {
+  std::vector<uint8_t> packet = {0x45, 0x00};
+  Append16(&packet, static_cast<uint16_t>(28 + payload.size()));
+  packet.insert(packet.end(), {0, 0, 0x40, 0x00, 64, protocol, 0, 0});
+  packet.insert(packet.end(), {192, 0, 2, 1, 192, 0, 2, 2});
+  Append16(&packet, kRemotePort);
+  Append16(&packet, destination_port);
+  Append16(&packet, static_cast<uint16_t>(8 + payload.size()));
+  Append16(&packet, 0);
+  packet.insert(packet.end(), payload.begin(), payload.end());
+  return packet;
+}
+
+// Writes a pcap file in big-endian byte order, which readers on
+// little-endian hosts see as swapped.
+class PcapWriter {
+ public:
+  PcapWriter(uint32_t link_type, bool nanoseconds, uint32_t snap_length) {
+    Append32(&data_, nanoseconds ? 0xa1b23c4d : 0xa1b2c3d4);
+    Append16(&data_, 2);
+    Append16(&data_, 4);
+    Append32(&data_, 0);
+    Append32(&data_, 0);
+    Append32(&data_, snap_length);
+    Append32(&data_, link_type);
+  }
+
+  void AddRecord(uint32_t seconds,
+                 uint32_t fraction,
+                 const std::vector<uint8_t>& frame) {
+    Append32(&data_, seconds);
+    Append32(&data_, fraction);
+    Append32(&data_, static_cast<uint32_t>(frame.size()));
+    Append32(&data_, static_cast<uint32_t>(frame.size()));
+    data_.insert(data_.end(), frame.begin(), frame.end());
+  }
+
+  std::vector<uint8_t>& data() { return data_; }
+
+ private:
+  std::vector<uint8_t> data_;
+};
+
+class RtpFileReaderTest : public ::testing::Test {
+ protected:
+  RtpFileReaderTest()
+      : path_(webrtc::test::TempFilename(webrtc::test::OutputPath(),
+                                         "rtp_file_reader_test")) {}
+  ~RtpFileReaderTest() override { webrtc::test::RemoveFile(path_); }
+
+  void WriteFile(const std::vector<uint8_t>& data) {
+    FILE* file = fopen(path_.c_str(), "wb");
+    ASSERT_TRUE(file);
+    ASSERT_EQ(fwrite(data.data(), 1, data.size(), file), data.size());
+    fclose(file);
+  }
+
+  const std::string path_;
+};
+
+TEST_F(RtpFileReaderTest, ReadsRtpFromRawIpPcap) {
+  PcapWriter pcap(kLinkTypeRaw, /*nanoseconds=*/false, 65535);
+  pcap.AddRecord(10, 500000, MakeIpv4Packet(MakeRtpPacket(1234, 1)));
+  pcap.AddRecord(10, 520000, MakeIpv4Packet(MakeRtcpPacket(1234)));
+  pcap.AddRecord(10, 530000,
+                 MakeIpv4Packet(MakeRtpPacket(1234, 9), kLocalPort,
+                                IPPROTO_TCP));
+  pcap.AddRecord(11, 0, MakeIpv4Packet(MakeRtpPacket(1234, 2)));
+  WriteFile(pcap.data());
+
+  std::vector<RecordedRtpPacket> packets;
+  ASSERT_TRUE(ReadRtpFile(path_, /*udp_port=*/0, &packets));
+  ASSERT_EQ(packets.size(), 2u);
+  EXPECT_EQ(packets[0].data, MakeRtpPacket(1234, 1));
+  EXPECT_EQ(packets[0].time_us, 10500000);
+  EXPECT_EQ(packets[1].data, MakeRtpPacket(1234, 2));
+  EXPECT_EQ(packets[1].time_us, 11000000);
+}
+
+TEST_F(RtpFileReaderTest, ReadsNanosecondPcap) {
+  PcapWriter pcap(kLinkTypeRaw, /*nanoseconds=*/true, 65535);
+  pcap.AddRecord(1, 2345678, MakeIpv4Packet(MakeRtpPacket(1, 1)));
+  WriteFile(pcap.data());
+
+  std::vector<RecordedRtpPacket> packets;
+  ASSERT_TRUE(ReadRtpFile(path_, /*udp_port=*/0, &packets));
+  ASSERT_EQ(packets.size(), 1u);
+  EXPECT_EQ(packets[0].time_us, 1002345);
+}
+
+TEST_F(RtpFileReaderTest, StripsEthernetAndVlanHeaders) {
+  const std::vector<uint8_t> ip = MakeIpv4Packet(MakeRtpPacket(1, 1));
+  std::vector<uint8_t> ethernet(12, 0);
+  Append16(&ethernet, 0x0800);
+  ethernet.insert(ethernet.end(), ip.begin(), ip.end());
+  std::vector<uint8_t> vlan(12, 0);
+  Append16(&vlan, 0x8100);
+  Append16(&vlan, 42);
+  Append16(&vlan, 0x0800);
+  vlan.insert(vlan.end(), ip.begin(), ip.end());
+  std::vector<uint8_t> arp(12, 0);
+  Append16(&arp, 0x0806);
+  arp.insert(arp.end(), ip.begin(), ip.end());
+
+  PcapWriter pcap(kLinkTypeEthernet, /*nanoseconds=*/false, 65535);
+  pcap.AddRecord(0, 0, ethernet);
+  pcap.AddRecord(0, 0, vlan);
+  pcap.AddRecord(0, 0, arp);
+  WriteFile(pcap.data());
+
+  std::vector<RecordedRtpPacket> packets;
+  ASSERT_TRUE(ReadRtpFile(path_, /*udp_port=*/0, &packets));
+  EXPECT_EQ(packets.size(), 2u);
+}
+
+TEST_F(RtpFileReaderTest, FiltersByUdpPort) {
+  PcapWriter pcap(kLinkTypeRaw, /*nanoseconds=*/false, 65535);
+  pcap.AddRecord(0, 0, MakeIpv4Packet(MakeRtpPacket(1, 1), kLocalPort));
+  pcap.AddRecord(0, 0, MakeIpv4Packet(MakeRtpPacket(2, 1), kLocalPort + 2));
+  WriteFile(pcap.data());
+
+  std::vector<RecordedRtpPacket> packets;
+  ASSERT_TRUE(ReadRtpFile(path_, kLocalPort + 2, &packets));
+  ASSERT_EQ(packets.size(), 1u);
+  EXPECT_EQ(packets[0].data, MakeRtpPacket(2, 1));
+
+  packets.clear();
+  // The source port matches too.
+  ASSERT_TRUE(ReadRtpFile(path_, kRemotePort, &packets));
+  EXPECT_EQ(packets.size(), 2u);
+}
+
+TEST_F(RtpFileReaderTest, TruncatedLastRecordEndsFile) {
+  PcapWriter pcap(kLinkTypeRaw, /*nanoseconds=*/false, 65535);
+  pcap.AddRecord(0, 0, MakeIpv4Packet(MakeRtpPacket(1, 1)));
+  pcap.AddRecord(0, 0, MakeIpv4Packet(MakeRtpPacket(1, 2)));
+  pcap.data().resize(pcap.data().size() - 5);
+  WriteFile(pcap.data());
+
+  std::vector<RecordedRtpPacket> packets;
+  ASSERT_TRUE(ReadRtpFile(path_, /*udp_port=*/0, &packets));
+  EXPECT_EQ(packets.size(), 1u);
+}
+
+TEST_F(RtpFileReaderTest, RejectsRecordBeyondSnapLength) {
+  PcapWriter pcap(kLinkTypeRaw, /*nanoseconds=*/false, /*snap_length=*/32);
+  pcap.AddRecord(0, 0, MakeIpv4Packet(MakeRtpPacket(1, 1)));
+  WriteFile(pcap.data());
+
+  std::vector<RecordedRtpPacket> packets;
+  EXPECT_FALSE(ReadRtpFile(path_, /*udp_port=*/0, &packets));
+}
+
+TEST_F(RtpFileReaderTest, RejectsUnknownFormat) {
+  WriteFile(std::vector<uint8_t>(64, 0x42));
+
+  std::vector<RecordedRtpPacket> packets;
+  EXPECT_FALSE(ReadRtpFile(path_, /*udp_port=*/0, &packets));
+}
+
+TEST_F(RtpFileReaderTest, FailsOnMissingFile) {
+  std::vector<RecordedRtpPacket> packets;
+  EXPECT_FALSE(
+      ReadRtpFile(path_ + ".missing", /*udp_port=*/0, &packets));
+}
+
+TEST_F(RtpFileReaderTest, ReadsRtpDump) {
+  const std::string first_line = "#!rtpplay1.0 192.0.2.1/5000\n";
+  std::vector<uint8_t> dump(first_line.begin(), first_line.end());
+  // Start time, source address and port, padding.
+  dump.insert(dump.end(), 16, 0);
+  auto add_packet = [&dump](const std::vector<uint8_t>& packet,
+                            bool rtcp, uint32_t offset_ms) {
+    Append16(&dump, static_cast<uint16_t>(8 + packet.size()));
+    Append16(&dump, rtcp ? 0 : static_cast<uint16_t>(packet.size()));
+    Append32(&dump, offset_ms);
+    dump.insert(dump.end(), packet.begin(), packet.end());
+  };
+  add_packet(MakeRtpPacket(7, 1), /*rtcp=*/false, 0);
+  add_packet(MakeRtcpPacket(7), /*rtcp=*/true, 10);
+  add_packet(MakeRtpPacket(7, 2), /*rtcp=*/false, 20);
+  WriteFile(dump);
+
+  std::vector<RecordedRtpPacket> packets;
+  ASSERT_TRUE(ReadRtpFile(path_, /*udp_port=*/0, &packets));
+  ASSERT_EQ(packets.size(), 2u);
+  EXPECT_EQ(packets[0].data, MakeRtpPacket(7, 1));
+  EXPECT_EQ(packets[0].time_us, 0);
+  EXPECT_EQ(packets[1].data, MakeRtpPacket(7, 2));
+  EXPECT_EQ(packets[1].time_us, 20000);
+}
+
+TEST_F(RtpFileReaderTest, RtpDumpPacketIsCutToRtpLength) {
+  const std::string first_line = "#!rtpplay1.0 192.0.2.1/5000\n";
+  std::vector<uint8_t> dump(first_line.begin(), first_line.end());
+  dump.insert(dump.end(), 16, 0);
+  // Captured with four bytes of trailing padding.
+  std::vector<uint8_t> packet = MakeRtpPacket(7, 1);
+  Append16(&dump, static_cast<uint16_t>(8 + packet.size() + 4));
+  Append16(&dump, static_cast<uint16_t>(packet.size()));
+  Append32(&dump, 0);
+  dump.insert(dump.end(), packet.begin(), packet.end());
+  dump.insert(dump.end(), 4, 0);
+  WriteFile(dump);
+
+  std::vector<RecordedRtpPacket> packets;
+  ASSERT_TRUE(ReadRtpFile(path_, /*udp_port=*/0, &packets));
+  ASSERT_EQ(packets.size(), 1u);
+  EXPECT_EQ(packets[0].data, packet);
+}
+
+}  // namespace
+}  // namespace webrtc_examples
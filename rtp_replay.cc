@@ -0,0 +1,326 @@
+/*
+ *  Copyright 2023 The WebRTC Project Authors. All rights reserved.
+ *
+ *  Use of this source code is governed by a BSD-style license
+ *  that can be found in the LICENSE file in the root of the source
+ *  tree. An additional intellectual property rights grant can be found
+ *  in the file PATENTS.  All contributing project authors may
+ *  be found in the AUTHORS file in the root of the source tree.
+ */
+
+// Replays one RTP stream from a pcap or rtpdump file into a VoipEngine
+// channel through Network().ReceivedRTPPacket and writes the decoded
+// audio to a WAV file.
+//
+// Playout is pulled by the tool itself, 10 ms at a time, instead of by a
+// sound card or timer thread, and the packets captured up to each 10 ms
+// point are delivered right before it. NetEq measures time in those pulls,
+// so the jitter buffer sees the capture's arrival pattern whether the run
+// is paced to the original timing (--realtime) or goes as fast as the
+// decoder allows. The latter makes a per-codec decode throughput benchmark
+// and a deterministic reproduction of field captures.
+//
+// The file is read by ReadRtpFile(), which takes the pcap framings
+// PacketCapture and tcpdump write and skips RTCP.
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <sys/resource.h>
+#include <unistd.h>
+
+#include <cstdio>
+#include <map>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "absl/flags/flag.h"
+#include "absl/flags/parse.h"
+#include "absl/strings/match.h"
+#include "api/array_view.h"
+#include "api/audio_codecs/builtin_audio_decoder_factory.h"
+#include "api/audio_codecs/builtin_audio_encoder_factory.h"
+#include "api/call/transport.h"
+#include "api/make_ref_counted.h"
+#include "api/task_queue/default_task_queue_factory.h"
+#include "api/voip/voip_base.h"
+#include "api/voip/voip_codec.h"
+#include "api/voip/voip_engine.h"
+#include "api/voip/voip_engine_factory.h"
+#include "api/voip/voip_network.h"
+#include "api/voip/voip_statistics.h"
+#include "examples/voipclient/rtp_file_reader.h"
+#include "examples/voipclient/rtp_utils.h"
+#include "modules/audio_device/include/audio_device_default.h"
+#include "modules/audio_device/include/test_audio_device.h"
+#include "modules/audio_processing/include/audio_processing.h"
+#include "rtc_base/checks.h"
+#include "rtc_base/time_utils.h"
+
+ABSL_FLAG(std::string, input, "", "pcap or rtpdump file to replay.");
+ABSL_FLAG(std::string,
+          output,
+          "",
+          "WAV file the decoded audio is written to; empty discards it.");
+ABSL_FLAG(bool,
+          realtime,
+          false,
+          "Deliver packets at their original timing instead of as fast as "
+          "possible.");
+ABSL_FLAG(uint32_t,
+          ssrc,
+          0,
+          "Stream to replay; 0 picks the first RTP stream in the file.");
+ABSL_FLAG(int,
+          udp_port,
+          0,
+          "Only consider pcap packets to or from this port; 0 takes all.");
+ABSL_FLAG(std::vector<std::string>,
+          payload_types,
+          {},
+          "Extra payload type mappings as pt=codec, e.g. 111=opus. The "
+          "VoipClient assignments (0 PCMU, 8 PCMA, 9 G722, 96 opus, "
+          "97 ISAC, 98 ILBC) apply otherwise.");
+ABSL_FLAG(int, sample_rate_hz, 48000, "Playout and WAV sample rate.");
+ABSL_FLAG(int,
+          tail_ms,
+          500,
+          "Keep playing out for this long after the last packet.");
+
+namespace {
+
+using webrtc_examples::ParseRtpSsrc;
+using webrtc_examples::ReadRtpFile;
+using webrtc_examples::RecordedRtpPacket;
+
+constexpr int64_t kPlayoutIntervalUs = 10000;
+// Keeps the packets of `ssrc`, or of the first stream if zero, and
+// returns the SSRC kept.
+uint32_t SelectStream(uint32_t ssrc, std::vector<RecordedRtpPacket>* packets) {
+  std::vector<RecordedRtpPacket> selected;
+  for (RecordedRtpPacket& packet : *packets) {
+    uint32_t packet_ssrc;
+    ParseRtpSsrc(packet.data.data(), packet.data.size(), &packet_ssrc);
+    if (ssrc == 0) {
+      ssrc = packet_ssrc;
+    }
+    if (packet_ssrc == ssrc) {
+      selected.push_back(std::move(packet));
+    }
+  }
+  *packets = std::move(selected);
+  return ssrc;
+}
+
+std::map<int, webrtc::SdpAudioFormat> GetReceiveCodecs(
+    const std::vector<webrtc::AudioCodecSpec>& supported_codecs) {
+  std::map<int, std::string> names = {{0, "PCMU"}, {8, "PCMA"},
+                                      {9, "G722"},  {96, "opus"},
+                                      {97, "ISAC"}, {98, "ILBC"}};
+  for (const std::string& mapping : absl::GetFlag(FLAGS_payload_types)) {
+    size_t equals = mapping.find('=');
+    if (equals == std::string::npos) {
+      fprintf(stderr, "Ignoring payload type mapping %s\n", mapping.c_str());
+      continue;
+    }
+    names[atoi(mapping.substr(0, equals).c_str())] =
+        mapping.substr(equals + 1);
+  }
+
+  std::map<int, webrtc::SdpAudioFormat> codecs;
+  for (const auto& entry : names) {
+    for (const webrtc::AudioCodecSpec& codec : supported_codecs) {
+      if (absl::EqualsIgnoreCase(codec.format.name, entry.second)) {
+        codecs.insert({entry.first, codec.format});
+        break;
+      }
+    }
+  }
+  return codecs;
+}
+
+int64_t CpuTimeUs() {
+  rusage usage;
+  RTC_CHECK_EQ(getrusage(RUSAGE_SELF, &usage), 0);
+  return (usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) *
+             rtc::kNumMicrosecsPerSec +
+         usage.ru_utime.tv_usec + usage.ru_stime.tv_usec;
+}
+
+// Audio device whose playout is pulled by the replay loop through
+// PullPlayout() rather than by a device or timer thread. Recording is
+// never started.
+class ReplayAudioDevice
+    : public webrtc::webrtc_impl::AudioDeviceModuleDefault<
+          webrtc::AudioDeviceModule> {
+ public:
+  ReplayAudioDevice(
+      int sample_rate_hz,
+      std::unique_ptr<webrtc::TestAudioDeviceModule::Renderer> renderer)
+      : sample_rate_hz_(sample_rate_hz),
+        renderer_(std::move(renderer)),
+        samples_(sample_rate_hz / 100) {}
+
+  // Plays out the next 10 ms.
+  void PullPlayout() {
+    RTC_CHECK(transport_);
+    size_t samples_out = 0;
+    int64_t elapsed_time_ms = 0;
+    int64_t ntp_time_ms = 0;
+    transport_->NeedMorePlayData(samples_.size(), sizeof(int16_t),
+                                 /*nChannels=*/1, sample_rate_hz_,
+                                 samples_.data(), samples_out,
+                                 &elapsed_time_ms, &ntp_time_ms);
+    if (renderer_) {
+      renderer_->Render(samples_);
+    }
+  }
+
+  // webrtc::AudioDeviceModule implementation.
+  int32_t RegisterAudioCallback(webrtc::AudioTransport* transport) override {
+    transport_ = transport;
+    return 0;
+  }
+  int32_t StartPlayout() override {
+    playing_ = true;
+    return 0;
+  }
+  int32_t StopPlayout() override {
+    playing_ = false;
+    return 0;
+  }
+  bool Playing() const override { return playing_; }
+
+ private:
+  const int sample_rate_hz_;
+  const std::unique_ptr<webrtc::TestAudioDeviceModule::Renderer> renderer_;
+  std::vector<int16_t> samples_;
+  webrtc::AudioTransport* transport_ = nullptr;
+  bool playing_ = false;
+};
+
+// The channel's RTCP reports go nowhere.
+class NullTransport : public webrtc::Transport {
+ public:
+  bool SendRtp(const uint8_t* packet,
+               size_t length,
+               const webrtc::PacketOptions& options) override {
+    return true;
+  }
+  bool SendRtcp(const uint8_t* packet, size_t length) override {
+    return true;
+  }
+};
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  absl::ParseCommandLine(argc, argv);
+
+  std::vector<RecordedRtpPacket> packets;
+  const std::string input = absl::GetFlag(FLAGS_input);
+  if (!ReadRtpFile(input, absl::GetFlag(FLAGS_udp_port), &packets)) {
+    fprintf(stderr, "Cannot read RTP packets from %s\n", input.c_str());
+    return 1;
+  }
+  const uint32_t ssrc = SelectStream(absl::GetFlag(FLAGS_ssrc), &packets);
+  if (packets.empty()) {
+    fprintf(stderr, "No RTP packets to replay\n");
+    return 1;
+  }
+
+  const int sample_rate_hz = absl::GetFlag(FLAGS_sample_rate_hz);
+  std::unique_ptr<webrtc::TestAudioDeviceModule::Renderer> renderer;
+  const std::string output = absl::GetFlag(FLAGS_output);
+  if (!output.empty()) {
+    renderer = webrtc::TestAudioDeviceModule::CreateWavFileWriter(
+        output, sample_rate_hz, /*num_channels=*/1);
+  }
+  auto device = rtc::make_ref_counted<ReplayAudioDevice>(sample_rate_hz,
+                                                         std::move(renderer));
+
+  webrtc::VoipEngineConfig config;
+  config.encoder_factory = webrtc::CreateBuiltinAudioEncoderFactory();
+  config.decoder_factory = webrtc::CreateBuiltinAudioDecoderFactory();
+  config.task_queue_factory = webrtc::CreateDefaultTaskQueueFactory();
+  config.audio_device_module = device;
+  config.audio_processing = webrtc::AudioProcessingBuilder().Create();
+  const std::map<int, webrtc::SdpAudioFormat> codecs =
+      GetReceiveCodecs(config.decoder_factory->GetSupportedDecoders());
+  std::unique_ptr<webrtc::VoipEngine> engine =
+      webrtc::CreateVoipEngine(std::move(config));
+
+  const int payload_type = packets[0].data[1] & 0x7f;
+  auto codec = codecs.find(payload_type);
+  if (codec == codecs.end()) {
+    fprintf(stderr, "No decoder for payload type %d; see --payload_types\n",
+            payload_type);
+    return 1;
+  }
+
+  NullTransport transport;
+  webrtc::ChannelId channel =
+      engine->Base().CreateChannel(&transport, absl::nullopt);
+  RTC_CHECK(engine->Codec().SetReceiveCodecs(channel, codecs) ==
+            webrtc::VoipResult::kOk);
+  RTC_CHECK(engine->Base().StartPlayout(channel) == webrtc::VoipResult::kOk);
+
+  const bool realtime = absl::GetFlag(FLAGS_realtime);
+  const int64_t first_us = packets.front().time_us;
+  const int64_t end_us = packets.back().time_us - first_us +
+                         absl::GetFlag(FLAGS_tail_ms) *
+                             rtc::kNumMicrosecsPerMillisec;
+  const int64_t start_wall_us = rtc::TimeMicros();
+  const int64_t start_cpu_us = CpuTimeUs();
+  size_t next = 0;
+  int64_t media_us = 0;
+  for (; media_us <= end_us; media_us += kPlayoutIntervalUs) {
+    if (realtime) {
+      const int64_t wait_us = start_wall_us + media_us - rtc::TimeMicros();
+      if (wait_us > 0) {
+        usleep(wait_us);
+      }
+    }
+    while (next < packets.size() &&
+           packets[next].time_us - first_us <= media_us) {
+      engine->Network().ReceivedRTPPacket(channel, packets[next].data);
+      ++next;
+    }
+    device->PullPlayout();
+  }
+  const int64_t wall_us = rtc::TimeMicros() - start_wall_us;
+  const int64_t cpu_us = CpuTimeUs() - start_cpu_us;
+
+  webrtc::IngressStatistics ingress;
+  engine->Statistics().GetIngressStatistics(channel, ingress);
+  engine->Base().StopPlayout(channel);
+  engine->Base().ReleaseChannel(channel);
+
+  const webrtc::NetEqLifetimeStatistics& neteq = ingress.neteq_stats;
+  const double media_s = static_cast<double>(media_us) / 1e6;
+  printf("ssrc %u, payload type %d (%s), %zu packets\n", ssrc, payload_type,
+         codec->second.name.c_str(), packets.size());
+  printf("%.1f s of audio in %.3f s wall, %.3f s CPU: %.1fx real time, "
+         "%.2f ms CPU per s of audio\n",
+         media_s, wall_us / 1e6, cpu_us / 1e6,
+         wall_us > 0 ? media_us / static_cast<double>(wall_us) : 0.0,
+         media_s > 0 ? cpu_us / 1e3 / media_s : 0.0);
+  printf("jitter buffer: %.1f ms mean delay, %.1f ms target, "
+         "%llu concealment events, %.2f%% concealed, %llu packets "
+         "discarded\n",
+         neteq.jitter_buffer_emitted_count > 0
+             ? static_cast<double>(neteq.jitter_buffer_delay_ms) /
+                   neteq.jitter_buffer_emitted_count
+             : 0.0,
+         neteq.jitter_buffer_emitted_count > 0
+             ? static_cast<double>(neteq.jitter_buffer_target_delay_ms) /
+                   neteq.jitter_buffer_emitted_count
+             : 0.0,
+         static_cast<unsigned long long>(neteq.concealment_events),
+         neteq.total_samples_received > 0
+             ? 100.0 * neteq.concealed_samples / neteq.total_samples_received
+             : 0.0,
+         static_cast<unsigned long long>(neteq.packets_discarded));
+  return 0;
+}
@@ -0,0 +1,62 @@
+/*
+ *  Copyright 2023 The WebRTC Project Authors. All rights reserved.
+ *
+ *  Use of this source code is governed by a BSD-style license
+ *  that can be found in the LICENSE file in the root of the source
+ *  tree. An additional intellectual property rights grant can be found
+ *  in the file PATENTS.  All contributing project authors may
+ *  be found in the AUTHORS file in the root of the source tree.
+ */
+
+#ifndef EXAMPLES_VOIPCLIENT_RTP_UTILS_H_
+#define EXAMPLES_VOIPCLIENT_RTP_UTILS_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace webrtc_examples {
+
+// Minimal header parsing for routing packets before they reach the engine.
+// The engine does full validation; these only look at fixed offsets.
+
+constexpr size_t kMinRtpHeaderSize = 12;
+constexpr size_t kMinRtcpHeaderSize = 8;
+
+inline uint32_t ReadBigEndian32(const uint8_t* data) {
+  return (static_cast<uint32_t>(data[0]) << 24) |
+         (static_cast<uint32_t>(data[1]) << 16) |
+         (static_cast<uint32_t>(data[2]) << 8) | static_cast<uint32_t>(data[3]);
+}
+
+// Returns false if `data` is too short to carry an RTP header.
+inline bool ParseRtpSsrc(const uint8_t* data, size_t size, uint32_t* ssrc) {
+  if (size < kMinRtpHeaderSize) {
+    return false;
+  }
+  *ssrc = ReadBigEndian32(data + 8);
+  return true;
+}
+
+// Returns the SSRC of the sender of the first packet in an RTCP compound
+// packet, or false if `data` is too short.
+inline bool ParseRtcpSenderSsrc(const uint8_t* data,
+                                size_t size,
+                                uint32_t* ssrc) {
+  if (size < kMinRtcpHeaderSize) {
+    return false;
+  }
+  *ssrc = ReadBigEndian32(data + 4);
+  return true;
+}
+
+// Tells RTCP from RTP on a multiplexed socket (RFC 5761, section 4). RTCP
+// packet types 192-223 occupy the marker bit and payload type byte of an RTP
+// header in a range that RTP payload types must not use when muxing.
+inline bool IsRtcpPacket(const uint8_t* data, size_t size) {
+  return size >= 2 && (data[0] >> 6) == 2 && data[1] >= 192 &&
+         data[1] <= 223;
+}
+
+}  // namespace webrtc_examples
+
+#endif  // EXAMPLES_VOIPCLIENT_RTP_UTILS_H_
@@ -0,0 +1,73 @@
+/*
+ *  Copyright 2023 The WebRTC Project Authors. All rights reserved.
+ *
+ *  Use of this source code is governed by a BSD-style license
+ *  that can be found in the LICENSE file in the root of the source
+ *  tree. An additional intellectual property rights grant can be found
+ *  in the file PATENTS.  All contributing project authors may
+ *  be found in the AUTHORS file in the root of the source tree.
+ */
+
+#include "examples/voipclient/rtp_utils.h"
+
+#include <stdint.h>
+
+#include "test/gtest.h"
+
+namespace webrtc_examples {
+namespace {
+
+TEST(RtpUtilsTest, RtcpPacketTypesAreRtcp) {
+  for (int packet_type = 192; packet_type <= 223; ++packet_type) {
+    const uint8_t packet[] = {0x80, static_cast<uint8_t>(packet_type)};
+    EXPECT_TRUE(IsRtcpPacket(packet, sizeof(packet))) << packet_type;
+  }
+}
+
+TEST(RtpUtilsTest, RtpPayloadTypesAreNotRtcp) {
+  for (int payload_type = 0; payload_type < 128; ++payload_type) {
+    const uint8_t packet[] = {0x80, static_cast<uint8_t>(payload_type)};
+    EXPECT_FALSE(IsRtcpPacket(packet, sizeof(packet))) << payload_type;
+    // With the marker bit set, payload types 64 to 95 would read as RTCP;
+    // RFC 5761 keeps them unused when muxing for that reason.
+    if (payload_type < 64 || payload_type >= 96) {
+      const uint8_t marked[] = {0x80,
+                                static_cast<uint8_t>(0x80 | payload_type)};
+      EXPECT_FALSE(IsRtcpPacket(marked, sizeof(marked))) << payload_type;
+    }
+  }
+}
+
+TEST(RtpUtilsTest, RtcpNeedsVersionTwo) {
+  const uint8_t version_one[] = {0x40, 200};
+  const uint8_t version_three[] = {0xc0, 200};
+  EXPECT_FALSE(IsRtcpPacket(version_one, sizeof(version_one)));
+  EXPECT_FALSE(IsRtcpPacket(version_three, sizeof(version_three)));
+}
+
+TEST(RtpUtilsTest, ShortPacketsAreNotRtcp) {
+  const uint8_t packet[] = {0x80, 200};
+  EXPECT_FALSE(IsRtcpPacket(packet, 0));
+  EXPECT_FALSE(IsRtcpPacket(packet, 1));
+}
+
+TEST(RtpUtilsTest, ParsesRtpSsrc) {
+  const uint8_t packet[] = {0x80, 0x00, 0x00, 0x01, 0x00, 0x00,
+                            0x00, 0xa0, 0x12, 0x34, 0x56, 0x78};
+  uint32_t ssrc = 0;
+  ASSERT_TRUE(ParseRtpSsrc(packet, sizeof(packet), &ssrc));
+  EXPECT_EQ(ssrc, 0x12345678u);
+  EXPECT_FALSE(ParseRtpSsrc(packet, sizeof(packet) - 1, &ssrc));
+}
+
+TEST(RtpUtilsTest, ParsesRtcpSenderSsrc) {
+  // Receiver report without report blocks.
+  const uint8_t packet[] = {0x80, 201, 0x00, 0x01, 0xca, 0xfe, 0xba, 0xbe};
+  uint32_t ssrc = 0;
+  ASSERT_TRUE(ParseRtcpSenderSsrc(packet, sizeof(packet), &ssrc));
+  EXPECT_EQ(ssrc, 0xcafebabeu);
+  EXPECT_FALSE(ParseRtcpSenderSsrc(packet, sizeof(packet) - 1, &ssrc));
+}
+
+}  // namespace
+}  // namespace webrtc_examples
@@ -0,0 +1,172 @@
+/*
+ *  Copyright 2023 The WebRTC Project Authors. All rights reserved.
+ *
+ *  Use of this source code is governed by a BSD-style license
+ *  that can be found in the LICENSE file in the root of the source
+ *  tree. An additional intellectual property rights grant can be found
+ *  in the file PATENTS.  All contributing project authors may
+ *  be found in the AUTHORS file in the root of the source tree.
+ */
+
+// Measures the latency from a session's SendRtp() being called on the
+// encoder's thread to the packet arriving on a loopback UDP socket, for each
+// VoipClient::SendMode.
+
+#include <netinet/in.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <memory>
+#include <vector>
+
+#include "absl/flags/flag.h"
+#include "absl/flags/parse.h"
+#include "api/call/transport.h"
+#include "examples/voipclient/packet_buffer_pool.h"
+#include "examples/voipclient/voip_client.h"
+#include "rtc_base/checks.h"
+#include "rtc_base/platform_thread.h"
+#include "rtc_base/thread.h"
+#include "rtc_base/time_utils.h"
+
+ABSL_FLAG(int, packets, 10000, "Number of packets sent per mode.");
+ABSL_FLAG(int, interval_us, 1000, "Pause between packets, in microseconds.");
+ABSL_FLAG(int,
+          packet_size,
+          172,
+          "Packet size in bytes (PCMU 20 ms); at least 16, for the sequence "
+          "number and send time, and at most 1500.");
+ABSL_FLAG(int, base_port, 41000, "First local UDP port used.");
+
+using webrtc_examples::PacketBuffer;
+using webrtc_examples::VoipClient;
+
+namespace {
+
+constexpr char kLoopback[] = "127.0.0.1";
+
+struct Sample {
+  uint32_t sequence;
+  int64_t send_time_ns;
+};
+
+// Blocking receiver bound to `port`; records one latency per packet.
+class Receiver {
+ public:
+  explicit Receiver(int port) {
+    fd_ = socket(AF_INET, SOCK_DGRAM, 0);
+    sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    RTC_CHECK_EQ(
+        bind(fd_, reinterpret_cast<const sockaddr*>(&addr), sizeof(addr)), 0);
+    timeval timeout = {/*tv_sec=*/1, /*tv_usec=*/0};
+    setsockopt(fd_, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+  }
+  ~Receiver() { close(fd_); }
+
+  // Receives until `expected` packets arrived or the socket times out.
+  std::vector<int64_t> Run(int expected) {
+    std::vector<int64_t> latencies_ns;
+    latencies_ns.reserve(expected);
+    uint8_t buffer[2048];
+    while (static_cast<int>(latencies_ns.size()) < expected) {
+      ssize_t size = recv(fd_, buffer, sizeof(buffer), 0);
+      int64_t now_ns = rtc::TimeNanos();
+      if (size < static_cast<ssize_t>(sizeof(Sample))) {
+        break;
+      }
+      Sample sample;
+      memcpy(&sample, buffer, sizeof(sample));
+      latencies_ns.push_back(now_ns - sample.send_time_ns);
+    }
+    return latencies_ns;
+  }
+
+ private:
+  int fd_;
+};
+
+int64_t Percentile(const std::vector<int64_t>& sorted, double fraction) {
+  if (sorted.empty()) {
+    return 0;
+  }
+  size_t index = static_cast<size_t>(fraction * (sorted.size() - 1));
+  return sorted[index];
+}
+
+void RunMode(VoipClient::SendMode mode, const char* name, int local_port) {
+  const int packets = absl::GetFlag(FLAGS_packets);
+  const int remote_port = local_port + 2;
+
+  VoipClient::Config config;
+  config.send_mode = mode;
+  config.audio_device.type = webrtc_examples::AudioDeviceType::kNull;
+  std::unique_ptr<VoipClient> client(VoipClient::Create(config));
+  RTC_CHECK(client);
+  client->SetLocalAddress(VoipClient::kDefaultSessionId, kLoopback,
+                          local_port);
+  client->SetRemoteAddress(VoipClient::kDefaultSessionId, kLoopback,
+                           remote_port);
+  client->StartSession(VoipClient::kDefaultSessionId);
+  // Blocks until the posted session setup above has run.
+  webrtc::Transport* transport =
+      client->GetTransportForTesting(VoipClient::kDefaultSessionId);
+  RTC_CHECK(transport);
+
+  Receiver receiver(remote_port);
+  std::vector<int64_t> latencies_ns;
+  auto receive_thread = rtc::PlatformThread::SpawnJoinable(
+      [&] { latencies_ns = receiver.Run(packets); }, "receiver",
+      rtc::ThreadAttributes().SetPriority(rtc::ThreadPriority::kRealtime));
+
+  // Stands in for the engine's encoder task queue.
+  auto encoder_thread = rtc::PlatformThread::SpawnJoinable(
+      [&] {
+        std::vector<uint8_t> packet(absl::GetFlag(FLAGS_packet_size));
+        for (int i = 0; i < packets; ++i) {
+          Sample sample = {static_cast<uint32_t>(i), rtc::TimeNanos()};
+          memcpy(packet.data(), &sample, sizeof(sample));
+          transport->SendRtp(packet.data(), packet.size(),
+                             webrtc::PacketOptions());
+          usleep(absl::GetFlag(FLAGS_interval_us));
+        }
+      },
+      "encoder",
+      rtc::ThreadAttributes().SetPriority(rtc::ThreadPriority::kRealtime));
+
+  encoder_thread.Finalize();
+  receive_thread.Finalize();
+  client->StopSession(VoipClient::kDefaultSessionId);
+
+  std::sort(latencies_ns.begin(), latencies_ns.end());
+  printf("%-12s sent=%d received=%zu p50=%.1fus p99=%.1fus p999=%.1fus\n",
+         name, packets, latencies_ns.size(),
+         Percentile(latencies_ns, 0.5) / 1000.0,
+         Percentile(latencies_ns, 0.99) / 1000.0,
+         Percentile(latencies_ns, 0.999) / 1000.0);
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  absl::ParseCommandLine(argc, argv);
+  // Each packet carries a Sample, and must fit the buffer SendRtp() copies
+  // it into.
+  const int packet_size = absl::GetFlag(FLAGS_packet_size);
+  if (packet_size < static_cast<int>(sizeof(Sample)) ||
+      packet_size > static_cast<int>(PacketBuffer::kCapacity)) {
+    fprintf(stderr, "--packet_size must be between %zu and %zu\n",
+            sizeof(Sample), PacketBuffer::kCapacity);
+    return 1;
+  }
+
+  const int base_port = absl::GetFlag(FLAGS_base_port);
+  RunMode(VoipClient::SendMode::kVoipThread, "voip_thread", base_port);
+  RunMode(VoipClient::SendMode::kDirect, "direct", base_port + 4);
+  return 0;
+}
@@ -0,0 +1,129 @@
+/*
+ *  Copyright 2023 The WebRTC Project Authors. All rights reserved.
+ *
+ *  Use of this source code is governed by a BSD-style license
+ *  that can be found in the LICENSE file in the root of the source
+ *  tree. An additional intellectual property rights grant can be found
+ *  in the file PATENTS.  All contributing project authors may
+ *  be found in the AUTHORS file in the root of the source tree.
+ */
+
+#include "examples/voipclient/shared_port_group.h"
+
+#include <linux/filter.h>
+#include <sys/socket.h>
+
+#include <iterator>
+
+#include "rtc_base/checks.h"
+#include "rtc_base/logging.h"
+
+namespace webrtc_examples {
+
+SharedPortGroup::SharedPortGroup(int size, Steering steering)
+    : size_(size), steering_(steering), removed_sessions_(size) {
+  RTC_DCHECK_GT(size, 0);
+}
+
+bool SharedPortGroup::AttachSsrcSteering(int fd) const {
+  // Runs on the UDP payload. The second byte tells RTCP (packet types 192
+  // to 223, as in IsRtcpPacket()) from RTP; the word at offset 4 is then
+  // the sender SSRC, and at offset 8 the RTP SSRC. A packet too short to
+  // read aborts the program, which sends it to socket 0.
+  sock_filter program[] = {
+      BPF_STMT(BPF_LD | BPF_B | BPF_ABS, 1),
+      BPF_JUMP(BPF_JMP | BPF_JGE | BPF_K, 192, 0, 3),
+      BPF_JUMP(BPF_JMP | BPF_JGE | BPF_K, 224, 2, 0),
+      BPF_STMT(BPF_LD | BPF_W | BPF_ABS, 4),
+      BPF_STMT(BPF_JMP | BPF_JA, 1),
+      BPF_STMT(BPF_LD | BPF_W | BPF_ABS, 8),
+      BPF_STMT(BPF_ALU | BPF_MOD | BPF_K, static_cast<uint32_t>(size_)),
+      BPF_STMT(BPF_RET | BPF_A, 0),
+  };
+  sock_fprog prog = {static_cast<unsigned short>(std::size(program)),
+                     program};
+  if (setsockopt(fd, SOL_SOCKET, SO_ATTACH_REUSEPORT_CBPF, &prog,
+                 sizeof(prog)) < 0) {
+    RTC_LOG_ERR(LS_WARNING) << "SO_ATTACH_REUSEPORT_CBPF failed";
+    return false;
+  }
+  return true;
+}
+
+bool SharedPortGroup::SetRoutes(SessionId session,
+                                MediaShard* owner,
+                                const rtc::SocketAddress& rtp_address,
+                                const rtc::SocketAddress& rtcp_address,
+                                absl::optional<uint32_t> remote_ssrc) {
+  webrtc::MutexLock lock(&mutex_);
+  RemoveRoutesLocked(session);
+  for (const rtc::SocketAddress* address : {&rtp_address, &rtcp_address}) {
+    auto range = routes_.equal_range(*address);
+    for (auto it = range.first; it != range.second; ++it) {
+      const Route& other = it->second;
+      if (!remote_ssrc || !other.ssrc || *other.ssrc == *remote_ssrc) {
+        RTC_LOG(LS_ERROR) << "Session " << session << " and session "
+                          << other.session << " both receive from "
+                          << address->ToString()
+                          << " without distinct remote SSRCs";
+        return false;
+      }
+    }
+  }
+  routes_.emplace(rtp_address, Route{session, owner, remote_ssrc});
+  // The same address with rtcp-mux.
+  if (rtcp_address != rtp_address) {
+    routes_.emplace(rtcp_address, Route{session, owner, remote_ssrc});
+  }
+  return true;
+}
+
+void SharedPortGroup::RemoveSession(SessionId session) {
+  webrtc::MutexLock lock(&mutex_);
+  RemoveRoutesLocked(session);
+}
+
+bool SharedPortGroup::Lookup(uint32_t ssrc,
+                             const rtc::SocketAddress& source,
+                             SessionId* session,
+                             MediaShard** owner) const {
+  webrtc::MutexLock lock(&mutex_);
+  auto range = routes_.equal_range(source);
+  for (auto it = range.first; it != range.second; ++it) {
+    // A route without an SSRC is alone at its address.
+    if (!it->second.ssrc || *it->second.ssrc == ssrc) {
+      *session = it->second.session;
+      *owner = it->second.owner;
+      return true;
+    }
+  }
+  return false;
+}
+
+std::vector<SessionId> SharedPortGroup::TakeRemovedSessions(int shard_index) {
+  std::vector<SessionId> sessions;
+  webrtc::MutexLock lock(&mutex_);
+  sessions.swap(removed_sessions_[shard_index]);
+  return sessions;
+}
+
+void SharedPortGroup::RemoveRoutesLocked(SessionId session) {
+  bool removed = false;
+  for (auto it = routes_.begin(); it != routes_.end();) {
+    if (it->second.session == session) {
+      it = routes_.erase(it);
+      removed = true;
+    } else {
+      ++it;
+    }
+  }
+  if (!removed) {
+    return;
+  }
+  for (std::vector<SessionId>& sessions : removed_sessions_) {
+    sessions.push_back(session);
+  }
+  removal_generation_.fetch_add(1, std::memory_order_release);
+}
+
+}  // namespace webrtc_examples
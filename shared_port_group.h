@@ -0,0 +1,126 @@
+/*
+ *  Copyright 2023 The WebRTC Project Authors. All rights reserved.
+ *
+ *  Use of this source code is governed by a BSD-style license
+ *  that can be found in the LICENSE file in the root of the source
+ *  tree. An additional intellectual property rights grant can be found
+ *  in the file PATENTS.  All contributing project authors may
+ *  be found in the AUTHORS file in the root of the source tree.
+ */
+
+#ifndef EXAMPLES_VOIPCLIENT_SHARED_PORT_GROUP_H_
+#define EXAMPLES_VOIPCLIENT_SHARED_PORT_GROUP_H_
+
+#include <stdint.h>
+
+#include <atomic>
+#include <map>
+#include <vector>
+
+#include "absl/types/optional.h"
+#include "examples/voipclient/voip_session.h"
+#include "rtc_base/socket_address.h"
+#include "rtc_base/synchronization/mutex.h"
+#include "rtc_base/thread_annotations.h"
+
+namespace webrtc_examples {
+
+class MediaShard;
+
+// The media shards that serve one shared port. With more than one shard,
+// each binds its own SO_REUSEPORT socket to the port, so the kernel spreads
+// the datagrams over the shard threads instead of one socket and one thread
+// reading them all. A stream always arrives at the same shard: the one
+// picked by the kernel's hash of its source address, or with
+// Steering::kSsrc by a classic BPF program keyed on its SSRC, which keeps
+// the streams of one remote address apart as well.
+//
+// The shard reading a packet need not be the one its session lives on; it
+// then forwards the packet there in a batch, so sessions, and the jitter
+// buffers of their channels, are still only fed from one thread. VoipClient
+// avoids that with Steering::kSsrc by placing each session that declares
+// its remote SSRC on the shard the program steers that SSRC to.
+//
+// Holds the remote addresses of every session, and the remote SSRC of those
+// that declared one, which each shard consults when it learns a stream.
+// Sessions whose peers share an address, behind an SFU or gateway, must
+// each declare the SSRC they receive. Thread-safe.
+class SharedPortGroup {
+ public:
+  enum class Steering {
+    // Hash of the source and destination address and port.
+    kKernelHash,
+    // SSRC of the RTP packet or the sender of the RTCP packet, modulo the
+    // number of shards.
+    kSsrc,
+  };
+
+  SharedPortGroup(int size, Steering steering);
+
+  SharedPortGroup(const SharedPortGroup&) = delete;
+  SharedPortGroup& operator=(const SharedPortGroup&) = delete;
+
+  // Number of shards, and of sockets bound to each shared port.
+  int size() const { return size_; }
+  Steering steering() const { return steering_; }
+
+  // Installs the steering program on the SO_REUSEPORT group of `fd`, a
+  // bound socket. Shard i must be the i-th to bind each port, as the
+  // program returns the index of a socket in the group. Returns false if
+  // the kernel refuses the program; the kernel hash is used then.
+  bool AttachSsrcSteering(int fd) const;
+
+  // Replaces the remote addresses and SSRC of `session`, which lives on
+  // `owner`. Without `remote_ssrc` the session takes every stream from its
+  // addresses. Returns false, leaving the session without routes, if
+  // another session has one of the addresses and the two are not told
+  // apart by distinct declared SSRCs.
+  bool SetRoutes(SessionId session,
+                 MediaShard* owner,
+                 const rtc::SocketAddress& rtp_address,
+                 const rtc::SocketAddress& rtcp_address,
+                 absl::optional<uint32_t> remote_ssrc);
+  void RemoveSession(SessionId session);
+
+  // Returns false if no session takes the stream `ssrc` from `source`.
+  bool Lookup(uint32_t ssrc,
+              const rtc::SocketAddress& source,
+              SessionId* session,
+              MediaShard** owner) const;
+
+  // Changes whenever a route is removed; cheap enough to read per batch.
+  uint64_t removal_generation() const {
+    return removal_generation_.load(std::memory_order_acquire);
+  }
+  // Returns the sessions removed since the last call for `shard_index`,
+  // whose learned streams the shard must drop.
+  std::vector<SessionId> TakeRemovedSessions(int shard_index);
+
+ private:
+  struct Route {
+    SessionId session;
+    MediaShard* owner;
+    // Empty if the session takes any stream from the address.
+    absl::optional<uint32_t> ssrc;
+  };
+
+  // Drops the routes of `session` and queues its removal for every shard.
+  void RemoveRoutesLocked(SessionId session)
+      RTC_EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
+  const int size_;
+  const Steering steering_;
+
+  mutable webrtc::Mutex mutex_;
+  // By remote address. Several routes share an address only if each has a
+  // distinct SSRC.
+  std::multimap<rtc::SocketAddress, Route> routes_ RTC_GUARDED_BY(mutex_);
+  // By shard index.
+  std::vector<std::vector<SessionId>> removed_sessions_
+      RTC_GUARDED_BY(mutex_);
+  std::atomic<uint64_t> removal_generation_{0};
+};
+
+}  // namespace webrtc_examples
+
+#endif  // EXAMPLES_VOIPCLIENT_SHARED_PORT_GROUP_H_
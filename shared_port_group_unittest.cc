@@ -0,0 +1,203 @@
+/*
+ *  Copyright 2023 The WebRTC Project Authors. All rights reserved.
+ *
+ *  Use of this source code is governed by a BSD-style license
+ *  that can be found in the LICENSE file in the root of the source
+ *  tree. An additional intellectual property rights grant can be found
+ *  in the file PATENTS.  All contributing project authors may
+ *  be found in the AUTHORS file in the root of the source tree.
+ */
+
+#include "examples/voipclient/shared_port_group.h"
+
+#include <poll.h>
+#include <stdint.h>
+#include <sys/socket.h>
+
+#include <vector>
+
+#include "absl/types/optional.h"
+#include "examples/voipclient/media_socket.h"
+#include "rtc_base/socket_address.h"
+#include "test/gtest.h"
+
+namespace webrtc_examples {
+namespace {
+
+constexpr int kShards = 3;
+constexpr int kPollTimeoutMs = 1000;
+
+const rtc::SocketAddress kRemote("192.0.2.1", 5000);
+const rtc::SocketAddress kOtherRemote("192.0.2.2", 5000);
+
+// Binds kShards SO_REUSEPORT sockets to one loopback port, in shard order,
+// and a socket sending to them.
+class SsrcSteeringTest : public ::testing::Test {
+ protected:
+  SsrcSteeringTest() : group_(kShards, SharedPortGroup::Steering::kSsrc) {
+    rtc::SocketAddress address("127.0.0.1", 0);
+    for (int i = 0; i < kShards; ++i) {
+      int fd = Bind(address, /*reuse_port=*/true, &address);
+      if (fd >= 0) {
+        shard_fds_.push_back(fd);
+      }
+    }
+    port_address_ = address;
+    sender_fd_ = Bind(rtc::SocketAddress("127.0.0.1", 0),
+                      /*reuse_port=*/false, &address);
+  }
+
+  ~SsrcSteeringTest() override {
+    for (int fd : shard_fds_) {
+      calls_.Close(fd);
+    }
+    if (sender_fd_ >= 0) {
+      calls_.Close(sender_fd_);
+    }
+  }
+
+  // Returns the index of the shard socket that receives `packet`, or -1.
+  int Steer(const std::vector<uint8_t>& packet) {
+    sockaddr_storage address;
+    socklen_t length = port_address_.ToSockAddrStorage(&address);
+    if (sendto(sender_fd_, packet.data(), packet.size(), 0,
+               reinterpret_cast<sockaddr*>(&address), length) < 0) {
+      return -1;
+    }
+    std::vector<pollfd> fds;
+    for (int fd : shard_fds_) {
+      fds.push_back({fd, POLLIN, 0});
+    }
+    if (poll(fds.data(), fds.size(), kPollTimeoutMs) != 1) {
+      return -1;
+    }
+    for (size_t i = 0; i < fds.size(); ++i) {
+      uint8_t buffer[64];
+      if (recv(fds[i].fd, buffer, sizeof(buffer), MSG_DONTWAIT) >= 0) {
+        return static_cast<int>(i);
+      }
+    }
+    return -1;
+  }
+
+  SharedPortGroup group_;
+  std::vector<int> shard_fds_;
+  int sender_fd_ = -1;
+
+ private:
+  int Bind(const rtc::SocketAddress& address,
+           bool reuse_port,
+           rtc::SocketAddress* bound_address) {
+    sockaddr_storage storage;
+    socklen_t length = address.ToSockAddrStorage(&storage);
+    int fd = calls_.Open(reinterpret_cast<sockaddr*>(&storage), length,
+                         reuse_port);
+    if (fd >= 0 &&
+        getsockname(fd, reinterpret_cast<sockaddr*>(&storage), &length) ==
+            0) {
+      rtc::SocketAddressFromSockAddrStorage(storage, bound_address);
+    }
+    return fd;
+  }
+
+  MediaSocket::SocketCalls calls_;
+  rtc::SocketAddress port_address_;
+};
+
+std::vector<uint8_t> MakeRtpPacket(uint32_t ssrc) {
+  return {0x80, 0x00, 0x00, 0x01, 0x00, 0x00, 0x00, 0xa0,
+          static_cast<uint8_t>(ssrc >> 24), static_cast<uint8_t>(ssrc >> 16),
+          static_cast<uint8_t>(ssrc >> 8), static_cast<uint8_t>(ssrc)};
+}
+
+// A receiver report without report blocks.
+std::vector<uint8_t> MakeRtcpPacket(uint32_t sender_ssrc) {
+  return {0x80,
+          201,
+          0x00,
+          0x01,
+          static_cast<uint8_t>(sender_ssrc >> 24),
+          static_cast<uint8_t>(sender_ssrc >> 16),
+          static_cast<uint8_t>(sender_ssrc >> 8),
+          static_cast<uint8_t>(sender_ssrc)};
+}
+
+TEST_F(SsrcSteeringTest, SteersBySsrc) {
+  ASSERT_EQ(shard_fds_.size(), static_cast<size_t>(kShards));
+  ASSERT_GE(sender_fd_, 0);
+  if (!group_.AttachSsrcSteering(shard_fds_[0])) {
+    GTEST_SKIP() << "SO_ATTACH_REUSEPORT_CBPF not supported";
+  }
+
+  for (uint32_t ssrc : {0u, 1u, 2u, 3u, 4u, 5u, 0x7fffffffu, 0xffffffffu}) {
+    const int shard = static_cast<int>(ssrc % kShards);
+    EXPECT_EQ(Steer(MakeRtpPacket(ssrc)), shard) << "RTP SSRC " << ssrc;
+    EXPECT_EQ(Steer(MakeRtcpPacket(ssrc)), shard) << "RTCP SSRC " << ssrc;
+  }
+}
+
+TEST_F(SsrcSteeringTest, SteersShortPacketsToFirstShard) {
+  ASSERT_EQ(shard_fds_.size(), static_cast<size_t>(kShards));
+  ASSERT_GE(sender_fd_, 0);
+  if (!group_.AttachSsrcSteering(shard_fds_[0])) {
+    GTEST_SKIP() << "SO_ATTACH_REUSEPORT_CBPF not supported";
+  }
+
+  // Too short for the SSRC of either.
+  std::vector<uint8_t> rtp = MakeRtpPacket(2);
+  rtp.resize(10);
+  std::vector<uint8_t> rtcp = MakeRtcpPacket(2);
+  rtcp.resize(6);
+  EXPECT_EQ(Steer(rtp), 0);
+  EXPECT_EQ(Steer(rtcp), 0);
+  EXPECT_EQ(Steer({0x80}), 0);
+}
+
+TEST(SharedPortGroupTest, RoutesBySourceAndDeclaredSsrc) {
+  SharedPortGroup group(kShards, SharedPortGroup::Steering::kSsrc);
+  ASSERT_TRUE(group.SetRoutes(1, nullptr, kRemote, kRemote, 100u));
+  ASSERT_TRUE(group.SetRoutes(2, nullptr, kRemote, kRemote, 200u));
+  ASSERT_TRUE(group.SetRoutes(3, nullptr, kOtherRemote, kOtherRemote,
+                              absl::nullopt));
+
+  SessionId session;
+  MediaShard* owner;
+  ASSERT_TRUE(group.Lookup(100, kRemote, &session, &owner));
+  EXPECT_EQ(session, 1);
+  ASSERT_TRUE(group.Lookup(200, kRemote, &session, &owner));
+  EXPECT_EQ(session, 2);
+  EXPECT_FALSE(group.Lookup(300, kRemote, &session, &owner));
+  ASSERT_TRUE(group.Lookup(300, kOtherRemote, &session, &owner));
+  EXPECT_EQ(session, 3);
+}
+
+TEST(SharedPortGroupTest, RejectsAmbiguousRoutes) {
+  SharedPortGroup group(kShards, SharedPortGroup::Steering::kKernelHash);
+  ASSERT_TRUE(group.SetRoutes(1, nullptr, kRemote, kRemote, 100u));
+  EXPECT_FALSE(group.SetRoutes(2, nullptr, kRemote, kRemote, 100u));
+  EXPECT_FALSE(group.SetRoutes(3, nullptr, kRemote, kRemote, absl::nullopt));
+
+  SessionId session;
+  MediaShard* owner;
+  ASSERT_TRUE(group.Lookup(100, kRemote, &session, &owner));
+  EXPECT_EQ(session, 1);
+}
+
+TEST(SharedPortGroupTest, RemovalIsReportedToEveryShard) {
+  SharedPortGroup group(kShards, SharedPortGroup::Steering::kKernelHash);
+  ASSERT_TRUE(group.SetRoutes(1, nullptr, kRemote, kRemote, absl::nullopt));
+  const uint64_t generation = group.removal_generation();
+  group.RemoveSession(1);
+  EXPECT_NE(group.removal_generation(), generation);
+
+  SessionId session;
+  MediaShard* owner;
+  EXPECT_FALSE(group.Lookup(100, kRemote, &session, &owner));
+  for (int shard = 0; shard < kShards; ++shard) {
+    EXPECT_EQ(group.TakeRemovedSessions(shard), std::vector<SessionId>{1});
+    EXPECT_TRUE(group.TakeRemovedSessions(shard).empty());
+  }
+}
+
+}  // namespace
+}  // namespace webrtc_examples
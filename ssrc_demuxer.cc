@@ -0,0 +1,144 @@
+/*
+ *  Copyright 2023 The WebRTC Project Authors. All rights reserved.
+ *
+ *  Use of this source code is governed by a BSD-style license
+ *  that can be found in the LICENSE file in the root of the source
+ *  tree. An additional intellectual property rights grant can be found
+ *  in the file PATENTS.  All contributing project authors may
+ *  be found in the AUTHORS file in the root of the source tree.
+ */
+
+#include "examples/voipclient/ssrc_demuxer.h"
+
+#include <netinet/in.h>
+#include <string.h>
+
+#include <utility>
+
+#include "rtc_base/checks.h"
+
+namespace webrtc_examples {
+
+namespace {
+
+// Power of two so that probing can mask instead of divide.
+constexpr size_t kInitialCapacity = 64;
+
+uint64_t Mix(uint64_t value) {
+  // Finalizer of MurmurHash3.
+  value ^= value >> 33;
+  value *= 0xff51afd7ed558ccdULL;
+  value ^= value >> 33;
+  value *= 0xc4ceb9fe1a85ec53ULL;
+  value ^= value >> 33;
+  return value;
+}
+
+}  // namespace
+
+bool SsrcDemuxer::Key::operator==(const Key& other) const {
+  return ssrc == other.ssrc && port == other.port && family == other.family &&
+         memcmp(address, other.address, sizeof(address)) == 0;
+}
+
+SsrcDemuxer::SsrcDemuxer() : slots_(kInitialCapacity) {}
+
+bool SsrcDemuxer::Lookup(uint32_t ssrc,
+                         const rtc::SocketAddress& source,
+                         SessionId* session) const {
+  const Key key = MakeKey(ssrc, source);
+  const Slot& slot = slots_[FindSlot(key)];
+  if (!slot.occupied) {
+    return false;
+  }
+  *session = slot.session;
+  return true;
+}
+
+void SsrcDemuxer::Insert(uint32_t ssrc,
+                         const rtc::SocketAddress& source,
+                         SessionId session) {
+  // Keep the load factor at or below one half so probe runs stay short.
+  if (2 * (size_ + 1) > slots_.size()) {
+    Rehash(2 * slots_.size());
+  }
+  const Key key = MakeKey(ssrc, source);
+  Slot& slot = slots_[FindSlot(key)];
+  if (!slot.occupied) {
+    slot.occupied = true;
+    slot.key = key;
+    ++size_;
+  }
+  slot.session = session;
+}
+
+void SsrcDemuxer::Erase(uint32_t ssrc, const rtc::SocketAddress& source) {
+  size_t hole = FindSlot(MakeKey(ssrc, source));
+  if (!slots_[hole].occupied) {
+    return;
+  }
+  slots_[hole] = Slot();
+  --size_;
+  // Shift the rest of the probe run back over the hole instead of leaving
+  // a tombstone for lookups to step over. An entry may move into the hole
+  // unless its home slot lies after the hole, up to where it sits.
+  const size_t mask = slots_.size() - 1;
+  for (size_t index = (hole + 1) & mask; slots_[index].occupied;
+       index = (index + 1) & mask) {
+    const size_t home = Hash(slots_[index].key) & mask;
+    if (((index - home) & mask) >= ((index - hole) & mask)) {
+      slots_[hole] = slots_[index];
+      slots_[index] = Slot();
+      hole = index;
+    }
+  }
+}
+
+SsrcDemuxer::Key SsrcDemuxer::MakeKey(uint32_t ssrc,
+                                      const rtc::SocketAddress& source) {
+  Key key;
+  key.ssrc = ssrc;
+  key.port = source.port();
+  const rtc::IPAddress& ip = source.ipaddr();
+  key.family = static_cast<uint8_t>(ip.family());
+  if (ip.family() == AF_INET) {
+    in_addr address = ip.ipv4_address();
+    memcpy(key.address, &address, sizeof(address));
+  } else if (ip.family() == AF_INET6) {
+    in6_addr address = ip.ipv6_address();
+    memcpy(key.address, &address, sizeof(address));
+  }
+  return key;
+}
+
+size_t SsrcDemuxer::Hash(const Key& key) {
+  uint64_t words[2];
+  memcpy(words, key.address, sizeof(words));
+  uint64_t hash = Mix((static_cast<uint64_t>(key.ssrc) << 32) |
+                      (static_cast<uint64_t>(key.port) << 8) | key.family);
+  hash = Mix(hash ^ words[0]);
+  hash = Mix(hash ^ words[1]);
+  return static_cast<size_t>(hash);
+}
+
+size_t SsrcDemuxer::FindSlot(const Key& key) const {
+  const size_t mask = slots_.size() - 1;
+  size_t index = Hash(key) & mask;
+  while (slots_[index].occupied && !(slots_[index].key == key)) {
+    index = (index + 1) & mask;
+  }
+  return index;
+}
+
+void SsrcDemuxer::Rehash(size_t capacity) {
+  RTC_DCHECK_EQ(capacity & (capacity - 1), 0);
+  std::vector<Slot> old_slots = std::move(slots_);
+  slots_.assign(capacity, Slot());
+  for (const Slot& slot : old_slots) {
+    if (slot.occupied) {
+      slots_[FindSlot(slot.key)] = slot;
+    }
+  }
+}
+
+}  // namespace webrtc_examples
@@ -0,0 +1,82 @@
+/*
+ *  Copyright 2023 The WebRTC Project Authors. All rights reserved.
+ *
+ *  Use of this source code is governed by a BSD-style license
+ *  that can be found in the LICENSE file in the root of the source
+ *  tree. An additional intellectual property rights grant can be found
+ *  in the file PATENTS.  All contributing project authors may
+ *  be found in the AUTHORS file in the root of the source tree.
+ */
+
+#ifndef EXAMPLES_VOIPCLIENT_SSRC_DEMUXER_H_
+#define EXAMPLES_VOIPCLIENT_SSRC_DEMUXER_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <vector>
+
+#include "examples/voipclient/voip_session.h"
+#include "rtc_base/socket_address.h"
+
+namespace webrtc_examples {
+
+// Maps (SSRC, source address) to the session a packet belongs to when many
+// sessions share one socket. The table is a flat, open-addressed hash with
+// linear probing: one lookup per packet touches a single, usually
+// already-cached, run of 32-byte slots and never allocates.
+//
+// Not thread-safe; owned by the thread that reads the shared socket.
+class SsrcDemuxer {
+ public:
+  SsrcDemuxer();
+
+  SsrcDemuxer(const SsrcDemuxer&) = delete;
+  SsrcDemuxer& operator=(const SsrcDemuxer&) = delete;
+
+  // Returns false if the stream is unknown.
+  bool Lookup(uint32_t ssrc,
+              const rtc::SocketAddress& source,
+              SessionId* session) const;
+
+  // Adds or replaces the mapping for the stream.
+  void Insert(uint32_t ssrc,
+              const rtc::SocketAddress& source,
+              SessionId session);
+
+  // Drops the mapping for the stream, if any.
+  void Erase(uint32_t ssrc, const rtc::SocketAddress& source);
+
+  size_t size() const { return size_; }
+
+ private:
+  struct Key {
+    uint32_t ssrc = 0;
+    uint16_t port = 0;
+    uint8_t family = 0;
+    // IPv4 addresses use the first four bytes.
+    uint8_t address[16] = {};
+
+    bool operator==(const Key& other) const;
+  };
+
+  struct Slot {
+    Key key;
+    bool occupied = false;
+    SessionId session = 0;
+  };
+
+  static Key MakeKey(uint32_t ssrc, const rtc::SocketAddress& source);
+  static size_t Hash(const Key& key);
+
+  // Returns the slot holding `key`, or the empty slot where it belongs.
+  size_t FindSlot(const Key& key) const;
+  void Rehash(size_t capacity);
+
+  std::vector<Slot> slots_;
+  size_t size_ = 0;
+};
+
+}  // namespace webrtc_examples
+
+#endif  // EXAMPLES_VOIPCLIENT_SSRC_DEMUXER_H_
@@ -0,0 +1,138 @@
+/*
+ *  Copyright 2023 The WebRTC Project Authors. All rights reserved.
+ *
+ *  Use of this source code is governed by a BSD-style license
+ *  that can be found in the LICENSE file in the root of the source
+ *  tree. An additional intellectual property rights grant can be found
+ *  in the file PATENTS.  All contributing project authors may
+ *  be found in the AUTHORS file in the root of the source tree.
+ */
+
+#include "examples/voipclient/ssrc_demuxer.h"
+
+#include <stdint.h>
+
+#include <map>
+#include <random>
+#include <utility>
+
+#include "rtc_base/socket_address.h"
+#include "test/gtest.h"
+
+namespace webrtc_examples {
+namespace {
+
+const rtc::SocketAddress kAlice("192.0.2.1", 5000);
+const rtc::SocketAddress kBob("192.0.2.2", 5000);
+const rtc::SocketAddress kCarol("2001:db8::1", 5000);
+
+TEST(SsrcDemuxerTest, UnknownStreamIsNotFound) {
+  SsrcDemuxer demuxer;
+  SessionId session = -1;
+  EXPECT_FALSE(demuxer.Lookup(1, kAlice, &session));
+  EXPECT_EQ(session, -1);
+  EXPECT_EQ(demuxer.size(), 0u);
+}
+
+TEST(SsrcDemuxerTest, StreamsAreKeyedOnSsrcAndSource) {
+  SsrcDemuxer demuxer;
+  demuxer.Insert(1, kAlice, 10);
+  demuxer.Insert(2, kAlice, 11);
+  demuxer.Insert(1, kBob, 12);
+  demuxer.Insert(1, kCarol, 13);
+  demuxer.Insert(1, rtc::SocketAddress("192.0.2.1", 5002), 14);
+  EXPECT_EQ(demuxer.size(), 5u);
+
+  SessionId session;
+  ASSERT_TRUE(demuxer.Lookup(1, kAlice, &session));
+  EXPECT_EQ(session, 10);
+  ASSERT_TRUE(demuxer.Lookup(2, kAlice, &session));
+  EXPECT_EQ(session, 11);
+  ASSERT_TRUE(demuxer.Lookup(1, kBob, &session));
+  EXPECT_EQ(session, 12);
+  ASSERT_TRUE(demuxer.Lookup(1, kCarol, &session));
+  EXPECT_EQ(session, 13);
+  ASSERT_TRUE(
+      demuxer.Lookup(1, rtc::SocketAddress("192.0.2.1", 5002), &session));
+  EXPECT_EQ(session, 14);
+  EXPECT_FALSE(demuxer.Lookup(2, kBob, &session));
+}
+
+TEST(SsrcDemuxerTest, InsertReplacesSession) {
+  SsrcDemuxer demuxer;
+  demuxer.Insert(1, kAlice, 10);
+  demuxer.Insert(1, kAlice, 20);
+  EXPECT_EQ(demuxer.size(), 1u);
+
+  SessionId session;
+  ASSERT_TRUE(demuxer.Lookup(1, kAlice, &session));
+  EXPECT_EQ(session, 20);
+}
+
+TEST(SsrcDemuxerTest, EraseDropsOnlyThatStream) {
+  SsrcDemuxer demuxer;
+  demuxer.Insert(1, kAlice, 10);
+  demuxer.Insert(2, kAlice, 11);
+  demuxer.Erase(1, kAlice);
+  demuxer.Erase(3, kAlice);
+  EXPECT_EQ(demuxer.size(), 1u);
+
+  SessionId session;
+  EXPECT_FALSE(demuxer.Lookup(1, kAlice, &session));
+  ASSERT_TRUE(demuxer.Lookup(2, kAlice, &session));
+  EXPECT_EQ(session, 11);
+}
+
+TEST(SsrcDemuxerTest, GrowsPastInitialCapacity) {
+  SsrcDemuxer demuxer;
+  constexpr uint32_t kStreams = 10000;
+  for (uint32_t ssrc = 0; ssrc < kStreams; ++ssrc) {
+    demuxer.Insert(ssrc, kAlice, static_cast<SessionId>(ssrc));
+  }
+  EXPECT_EQ(demuxer.size(), kStreams);
+  for (uint32_t ssrc = 0; ssrc < kStreams; ++ssrc) {
+    SessionId session;
+    ASSERT_TRUE(demuxer.Lookup(ssrc, kAlice, &session));
+    EXPECT_EQ(session, static_cast<SessionId>(ssrc));
+  }
+}
+
+// Erasing shifts entries back over the hole; check it against a map with
+// enough churn that probe runs wrap and overlap.
+TEST(SsrcDemuxerTest, MatchesMapUnderRandomInsertsAndErases) {
+  SsrcDemuxer demuxer;
+  std::map<std::pair<uint32_t, int>, SessionId> expected;
+  const rtc::SocketAddress sources[] = {kAlice, kBob, kCarol};
+  std::mt19937 random(1);
+  std::uniform_int_distribution<uint32_t> ssrc_distribution(0, 40);
+  std::uniform_int_distribution<int> source_distribution(0, 2);
+
+  for (int i = 0; i < 20000; ++i) {
+    const uint32_t ssrc = ssrc_distribution(random);
+    const int source = source_distribution(random);
+    if (random() % 2 == 0) {
+      demuxer.Insert(ssrc, sources[source], i);
+      expected[{ssrc, source}] = i;
+    } else {
+      demuxer.Erase(ssrc, sources[source]);
+      expected.erase({ssrc, source});
+    }
+    ASSERT_EQ(demuxer.size(), expected.size());
+  }
+
+  for (uint32_t ssrc = 0; ssrc <= 40; ++ssrc) {
+    for (int source = 0; source < 3; ++source) {
+      SessionId session;
+      auto it = expected.find({ssrc, source});
+      if (it == expected.end()) {
+        EXPECT_FALSE(demuxer.Lookup(ssrc, sources[source], &session));
+      } else {
+        ASSERT_TRUE(demuxer.Lookup(ssrc, sources[source], &session));
+        EXPECT_EQ(session, it->second);
+      }
+    }
+  }
+}
+
+}  // namespace
+}  // namespace webrtc_examples
@@ -0,0 +1,294 @@
+/*
+ *  Copyright 2023 The WebRTC Project Authors. All rights reserved.
+ *
+ *  Use of this source code is governed by a BSD-style license
+ *  that can be found in the LICENSE file in the root of the source
+ *  tree. An additional intellectual property rights grant can be found
+ *  in the file PATENTS.  All contributing project authors may
+ *  be found in the AUTHORS file in the root of the source tree.
+ */
+
+#include "examples/voipclient/trace_recorder.h"
+
+#include <pthread.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <memory>
+#include <vector>
+
+#include "rtc_base/logging.h"
+#include "rtc_base/platform_thread_types.h"
+#include "rtc_base/synchronization/mutex.h"
+#include "rtc_base/time_utils.h"
+
+namespace webrtc_examples {
+
+namespace {
+
+struct TraceEvent {
+  const char* name;
+  // Chrome trace event phase: 'X' complete, 'i' instant, 's'/'f' flow.
+  char phase;
+  int64_t timestamp_ns;
+  int64_t duration_ns;
+  int64_t arg;
+  uint64_t flow_id;
+};
+
+// One thread's ring. Only the owning thread writes it, including to
+// discard the events of an earlier recording, which it does on its first
+// event of a new generation. Each slot carries the index of its event,
+// zeroed while the slot is rewritten, so that Dump() can read the ring
+// while the owner is still writing and skip the events it tore.
+class ThreadRing {
+ public:
+  explicit ThreadRing(size_t capacity)
+      : thread_id_(rtc::CurrentThreadId()), slots_(capacity) {
+    char name[16] = {};
+    pthread_getname_np(pthread_self(), name, sizeof(name));
+    thread_name_ = name;
+  }
+
+  void Add(const TraceEvent& event, uint64_t generation) {
+    const uint64_t next = next_.load(std::memory_order_relaxed);
+    if (generation_.load(std::memory_order_relaxed) != generation) {
+      begin_.store(next, std::memory_order_relaxed);
+      generation_.store(generation, std::memory_order_release);
+    }
+    Slot& slot = slots_[next % slots_.size()];
+    slot.sequence.store(0, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    slot.name.store(event.name, std::memory_order_relaxed);
+    slot.phase.store(event.phase, std::memory_order_relaxed);
+    slot.timestamp_ns.store(event.timestamp_ns, std::memory_order_relaxed);
+    slot.duration_ns.store(event.duration_ns, std::memory_order_relaxed);
+    slot.arg.store(event.arg, std::memory_order_relaxed);
+    slot.flow_id.store(event.flow_id, std::memory_order_relaxed);
+    slot.sequence.store(next + 1, std::memory_order_release);
+    next_.store(next + 1, std::memory_order_release);
+  }
+
+  // Visits the events recorded in `generation` that are intact.
+  template <typename Visitor>
+  void ForEach(uint64_t generation, Visitor visitor) const {
+    if (generation_.load(std::memory_order_acquire) != generation) {
+      return;
+    }
+    const uint64_t end = next_.load(std::memory_order_acquire);
+    const uint64_t begin =
+        std::max(begin_.load(std::memory_order_relaxed),
+                 end > slots_.size() ? end - slots_.size() : 0);
+    for (uint64_t i = begin; i < end; ++i) {
+      const Slot& slot = slots_[i % slots_.size()];
+      const uint64_t before = slot.sequence.load(std::memory_order_acquire);
+      TraceEvent event;
+      event.name = slot.name.load(std::memory_order_relaxed);
+      event.phase = slot.phase.load(std::memory_order_relaxed);
+      event.timestamp_ns = slot.timestamp_ns.load(std::memory_order_relaxed);
+      event.duration_ns = slot.duration_ns.load(std::memory_order_relaxed);
+      event.arg = slot.arg.load(std::memory_order_relaxed);
+      event.flow_id = slot.flow_id.load(std::memory_order_relaxed);
+      std::atomic_thread_fence(std::memory_order_acquire);
+      const uint64_t after = slot.sequence.load(std::memory_order_relaxed);
+      // Otherwise overwritten by a later event, or being written.
+      if (before == i + 1 && after == i + 1) {
+        visitor(event);
+      }
+    }
+  }
+
+  rtc::PlatformThreadId thread_id() const { return thread_id_; }
+  const std::string& thread_name() const { return thread_name_; }
+
+ private:
+  // A TraceEvent in relaxed atomics, as Dump() may read it mid-write.
+  struct Slot {
+    // One more than the index of the event held; zero while written.
+    std::atomic<uint64_t> sequence{0};
+    std::atomic<const char*> name{nullptr};
+    std::atomic<char> phase{0};
+    std::atomic<int64_t> timestamp_ns{0};
+    std::atomic<int64_t> duration_ns{0};
+    std::atomic<int64_t> arg{0};
+    std::atomic<uint64_t> flow_id{0};
+  };
+
+  const rtc::PlatformThreadId thread_id_;
+  std::string thread_name_;
+  std::vector<Slot> slots_;
+  // Index of the first event of the current generation.
+  std::atomic<uint64_t> begin_{0};
+  std::atomic<uint64_t> next_{0};
+  std::atomic<uint64_t> generation_{0};
+};
+
+// Rings of all threads that recorded since the process started. A ring
+// outlives its thread so that its events can still be dumped.
+class RingRegistry {
+ public:
+  ThreadRing* Register() {
+    webrtc::MutexLock lock(&mutex_);
+    rings_.push_back(std::make_unique<ThreadRing>(capacity_));
+    return rings_.back().get();
+  }
+
+  // Starts a new generation, whose events the rings keep apart from the
+  // earlier ones. `capacity` applies to rings registered from now on.
+  void Restart(size_t capacity) {
+    webrtc::MutexLock lock(&mutex_);
+    capacity_ = capacity;
+    generation_.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  uint64_t generation() const {
+    return generation_.load(std::memory_order_relaxed);
+  }
+
+  template <typename Visitor>
+  void ForEach(Visitor visitor) {
+    webrtc::MutexLock lock(&mutex_);
+    for (const std::unique_ptr<ThreadRing>& ring : rings_) {
+      visitor(*ring);
+    }
+  }
+
+ private:
+  webrtc::Mutex mutex_;
+  size_t capacity_ RTC_GUARDED_BY(mutex_) =
+      TraceRecorder::kDefaultEventsPerThread;
+  std::vector<std::unique_ptr<ThreadRing>> rings_ RTC_GUARDED_BY(mutex_);
+  std::atomic<uint64_t> generation_{1};
+};
+
+RingRegistry* GetRegistry() {
+  static RingRegistry* const registry = new RingRegistry();
+  return registry;
+}
+
+void Record(const TraceEvent& event) {
+  thread_local ThreadRing* const ring = GetRegistry()->Register();
+  ring->Add(event, GetRegistry()->generation());
+}
+
+std::atomic<uint64_t> g_next_flow_id{1};
+
+}  // namespace
+
+std::atomic<bool> TraceRecorder::recording_{false};
+
+void TraceRecorder::Start(size_t events_per_thread) {
+  recording_.store(false);
+  GetRegistry()->Restart(events_per_thread > 0 ? events_per_thread : 1);
+  recording_.store(true);
+}
+
+void TraceRecorder::Stop() {
+  recording_.store(false);
+}
+
+bool TraceRecorder::Dump(const std::string& path) {
+  Stop();
+
+  FILE* file = fopen(path.c_str(), "w");
+  if (!file) {
+    RTC_LOG_ERR(LS_ERROR) << "Cannot open trace file " << path;
+    return false;
+  }
+  const int pid = getpid();
+  bool first = true;
+  auto separator = [&first] {
+    const char* text = first ? "\n" : ",\n";
+    first = false;
+    return text;
+  };
+
+  fprintf(file, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[");
+  const uint64_t generation = GetRegistry()->generation();
+  GetRegistry()->ForEach([&](const ThreadRing& ring) {
+    const long tid = static_cast<long>(ring.thread_id());
+    fprintf(file,
+            "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,"
+            "\"tid\":%ld,\"args\":{\"name\":\"%s\"}}",
+            separator(), pid, tid, ring.thread_name().c_str());
+    ring.ForEach(generation, [&](const TraceEvent& event) {
+      fprintf(file,
+              "%s{\"name\":\"%s\",\"cat\":\"voip\",\"ph\":\"%c\","
+              "\"ts\":%.3f,\"pid\":%d,\"tid\":%ld",
+              separator(), event.name, event.phase,
+              event.timestamp_ns / 1000.0, pid, tid);
+      switch (event.phase) {
+        case 'X':
+          fprintf(file, ",\"dur\":%.3f", event.duration_ns / 1000.0);
+          break;
+        case 'i':
+          fprintf(file, ",\"s\":\"t\"");
+          break;
+        case 'f':
+          fprintf(file, ",\"bp\":\"e\"");
+          [[fallthrough]];
+        case 's':
+          fprintf(file, ",\"id\":%llu",
+                  static_cast<unsigned long long>(event.flow_id));
+          break;
+      }
+      fprintf(file, ",\"args\":{\"arg\":%lld}}",
+              static_cast<long long>(event.arg));
+    });
+  });
+  fprintf(file, "\n]}\n");
+
+  bool ok = ferror(file) == 0;
+  if (fclose(file) != 0 || !ok) {
+    RTC_LOG(LS_ERROR) << "Failed to write trace file " << path;
+    return false;
+  }
+  return true;
+}
+
+void TraceRecorder::Complete(const char* name, int64_t start_ns, int64_t arg) {
+  if (!IsRecording()) {
+    return;
+  }
+  const int64_t now_ns = rtc::TimeNanos();
+  Record({name, 'X', start_ns, now_ns - start_ns, arg, 0});
+}
+
+void TraceRecorder::Instant(const char* name, int64_t arg) {
+  if (!IsRecording()) {
+    return;
+  }
+  Record({name, 'i', rtc::TimeNanos(), 0, arg, 0});
+}
+
+uint64_t TraceRecorder::BeginFlow(const char* name) {
+  if (!IsRecording()) {
+    return 0;
+  }
+  const uint64_t id = g_next_flow_id.fetch_add(1, std::memory_order_relaxed);
+  Record({name, 's', rtc::TimeNanos(), 0, 0, id});
+  return id;
+}
+
+void TraceRecorder::EndFlow(const char* name, uint64_t id) {
+  if (id == 0 || !IsRecording()) {
+    return;
+  }
+  Record({name, 'f', rtc::TimeNanos(), 0, 0, id});
+}
+
+ScopedTraceEvent::ScopedTraceEvent(const char* name, int64_t arg)
+    : name_(name), arg_(arg) {
+  if (TraceRecorder::IsRecording()) {
+    start_ns_ = rtc::TimeNanos();
+  }
+}
+
+ScopedTraceEvent::~ScopedTraceEvent() {
+  if (start_ns_ >= 0) {
+    TraceRecorder::Complete(name_, start_ns_, arg_);
+  }
+}
+
+}  // namespace webrtc_examples
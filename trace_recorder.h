@@ -0,0 +1,82 @@
+/*
+ *  Copyright 2023 The WebRTC Project Authors. All rights reserved.
+ *
+ *  Use of this source code is governed by a BSD-style license
+ *  that can be found in the LICENSE file in the root of the source
+ *  tree. An additional intellectual property rights grant can be found
+ *  in the file PATENTS.  All contributing project authors may
+ *  be found in the AUTHORS file in the root of the source tree.
+ */
+
+#ifndef EXAMPLES_VOIPCLIENT_TRACE_RECORDER_H_
+#define EXAMPLES_VOIPCLIENT_TRACE_RECORDER_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <atomic>
+#include <string>
+
+namespace webrtc_examples {
+
+// Opt-in recorder of call lifecycle and packet flow events, written out in
+// the Chrome trace event JSON format that chrome://tracing and Perfetto
+// load. Each thread records into its own ring buffer, keeping its latest
+// events, with relaxed stores and no locks; while not recording every call
+// is a single relaxed load.
+//
+// The recorder is process-wide: a process that records starts it once,
+// e.g. from main(), and dumps it once on exit, whatever number of
+// VoipClients it runs.
+//
+// Event names must be string literals, as only the pointer is kept.
+class TraceRecorder {
+ public:
+  static constexpr size_t kDefaultEventsPerThread = 1 << 14;
+
+  // Starts recording, discarding what was recorded before. Each thread
+  // keeps its most recent `events_per_thread` events; the size of a ring is
+  // fixed when its thread first records.
+  static void Start(size_t events_per_thread = kDefaultEventsPerThread);
+  static void Stop();
+  static bool IsRecording() {
+    return recording_.load(std::memory_order_relaxed);
+  }
+
+  // Stops recording and writes all recorded events to `path`. Events a
+  // thread is writing at that moment may be missing.
+  static bool Dump(const std::string& path);
+
+  // A slice from `start_ns` (rtc::TimeNanos()) to now.
+  static void Complete(const char* name, int64_t start_ns, int64_t arg);
+  static void Instant(const char* name, int64_t arg);
+  // Arrows between threads, e.g. from the thread posting a packet to the
+  // one sending it. Both ends use the same name. BeginFlow() returns 0 when
+  // not recording, and EndFlow() ignores 0.
+  static uint64_t BeginFlow(const char* name);
+  static void EndFlow(const char* name, uint64_t id);
+
+ private:
+  static std::atomic<bool> recording_;
+};
+
+// Records a slice covering its own lifetime. `arg`, typically a session
+// id, is shown with the event.
+class ScopedTraceEvent {
+ public:
+  ScopedTraceEvent(const char* name, int64_t arg);
+  ~ScopedTraceEvent();
+
+  ScopedTraceEvent(const ScopedTraceEvent&) = delete;
+  ScopedTraceEvent& operator=(const ScopedTraceEvent&) = delete;
+
+ private:
+  const char* const name_;
+  const int64_t arg_;
+  // Negative when not recording at construction.
+  int64_t start_ns_ = -1;
+};
+
+}  // namespace webrtc_examples
+
+#endif  // EXAMPLES_VOIPCLIENT_TRACE_RECORDER_H_
@@ -12,10 +12,13 @@
 
 #include <errno.h>
 #include <sys/socket.h>
+#include <unistd.h>
 
 #include <algorithm>
+#include <functional>
 #include <map>
 #include <memory>
+#include <string>
 #include <unordered_map>
 #include <unordered_set>
 #include <utility>
@@ -25,23 +28,35 @@
 #include "api/audio_codecs/builtin_audio_decoder_factory.h"
 #include "api/audio_codecs/builtin_audio_encoder_factory.h"
 #include "api/task_queue/default_task_queue_factory.h"
-#include "api/voip/voip_codec.h"
 #include "api/voip/voip_engine_factory.h"
-#include "api/voip/voip_network.h"
-#include "modules/audio_device/include/audio_device.h"
+#include "examples/voipclient/instrumentation.h"
+#include "examples/voipclient/trace_recorder.h"
+#include "rtc_base/checks.h"
 #include "rtc_base/logging.h"
 #include "rtc_base/network.h"
 #include "rtc_base/socket_server.h"
 
 namespace {
 
-#define RUN_ON_VOIP_THREAD(method, ...)                       \
-  if (!voip_thread_->IsCurrent()) {                           \
-    voip_thread_->PostTask(                                   \
-        std::bind(&VoipClient::method, this, ##__VA_ARGS__)); \
-    return;                                                   \
-  }                                                           \
-  RTC_DCHECK_RUN_ON(voip_thread_.get());
+// Re-posts the call to the thread of `shard_of_session`, the shard
+// hosting `session`, and declares `shard` for the rest of the method.
+#define RUN_ON_SHARD(shard_of_session, method, session, ...)            \
+  MediaShard* shard = shard_of_session;                                 \
+  if (!shard->thread()->IsCurrent()) {                                  \
+    ScopedTaskName task_name(#method);                                  \
+    shard->thread()->PostTask(                                          \
+        std::bind(&VoipClient::method, this, session, ##__VA_ARGS__)); \
+    return;                                                             \
+  }                                                                     \
+  RTC_DCHECK_RUN_ON(shard->thread());                                   \
+  ScopedTraceEvent trace_event(#method, session);
+
+// For methods that only act on an existing session.
+#define RUN_ON_SHARD_THREAD(method, session, ...) \
+  RUN_ON_SHARD(GetShard(session), method, session, ##__VA_ARGS__)
+// For methods that create the session if needed.
+#define RUN_ON_ASSIGNED_SHARD_THREAD(method, session, ...) \
+  RUN_ON_SHARD(AssignShard(session), method, session, ##__VA_ARGS__)
 
 // Connects a UDP socket to a public address and returns the local
 // address associated with it. Since it binds to the "any" address
@@ -116,37 +131,103 @@ int GetPayloadType(const std::string& codec_name) {
 
 namespace webrtc_examples {
 
-void VoipClient::Init() {
-  voip_thread_->Start();
+VoipClient::VoipClient(const Config& config)
+    : config_(config), callback_(config.callback) {}
+
+bool VoipClient::Init() {
+  if (!config_.packet_capture.path.empty()) {
+    packet_capture_ = PacketCapture::Create(config_.packet_capture);
+    if (!packet_capture_) {
+      return false;
+    }
+  }
+  if (config_.network_emulation && config_.send_mode == SendMode::kDirect) {
+    RTC_LOG(LS_WARNING) << "Direct sends bypass the network emulation";
+  }
+
+  int num_shards = config_.num_shards;
+  if (num_shards <= 0) {
+    num_shards = std::max(1, static_cast<int>(sysconf(_SC_NPROCESSORS_ONLN)));
+  }
+  if (config_.shared_local_address) {
+    shared_port_group_ = std::make_unique<SharedPortGroup>(
+        num_shards, config_.shared_port_steering);
+    place_by_ssrc_ = num_shards > 1 && config_.shared_port_steering ==
+                                           SharedPortGroup::Steering::kSsrc;
+  }
+  for (int i = 0; i < num_shards; ++i) {
+    std::unique_ptr<MediaShard> shard =
+        MediaShard::Create(i, GetShardOptions(i));
+    RTC_CHECK(shard);
+    shards_.push_back(std::move(shard));
+  }
 
   // Due to consistent thread requirement on
   // modules/audio_device/android/audio_device_template.h,
-  // code is invoked in the context of voip_thread_.
-  voip_thread_->BlockingCall([this] {
-    RTC_DCHECK_RUN_ON(voip_thread_.get());
-
+  // code is invoked in the context of the first shard's thread.
+  shards_[0]->thread()->BlockingCall([this] {
     webrtc::VoipEngineConfig config;
     config.encoder_factory = webrtc::CreateBuiltinAudioEncoderFactory();
     config.decoder_factory = webrtc::CreateBuiltinAudioDecoderFactory();
     config.task_queue_factory = webrtc::CreateDefaultTaskQueueFactory();
-    config.audio_device_module = webrtc::AudioDeviceModule::Create(
-        webrtc::AudioDeviceModule::kLinuxPulseAudio,
-        config.task_queue_factory.get());
+    config.audio_device_module = CreateAudioDevice(
+        config_.audio_device, config.task_queue_factory.get());
+    if (!config.audio_device_module) {
+      RTC_LOG(LS_ERROR) << "Audio device creation failed";
+      return;
+    }
     config.audio_processing = webrtc::AudioProcessingBuilder().Create();
 
     supported_codecs_ = config.encoder_factory->GetSupportedEncoders();
     voip_engine_ = webrtc::CreateVoipEngine(std::move(config));
   });
+  if (!voip_engine_) {
+    return false;
+  }
+
+  // In order, so that shard i binds the i-th socket of a shared port.
+  // Sessions of a shard without its shared sockets would bind ports of
+  // their own instead.
+  for (const std::unique_ptr<MediaShard>& shard : shards_) {
+    if (!shard->Start(voip_engine_.get())) {
+      return false;
+    }
+  }
+
+  if (config_.metrics_address) {
+    metrics_server_ = MetricsServer::Create(
+        *config_.metrics_address, config_.metrics_refresh_interval,
+        [this] { return RenderMetrics(); });
+    if (!metrics_server_) {
+      return false;
+    }
+  }
+  return true;
 }
 
 VoipClient::~VoipClient() {
-  voip_thread_->Stop();
+  // Stops rendering, which reads from the shards and the engine.
+  metrics_server_.reset();
+  // Each shard releases its sessions' channels before the engine goes away.
+  // All stop reading first, as shards sharing a port post to each other.
+  for (const std::unique_ptr<MediaShard>& shard : shards_) {
+    shard->Shutdown();
+  }
+  shards_.clear();
+  packet_capture_.reset();
+  shared_port_group_.reset();
 }
 
 VoipClient* VoipClient::Create() {
+  return Create(Config());
+}
+
+VoipClient* VoipClient::Create(const Config& config) {
   // Using `new` to access a non-public constructor.
-  auto voip_client = absl::WrapUnique(new VoipClient());
-  voip_client->Init();
+  auto voip_client = absl::WrapUnique(new VoipClient(config));
+  if (!voip_client->Init()) {
+    return nullptr;
+  }
   return voip_client.release();
 }
 
@@ -172,30 +253,23 @@ std::string VoipClient::GetLocalIPAddress() {
   return local_ip_address;
 }
 
-void VoipClient::SetEncoder(const std::string& encoder) {
-  RUN_ON_VOIP_THREAD(SetEncoder, encoder);
+void VoipClient::SetEncoder(SessionId session, const std::string& encoder) {
+  RUN_ON_ASSIGNED_SHARD_THREAD(SetEncoder, session, encoder);
 
-  if (!channel_) {
-    RTC_LOG(LS_ERROR) << "Channel has not been created";
-    return;
-  }
   for (const webrtc::AudioCodecSpec& codec : supported_codecs_) {
     if (codec.format.name == encoder) {
-      webrtc::VoipResult result = voip_engine_->Codec().SetSendCodec(
-          *channel_, GetPayloadType(codec.format.name), codec.format);
-      RTC_CHECK(result == webrtc::VoipResult::kOk);
+      shard->GetOrCreateSession(session)->SetSendCodec(
+          GetPayloadType(codec.format.name), codec.format);
       return;
     }
   }
+  RTC_LOG(LS_ERROR) << "Unsupported encoder " << encoder;
 }
 
-void VoipClient::SetDecoders(const std::vector<std::string>& decoders) {
-  RUN_ON_VOIP_THREAD(SetDecoders, decoders);
+void VoipClient::SetDecoders(SessionId session,
+                             const std::vector<std::string>& decoders) {
+  RUN_ON_ASSIGNED_SHARD_THREAD(SetDecoders, session, decoders);
 
-  if (!channel_) {
-    RTC_LOG(LS_ERROR) << "Channel has not been created";
-    return;
-  }
   std::map<int, webrtc::SdpAudioFormat> decoder_specs;
   for (const webrtc::AudioCodecSpec& codec : supported_codecs_) {
     if (std::find(decoders.begin(), decoders.end(), codec.format.name) !=
@@ -203,257 +277,506 @@ void VoipClient::SetDecoders(const std::vector<std::string>& decoders) {
       decoder_specs.insert({GetPayloadType(codec.format.name), codec.format});
     }
   }
-
-  webrtc::VoipResult result =
-      voip_engine_->Codec().SetReceiveCodecs(*channel_, decoder_specs);
-  RTC_CHECK(result == webrtc::VoipResult::kOk);
+  shard->GetOrCreateSession(session)->SetReceiveCodecs(decoder_specs);
 }
 
-void VoipClient::SetLocalAddress(const std::string& ip_address,
+void VoipClient::SetLocalAddress(SessionId session,
+                                 const std::string& ip_address,
                                  const int port_number) {
-  RUN_ON_VOIP_THREAD(SetLocalAddress, ip_address, port_number);
+  RUN_ON_ASSIGNED_SHARD_THREAD(SetLocalAddress, session, ip_address,
+                               port_number);
 
-  rtp_local_address_ = rtc::SocketAddress(ip_address, port_number);
-  rtcp_local_address_ = rtc::SocketAddress(ip_address, port_number + 1);
+  shard->GetOrCreateSession(session)->SetLocalAddress(ip_address,
+                                                      port_number);
 }
 
-void VoipClient::SetRemoteAddress(const std::string& ip_address,
+void VoipClient::SetRemoteAddress(SessionId session,
+                                  const std::string& ip_address,
                                   const int port_number) {
-  RUN_ON_VOIP_THREAD(SetRemoteAddress, ip_address, port_number);
+  RUN_ON_ASSIGNED_SHARD_THREAD(SetRemoteAddress, session, ip_address,
+                               port_number);
 
-  rtp_remote_address_ = rtc::SocketAddress(ip_address, port_number);
-  rtcp_remote_address_ = rtc::SocketAddress(ip_address, port_number + 1);
+  shard->SetRemoteAddress(session, ip_address, port_number);
 }
 
-void VoipClient::StartSession() {
-  RUN_ON_VOIP_THREAD(StartSession);
-
-  // CreateChannel guarantees to return valid channel id.
-  channel_ = voip_engine_->Base().CreateChannel(this, absl::nullopt);
-
-  rtp_socket_.reset(rtc::AsyncUDPSocket::Create(voip_thread_->socketserver(),
-                                                rtp_local_address_));
-  if (!rtp_socket_) {
-    RTC_LOG_ERR(LS_ERROR) << "Socket creation failed";
-    auto callback = callback_.lock();
-    if (callback) {
-      callback->OnStartSessionCompleted(/*isSuccessful=*/false);
+void VoipClient::SetRemoteSsrc(SessionId session, uint32_t ssrc) {
+  if (place_by_ssrc_) {
+    // The steering program hands the stream to the socket of shard
+    // `ssrc % size`; living there saves forwarding every packet.
+    const size_t index = ssrc % shards_.size();
+    webrtc::MutexLock lock(&placement_mutex_);
+    const size_t placed = placements_.emplace(session, index).first->second;
+    if (placed != index) {
+      RTC_LOG(LS_WARNING) << "Session " << session
+                          << " was created before its SSRC was declared; "
+                             "its packets are forwarded between shards";
     }
-    return;
   }
-  rtp_socket_->SignalReadPacket.connect(this,
-                                        &VoipClient::OnSignalReadRTPPacket);
+  RUN_ON_ASSIGNED_SHARD_THREAD(SetRemoteSsrc, session, ssrc);
 
-  rtcp_socket_.reset(rtc::AsyncUDPSocket::Create(voip_thread_->socketserver(),
-                                                 rtcp_local_address_));
-  if (!rtcp_socket_) {
-    RTC_LOG_ERR(LS_ERROR) << "Socket creation failed";
-    auto callback = callback_.lock();
-    if (callback) {
-      callback->OnStartSessionCompleted(/*isSuccessful=*/false);
-    }
-    return;
+  shard->SetRemoteSsrc(session, ssrc);
+}
+
+void VoipClient::StartSession(SessionId session) {
+  RUN_ON_ASSIGNED_SHARD_THREAD(StartSession, session);
+
+  bool success = shard->StartSession(session);
+  if (!success) {
+    ForgetShard(session);
   }
-  rtcp_socket_->SignalReadPacket.connect(this,
-                                         &VoipClient::OnSignalReadRTCPPacket);
   auto callback = callback_.lock();
   if (callback) {
-    callback->OnStartSessionCompleted(/*isSuccessful=*/true);
+    callback->OnStartSessionCompleted(session, success);
   }
 }
 
-void VoipClient::StopSession() {
-  RUN_ON_VOIP_THREAD(StopSession);
+void VoipClient::StopSession(SessionId session) {
+  RUN_ON_SHARD_THREAD(StopSession, session);
 
-  if (!channel_) {
-    RTC_LOG(LS_ERROR) << "Channel has not been created";
-    auto callback = callback_.lock();
-    if (callback) {
-      callback->OnStopSessionCompleted(/*isSuccessful=*/false);
-    }
-
-    return;
+  bool success = shard->StopSession(session);
+  if (success) {
+    ForgetShard(session);
   }
-  if (voip_engine_->Base().StopSend(*channel_) != webrtc::VoipResult::kOk ||
-      voip_engine_->Base().StopPlayout(*channel_) != webrtc::VoipResult::kOk) {
-    auto callback = callback_.lock();
-    if (callback) {
-      callback->OnStopSessionCompleted(/*isSuccessful=*/false);
-    }
-    return;
+  auto callback = callback_.lock();
+  if (callback) {
+    callback->OnStopSessionCompleted(session, success);
   }
+}
 
-  rtp_socket_->Close();
-  rtcp_socket_->Close();
-
-  webrtc::VoipResult result = voip_engine_->Base().ReleaseChannel(*channel_);
-  RTC_CHECK(result == webrtc::VoipResult::kOk);
+void VoipClient::StartSend(SessionId session) {
+  RUN_ON_SHARD_THREAD(StartSend, session);
 
-  channel_ = absl::nullopt;
+  VoipSession* voip_session = shard->FindSession(session);
+  bool sending_started = voip_session && voip_session->StartSend();
   auto callback = callback_.lock();
   if (callback) {
-    callback->OnStopSessionCompleted(/*isSuccessful=*/false);
+    callback->OnStartSendCompleted(session, sending_started);
   }
 }
 
-void VoipClient::StartSend() {
-  RUN_ON_VOIP_THREAD(StartSend);
+void VoipClient::StopSend(SessionId session) {
+  RUN_ON_SHARD_THREAD(StopSend, session);
 
-  if (!channel_) {
-    RTC_LOG(LS_ERROR) << "Channel has not been created";
-    auto callback = callback_.lock();
-    if (callback) {
-      callback->OnStartSendCompleted(/*isSuccessful=*/false);
-    }
-    return;
-  }
-  bool sending_started =
-      (voip_engine_->Base().StartSend(*channel_) == webrtc::VoipResult::kOk);
+  VoipSession* voip_session = shard->FindSession(session);
+  bool sending_stopped = voip_session && voip_session->StopSend();
   auto callback = callback_.lock();
   if (callback) {
-    callback->OnStartSendCompleted(sending_started);
+    callback->OnStopSendCompleted(session, sending_stopped);
   }
 }
 
-void VoipClient::StopSend() {
-  RUN_ON_VOIP_THREAD(StopSend);
+void VoipClient::StartPlayout(SessionId session) {
+  RUN_ON_SHARD_THREAD(StartPlayout, session);
 
-  if (!channel_) {
-    RTC_LOG(LS_ERROR) << "Channel has not been created";
-    auto callback = callback_.lock();
-    if (callback) {
-      callback->OnStopSendCompleted(/*isSuccessful=*/false);
-    }
-    return;
-  }
-  bool sending_stopped =
-      (voip_engine_->Base().StopSend(*channel_) == webrtc::VoipResult::kOk);
+  VoipSession* voip_session = shard->FindSession(session);
+  bool playout_started = voip_session && voip_session->StartPlayout();
   auto callback = callback_.lock();
   if (callback) {
-    callback->OnStopSendCompleted(sending_stopped);
+    callback->OnStartPlayoutCompleted(session, playout_started);
   }
 }
 
-void VoipClient::StartPlayout() {
-  RUN_ON_VOIP_THREAD(StartPlayout);
+void VoipClient::StopPlayout(SessionId session) {
+  RUN_ON_SHARD_THREAD(StopPlayout, session);
 
-  if (!channel_) {
-    RTC_LOG(LS_ERROR) << "Channel has not been created";
-    auto callback = callback_.lock();
-    if (callback) {
-      callback->OnStartPlayoutCompleted(/*isSuccessful=*/false);
-    }
-    return;
-  }
-  bool playout_started =
-      (voip_engine_->Base().StartPlayout(*channel_) == webrtc::VoipResult::kOk);
+  VoipSession* voip_session = shard->FindSession(session);
+  bool playout_stopped = voip_session && voip_session->StopPlayout();
   auto callback = callback_.lock();
   if (callback) {
-    callback->OnStartPlayoutCompleted(playout_started);
+    callback->OnStopPlayoutCompleted(session, playout_stopped);
+  }
+}
+
+size_t VoipClient::GetSessionCount() {
+  size_t count = 0;
+  for (const std::unique_ptr<MediaShard>& shard : shards_) {
+    count += shard->thread()->BlockingCall([&shard] {
+      RTC_DCHECK_RUN_ON(shard->thread());
+      return shard->session_count();
+    });
   }
+  return count;
 }
 
-void VoipClient::StopPlayout() {
-  RUN_ON_VOIP_THREAD(StopPlayout);
+std::vector<MediaShard::Load> VoipClient::GetShardLoads() {
+  std::vector<MediaShard::Load> loads;
+  for (const std::unique_ptr<MediaShard>& shard : shards_) {
+    loads.push_back(shard->GetLoad());
+  }
+  return loads;
+}
 
-  if (!channel_) {
-    RTC_LOG(LS_ERROR) << "Channel has not been created";
-    auto callback = callback_.lock();
-    if (callback) {
-      callback->OnStopPlayoutCompleted(/*isSuccessful=*/false);
-    }
-    return;
+std::vector<MonitoredThread::SlowTask> VoipClient::GetSlowTasks() const {
+  std::vector<MonitoredThread::SlowTask> slow_tasks;
+  for (const std::unique_ptr<MediaShard>& shard : shards_) {
+    std::vector<MonitoredThread::SlowTask> shard_tasks =
+        shard->GetSlowTasks();
+    slow_tasks.insert(slow_tasks.end(), shard_tasks.begin(),
+                      shard_tasks.end());
   }
-  bool playout_stopped =
-      (voip_engine_->Base().StopPlayout(*channel_) == webrtc::VoipResult::kOk);
-  auto callback = callback_.lock();
-  if (callback) {
-    callback->OnStopPlayoutCompleted(playout_stopped);
+  std::stable_sort(slow_tasks.begin(), slow_tasks.end(),
+                   [](const MonitoredThread::SlowTask& a,
+                      const MonitoredThread::SlowTask& b) {
+                     return a.end_time_ms < b.end_time_ms;
+                   });
+  return slow_tasks;
+}
+
+PacketBufferPool::Stats VoipClient::GetPacketPoolStats() const {
+  return PacketBufferPool::Get()->GetStats();
+}
+
+MediaSocket::SendStats VoipClient::GetSendStats() {
+  MediaSocket::SendStats total;
+  for (const std::unique_ptr<MediaShard>& shard : shards_) {
+    total.Accumulate(shard->thread()->BlockingCall([&shard] {
+      RTC_DCHECK_RUN_ON(shard->thread());
+      return shard->GetSendStats();
+    }));
   }
+  return total;
 }
 
-void VoipClient::SendRtpPacket(const std::vector<uint8_t>& packet_copy) {
-  RTC_DCHECK_RUN_ON(voip_thread_.get());
+absl::optional<VoipClient::SessionStats> VoipClient::GetStats(
+    SessionId session) {
+  absl::optional<MediaShard::SessionSnapshot> snapshot =
+      GetShard(session)->GetSessionSnapshot(session);
+  SessionStats stats;
+  if (!snapshot || !ReadStats(*snapshot, &stats)) {
+    return absl::nullopt;
+  }
+  stats.packet_pool = PacketBufferPool::Get()->GetStats();
+  return stats;
+}
 
-  if (!rtp_socket_->SendTo(packet_copy.data(), packet_copy.size(),
-                           rtp_remote_address_, rtc::PacketOptions())) {
-    RTC_LOG(LS_ERROR) << "Failed to send RTP packet";
+std::map<SessionId, VoipClient::SessionStats> VoipClient::GetAllStats() {
+  const PacketBufferPool::Stats pool_stats =
+      PacketBufferPool::Get()->GetStats();
+  std::map<SessionId, SessionStats> all_stats;
+  for (const std::unique_ptr<MediaShard>& shard : shards_) {
+    for (const auto& entry : shard->GetSessionSnapshots()) {
+      SessionStats stats;
+      if (ReadStats(entry.second, &stats)) {
+        stats.packet_pool = pool_stats;
+        all_stats.emplace(entry.first, stats);
+      }
+    }
   }
+  return all_stats;
 }
 
-bool VoipClient::SendRtp(const uint8_t* packet,
-                         size_t length,
-                         const webrtc::PacketOptions& options) {
-  std::vector<uint8_t> packet_copy(packet, packet + length);
-  voip_thread_->PostTask([this, packet_copy = std::move(packet_copy)] {
-    SendRtpPacket(packet_copy);
-  });
-  return true;
+bool VoipClient::ReadStats(const MediaShard::SessionSnapshot& snapshot,
+                           SessionStats* stats) {
+  stats->send = snapshot.send;
+  stats->receive = snapshot.receive;
+  stats->receive_delay = snapshot.receive_delay;
+  stats->send_queue_depth = snapshot.send_queue_depth;
+  return ReadEngineStats(snapshot.channel, stats);
+}
+
+bool VoipClient::ReadEngineStats(webrtc::ChannelId channel,
+                                 SessionStats* stats) {
+  webrtc::VoipStatistics& statistics = voip_engine_->Statistics();
+  return statistics.GetChannelStatistics(channel, stats->channel) ==
+             webrtc::VoipResult::kOk &&
+         statistics.GetIngressStatistics(channel, stats->ingress) ==
+             webrtc::VoipResult::kOk;
 }
 
-void VoipClient::SendRtcpPacket(const std::vector<uint8_t>& packet_copy) {
-  RTC_DCHECK_RUN_ON(voip_thread_.get());
+std::string VoipClient::RenderMetrics() {
+  const std::map<SessionId, SessionStats> all_stats = GetAllStats();
+  const std::vector<MediaShard::Load> loads = GetShardLoads();
+  const PacketBufferPool::Stats pool = GetPacketPoolStats();
+  MetricsWriter writer;
+
+  writer.Add("voip_sessions", "gauge", {}, all_stats.size());
+  writer.Add("voip_packet_pool_hits_total", "counter", {}, pool.hits);
+  writer.Add("voip_packet_pool_misses_total", "counter", {}, pool.misses);
+  writer.Add("voip_packet_pool_buffers", "gauge", {}, pool.allocated);
+  writer.Add("voip_packet_pool_buffers_in_use", "gauge", {}, pool.in_use);
+  writer.Add("voip_packet_pool_buffers_high_water_mark", "gauge", {},
+             pool.high_water_mark);
+  if (packet_capture_) {
+    const PacketCapture::Stats capture = packet_capture_->GetStats();
+    writer.Add("voip_capture_packets_written_total", "counter", {},
+               capture.packets_written);
+    writer.Add("voip_capture_packets_dropped_total", "counter", {},
+               capture.packets_dropped);
+    writer.Add("voip_capture_bytes_written_total", "counter", {},
+               capture.bytes_written);
+  }
+  if (config_.network_emulation) {
+    const NetworkEmulator::Stats emulator = *GetNetworkEmulatorStats();
+    const std::pair<const char*, uint64_t> emulator_counters[] = {
+        {"voip_emulator_packets_in_total", emulator.packets_in},
+        {"voip_emulator_packets_out_total", emulator.packets_out},
+        {"voip_emulator_lost_total", emulator.lost},
+        {"voip_emulator_queue_drops_total", emulator.queue_drops},
+        {"voip_emulator_reordered_total", emulator.reordered},
+        {"voip_emulator_duplicated_total", emulator.duplicated},
+    };
+    for (const auto& counter : emulator_counters) {
+      writer.Add(counter.first, "counter", {}, counter.second);
+    }
+  }
 
-  if (!rtcp_socket_->SendTo(packet_copy.data(), packet_copy.size(),
-                            rtcp_remote_address_, rtc::PacketOptions())) {
-    RTC_LOG(LS_ERROR) << "Failed to send RTCP packet";
+  std::vector<std::pair<const char*, size_t MediaShard::Load::*>>
+      shard_gauges = {
+          {"voip_shard_sessions", &MediaShard::Load::sessions},
+      };
+  std::vector<std::pair<const char*, uint64_t MediaShard::Load::*>>
+      shard_counters = {
+          {"voip_shard_receive_calls_total", &MediaShard::Load::receive_calls},
+          {"voip_shard_packets_received_total",
+           &MediaShard::Load::packets_received},
+          {"voip_shard_late_packets_total", &MediaShard::Load::late_packets},
+          {"voip_shard_send_calls_total", &MediaShard::Load::send_calls},
+          {"voip_shard_packets_sent_total", &MediaShard::Load::packets_sent},
+          {"voip_shard_forwarded_packets_total",
+           &MediaShard::Load::forwarded_packets},
+      };
+  // Zero unless the shard threads are monitored.
+  if (config_.shard_monitor.enabled) {
+    shard_gauges.insert(
+        shard_gauges.end(),
+        {{"voip_shard_queue_depth", &MediaShard::Load::queue_depth},
+         {"voip_shard_max_queue_depth", &MediaShard::Load::max_queue_depth}});
+    shard_counters.insert(
+        shard_counters.end(),
+        {{"voip_shard_slow_tasks_total", &MediaShard::Load::slow_tasks},
+         {"voip_shard_backlog_events_total",
+          &MediaShard::Load::backlog_events}});
+  }
+  for (const auto& gauge : shard_gauges) {
+    for (size_t i = 0; i < loads.size(); ++i) {
+      writer.Add(gauge.first, "gauge", {{"shard", std::to_string(i)}},
+                 static_cast<uint64_t>(loads[i].*gauge.second));
+    }
   }
+  for (const auto& counter : shard_counters) {
+    for (size_t i = 0; i < loads.size(); ++i) {
+      writer.Add(counter.first, "counter", {{"shard", std::to_string(i)}},
+                 loads[i].*counter.second);
+    }
+  }
+  if (config_.shard_monitor.enabled) {
+    for (size_t i = 0; i < loads.size(); ++i) {
+      writer.Add("voip_shard_max_queue_delay_seconds", "gauge",
+                 {{"shard", std::to_string(i)}},
+                 loads[i].max_queue_delay.seconds<double>());
+    }
+  }
+
+  // One group per metric, as the text format requires.
+  struct SessionMetric {
+    const char* name;
+    const char* type;
+    std::function<absl::optional<double>(const SessionStats&)> value;
+  };
+  const SessionMetric session_metrics[] = {
+      {"voip_packets_sent_total", "counter",
+       [](const SessionStats& s) { return s.channel.packets_sent; }},
+      {"voip_bytes_sent_total", "counter",
+       [](const SessionStats& s) { return s.channel.bytes_sent; }},
+      {"voip_packets_received_total", "counter",
+       [](const SessionStats& s) { return s.channel.packets_received; }},
+      {"voip_bytes_received_total", "counter",
+       [](const SessionStats& s) { return s.channel.bytes_received; }},
+      {"voip_packets_lost", "gauge",
+       [](const SessionStats& s) { return s.channel.packets_lost; }},
+      {"voip_jitter_seconds", "gauge",
+       [](const SessionStats& s) { return s.channel.jitter; }},
+      {"voip_round_trip_time_seconds", "gauge",
+       [](const SessionStats& s) -> absl::optional<double> {
+         if (!s.channel.remote_rtcp) {
+           return absl::nullopt;
+         }
+         return s.channel.remote_rtcp->round_trip_time;
+       }},
+      {"voip_jitter_buffer_delay_seconds", "gauge",
+       [](const SessionStats& s) -> absl::optional<double> {
+         const webrtc::NetEqLifetimeStatistics& neteq = s.ingress.neteq_stats;
+         if (neteq.jitter_buffer_emitted_count == 0) {
+           return absl::nullopt;
+         }
+         return neteq.jitter_buffer_delay_ms / 1000.0 /
+                neteq.jitter_buffer_emitted_count;
+       }},
+      {"voip_concealment_events_total", "counter",
+       [](const SessionStats& s) {
+         return s.ingress.neteq_stats.concealment_events;
+       }},
+      {"voip_concealed_samples_total", "counter",
+       [](const SessionStats& s) {
+         return s.ingress.neteq_stats.concealed_samples;
+       }},
+      {"voip_receive_delay_seconds_total", "counter",
+       [](const SessionStats& s) -> absl::optional<double> {
+         if (s.receive_delay.packets == 0) {
+           return absl::nullopt;
+         }
+         return s.receive_delay.total.seconds<double>();
+       }},
+      {"voip_receive_delay_packets_total", "counter",
+       [](const SessionStats& s) -> absl::optional<double> {
+         if (s.receive_delay.packets == 0) {
+           return absl::nullopt;
+         }
+         return s.receive_delay.packets;
+       }},
+      {"voip_receive_delay_clock_errors_total", "counter",
+       [](const SessionStats& s) -> absl::optional<double> {
+         if (s.receive_delay.packets + s.receive_delay.clock_errors == 0) {
+           return absl::nullopt;
+         }
+         return s.receive_delay.clock_errors;
+       }},
+      {"voip_max_receive_delay_seconds", "gauge",
+       [](const SessionStats& s) -> absl::optional<double> {
+         if (s.receive_delay.packets == 0) {
+           return absl::nullopt;
+         }
+         return s.receive_delay.max.seconds<double>();
+       }},
+      {"voip_socket_send_failures_total", "counter",
+       [](const SessionStats& s) { return s.send.send_failures; }},
+      {"voip_socket_blocked_sends_total", "counter",
+       [](const SessionStats& s) { return s.send.blocked_sends; }},
+      {"voip_socket_blocked_drops_total", "counter",
+       [](const SessionStats& s) { return s.send.blocked_drops; }},
+      {"voip_send_queue_depth", "gauge",
+       [](const SessionStats& s) { return s.send_queue_depth; }},
+  };
+  for (const SessionMetric& metric : session_metrics) {
+    for (const auto& entry : all_stats) {
+      absl::optional<double> value = metric.value(entry.second);
+      if (value) {
+        writer.Add(metric.name, metric.type,
+                   {{"session", std::to_string(entry.first)}}, *value);
+      }
+    }
+  }
+
+  if (Instrumentation::IsEnabled()) {
+    const Instrumentation::Snapshot snapshot = Instrumentation::Read();
+    for (size_t i = 0; i < kNumCounters; ++i) {
+      writer.Add(std::string("voip_") +
+                     Instrumentation::Name(static_cast<Counter>(i)) +
+                     "_total",
+                 "counter", {}, snapshot.counters[i]);
+    }
+    for (size_t i = 0; i < kNumHistograms; ++i) {
+      const std::string name =
+          std::string("voip_") +
+          Instrumentation::Name(static_cast<Histogram>(i));
+      const Instrumentation::HistogramSnapshot& histogram =
+          snapshot.histograms[i];
+      const std::pair<const char*, double> quantiles[] = {
+          {"0.5", 0.5}, {"0.9", 0.9}, {"0.99", 0.99}, {"0.999", 0.999}};
+      for (const auto& quantile : quantiles) {
+        writer.Add(name, "summary", {{"quantile", quantile.first}},
+                   static_cast<double>(histogram.Percentile(quantile.second)));
+      }
+      writer.Add(name + "_sum", "", {}, histogram.sum);
+      writer.Add(name + "_count", "", {}, histogram.count);
+    }
+  }
+  return writer.text();
 }
 
-bool VoipClient::SendRtcp(const uint8_t* packet, size_t length) {
-  std::vector<uint8_t> packet_copy(packet, packet + length);
-  voip_thread_->PostTask([this, packet_copy = std::move(packet_copy)] {
-    SendRtcpPacket(packet_copy);
-  });
-  return true;
+absl::optional<PacketCapture::Stats> VoipClient::GetPacketCaptureStats()
+    const {
+  if (!packet_capture_) {
+    return absl::nullopt;
+  }
+  return packet_capture_->GetStats();
+}
+
+absl::optional<NetworkEmulator::Stats> VoipClient::GetNetworkEmulatorStats()
+    const {
+  if (!config_.network_emulation) {
+    return absl::nullopt;
+  }
+  NetworkEmulator::Stats stats;
+  for (const std::unique_ptr<MediaShard>& shard : shards_) {
+    stats.Accumulate(*shard->GetNetworkEmulatorStats());
+  }
+  return stats;
+}
+
+absl::optional<rtc::SocketAddress> VoipClient::GetMetricsAddress() const {
+  if (!metrics_server_) {
+    return absl::nullopt;
+  }
+  return metrics_server_->address();
 }
 
-void VoipClient::ReadRTPPacket(const std::vector<uint8_t>& packet_copy) {
-  RTC_DCHECK_RUN_ON(voip_thread_.get());
+webrtc::Transport* VoipClient::GetTransportForTesting(SessionId session) {
+  MediaShard* shard = GetShard(session);
+  return shard->thread()->BlockingCall(
+      [shard, session]() -> webrtc::Transport* {
+        RTC_DCHECK_RUN_ON(shard->thread());
+        return shard->FindSession(session);
+      });
+}
 
-  if (!channel_) {
-    RTC_LOG(LS_ERROR) << "Channel has not been created";
-    return;
+MediaShard::Options VoipClient::GetShardOptions(int index) const {
+  MediaShard::Options options;
+  options.session.socket.receive_batch_size = config_.receive_batch_size;
+  options.session.socket.batch_sends = config_.batch_sends;
+  options.session.socket.send_flush_window = config_.send_flush_window;
+  options.session.socket.use_udp_gso = config_.use_udp_gso;
+  options.session.socket.late_arrival_gap = config_.late_arrival_gap;
+  options.session.socket.receive_timestamps = config_.receive_timestamps;
+  options.session.socket.hardware_receive_timestamps =
+      config_.hardware_receive_timestamps;
+  options.session.direct_send = config_.send_mode == SendMode::kDirect;
+  options.session.rtcp_mux = config_.rtcp_mux;
+  options.session.capture = packet_capture_.get();
+  options.shared_local_address = config_.shared_local_address;
+  options.shared_port_group = shared_port_group_.get();
+  options.thread_monitor = config_.shard_monitor;
+  options.use_io_uring = config_.use_io_uring;
+  options.stats_interval = config_.stats_interval;
+  options.network_emulation = config_.network_emulation;
+  if (config_.pin_shards) {
+    int num_cpus = std::max(1, static_cast<int>(sysconf(_SC_NPROCESSORS_ONLN)));
+    options.cpu = index % num_cpus;
   }
-  webrtc::VoipResult result = voip_engine_->Network().ReceivedRTPPacket(
-      *channel_,
-      rtc::ArrayView<const uint8_t>(packet_copy.data(), packet_copy.size()));
-  RTC_CHECK(result == webrtc::VoipResult::kOk);
+  return options;
 }
 
-void VoipClient::OnSignalReadRTPPacket(rtc::AsyncPacketSocket* socket,
-                                       const char* rtp_packet,
-                                       size_t size,
-                                       const rtc::SocketAddress& addr,
-                                       const int64_t& timestamp) {
-  std::vector<uint8_t> packet_copy(rtp_packet, rtp_packet + size);
-  voip_thread_->PostTask([this, packet_copy = std::move(packet_copy)] {
-    ReadRTPPacket(packet_copy);
-  });
+MediaShard* VoipClient::GetShard(SessionId session) const {
+  if (!place_by_ssrc_) {
+    return shards_[HashShard(session)].get();
+  }
+  webrtc::MutexLock lock(&placement_mutex_);
+  auto it = placements_.find(session);
+  return shards_[it != placements_.end() ? it->second : HashShard(session)]
+      .get();
 }
 
-void VoipClient::ReadRTCPPacket(const std::vector<uint8_t>& packet_copy) {
-  RTC_DCHECK_RUN_ON(voip_thread_.get());
+MediaShard* VoipClient::AssignShard(SessionId session) {
+  if (!place_by_ssrc_) {
+    return shards_[HashShard(session)].get();
+  }
+  webrtc::MutexLock lock(&placement_mutex_);
+  return shards_[placements_.emplace(session, HashShard(session)).first->second]
+      .get();
+}
 
-  if (!channel_) {
-    RTC_LOG(LS_ERROR) << "Channel has not been created";
-    return;
+void VoipClient::ForgetShard(SessionId session) {
+  if (place_by_ssrc_) {
+    webrtc::MutexLock lock(&placement_mutex_);
+    placements_.erase(session);
   }
-  webrtc::VoipResult result = voip_engine_->Network().ReceivedRTCPPacket(
-      *channel_,
-      rtc::ArrayView<const uint8_t>(packet_copy.data(), packet_copy.size()));
-  RTC_CHECK(result == webrtc::VoipResult::kOk);
 }
 
-void VoipClient::OnSignalReadRTCPPacket(rtc::AsyncPacketSocket* socket,
-                                        const char* rtcp_packet,
-                                        size_t size,
-                                        const rtc::SocketAddress& addr,
-                                        const int64_t& timestamp) {
-  std::vector<uint8_t> packet_copy(rtcp_packet, rtcp_packet + size);
-  voip_thread_->PostTask([this, packet_copy = std::move(packet_copy)] {
-    ReadRTCPPacket(packet_copy);
-  });
+size_t VoipClient::HashShard(SessionId session) const {
+  // Fibonacci hashing, so that ids following a pattern (all even, say)
+  // still spread over every shard.
+  uint64_t hash = static_cast<uint32_t>(session) * 0x9e3779b97f4a7c15ULL;
+  return (hash >> 32) % shards_.size();
 }
 
 }  // namespace webrtc_examples
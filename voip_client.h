@@ -11,110 +11,302 @@
 #ifndef EXAMPLES_VOIP_CLIENT_VOIP_CLIENT_H_
 #define EXAMPLES_VOIP_CLIENT_VOIP_CLIENT_H_
 
+#include <stdint.h>
+
+#include <map>
 #include <memory>
 #include <string>
+#include <unordered_map>
 #include <vector>
 
+#include "absl/types/optional.h"
 #include "api/audio_codecs/audio_format.h"
 #include "api/call/transport.h"
-#include "api/voip/voip_base.h"
+#include "api/units/time_delta.h"
 #include "api/voip/voip_engine.h"
-#include "rtc_base/async_packet_socket.h"
-#include "rtc_base/async_udp_socket.h"
+#include "api/voip/voip_statistics.h"
+#include "examples/voipclient/audio_device_factory.h"
+#include "examples/voipclient/media_shard.h"
+#include "examples/voipclient/media_socket.h"
+#include "examples/voipclient/metrics_server.h"
+#include "examples/voipclient/monitored_thread.h"
+#include "examples/voipclient/network_emulator.h"
+#include "examples/voipclient/packet_buffer_pool.h"
+#include "examples/voipclient/packet_capture.h"
+#include "examples/voipclient/shared_port_group.h"
+#include "examples/voipclient/voip_session.h"
 #include "rtc_base/socket_address.h"
-#include "rtc_base/third_party/sigslot/sigslot.h"
-#include "rtc_base/thread.h"
+#include "rtc_base/synchronization/mutex.h"
+#include "rtc_base/thread_annotations.h"
 
 namespace webrtc_examples {
 
-class VoipClient : public webrtc::Transport, public sigslot::has_slots<> {
+// Hosts any number of concurrent calls ("sessions") on a single
+// VoipEngine. Every method taking a SessionId is asynchronous and may be
+// called from any thread; a session is created by the first call that
+// names it and destroyed by StopSession().
+//
+// Sessions are spread over a pool of MediaShards, each a thread with its
+// own socket server, by hashing the session id, or with SSRC steering of
+// a shared port by their remote SSRC. A session's control calls, socket
+// I/O and Callback notifications all run on its shard's thread.
+class VoipClient {
  public:
   class Callback {
    public:
     virtual ~Callback() = default;
-    virtual void OnStartSessionCompleted(bool success) = 0;
-    virtual void OnStopSessionCompleted(bool success) = 0;
-    virtual void OnStartSendCompleted(bool success) = 0;
-    virtual void OnStopSendCompleted(bool success) = 0;
-    virtual void OnStartPlayoutCompleted(bool success) = 0;
-    virtual void OnStopPlayoutCompleted(bool success) = 0;
+    virtual void OnStartSessionCompleted(SessionId session, bool success) = 0;
+    virtual void OnStopSessionCompleted(SessionId session, bool success) = 0;
+    virtual void OnStartSendCompleted(SessionId session, bool success) = 0;
+    virtual void OnStopSendCompleted(SessionId session, bool success) = 0;
+    virtual void OnStartPlayoutCompleted(SessionId session, bool success) = 0;
+    virtual void OnStopPlayoutCompleted(SessionId session, bool success) = 0;
   };
 
+  // Session used by single-call front ends.
+  static constexpr SessionId kDefaultSessionId = 0;
+
+  enum class SendMode {
+    // SendRtp/SendRtcp copy the packet and post the socket write to the
+    // session's shard thread, where it may be batched with others.
+    kVoipThread,
+    // SendRtp/SendRtcp write the packet on the calling (encoder) thread
+    // through a lock-free DirectSendHandle, without a copy or thread hop.
+    // Send batching does not apply in this mode.
+    kDirect,
+  };
+
+  struct Config {
+    // Told the outcome of the session calls, on the session's shard thread,
+    // for as long as it exists.
+    std::weak_ptr<Callback> callback;
+    SendMode send_mode = SendMode::kVoipThread;
+    // Maximum number of datagrams drained from a socket per wakeup.
+    size_t receive_batch_size = 32;
+    // Outgoing packets are coalesced and written with sendmmsg(). A zero
+    // window flushes at the end of the shard thread task that queued them;
+    // a longer window trades that much latency for fewer system calls.
+    bool batch_sends = true;
+    webrtc::TimeDelta send_flush_window = webrtc::TimeDelta::Zero();
+    // Use UDP_SEGMENT for same-destination bursts when the kernel allows.
+    bool use_udp_gso = true;
+    // Read each shard's sockets through one io_uring with multishot receive
+    // (see IoUringReceiver). Shards fall back to the socket server when the
+    // kernel or build lacks support.
+    bool use_io_uring = false;
+    // Read the time each RTP packet reached the host, stamped by the kernel
+    // (see ReceiveTimestamp), and report the delay until the engine is
+    // handed the packet in SessionStats::receive_delay.
+    bool receive_timestamps = false;
+    // Use the NIC's stamps instead where the device is set up for them.
+    // Only set this if its PTP clock is synchronised to the system clock,
+    // as by phc2sys, or the delays are off by the difference.
+    bool hardware_receive_timestamps = false;
+    // Count packets of a session arriving after a silence longer than this
+    // as late in MediaShard::Load; zero disables. Ignored with a shared port.
+    webrtc::TimeDelta late_arrival_gap = webrtc::TimeDelta::Zero();
+    // When set, all sessions send and receive RTP on this one address, and
+    // RTCP on its port + 1 unless `rtcp_mux` is set, instead of binding ports
+    // of their own. Incoming packets are routed to sessions by SSRC and
+    // source address (see SetRemoteSsrc()), and the sessions' local
+    // addresses are ignored. With more than one shard, each binds the port
+    // with SO_REUSEPORT and reads its share of the packets; see
+    // SharedPortGroup. Create() fails if the address cannot be bound.
+    absl::optional<rtc::SocketAddress> shared_local_address;
+    // How the kernel spreads shared port packets over the shards. Packets
+    // read by a shard other than their session's are forwarded to it,
+    // which only kSsrc with a declared remote SSRC avoids.
+    SharedPortGroup::Steering shared_port_steering =
+        SharedPortGroup::Steering::kKernelHash;
+    // Carry RTCP on the RTP port (RFC 5761), halving the sockets, NAT
+    // bindings and polled descriptors per call. Both ends must agree.
+    bool rtcp_mux = false;
+    // Number of network/media threads; zero means one per online CPU.
+    int num_shards = 1;
+    // Pin shard i to CPU i, modulo the number of online CPUs.
+    bool pin_shards = false;
+    // Audio backend shared by all sessions. The null and file devices make
+    // runs on headless machines reproducible.
+    AudioDeviceConfig audio_device;
+    // How often each shard copies its sessions' transport counters for
+    // GetStats(), which then never has to wait for a shard.
+    webrtc::TimeDelta stats_interval = webrtc::TimeDelta::Millis(100);
+    // When set, per-session and process metrics are served in the
+    // Prometheus text format at http://<address>/metrics. The page is
+    // rebuilt every `metrics_refresh_interval` on the server's own thread,
+    // so scrapes never wait on a shard or the engine. Bind a loopback
+    // address unless the network is trusted.
+    absl::optional<rtc::SocketAddress> metrics_address;
+    webrtc::TimeDelta metrics_refresh_interval = webrtc::TimeDelta::Seconds(1);
+    // Queue delay, depth and slow task tracking of the shard threads,
+    // reported in MediaShard::Load and the metrics. `on_backlog` runs on
+    // the shard thread that fell behind.
+    MonitoredThread::Options shard_monitor;
+    // When `packet_capture.path` is set, every RTP and RTCP packet of every
+    // session is recorded to pcap files, written and rotated by a
+    // background thread.
+    PacketCapture::Options packet_capture;
+    // When set, the datagrams of all sessions are delayed, dropped,
+    // reordered, duplicated and rate limited as configured before they
+    // reach the network, by an emulator per shard: `bandwidth_kbps` is the
+    // rate of each shard's link. Does not apply to SendMode::kDirect.
+    absl::optional<NetworkEmulator::Options> network_emulation;
+  };
+
+  // Returns null if the audio device cannot be created.
   static VoipClient* Create();
+  static VoipClient* Create(const Config& config);
 
-  ~VoipClient() override;
+  ~VoipClient();
 
   std::vector<std::string> GetSupportedCodecs();
   std::string GetLocalIPAddress();
 
-  void SetEncoder(const std::string& encoder);
-  void SetDecoders(const std::vector<std::string>& decoders);
-  void SetLocalAddress(const std::string& ip_address, int port_number);
-  void SetRemoteAddress(const std::string& ip_address, int port_number);
+  void SetEncoder(SessionId session, const std::string& encoder);
+  void SetDecoders(SessionId session, const std::vector<std::string>& decoders);
+  void SetLocalAddress(SessionId session,
+                       const std::string& ip_address,
+                       int port_number);
+  void SetRemoteAddress(SessionId session,
+                        const std::string& ip_address,
+                        int port_number);
+  // Declares the SSRC the remote end of `session` sends with. Only matters
+  // with `shared_local_address`, where sessions whose peers share an
+  // address must each declare one; otherwise the session takes the first
+  // stream arriving from its remote address. With Steering::kSsrc it also
+  // places the session on the shard whose socket the kernel hands the
+  // stream to, if it is the first call naming the session.
+  void SetRemoteSsrc(SessionId session, uint32_t ssrc);
+
+  void StartSession(SessionId session);
 
-  void StartSession();
+  void StopSession(SessionId session);
 
-  void StopSession();
+  void StartSend(SessionId session);
 
-  void StartSend();
+  void StopSend(SessionId session);
 
-  void StopSend();
+  void StartPlayout(SessionId session);
 
-  void StartPlayout();
+  void StopPlayout(SessionId session);
 
-  void StopPlayout();
+  // Number of sessions currently hosted by all shards.
+  size_t GetSessionCount();
+  // Per-shard session and packet counters, indexed by shard.
+  std::vector<MediaShard::Load> GetShardLoads();
+  // The recent slow tasks of all shard threads, oldest first. Empty unless
+  // Config::shard_monitor is enabled.
+  std::vector<MonitoredThread::SlowTask> GetSlowTasks() const;
 
-  // protcted:
-  bool SendRtp(const uint8_t* packet,
-               size_t length,
-               const webrtc::PacketOptions& options) override;
-  bool SendRtcp(const uint8_t* packet, size_t length) override;
+  // Returns the hit/miss and occupancy counters of the packet buffer pool
+  // shared by the send and receive paths. Safe to call from any thread.
+  PacketBufferPool::Stats GetPacketPoolStats() const;
+  // Returns the combined send counters and batch size histogram of the
+  // sockets of all shards.
+  MediaSocket::SendStats GetSendStats();
+
+  struct SessionStats {
+    // Packet and byte counts in both directions, loss, jitter and, once
+    // RTCP reports have arrived, the round trip time.
+    webrtc::ChannelStatistics channel;
+    // Jitter buffer delay, concealment events and the other NetEq
+    // counters of the receive side.
+    webrtc::IngressStatistics ingress;
+    // Counters of the session's own sockets, up to
+    // Config::stats_interval old. With a shared port the sockets belong
+    // to the shards, so these stay zero; the per-shard counters of
+    // GetShardLoads() cover them.
+    MediaSocket::SendStats send;
+    MediaSocket::ReceiveStats receive;
+    // Zero unless Config::receive_timestamps.
+    VoipSession::ReceiveDelayStats receive_delay;
+    size_t send_queue_depth = 0;
+    // Process-wide, as the pool is shared by all sessions.
+    PacketBufferPool::Stats packet_pool;
+  };
 
-  // Slots for sockets to connect to.
-  void OnSignalReadRTPPacket(rtc::AsyncPacketSocket* socket,
-                             const char* rtp_packet,
-                             size_t size,
-                             const rtc::SocketAddress& addr,
-                             const int64_t& timestamp);
-  void OnSignalReadRTCPPacket(rtc::AsyncPacketSocket* socket,
-                              const char* rtcp_packet,
-                              size_t size,
-                              const rtc::SocketAddress& addr,
-                              const int64_t& timestamp);
+  // Returns a snapshot of the statistics of `session`, or nothing if it does
+  // not exist or has not been started. Everything is read on the calling
+  // thread and nothing is posted to the shards: the transport counters come
+  // from the copy each shard publishes every `stats_interval`, and the
+  // engine statistics from the engine. Cheap enough to poll every 100 ms
+  // per call.
+  absl::optional<SessionStats> GetStats(SessionId session);
+  // Statistics of every started session, read the same way.
+  std::map<SessionId, SessionStats> GetAllStats();
+
+  // Counters of the packet capture, if there is one. Safe to call from any
+  // thread.
+  absl::optional<PacketCapture::Stats> GetPacketCaptureStats() const;
+
+  // Counters of the network emulation, if enabled. Safe to call from any
+  // thread.
+  absl::optional<NetworkEmulator::Stats> GetNetworkEmulatorStats() const;
+
+  // Address the metrics server listens on, if there is one.
+  absl::optional<rtc::SocketAddress> GetMetricsAddress() const;
+
+  // Returns the webrtc::Transport the engine uses for `session`, or null if
+  // the session does not exist. Lets benchmarks drive the send path without
+  // an encoder.
+  webrtc::Transport* GetTransportForTesting(SessionId session);
 
  private:
-  VoipClient() : voip_thread_(rtc::Thread::CreateWithSocketServer()) {}
+  explicit VoipClient(const Config& config);
+
+  MediaShard::Options GetShardOptions(int index) const;
+
+  bool Init();
+
+  // Returns the shard `session` is assigned to, or the one its id hashes to
+  // if it has none.
+  MediaShard* GetShard(SessionId session) const;
+  // Returns the shard `session` is assigned to, assigning it if new.
+  MediaShard* AssignShard(SessionId session);
+  // Drops the assignment of a session that no longer exists.
+  void ForgetShard(SessionId session);
+  // Returns the shard the session id hashes to.
+  size_t HashShard(SessionId session) const;
+
+  // Fills `stats` from the shard's snapshot and the engine; runs on any
+  // thread.
+  bool ReadStats(const MediaShard::SessionSnapshot& snapshot,
+                 SessionStats* stats);
+  // Fills the engine statistics of `stats`; runs on any thread.
+  bool ReadEngineStats(webrtc::ChannelId channel, SessionStats* stats);
+  // Renders the metrics page on the metrics server's thread.
+  std::string RenderMetrics();
 
-  void Init();
+  const Config config_;
 
-  // Methods to send and receive RTP/RTCP packets. Takes in a
-  // copy of a packet as a vector to prolong the lifetime of
-  // the packet as these methods will be called asynchronously.
-  void SendRtpPacket(const std::vector<uint8_t>& packet_copy);
-  void SendRtcpPacket(const std::vector<uint8_t>& packet_copy);
-  void ReadRTPPacket(const std::vector<uint8_t>& packet_copy);
-  void ReadRTCPPacket(const std::vector<uint8_t>& packet_copy);
+  // Outlive the shards, whose sessions record into and send through them.
+  std::unique_ptr<PacketCapture> packet_capture_;
+  // Null without `shared_local_address`.
+  std::unique_ptr<SharedPortGroup> shared_port_group_;
 
-  // Used to invoke operations and send/receive RTP/RTCP packets.
-  std::unique_ptr<rtc::Thread> voip_thread_;
+  // Network/media threads. A session lives on exactly one of them,
+  // picked by hashing its id; all of its work runs there.
+  std::vector<std::unique_ptr<MediaShard>> shards_;
+  // With SSRC steering of a shared port, the shard index of every live
+  // session, as a session may be placed by its SSRC instead of its id.
+  // Assigned by the first call that creates the session; dropped when it
+  // stops or fails to start.
+  bool place_by_ssrc_ = false;
+  mutable webrtc::Mutex placement_mutex_;
+  std::unordered_map<SessionId, size_t> placements_
+      RTC_GUARDED_BY(placement_mutex_);
 
   std::weak_ptr<Callback> callback_;
 
   // A list of AudioCodecSpec supported by the built-in
   // encoder/decoder factories.
   std::vector<webrtc::AudioCodecSpec> supported_codecs_;
-  // The entry point to all VoIP APIs.
-  std::unique_ptr<webrtc::VoipEngine> voip_engine_ RTC_GUARDED_BY(voip_thread_);
-  // Used by the VoIP API to facilitate a VoIP session.
-  absl::optional<webrtc::ChannelId> channel_ RTC_GUARDED_BY(voip_thread_);
-  // Members below are used for network related operations.
-  std::unique_ptr<rtc::AsyncUDPSocket> rtp_socket_ RTC_GUARDED_BY(voip_thread_);
-  std::unique_ptr<rtc::AsyncUDPSocket> rtcp_socket_
-      RTC_GUARDED_BY(voip_thread_);
-  rtc::SocketAddress rtp_local_address_ RTC_GUARDED_BY(voip_thread_);
-  rtc::SocketAddress rtcp_local_address_ RTC_GUARDED_BY(voip_thread_);
-  rtc::SocketAddress rtp_remote_address_ RTC_GUARDED_BY(voip_thread_);
-  rtc::SocketAddress rtcp_remote_address_ RTC_GUARDED_BY(voip_thread_);
+  // The entry point to all VoIP APIs. Its methods are thread-safe and are
+  // called from every shard; it outlives the shards' sessions.
+  std::unique_ptr<webrtc::VoipEngine> voip_engine_;
+  // Reset first by the destructor, as it renders from the shards and the
+  // engine.
+  std::unique_ptr<MetricsServer> metrics_server_;
 };
 
 }  // namespace webrtc_examples
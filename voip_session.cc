@@ -0,0 +1,474 @@
+/*
+ *  Copyright 2023 The WebRTC Project Authors. All rights reserved.
+ *
+ *  Use of this source code is governed by a BSD-style license
+ *  that can be found in the LICENSE file in the root of the source
+ *  tree. An additional intellectual property rights grant can be found
+ *  in the file PATENTS.  All contributing project authors may
+ *  be found in the AUTHORS file in the root of the source tree.
+ */
+
+#include "examples/voipclient/voip_session.h"
+
+#include <algorithm>
+#include <utility>
+
+#include "api/units/time_delta.h"
+#include "api/voip/voip_codec.h"
+#include "api/voip/voip_network.h"
+#include "examples/voipclient/instrumentation.h"
+#include "examples/voipclient/monitored_thread.h"
+#include "examples/voipclient/rtp_utils.h"
+#include "examples/voipclient/trace_recorder.h"
+#include "rtc_base/checks.h"
+#include "rtc_base/logging.h"
+#include "rtc_base/time_utils.h"
+
+namespace webrtc_examples {
+
+VoipSession::VoipSession(SessionId id,
+                         rtc::Thread* thread,
+                         rtc::PhysicalSocketServer* socket_server,
+                         webrtc::VoipEngine* voip_engine,
+                         const Options& options)
+    : id_(id),
+      thread_(thread),
+      socket_server_(socket_server),
+      voip_engine_(voip_engine),
+      options_(options) {}
+
+VoipSession::~VoipSession() {
+  RTC_DCHECK_RUN_ON(thread_);
+  if (channel_ && !Stop()) {
+    ReleaseChannel();
+  }
+}
+
+bool VoipSession::started() const {
+  RTC_DCHECK_RUN_ON(thread_);
+  return channel_.has_value();
+}
+
+void VoipSession::SetLocalAddress(const std::string& ip_address,
+                                  int port_number) {
+  RTC_DCHECK_RUN_ON(thread_);
+
+  rtp_local_address_ = rtc::SocketAddress(ip_address, port_number);
+  rtcp_local_address_ = rtc::SocketAddress(
+      ip_address, options_.rtcp_mux ? port_number : port_number + 1);
+}
+
+void VoipSession::SetRemoteAddress(const std::string& ip_address,
+                                   int port_number) {
+  RTC_DCHECK_RUN_ON(thread_);
+
+  rtp_remote_address_ = rtc::SocketAddress(ip_address, port_number);
+  rtcp_remote_address_ = rtc::SocketAddress(
+      ip_address, options_.rtcp_mux ? port_number : port_number + 1);
+  rtp_send_handle_.SetDestination(rtp_remote_address_);
+  rtcp_send_handle_.SetDestination(rtcp_remote_address_);
+}
+
+void VoipSession::SetRemoteSsrc(uint32_t ssrc) {
+  RTC_DCHECK_RUN_ON(thread_);
+  remote_ssrc_ = ssrc;
+}
+
+void VoipSession::SetSendCodec(int payload_type,
+                               const webrtc::SdpAudioFormat& format) {
+  RTC_DCHECK_RUN_ON(thread_);
+
+  send_codec_.emplace(payload_type, format);
+  if (channel_) {
+    webrtc::VoipResult result =
+        voip_engine_->Codec().SetSendCodec(*channel_, payload_type, format);
+    RTC_CHECK(result == webrtc::VoipResult::kOk);
+  }
+}
+
+void VoipSession::SetReceiveCodecs(
+    const std::map<int, webrtc::SdpAudioFormat>& codecs) {
+  RTC_DCHECK_RUN_ON(thread_);
+
+  receive_codecs_ = codecs;
+  if (channel_) {
+    webrtc::VoipResult result =
+        voip_engine_->Codec().SetReceiveCodecs(*channel_, receive_codecs_);
+    RTC_CHECK(result == webrtc::VoipResult::kOk);
+  }
+}
+
+bool VoipSession::Start() {
+  RTC_DCHECK_RUN_ON(thread_);
+
+  if (channel_) {
+    RTC_LOG(LS_WARNING) << "Session " << id_ << " already started";
+    return false;
+  }
+
+  if (options_.shared_rtp_socket) {
+    rtp_sender_ = options_.shared_rtp_socket;
+    rtcp_sender_ = options_.shared_rtcp_socket;
+  } else if (options_.rtcp_mux) {
+    rtp_socket_ = MediaSocket::Create(thread_, socket_server_,
+                                      rtp_local_address_, options_.socket);
+    if (!rtp_socket_) {
+      RTC_LOG_ERR(LS_ERROR) << "Socket creation failed";
+      return false;
+    }
+    rtp_socket_->SetReceiveCallback(
+        [this](rtc::ArrayView<const MediaSocket::ReceivedPacket> packets) {
+          OnMuxedPacketsReceived(packets);
+        });
+    rtp_sender_ = rtp_socket_.get();
+    rtcp_sender_ = rtp_socket_.get();
+  } else {
+    rtp_socket_ = MediaSocket::Create(thread_, socket_server_,
+                                      rtp_local_address_, options_.socket);
+    // RTCP is sent every few seconds; arrival gaps and times say nothing
+    // about it.
+    MediaSocket::Options rtcp_options = options_.socket;
+    rtcp_options.late_arrival_gap = webrtc::TimeDelta::Zero();
+    rtcp_options.receive_timestamps = false;
+    rtcp_socket_ = MediaSocket::Create(thread_, socket_server_,
+                                       rtcp_local_address_, rtcp_options);
+    if (!rtp_socket_ || !rtcp_socket_) {
+      RTC_LOG_ERR(LS_ERROR) << "Socket creation failed";
+      rtp_socket_.reset();
+      rtcp_socket_.reset();
+      return false;
+    }
+    rtp_socket_->SetReceiveCallback(
+        [this](rtc::ArrayView<const MediaSocket::ReceivedPacket> packets) {
+          OnRTPPacketsReceived(packets);
+        });
+    rtcp_socket_->SetReceiveCallback(
+        [this](rtc::ArrayView<const MediaSocket::ReceivedPacket> packets) {
+          OnRTCPPacketsReceived(packets);
+        });
+    rtp_sender_ = rtp_socket_.get();
+    rtcp_sender_ = rtcp_socket_.get();
+  }
+
+  if (options_.direct_send) {
+    rtp_send_handle_.SetCapture(options_.capture, rtp_local_address_);
+    rtcp_send_handle_.SetCapture(options_.capture, rtcp_local_address_);
+    rtp_send_handle_.Attach(rtp_sender_->GetDescriptor());
+    rtcp_send_handle_.Attach(rtcp_sender_->GetDescriptor());
+  }
+
+  // CreateChannel guarantees to return valid channel id.
+  channel_ = voip_engine_->Base().CreateChannel(this, absl::nullopt);
+
+  if (send_codec_) {
+    webrtc::VoipResult result = voip_engine_->Codec().SetSendCodec(
+        *channel_, send_codec_->first, send_codec_->second);
+    RTC_CHECK(result == webrtc::VoipResult::kOk);
+  }
+  if (!receive_codecs_.empty()) {
+    webrtc::VoipResult result =
+        voip_engine_->Codec().SetReceiveCodecs(*channel_, receive_codecs_);
+    RTC_CHECK(result == webrtc::VoipResult::kOk);
+  }
+  return true;
+}
+
+bool VoipSession::Stop() {
+  RTC_DCHECK_RUN_ON(thread_);
+
+  if (!channel_) {
+    RTC_LOG(LS_ERROR) << "Channel has not been created";
+    return false;
+  }
+  if (voip_engine_->Base().StopSend(*channel_) != webrtc::VoipResult::kOk ||
+      voip_engine_->Base().StopPlayout(*channel_) != webrtc::VoipResult::kOk) {
+    return false;
+  }
+  ReleaseChannel();
+  return true;
+}
+
+void VoipSession::ReleaseChannel() {
+  // Release the channel first so that no SendRtp/SendRtcp call can still be
+  // using the direct send handles once the descriptors are closed.
+  webrtc::VoipResult result = voip_engine_->Base().ReleaseChannel(*channel_);
+  RTC_CHECK(result == webrtc::VoipResult::kOk);
+  channel_ = absl::nullopt;
+
+  rtp_send_handle_.Detach();
+  rtcp_send_handle_.Detach();
+  rtp_sender_ = nullptr;
+  rtcp_sender_ = nullptr;
+  rtp_socket_.reset();
+  rtcp_socket_.reset();
+}
+
+bool VoipSession::StartSend() {
+  RTC_DCHECK_RUN_ON(thread_);
+
+  if (!channel_) {
+    RTC_LOG(LS_ERROR) << "Channel has not been created";
+    return false;
+  }
+  return voip_engine_->Base().StartSend(*channel_) == webrtc::VoipResult::kOk;
+}
+
+bool VoipSession::StopSend() {
+  RTC_DCHECK_RUN_ON(thread_);
+
+  if (!channel_) {
+    RTC_LOG(LS_ERROR) << "Channel has not been created";
+    return false;
+  }
+  return voip_engine_->Base().StopSend(*channel_) == webrtc::VoipResult::kOk;
+}
+
+bool VoipSession::StartPlayout() {
+  RTC_DCHECK_RUN_ON(thread_);
+
+  if (!channel_) {
+    RTC_LOG(LS_ERROR) << "Channel has not been created";
+    return false;
+  }
+  return voip_engine_->Base().StartPlayout(*channel_) ==
+         webrtc::VoipResult::kOk;
+}
+
+bool VoipSession::StopPlayout() {
+  RTC_DCHECK_RUN_ON(thread_);
+
+  if (!channel_) {
+    RTC_LOG(LS_ERROR) << "Channel has not been created";
+    return false;
+  }
+  return voip_engine_->Base().StopPlayout(*channel_) ==
+         webrtc::VoipResult::kOk;
+}
+
+MediaSocket::SendStats VoipSession::GetSendStats() const {
+  RTC_DCHECK_RUN_ON(thread_);
+
+  MediaSocket::SendStats total;
+  for (const MediaSocket* socket : {rtp_socket_.get(), rtcp_socket_.get()}) {
+    if (socket) {
+      total.Accumulate(socket->GetSendStats());
+    }
+  }
+  // Direct sends are one sendto() per packet.
+  for (const DirectSendHandle* handle :
+       {&rtp_send_handle_, &rtcp_send_handle_}) {
+    DirectSendHandle::Stats stats = handle->GetStats();
+    total.send_calls += stats.packets_sent + stats.send_failures;
+    total.packets_sent += stats.packets_sent;
+    total.send_failures += stats.send_failures;
+    total.batch_size_histogram[0] += stats.packets_sent;
+  }
+  return total;
+}
+
+MediaSocket::ReceiveStats VoipSession::GetReceiveStats() const {
+  RTC_DCHECK_RUN_ON(thread_);
+
+  MediaSocket::ReceiveStats total;
+  for (const MediaSocket* socket : {rtp_socket_.get(), rtcp_socket_.get()}) {
+    if (socket) {
+      total.Accumulate(socket->GetReceiveStats());
+    }
+  }
+  return total;
+}
+
+VoipSession::ReceiveDelayStats VoipSession::GetReceiveDelayStats() const {
+  RTC_DCHECK_RUN_ON(thread_);
+  return receive_delay_;
+}
+
+size_t VoipSession::GetPendingSendCount() const {
+  RTC_DCHECK_RUN_ON(thread_);
+
+  size_t count = 0;
+  for (const MediaSocket* socket : {rtp_socket_.get(), rtcp_socket_.get()}) {
+    if (socket) {
+      count += socket->pending_send_count();
+    }
+  }
+  return count;
+}
+
+absl::optional<webrtc::ChannelId> VoipSession::channel() const {
+  RTC_DCHECK_RUN_ON(thread_);
+  return channel_;
+}
+
+const rtc::SocketAddress& VoipSession::rtp_remote_address() const {
+  RTC_DCHECK_RUN_ON(thread_);
+  return rtp_remote_address_;
+}
+
+const rtc::SocketAddress& VoipSession::rtcp_remote_address() const {
+  RTC_DCHECK_RUN_ON(thread_);
+  return rtcp_remote_address_;
+}
+
+absl::optional<uint32_t> VoipSession::remote_ssrc() const {
+  RTC_DCHECK_RUN_ON(thread_);
+  return remote_ssrc_;
+}
+
+void VoipSession::SendRtpPacket(rtc::scoped_refptr<PacketBuffer> packet) {
+  RTC_DCHECK_RUN_ON(thread_);
+  ScopedTraceEvent trace_event("SendRtpPacket", id_);
+
+  if (rtp_sender_) {
+    Instrumentation::Increment(Counter::kRtpPacketsSent);
+    if (options_.capture) {
+      options_.capture->Capture(PacketCapture::Direction::kOutgoing,
+                                rtp_local_address_, rtp_remote_address_,
+                                packet->data(), packet->size());
+    }
+    rtp_sender_->Send(std::move(packet), rtp_remote_address_);
+  }
+}
+
+bool VoipSession::SendRtp(const uint8_t* packet,
+                          size_t length,
+                          const webrtc::PacketOptions& options) {
+  if (options_.direct_send) {
+    return rtp_send_handle_.Send(packet, length);
+  }
+
+  rtc::scoped_refptr<PacketBuffer> buffer =
+      PacketBufferPool::Get()->Allocate(packet, length);
+  if (!buffer) {
+    RTC_LOG(LS_ERROR) << "RTP packet too large: " << length;
+    return false;
+  }
+  Instrumentation::Increment(Counter::kRtpPacketsQueued);
+  const uint64_t flow = TraceRecorder::BeginFlow("RtpSendQueue");
+  ScopedTaskName task_name("VoipSession::SendRtp");
+  thread_->PostTask(webrtc::SafeTask(
+      safety_.flag(), [this, buffer = std::move(buffer), queued = Stopwatch(),
+                       flow]() mutable {
+        queued.Record(Histogram::kSendQueueWait);
+        TraceRecorder::EndFlow("RtpSendQueue", flow);
+        SendRtpPacket(std::move(buffer));
+      }));
+  return true;
+}
+
+void VoipSession::SendRtcpPacket(rtc::scoped_refptr<PacketBuffer> packet) {
+  RTC_DCHECK_RUN_ON(thread_);
+
+  if (rtcp_sender_) {
+    if (options_.capture) {
+      options_.capture->Capture(PacketCapture::Direction::kOutgoing,
+                                rtcp_local_address_, rtcp_remote_address_,
+                                packet->data(), packet->size());
+    }
+    rtcp_sender_->Send(std::move(packet), rtcp_remote_address_);
+  }
+}
+
+bool VoipSession::SendRtcp(const uint8_t* packet, size_t length) {
+  if (options_.direct_send) {
+    return rtcp_send_handle_.Send(packet, length);
+  }
+
+  rtc::scoped_refptr<PacketBuffer> buffer =
+      PacketBufferPool::Get()->Allocate(packet, length);
+  if (!buffer) {
+    RTC_LOG(LS_ERROR) << "RTCP packet too large: " << length;
+    return false;
+  }
+  ScopedTaskName task_name("VoipSession::SendRtcp");
+  thread_->PostTask(webrtc::SafeTask(
+      safety_.flag(), [this, buffer = std::move(buffer)]() mutable {
+        SendRtcpPacket(std::move(buffer));
+      }));
+  return true;
+}
+
+void VoipSession::ReadRTPPacket(const MediaSocket::ReceivedPacket& packet) {
+  RTC_DCHECK_RUN_ON(thread_);
+
+  if (!channel_) {
+    RTC_LOG(LS_ERROR) << "Channel has not been created";
+    return;
+  }
+#if defined(VOIP_CLIENT_INSTRUMENTATION)
+  if (last_rtp_packet_) {
+    last_rtp_packet_->Lap(Histogram::kRtpInterArrival);
+  } else {
+    last_rtp_packet_.emplace();
+  }
+#endif
+  Instrumentation::Increment(Counter::kRtpPacketsReceived);
+  ScopedTraceEvent trace_event("ReceivedRTPPacket", id_);
+  if (options_.capture) {
+    options_.capture->Capture(PacketCapture::Direction::kIncoming,
+                              rtp_local_address_, packet.source,
+                              packet.buffer->data(), packet.buffer->size());
+  }
+  if (packet.arrival_time_us >= 0) {
+    const webrtc::TimeDelta delay = webrtc::TimeDelta::Micros(
+        rtc::TimeMicros() - packet.arrival_time_us);
+    if (delay < webrtc::TimeDelta::Zero()) {
+      ++receive_delay_.clock_errors;
+    } else {
+      ++receive_delay_.packets;
+      receive_delay_.total += delay;
+      receive_delay_.max = std::max(receive_delay_.max, delay);
+      Instrumentation::Record(Histogram::kReceiveDelay, delay.ns());
+    }
+  }
+  webrtc::VoipResult result =
+      voip_engine_->Network().ReceivedRTPPacket(*channel_,
+                                                packet.buffer->view());
+  RTC_CHECK(result == webrtc::VoipResult::kOk);
+}
+
+void VoipSession::OnRTPPacketsReceived(
+    rtc::ArrayView<const MediaSocket::ReceivedPacket> packets) {
+  for (const MediaSocket::ReceivedPacket& packet : packets) {
+    ReadRTPPacket(packet);
+  }
+}
+
+void VoipSession::ReadRTCPPacket(const MediaSocket::ReceivedPacket& packet) {
+  RTC_DCHECK_RUN_ON(thread_);
+
+  if (!channel_) {
+    RTC_LOG(LS_ERROR) << "Channel has not been created";
+    return;
+  }
+  if (options_.capture) {
+    options_.capture->Capture(PacketCapture::Direction::kIncoming,
+                              rtcp_local_address_, packet.source,
+                              packet.buffer->data(), packet.buffer->size());
+  }
+  webrtc::VoipResult result =
+      voip_engine_->Network().ReceivedRTCPPacket(*channel_,
+                                                 packet.buffer->view());
+  RTC_CHECK(result == webrtc::VoipResult::kOk);
+}
+
+void VoipSession::OnRTCPPacketsReceived(
+    rtc::ArrayView<const MediaSocket::ReceivedPacket> packets) {
+  for (const MediaSocket::ReceivedPacket& packet : packets) {
+    ReadRTCPPacket(packet);
+  }
+}
+
+void VoipSession::OnMuxedPacketsReceived(
+    rtc::ArrayView<const MediaSocket::ReceivedPacket> packets) {
+  for (const MediaSocket::ReceivedPacket& packet : packets) {
+    const PacketBuffer& buffer = *packet.buffer;
+    if (IsRtcpPacket(buffer.data(), buffer.size())) {
+      ReadRTCPPacket(packet);
+    } else {
+      ReadRTPPacket(packet);
+    }
+  }
+}
+
+}  // namespace webrtc_examples
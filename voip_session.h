@@ -0,0 +1,207 @@
+/*
+ *  Copyright 2023 The WebRTC Project Authors. All rights reserved.
+ *
+ *  Use of this source code is governed by a BSD-style license
+ *  that can be found in the LICENSE file in the root of the source
+ *  tree. An additional intellectual property rights grant can be found
+ *  in the file PATENTS.  All contributing project authors may
+ *  be found in the AUTHORS file in the root of the source tree.
+ */
+
+#ifndef EXAMPLES_VOIPCLIENT_VOIP_SESSION_H_
+#define EXAMPLES_VOIPCLIENT_VOIP_SESSION_H_
+
+#include <stdint.h>
+
+#include <map>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "absl/types/optional.h"
+#include "api/array_view.h"
+#include "api/audio_codecs/audio_format.h"
+#include "api/call/transport.h"
+#include "api/task_queue/pending_task_safety_flag.h"
+#include "api/units/time_delta.h"
+#include "api/voip/voip_base.h"
+#include "api/voip/voip_engine.h"
+#include "examples/voipclient/direct_send_handle.h"
+#include "examples/voipclient/instrumentation.h"
+#include "examples/voipclient/media_socket.h"
+#include "examples/voipclient/packet_buffer_pool.h"
+#include "examples/voipclient/packet_capture.h"
+#include "rtc_base/physical_socket_server.h"
+#include "rtc_base/socket_address.h"
+#include "rtc_base/thread.h"
+
+namespace webrtc_examples {
+
+// Identifies a call hosted by a VoipClient. Chosen by the application.
+using SessionId = int;
+
+// One call: a VoIP engine channel together with its sockets, addresses,
+// codec configuration and send/playout state. Sessions share the engine
+// owned by VoipClient; each one is the webrtc::Transport of its channel.
+//
+// Apart from SendRtp/SendRtcp, which the engine calls on its own threads,
+// all methods run on `thread`.
+class VoipSession : public webrtc::Transport {
+ public:
+  struct Options {
+    MediaSocket::Options socket;
+    // Write outgoing packets on the engine's thread through a
+    // DirectSendHandle instead of posting them to `thread`.
+    bool direct_send = false;
+    // When set, the session sends on these sockets, owned by its MediaShard
+    // and shared by the shard's sessions, instead of opening its own.
+    // Incoming packets are then routed to ReadRTPPacket/ReadRTCPPacket by
+    // the shard.
+    MediaSocket* shared_rtp_socket = nullptr;
+    MediaSocket* shared_rtcp_socket = nullptr;
+    // Carry RTCP on the RTP socket and port (RFC 5761) instead of port + 1.
+    bool rtcp_mux = false;
+    // When set, every RTP and RTCP packet sent or handed to the engine is
+    // recorded here, between the session's local and remote addresses. Not
+    // owned; must outlive the session.
+    PacketCapture* capture = nullptr;
+  };
+
+  // Time from RTP packets reaching the host to their hand-off to the
+  // engine, which takes the hand-off as their arrival time: the socket and
+  // task queue wait its jitter estimate absorbs. Only packets read with
+  // MediaSocket::Options::receive_timestamps count.
+  struct ReceiveDelayStats {
+    uint64_t packets = 0;
+    webrtc::TimeDelta total = webrtc::TimeDelta::Zero();
+    webrtc::TimeDelta max = webrtc::TimeDelta::Zero();
+    // Packets stamped after their hand-off, left out of the above: a sign
+    // that the stamping clock is not the system clock.
+    uint64_t clock_errors = 0;
+  };
+
+  VoipSession(SessionId id,
+              rtc::Thread* thread,
+              rtc::PhysicalSocketServer* socket_server,
+              webrtc::VoipEngine* voip_engine,
+              const Options& options);
+  ~VoipSession() override;
+
+  VoipSession(const VoipSession&) = delete;
+  VoipSession& operator=(const VoipSession&) = delete;
+
+  SessionId id() const { return id_; }
+  bool started() const;
+
+  void SetLocalAddress(const std::string& ip_address, int port_number);
+  void SetRemoteAddress(const std::string& ip_address, int port_number);
+  // The SSRC the remote end sends with, when known in advance. Only used to
+  // route packets arriving on shared sockets.
+  void SetRemoteSsrc(uint32_t ssrc);
+
+  // Codecs are remembered and applied whenever a channel exists, so they
+  // may be set before or after Start().
+  void SetSendCodec(int payload_type, const webrtc::SdpAudioFormat& format);
+  void SetReceiveCodecs(const std::map<int, webrtc::SdpAudioFormat>& codecs);
+
+  // Creates the channel and opens the sockets.
+  bool Start();
+  // Stops media, releases the channel and closes the sockets.
+  bool Stop();
+
+  bool StartSend();
+  bool StopSend();
+  bool StartPlayout();
+  bool StopPlayout();
+
+  // Combined send counters of the session's own sockets and direct send
+  // handles. Shared sockets are accounted for by their owner.
+  MediaSocket::SendStats GetSendStats() const;
+  MediaSocket::ReceiveStats GetReceiveStats() const;
+  ReceiveDelayStats GetReceiveDelayStats() const;
+  // Packets waiting on the session's own sockets for the next flush.
+  size_t GetPendingSendCount() const;
+
+  // The engine channel; empty until Start() succeeded.
+  absl::optional<webrtc::ChannelId> channel() const;
+
+  const rtc::SocketAddress& rtp_remote_address() const;
+  const rtc::SocketAddress& rtcp_remote_address() const;
+  absl::optional<uint32_t> remote_ssrc() const;
+
+  // Hands a received packet to the engine.
+  void ReadRTPPacket(const MediaSocket::ReceivedPacket& packet);
+  void ReadRTCPPacket(const MediaSocket::ReceivedPacket& packet);
+
+  // webrtc::Transport implementation.
+  bool SendRtp(const uint8_t* packet,
+               size_t length,
+               const webrtc::PacketOptions& options) override;
+  bool SendRtcp(const uint8_t* packet, size_t length) override;
+
+ private:
+  // Releases the channel and closes the sockets, whether or not media
+  // stopped cleanly.
+  void ReleaseChannel();
+
+  // Methods to send and receive RTP/RTCP packets. The packet is
+  // copied into a pooled buffer whose reference is held by the
+  // posted task, as these methods will be called asynchronously.
+  void SendRtpPacket(rtc::scoped_refptr<PacketBuffer> packet);
+  void SendRtcpPacket(rtc::scoped_refptr<PacketBuffer> packet);
+
+  // Receive callbacks for the sockets, which are served by `thread_`. Each
+  // call carries every datagram drained by one wakeup, which is handed to
+  // the engine right away as a view of the pooled buffer it was read into.
+  void OnRTPPacketsReceived(
+      rtc::ArrayView<const MediaSocket::ReceivedPacket> packets);
+  void OnRTCPPacketsReceived(
+      rtc::ArrayView<const MediaSocket::ReceivedPacket> packets);
+  // With `Options::rtcp_mux`; classifies each packet by its second byte.
+  void OnMuxedPacketsReceived(
+      rtc::ArrayView<const MediaSocket::ReceivedPacket> packets);
+
+  const SessionId id_;
+  rtc::Thread* const thread_;
+  rtc::PhysicalSocketServer* const socket_server_;
+  webrtc::VoipEngine* const voip_engine_;
+  const Options options_;
+
+  // Used by the VoIP API to facilitate a VoIP session.
+  absl::optional<webrtc::ChannelId> channel_ RTC_GUARDED_BY(thread_);
+  absl::optional<std::pair<int, webrtc::SdpAudioFormat>> send_codec_
+      RTC_GUARDED_BY(thread_);
+  std::map<int, webrtc::SdpAudioFormat> receive_codecs_
+      RTC_GUARDED_BY(thread_);
+
+  // Members below are used for network related operations. The senders
+  // point either at the owned sockets or at the shared ones.
+  std::unique_ptr<MediaSocket> rtp_socket_ RTC_GUARDED_BY(thread_);
+  std::unique_ptr<MediaSocket> rtcp_socket_ RTC_GUARDED_BY(thread_);
+  MediaSocket* rtp_sender_ RTC_GUARDED_BY(thread_) = nullptr;
+  MediaSocket* rtcp_sender_ RTC_GUARDED_BY(thread_) = nullptr;
+  rtc::SocketAddress rtp_local_address_ RTC_GUARDED_BY(thread_);
+  rtc::SocketAddress rtcp_local_address_ RTC_GUARDED_BY(thread_);
+  rtc::SocketAddress rtp_remote_address_ RTC_GUARDED_BY(thread_);
+  rtc::SocketAddress rtcp_remote_address_ RTC_GUARDED_BY(thread_);
+  absl::optional<uint32_t> remote_ssrc_ RTC_GUARDED_BY(thread_);
+  // Used by SendRtp/SendRtcp with `Options::direct_send` from the engine's
+  // threads; attached to the sockets' descriptors while the session runs.
+  DirectSendHandle rtp_send_handle_;
+  DirectSendHandle rtcp_send_handle_;
+
+  ReceiveDelayStats receive_delay_ RTC_GUARDED_BY(thread_);
+#if defined(VOIP_CLIENT_INSTRUMENTATION)
+  // Start of the current RTP inter-arrival interval; empty until the first
+  // packet.
+  absl::optional<Stopwatch> last_rtp_packet_ RTC_GUARDED_BY(thread_);
+#endif
+
+  // Drops packet tasks still queued on `thread_` once the session is gone.
+  webrtc::ScopedTaskSafety safety_;
+};
+
+}  // namespace webrtc_examples
+
+#endif  // EXAMPLES_VOIPCLIENT_VOIP_SESSION_H_
@@ -0,0 +1,94 @@
+/*
+ *  Copyright 2023 The WebRTC Project Authors. All rights reserved.
+ *
+ *  Use of this source code is governed by a BSD-style license
+ *  that can be found in the LICENSE file in the root of the source
+ *  tree. An additional intellectual property rights grant can be found
+ *  in the file PATENTS.  All contributing project authors may
+ *  be found in the AUTHORS file in the root of the source tree.
+ */
+
+#include "examples/voipclient/voip_session.h"
+
+#include <stdint.h>
+
+#include <memory>
+#include <utility>
+
+#include "api/units/time_delta.h"
+#include "examples/voipclient/allocation_counter.h"
+#include "examples/voipclient/packet_path_fakes.h"
+#include "rtc_base/event.h"
+#include "rtc_base/physical_socket_server.h"
+#include "rtc_base/thread.h"
+#include "test/gtest.h"
+
+namespace webrtc_examples {
+namespace {
+
+constexpr char kLoopback[] = "127.0.0.1";
+constexpr int kLocalPort = 43000;
+constexpr int kRemotePort = 43002;
+// PCMU, 20 ms.
+constexpr size_t kPacketSize = 172;
+constexpr webrtc::TimeDelta kTimeout = webrtc::TimeDelta::Seconds(10);
+
+// A session on its own thread, reading from FakeSocketCalls into a
+// StubVoipEngine.
+class VoipSessionReceiveTest : public ::testing::Test {
+ protected:
+  VoipSessionReceiveTest() : calls_(kPacketSize, kRemotePort) {
+    auto socket_server = std::make_unique<rtc::PhysicalSocketServer>();
+    socket_server_ = socket_server.get();
+    thread_ = std::make_unique<rtc::Thread>(std::move(socket_server));
+    thread_->Start();
+
+    VoipSession::Options options;
+    options.socket.socket_calls = &calls_;
+    session_ = std::make_unique<VoipSession>(/*id=*/0, thread_.get(),
+                                             socket_server_, &engine_,
+                                             options);
+  }
+
+  ~VoipSessionReceiveTest() override {
+    thread_->BlockingCall([this] { session_.reset(); });
+    thread_->Stop();
+  }
+
+  bool Start() {
+    return thread_->BlockingCall([this] {
+      session_->SetLocalAddress(kLoopback, kLocalPort);
+      session_->SetRemoteAddress(kLoopback, kRemotePort);
+      return session_->Start();
+    });
+  }
+
+  // Returns once the engine has been handed `count` packets.
+  bool Receive(int count) {
+    rtc::Event done;
+    engine_.ExpectPackets(count, &done);
+    calls_.Deliver(count);
+    return done.Wait(kTimeout);
+  }
+
+  FakeSocketCalls calls_;
+  StubVoipEngine engine_;
+  rtc::PhysicalSocketServer* socket_server_;
+  std::unique_ptr<rtc::Thread> thread_;
+  std::unique_ptr<VoipSession> session_;
+};
+
+// Datagrams are read into pooled buffers, which the engine is handed in
+// place, so once the pool and the socket's batch have grown nothing on the
+// way from the socket to the engine may allocate.
+TEST_F(VoipSessionReceiveTest, DoesNotAllocateOnceWarmedUp) {
+  ASSERT_TRUE(Start());
+  ASSERT_TRUE(Receive(10000));
+
+  const uint64_t allocations = GetAllocationCount();
+  ASSERT_TRUE(Receive(10000));
+  EXPECT_EQ(GetAllocationCount() - allocations, 0u);
+}
+
+}  // namespace
+}  // namespace webrtc_examples